@@ -8,175 +8,487 @@
 #include "lwip/pbuf.h"
 #include "lwip/tcp.h"
 #include "lwip/netif.h"
+#include "telemetry.h"
+#include "command_stream.h"
+#include "command.h"
+#include "trace.h"
+#include "profile.h"
 
 #define WIFI_SSID "WenJie (2)"
 #define WIFI_PASSWORD "qx25fuhutxvx9"
-#define TCP_PORT 4242
 #define DEBUG_printf printf
-#define BUF_SIZE 2048
 
 // Define the telemetry data struct to store received information
 typedef struct {
     char direction[40];  // Holds the direction command (e.g., "Forward Right")
     int speed;           // Holds the speed value
+    telemetry_drive drive; // Parsed command as sent on the wire
 } TelemetryData;
 
 TelemetryData telemetry_data = {0};  // Initialize telemetry_data
 
+// Per-connection state
+typedef struct TCP_CLIENT_T_ {
+    struct tcp_pcb *pcb;            // NULL when the slot is free
+    command_stream commands;        // Reassembles commands split or merged by TCP
+    tx_queue tx_queue;              // Frames for this client, written as its send buffer allows
+    uint16_t subscriptions;         // Bit (1 << telemetry_type) per frame type wanted
+    rate_adapter adapter;           // Rate of the TCP sample stream for this client's link
+    telemetry_report_fn reports[TELEMETRY_REPORTS];    // Reports being sent, NULL when a slot is free
+    uint8_t report_next[TELEMETRY_REPORTS];             // Index of each one's next frame
+    err_t close_result;             // ERR_ABRT if the last close aborted the connection
+    uint32_t arrival_us;            // When the segment being handled reached tcp_server_recv
+} TCP_CLIENT_T;
+
 // Struct to track TCP server state
 typedef struct TCP_SERVER_T_ {
     struct tcp_pcb *server_pcb;
-    struct tcp_pcb *client_pcb;
-    bool complete;
-    uint8_t buffer_recv[BUF_SIZE];
-    int recv_len;
+    TCP_CLIENT_T clients[MAX_CLIENTS];
 } TCP_SERVER_T;
 
-TCP_SERVER_T *persistent_state = NULL;  // Persistent state for sending data
+static TCP_SERVER_T server_storage;     // Sized at compile time by MAX_CLIENTS
+static TCP_CLIENT_T *stream_client = NULL;  // Client whose host receives the UDP sample stream
+static profile_summary profile_report[PROFILE_MAX_SECTIONS];   // Snapshot sent by profile_report_frame
+static uint8_t profile_report_section[PROFILE_MAX_SECTIONS];
+static int profile_report_count = 0;
+TCP_SERVER_T *server_state = NULL;      // Server state for publishing telemetry, set once listening
+uint16_t telemetry_seq = 0;             // Sequence number of the next telemetry frame
 
 // Function prototypes
-static err_t tcp_server_close(void *arg);
+static err_t tcp_client_close(TCP_CLIENT_T *client);
 static TCP_SERVER_T* tcp_server_init(void);
 static bool tcp_server_open(TCP_SERVER_T *state);
 static err_t tcp_server_accept(void *arg, struct tcp_pcb *client_pcb, err_t err);
 static err_t tcp_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err);
-static err_t send_data_to_target(const char *direction, int speed);
+static err_t tcp_server_sent(void *arg, struct tcp_pcb *tpcb, u16_t len);
+static err_t tcp_server_poll(void *arg, struct tcp_pcb *tpcb);
+static void tcp_server_err(void *arg, err_t err);
+static void send_data_to_target(const telemetry_drive *drive);
 
 // Initialize the TCP server state
 static TCP_SERVER_T* tcp_server_init(void) {
-    TCP_SERVER_T *state = calloc(1, sizeof(TCP_SERVER_T));
-    if (!state) {
-        DEBUG_printf("Failed to allocate state\n");
-        return NULL;
+    memset(&server_storage, 0, sizeof(server_storage));
+    return &server_storage;
+}
+
+// A client is gone: if its host had the UDP sample stream, hand the stream to
+// another connected client, or stop it when none is left
+static void stream_client_gone(TCP_CLIENT_T *client) {
+    if (client != stream_client) {
+        return;
     }
-    return state;
+    stream_client = NULL;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (server_state->clients[i].pcb) {
+            stream_client = &server_state->clients[i];
+            telemetry_stream_retarget(&stream_client->pcb->remote_ip);
+            return;
+        }
+    }
+    telemetry_stream_stop();
 }
 
-// Close the TCP connection and reset server state
-static err_t tcp_server_close(void *arg) {
-    TCP_SERVER_T *state = (TCP_SERVER_T*)arg;
-    if (state->client_pcb != NULL) {
-        tcp_close(state->client_pcb);
-        state->client_pcb = NULL;
+// Close one client connection and free its slot. Returns ERR_ABRT if the
+// connection had to be aborted, which lwIP callbacks must pass back.
+static err_t tcp_client_close(TCP_CLIENT_T *client) {
+    err_t result = ERR_OK;
+    if (client->pcb != NULL) {
+        tcp_arg(client->pcb, NULL);
+        tcp_recv(client->pcb, NULL);
+        tcp_sent(client->pcb, NULL);
+        tcp_poll(client->pcb, NULL, 0);
+        tcp_err(client->pcb, NULL);
+        if (client->tx_queue.written > 0) {
+            // Unacked data still points into pool buffers; tcp_close would keep
+            // retransmitting it after the buffers are reused, so drop it instead
+            tcp_abort(client->pcb);
+            result = ERR_ABRT;
+        } else {
+            tcp_close(client->pcb);
+        }
+        client->pcb = NULL;
     }
-    state->complete = false;
-    return ERR_OK;
+    tx_queue_clear(&client->tx_queue);
+    client->close_result = result;
+    stream_client_gone(client);
+    return result;
 }
 
-// Send parsed data to the connected client
-static err_t send_data_to_target(const char *direction, int speed) {
-    if (!persistent_state || !persistent_state->client_pcb) {
-        DEBUG_printf("No client connected, cannot send data\n");
-        return ERR_CONN;
+// Queue an encoded frame on one client and write what its send buffer allows
+static bool client_queue_frame(TCP_CLIENT_T *client, tx_buffer *buffer) {
+    // A full queue only costs this client a frame; it never holds up the others
+    bool queued = tx_queue_push(&client->tx_queue, buffer);
+    err_t err = tx_queue_flush(&client->tx_queue, client->pcb);
+    if (err != ERR_OK) {
+        DEBUG_printf("Failed to send data to client: %d\n", err);
+        tcp_client_close(client);  // Close connection on error
+        return false;
     }
+    return queued;
+}
 
-    char send_buffer[BUF_SIZE];
-    snprintf(send_buffer, sizeof(send_buffer), "Direction: %s; Speed: %d", direction, speed);
+void telemetry_publish(telemetry_frame *frame) {
+    if (!server_state) {
+        return;
+    }
 
-    DEBUG_printf("Sending telemetry to client: %s\n", send_buffer);
+    // Encode once into a pooled buffer; every subscribed client queues a reference
+    tx_buffer *buffer = tx_pool_alloc();
+    if (!buffer) {
+        return;  // Pool exhausted, frame dropped (counted in tx_pool_counters)
+    }
+    frame->seq = telemetry_seq++;
+    frame->timestamp_us = time_us_32();
+    if (tx_pool_encode(buffer, frame) == 0) {
+        tx_pool_release(buffer);
+        return;
+    }
 
-    err_t err = tcp_write(persistent_state->client_pcb, send_buffer, strlen(send_buffer), TCP_WRITE_FLAG_COPY);
-    if (err != ERR_OK) {
-        DEBUG_printf("Failed to send data to client: %d\n", err);
-        tcp_server_close(persistent_state);  // Close connection on error
-        return err;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        TCP_CLIENT_T *client = &server_state->clients[i];
+        if (!client->pcb || !(client->subscriptions & (1u << frame->type))) {
+            continue;
+        }
+        client_queue_frame(client, buffer);
     }
+    tx_pool_release(buffer);
+}
 
-    tcp_output(persistent_state->client_pcb);  // Ensure data is sent immediately
-    return ERR_OK;
+// Queue the next frames of a client's reports, one at a time and only once
+// everything queued before has been written, so a report never pushes a live
+// frame out of the queue. Frames of types the client did not subscribe to
+// are skipped.
+static void client_send_reports(TCP_CLIENT_T *client) {
+    for (int r = 0; r < TELEMETRY_REPORTS; r++) {
+        while (client->pcb && client->reports[r]) {
+            if (client->tx_queue.written < client->tx_queue.count ||
+                tx_pool_counters.in_use >= TX_POOL_SLOTS - TX_POOL_REPORT_RESERVE) {
+                return;     // Resumed from tcp_sent or tcp_server_poll
+            }
+            telemetry_frame frame;
+            if (!client->reports[r](client->report_next[r], &frame)) {
+                client->reports[r] = NULL;
+                break;
+            }
+            if (client->subscriptions & (1u << frame.type)) {
+                tx_buffer *buffer = tx_pool_alloc();
+                if (!buffer) {
+                    return;
+                }
+                frame.seq = telemetry_seq++;
+                frame.timestamp_us = time_us_32();
+                if (tx_pool_encode(buffer, &frame) != 0) {
+                    client_queue_frame(client, buffer);
+                }
+                tx_pool_release(buffer);
+            }
+            client->report_next[r]++;
+        }
+    }
 }
 
-// Handle data reception from the client
-static err_t tcp_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
-    if (!p) {
-        DEBUG_printf("Connection closed by client\n");
-        tcp_server_close(arg);  // Close server connection if client disconnects
-        return ERR_OK;
+bool telemetry_publish_report(telemetry_report_fn report) {
+    if (!server_state) {
+        return false;
     }
 
-    if (p->tot_len > 0) {
-        char received_data[BUF_SIZE];
+    bool started = true;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        TCP_CLIENT_T *client = &server_state->clients[i];
+        if (!client->pcb) {
+            continue;
+        }
+        int slot = -1;
+        for (int r = 0; r < TELEMETRY_REPORTS; r++) {
+            if (client->reports[r] == report) {
+                slot = r;
+                break;
+            }
+            if (!client->reports[r] && slot < 0) {
+                slot = r;
+            }
+        }
+        if (slot < 0) {
+            started = false;
+            continue;
+        }
+        client->reports[slot] = report;
+        client->report_next[slot] = 0;
+        client_send_reports(client);
+    }
+    return started;
+}
 
-        // Copy and null-terminate the received payload
-        memcpy(received_data, p->payload, p->tot_len);
-        received_data[p->tot_len] = '\0';  // Null-terminate to make it a proper C string
+// Send one rate-adapted batch to a single client. The batch keeps the
+// timestamp of its first sample; only the sequence number is stamped here.
+static void client_emit_batch(void *context, telemetry_frame *frame) {
+    TCP_CLIENT_T *client = (TCP_CLIENT_T*)context;
+    uint32_t samples = frame->u.batch.count * rate_adapter_current(&client->adapter)->stride;
 
-        // Print the received content for debugging
-        DEBUG_printf("Received data: %s\n", received_data);
+    tx_buffer *buffer = client->pcb ? tx_pool_alloc() : NULL;
+    if (!buffer) {
+        client->adapter.dropped += samples;
+        return;
+    }
+    frame->seq = telemetry_seq++;
+    if (tx_pool_encode(buffer, frame) == 0 || !client_queue_frame(client, buffer)) {
+        client->adapter.dropped += samples;
+    }
+    tx_pool_release(buffer);
+}
 
-        // Parse the direction and speed
-        char movement[20] = {0};
-        char turn_direction[20] = {0};
-        int speed = 0;
+void telemetry_publish_batch(const telemetry_frame *frame) {
+    if (!server_state) {
+        return;
+    }
 
-        // Determine the movement direction
-        if (strstr(received_data, "Forward")) {
-            strcpy(movement, "Forward");
-        } else if (strstr(received_data, "Backward")) {
-            strcpy(movement, "Backward");
-        } else if (strstr(received_data, "Stop Movement")) {
-            strcpy(movement, "Stopped");
+    uint32_t now = time_us_32();
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        TCP_CLIENT_T *client = &server_state->clients[i];
+        if (!client->pcb || !(client->subscriptions & (1u << TELEMETRY_BATCH))) {
+            continue;
         }
+        // Check the link before building frames so a congested client steps down
+        // instead of failing writes
+        float occupancy = 1.0f - (float)tcp_sndbuf(client->pcb) / TCP_SND_BUF;
+        rate_adapter_observe(&client->adapter, occupancy, client->tx_queue.rtt_us, now);
+        rate_adapter_feed(&client->adapter, frame, client_emit_batch, client);
+    }
+}
 
-        // Determine the turning direction
-        if (strstr(received_data, "Left")) {
-            strcpy(turn_direction, "Left");
-        } else if (strstr(received_data, "Right")) {
-            strcpy(turn_direction, "Right");
-        } else if (strstr(received_data, "Stop Turning")) {
-            strcpy(turn_direction, "Stopped");
-        }
+// Send parsed data to the subscribed clients
+static void send_data_to_target(const telemetry_drive *drive) {
+    telemetry_frame frame = {.type = TELEMETRY_DRIVE};
+    frame.u.drive = *drive;
+    telemetry_publish(&frame);
+}
 
-        // Extract speed from the received data if present
-        if (sscanf(received_data, "%*[^0-9]%d", &speed) == 1) {
-            telemetry_data.speed = speed;
-        } else {
-            telemetry_data.speed = 0;  // Default to 0 if speed is not found
-        }
+void telemetry_log_sink(uint8_t level, uint32_t time_us, const char *line) {
+    printf("[%lu] %s\n", (unsigned long)time_us, line);
 
-        // Formulate the final direction string based on conditions
-        if (strcmp(movement, "Stopped") == 0 && strcmp(turn_direction, "Stopped") == 0) {
-            // Only show "Stopped" if both movement and turning are stopped
-            snprintf(telemetry_data.direction, sizeof(telemetry_data.direction), "Stopped");
-        } else if (strcmp(turn_direction, "Stopped") == 0 || strcmp(turn_direction, "") == 0) {
-            // Only show movement direction if there’s no turn or turn is stopped
-            snprintf(telemetry_data.direction, sizeof(telemetry_data.direction), "%s", movement);
-        } else if (strcmp(movement, "Stopped") == 0 || strcmp(movement, "") == 0) {
-            // Only show turning direction if there’s no movement or movement is stopped
-            snprintf(telemetry_data.direction, sizeof(telemetry_data.direction), "%s", turn_direction);
-        } else {
-            // Show both movement and turning directions if both are active
-            snprintf(telemetry_data.direction, sizeof(telemetry_data.direction), "%s %s", movement, turn_direction);
+    telemetry_frame frame = {.type = TELEMETRY_LOG};
+    size_t length = strlen(line);
+    frame.u.log.level = level;
+    frame.u.log.length = (uint8_t)(length < TELEMETRY_LOG_MAX ? length : TELEMETRY_LOG_MAX);
+    memcpy(frame.u.log.text, line, frame.u.log.length);
+
+    cyw43_arch_lwip_begin();
+    telemetry_publish(&frame);
+    cyw43_arch_lwip_end();
+}
+
+// telemetry_report_fn over the profile snapshot: one frame per section
+static bool profile_report_frame(int index, telemetry_frame *frame) {
+    if (index >= profile_report_count) {
+        return false;
+    }
+    const profile_summary *summary = &profile_report[index];
+    *frame = (telemetry_frame){.type = TELEMETRY_PROFILE};
+    frame->u.profile.section = profile_report_section[index];
+    memcpy(frame->u.profile.name, summary->name, TELEMETRY_PROFILE_NAME);
+    frame->u.profile.count = summary->count;
+    frame->u.profile.min_ns = summary->min_ns;
+    frame->u.profile.mean_ns = summary->mean_ns;
+    frame->u.profile.p50_ns = summary->p50_ns;
+    frame->u.profile.p99_ns = summary->p99_ns;
+    frame->u.profile.max_ns = summary->max_ns;
+    return true;
+}
+
+void telemetry_profile_publish(void) {
+    // Summarised now, so a profile reset right after does not empty the report
+    cyw43_arch_lwip_begin();
+    profile_report_count = 0;
+    for (int id = 0; id < profile_section_count(); id++) {
+        if (profile_summarise(id, &profile_report[profile_report_count])) {
+            profile_report_section[profile_report_count++] = (uint8_t)id;
         }
+    }
+    telemetry_publish_report(profile_report_frame);
+    cyw43_arch_lwip_end();
+}
+
+// Handle one complete command from the client's stream
+static void handle_command(void *context, const char *text, size_t length) {
+    TCP_CLIENT_T *client = (TCP_CLIENT_T*)context;
+    if (!client->pcb) {
+        return;  // Connection closed by an earlier reply in this segment
+    }
+
+    command cmd;
+    int result;
+    if (client->commands.framing == COMMAND_FRAMING_LENGTH) {
+        result = command_parse_binary((const uint8_t *)text, length, &cmd);
+    } else {
+        DEBUG_printf("Received data: %s\n", text);
+        result = command_parse_text(text, length, &cmd);
+    }
+    if (result != COMMAND_OK) {
+        DEBUG_printf("Rejected command (%d)\n", result);
+        return;
+    }
 
-        DEBUG_printf("Parsed Direction: %s, Speed: %d\n", telemetry_data.direction, telemetry_data.speed);
+    switch (cmd.opcode) {
+        case CMD_DRIVE:
+            remote_drive_submit(&cmd, client->arrival_us);
+            telemetry_data.drive = cmd.u.drive;
+            telemetry_data.speed = cmd.u.drive.speed;
+            telemetry_drive_direction(&cmd.u.drive, telemetry_data.direction, sizeof(telemetry_data.direction));
+            DEBUG_printf("Parsed Direction: %s, Speed: %d\n", telemetry_data.direction, telemetry_data.speed);
+
+            // Send parsed direction and speed to the clients
+            send_data_to_target(&cmd.u.drive);
+            break;
+        case CMD_BINARY:
+            // Everything after this line is length-prefixed binary commands
+            client->commands.framing = COMMAND_FRAMING_LENGTH;
+            break;
+        case CMD_SUBSCRIBE:
+            client->subscriptions = cmd.u.subscriptions;
+            break;
+        case CMD_TRACE:
+            trace_set_level((trace_level)cmd.u.trace_level);
+            break;
+        case CMD_PROFILE:
+            profile_dump();
+            telemetry_profile_publish();
+            if (cmd.u.profile_reset) {
+                profile_reset();
+            }
+            break;
+        default:
+            remote_drive_submit(&cmd, client->arrival_us);
+            DEBUG_printf("Parsed %s command\n", command_opcode_name(cmd.opcode));
+            break;
+    }
+}
+
+// Handle data reception from a client. A segment may hold several commands
+// or part of one, and may arrive as a chain of pbufs, so bytes go through the
+// connection's command stream and only complete commands are handled.
+static err_t tcp_server_recv(void *arg, struct tcp_pcb *tpcb, struct pbuf *p, err_t err) {
+    TCP_CLIENT_T *client = (TCP_CLIENT_T*)arg;
+    if (!client) {
+        if (p) {
+            pbuf_free(p);
+        }
+        return ERR_OK;
+    }
+    client->arrival_us = time_us_32();
+    if (!p) {
+        DEBUG_printf("Connection closed by client\n");
+        return tcp_client_close(client);  // Free the slot when the client disconnects
+    }
 
-        // Send parsed direction and speed to client
-        send_data_to_target(telemetry_data.direction, telemetry_data.speed);
+    uint16_t offset = 0;
+    while (offset < p->tot_len) {
+        size_t contiguous;
+        uint8_t *dst = command_stream_write_ptr(&client->commands, &contiguous);
+        if (contiguous == 0) {
+            // Ring full: handle what is complete to make room. Cannot stall, a
+            // partial command never holds more than COMMAND_MAX_LENGTH bytes.
+            command_stream_dispatch(&client->commands, handle_command, client);
+            continue;
+        }
+        uint16_t chunk = p->tot_len - offset < contiguous ? p->tot_len - offset : (uint16_t)contiguous;
+        uint16_t copied = pbuf_copy_partial(p, dst, chunk, offset);
+        command_stream_commit(&client->commands, copied);
+        offset += copied;
+    }
+    command_stream_dispatch(&client->commands, handle_command, client);
 
-        tcp_recved(tpcb, p->tot_len);
+    if (client->pcb != tpcb) {
+        // A reply failed and the connection was closed while handling commands
+        pbuf_free(p);
+        return client->close_result;
     }
+
+    tcp_recved(tpcb, p->tot_len);
     pbuf_free(p);
     return ERR_OK;
 }
 
+// Data acked by a client: return delivered frames to the pool and write
+// whatever was waiting for send buffer space
+static err_t tcp_server_sent(void *arg, struct tcp_pcb *tpcb, u16_t len) {
+    TCP_CLIENT_T *client = (TCP_CLIENT_T*)arg;
+    if (!client) {
+        return ERR_OK;
+    }
+    tx_queue_acked(&client->tx_queue, len);
+    if (tx_queue_flush(&client->tx_queue, tpcb) != ERR_OK) {
+        return tcp_client_close(client);
+    }
+    client_send_reports(client);
+    return client->pcb == tpcb ? ERR_OK : client->close_result;
+}
+
+// Poll timer: resume reports held back by a pool that other clients had
+// filled, when this client has nothing in flight to bring a tcp_sent
+static err_t tcp_server_poll(void *arg, struct tcp_pcb *tpcb) {
+    TCP_CLIENT_T *client = (TCP_CLIENT_T*)arg;
+    if (!client) {
+        return ERR_OK;
+    }
+    client_send_reports(client);
+    return client->pcb == tpcb ? ERR_OK : client->close_result;
+}
+
+// Connection reset or aborted by lwIP: the pcb is already freed
+static void tcp_server_err(void *arg, err_t err) {
+    TCP_CLIENT_T *client = (TCP_CLIENT_T*)arg;
+    if (client) {
+        DEBUG_printf("Client connection error %d\n", err);
+        client->pcb = NULL;
+        tx_queue_clear(&client->tx_queue);
+        stream_client_gone(client);
+    }
+}
+
 // Handle client connection acceptance
 static err_t tcp_server_accept(void *arg, struct tcp_pcb *client_pcb, err_t err) {
     if (err != ERR_OK || client_pcb == NULL) {
         DEBUG_printf("Failed to accept connection\n");
-        tcp_server_close(arg);
         return ERR_VAL;
     }
 
+    TCP_SERVER_T *state = (TCP_SERVER_T*)arg;
+    TCP_CLIENT_T *client = NULL;
+    for (int i = 0; i < MAX_CLIENTS; i++) {
+        if (!state->clients[i].pcb) {
+            client = &state->clients[i];
+            break;
+        }
+    }
+    if (!client) {
+        DEBUG_printf("Too many clients, refusing connection\n");
+        tcp_abort(client_pcb);
+        return ERR_ABRT;
+    }
+
     const char *client_ip = ipaddr_ntoa(&client_pcb->remote_ip);
     DEBUG_printf("Client connected from IP: %s\n", client_ip);
 
-    TCP_SERVER_T *state = (TCP_SERVER_T*)arg;
-    state->client_pcb = client_pcb;
-    persistent_state = state;  // Update persistent state for active connection
+    client->pcb = client_pcb;
+    client->subscriptions = SUBSCRIBE_DEFAULT;
+    tx_queue_init(&client->tx_queue);
+    memset(client->reports, 0, sizeof(client->reports));
+    rate_adapter_init(&client->adapter);
+    command_stream_init(&client->commands, COMMAND_FRAMING_NEWLINE);
 
-    tcp_arg(client_pcb, state);
+    tcp_arg(client_pcb, client);
     tcp_recv(client_pcb, tcp_server_recv);
+    tcp_sent(client_pcb, tcp_server_sent);
+    tcp_poll(client_pcb, tcp_server_poll, TELEMETRY_REPORT_POLL);
+    tcp_err(client_pcb, tcp_server_err);
+
+    // High-rate samples go over UDP to one client's host, the first one until
+    // it leaves; TCP stays for commands and events.
+    if (!telemetry_stream_running() &&
+        telemetry_stream_start(&client_pcb->remote_ip, TELEMETRY_UDP_PORT, TELEMETRY_SAMPLE_HZ,
+                               TELEMETRY_BATCH_SAMPLES, remote_drive_sample)) {
+        stream_client = client;
+    }
     return ERR_OK;
 }
 
@@ -195,7 +507,7 @@ static bool tcp_server_open(TCP_SERVER_T *state) {
         return false;
     }
 
-    state->server_pcb = tcp_listen_with_backlog(pcb, 1);
+    state->server_pcb = tcp_listen_with_backlog(pcb, MAX_CLIENTS);
     if (!state->server_pcb) {
         DEBUG_printf("Failed to listen\n");
         tcp_close(pcb);
@@ -207,36 +519,11 @@ static bool tcp_server_open(TCP_SERVER_T *state) {
     return true;
 }
 
-void run_tcp_server_test(void) {
-    TCP_SERVER_T *state = tcp_server_init();
-    if (!state) return;
-
-    if (!tcp_server_open(state)) {
-        tcp_server_close(state);
-        free(state);
-        return;
-    }
-
-    while (true) {
-        #if PICO_CYW43_ARCH_POLL
-        cyw43_arch_poll();
-        cyw43_arch_wait_for_work_until(make_timeout_time_ms(1000));
-        #else
-        sleep_ms(1000);
-        #endif
-    }
-
-    tcp_server_close(state);
-    free(state);
-}
-
-int main() {
-    stdio_init_all();
-
+bool remote_server_start(void) {
     DEBUG_printf("Searching for Wi-Fi...\n");
     if (cyw43_arch_init()) {
         DEBUG_printf("Failed to initialize Wi-Fi\n");
-        return 1;
+        return false;
     }
 
     cyw43_arch_enable_sta_mode();
@@ -244,7 +531,7 @@ int main() {
     DEBUG_printf("Connecting to Wi-Fi...\n");
     if (cyw43_arch_wifi_connect_timeout_ms(WIFI_SSID, WIFI_PASSWORD, CYW43_AUTH_WPA2_AES_PSK, 30000)) {
         DEBUG_printf("Failed to connect to Wi-Fi\n");
-        return 1;
+        return false;
     }
     DEBUG_printf("Connected to Wi-Fi\n");
 
@@ -255,7 +542,28 @@ int main() {
         DEBUG_printf("Pico W server IP address: %s\n", ip4addr_ntoa(ip_addr));
     }
 
-    run_tcp_server_test();
-    cyw43_arch_deinit();
-    return 0;
+    TCP_SERVER_T *state = tcp_server_init();
+    server_state = state;
+
+    cyw43_arch_lwip_begin();
+    bool opened = tcp_server_open(state);
+    cyw43_arch_lwip_end();
+    if (!opened) {
+        server_state = NULL;
+        return false;
+    }
+
+    // Not fatal: clients can still connect by address
+    discovery_beacon_start();
+    return true;
+}
+
+int remote_server_clients(void) {
+    int count = 0;
+    if (server_state) {
+        for (int i = 0; i < MAX_CLIENTS; i++) {
+            count += server_state->clients[i].pcb != NULL;
+        }
+    }
+    return count;
 }
@@ -1,6 +1,252 @@
 #ifndef BUDDY1_H
 #define BUDDY1_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include "lwip/ip_addr.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "lwip/tcp.h"
+#include "telemetry.h"
+#include "command.h"
+
 void buddy1_function();
 
+#define TCP_PORT 4242
+#define FIRMWARE_VERSION 0x0100         // major << 8 | minor, announced in the beacon
+
+// Join Wi-Fi, start the command server (TCP_PORT) and the discovery beacon;
+// lwIP then runs in the background
+bool remote_server_start(void);
+
+// Connected command clients
+int remote_server_clients(void);
+
+// Discovery: a TELEMETRY_BEACON is broadcast to TELEMETRY_DISCOVERY_PORT every
+// interval, so clients find the car without a configured address
+#define DISCOVERY_BEACON_INTERVAL_MS 1000
+
+bool discovery_beacon_start(void);
+
+// Command/telemetry server: up to MAX_CLIENTS connections (dashboard, logger,
+// controller), each with its own send queue and subscription mask
+#define MAX_CLIENTS 4
+#define SUBSCRIBE_ALL 0xFFFF    // Bit (1 << telemetry_type) per frame type
+// Sample batches go over UDP by default; a client subscribes to
+// TELEMETRY_BATCH to also get them over TCP, rate adapted to its link
+#define SUBSCRIBE_DEFAULT (SUBSCRIBE_ALL & ~(1u << TELEMETRY_BATCH))
+
+// Stamp a frame and queue it to every subscribed client. Call from the lwIP
+// context (a callback, or inside cyw43_arch_lwip_begin/end).
+void telemetry_publish(telemetry_frame *frame);
+
+// Offer a batch frame from the sample stream to the clients subscribed to batches
+void telemetry_publish_batch(const telemetry_frame *frame);
+
+// trace_sink_fn (common/trace.h) for the remote firmware: prints each drained
+// trace line and publishes it as a TELEMETRY_LOG frame. Takes the lwIP lock
+// itself, so trace_drain is called from the main loop as usual.
+void telemetry_log_sink(uint8_t level, uint32_t time_us, const char *line);
+
+// Reports of many frames (the profile, task stats) are not queued in one
+// burst, which would overrun TX_QUEUE_PENDING: each client is sent the next
+// frame once everything queued before it is written, resuming from tcp_sent
+// and the poll timer. report(index, frame) fills frame index of the report
+// and returns false past the last one. It is called for each client as that
+// client catches up, so it must read a snapshot, not live state.
+#define TELEMETRY_REPORTS 2             // Reports in progress at once per client
+#define TELEMETRY_REPORT_POLL 2         // tcp_poll interval (0.5 s units) for resuming
+#define TX_POOL_REPORT_RESERVE 4        // Pool buffers report frames leave to live frames
+
+typedef bool (*telemetry_report_fn)(int index, telemetry_frame *frame);
+
+// Start sending a report to every client, restarting it for a client still
+// sending the previous one. Call from the lwIP context. Returns false if a
+// client already has TELEMETRY_REPORTS other reports in progress.
+bool telemetry_publish_report(telemetry_report_fn report);
+
+// Publish a TELEMETRY_PROFILE frame per profiled section (common/profile.h)
+// as a report. Takes the lwIP lock itself.
+void telemetry_profile_publish(void);
+
+// Backpressure-aware rate adaptation of the per-client TCP sample stream.
+// Each level trades resolution for bandwidth: first the sample rate (by
+// averaging consecutive samples), then larger batches, then low-priority
+// field groups are left out.
+#define ADAPT_OCCUPANCY_HIGH 0.5f       // Send buffer share in use that counts as congested
+#define ADAPT_OCCUPANCY_LOW 0.2f        // ... and as clear
+#define ADAPT_RTT_HIGH_US 150000        // Smoothed write-to-ack time that counts as congested
+#define ADAPT_RTT_LOW_US 60000          // ... and as clear
+#define ADAPT_STEP_DOWN_US 250000       // Minimum time between two degrading steps
+#define ADAPT_RECOVER_US 2000000        // Clear time needed before stepping back up
+
+typedef struct {
+    uint8_t stride;         // Input samples averaged into one output sample
+    uint8_t batch;          // Output samples per frame
+    uint8_t fields;         // TELEMETRY_FIELD_* groups sent
+} adapt_level;
+
+typedef void (*adapt_emit_fn)(void *context, telemetry_frame *frame);
+
+typedef struct {
+    uint8_t level;                  // Index into the level table, 0 = full rate
+    uint32_t last_change_us;
+    uint32_t clear_since_us;        // Start of the current uncongested stretch, 0 if congested
+    uint32_t last_drops;            // dropped at the previous observation
+
+    telemetry_frame frame;          // Batch being built
+    uint32_t next_sample;           // Sample number expected next from the stream
+    int32_t sum[8];                 // Coalescing accumulator, one per numeric field
+    uint8_t flags;                  // OR of the coalesced samples' flags
+    uint8_t pending;                // Samples in the accumulator
+    uint32_t pending_first;         // Sample number of the first of them
+
+    uint32_t coalesced;             // Samples merged into a neighbour
+    uint32_t dropped;               // Samples lost because their frame could not be queued
+} rate_adapter;
+
+void rate_adapter_init(rate_adapter *adapter);
+void rate_adapter_observe(rate_adapter *adapter, float occupancy, uint32_t rtt_us, uint32_t now_us);
+void rate_adapter_feed(rate_adapter *adapter, const telemetry_frame *frame, adapt_emit_fn emit, void *context);
+const adapt_level *rate_adapter_current(const rate_adapter *adapter);
+
+// UDP telemetry streaming: samples are taken at a fixed rate from a timer and
+// sent as TELEMETRY_BATCH frames of several samples per datagram, delta
+// compressed to TELEMETRY_BATCH_DELTA unless TELEMETRY_STREAM_DELTA is 0
+#define TELEMETRY_UDP_PORT 4243
+#define TELEMETRY_SAMPLE_HZ 200         // Control loop sampling rate
+#define TELEMETRY_BATCH_SAMPLES 10      // Samples per datagram (200 Hz / 10 = 20 datagrams/s)
+#ifndef TELEMETRY_STREAM_DELTA
+#define TELEMETRY_STREAM_DELTA 1
+#endif
+
+// Fills one sample; runs in timer IRQ context so it must only copy state
+typedef void (*telemetry_source_fn)(telemetry_sample *sample);
+
+typedef struct {
+    uint32_t samples;       // Samples taken
+    uint32_t datagrams;     // Datagrams sent
+    uint32_t send_errors;   // udp_sendto or pbuf_alloc failures
+    uint32_t overruns;      // Samples dropped because the previous batch was not sent yet
+    uint32_t raw_bytes;     // Bytes the datagrams would take as TELEMETRY_BATCH
+    uint32_t sent_bytes;    // Bytes actually sent
+    uint32_t keyframes;     // Datagrams sent uncompressed or as delta keyframes
+    uint32_t encode_cycles_max;  // CPU cycles to encode one datagram (SysTick)
+    uint64_t encode_cycles_sum;
+} telemetry_stream_stats;
+
+extern telemetry_stream_stats telemetry_stream_counters;
+
+bool telemetry_stream_start(const ip_addr_t *dest, uint16_t port, uint32_t sample_hz, uint8_t batch_samples, telemetry_source_fn source);
+void telemetry_stream_stop(void);
+// Send the running stream to another host (lwIP context); it restarts with a keyframe
+void telemetry_stream_retarget(const ip_addr_t *dest);
+bool telemetry_stream_running(void);
+void telemetry_stream_report(void);
+
+// Preallocated transmit buffers: frames are encoded in place and handed to lwIP
+// by reference, so sends need no heap allocation and no extra copy. A frame
+// sent to several clients is encoded once and reference counted. Only used
+// from the lwIP (async context) side, so the pool needs no locking.
+#define TX_POOL_SLOTS 16
+
+typedef struct tx_buffer {
+    struct pbuf_custom pbuf;            // PBUF_REF wrapper returned to the pool on free
+    uint8_t data[TELEMETRY_MAX_FRAME];
+    uint16_t length;                    // Encoded frame length
+    uint8_t refs;                       // Owners: the encoder, client queues, lwIP
+} tx_buffer;
+
+// Per-client send queue. Frames are written to TCP oldest first while
+// tcp_sndbuf has room; the rest wait as pending, at most TX_QUEUE_PENDING of
+// them. Written frames stay queued until tcp_sent reports their bytes acked,
+// because TCP references them without TCP_WRITE_FLAG_COPY; the send buffer
+// bounds those, and the queue has a slot for every pool buffer, so a burst
+// that fits the send buffer (a report of several frames) is never cut short.
+#define TX_QUEUE_DEPTH TX_POOL_SLOTS
+#define TX_QUEUE_PENDING 3
+
+typedef struct {
+    tx_buffer *slots[TX_QUEUE_DEPTH];
+    uint32_t written_us[TX_QUEUE_DEPTH]; // When each written frame went to tcp_write
+    uint8_t head;
+    uint8_t count;                      // Frames queued
+    uint8_t written;                    // Of those, already passed to tcp_write
+    uint16_t head_acked;                // Bytes of the oldest frame already acked
+    uint32_t dropped;                   // Frames dropped because TX_QUEUE_PENDING were waiting
+    uint32_t rtt_us;                    // Smoothed write-to-ack time (0 until measured)
+} tx_queue;
+
+typedef struct {
+    uint32_t allocs;        // Successful allocations
+    uint32_t exhausted;     // Allocations refused because every slot was in use
+    uint16_t in_use;        // Slots currently allocated
+    uint16_t high_water;    // Most slots ever in use at once
+} tx_pool_stats;
+
+extern tx_pool_stats tx_pool_counters;
+
+tx_buffer *tx_pool_alloc(void);
+void tx_pool_retain(tx_buffer *buffer);
+void tx_pool_release(tx_buffer *buffer);
+size_t tx_pool_encode(tx_buffer *buffer, const telemetry_frame *frame);
+err_t tx_pool_send_udp(struct udp_pcb *pcb, tx_buffer *buffer, const ip_addr_t *dest, uint16_t port);
+
+void tx_queue_init(tx_queue *queue);
+bool tx_queue_push(tx_queue *queue, tx_buffer *buffer);
+err_t tx_queue_flush(tx_queue *queue, struct tcp_pcb *pcb);
+void tx_queue_acked(tx_queue *queue, uint16_t len);
+void tx_queue_clear(tx_queue *queue);
+
+// Remote drive: commands from the network are queued with their arrival time
+// and applied to the buddy2 drive layer by remote_drive_poll in the main loop
+#define REMOTE_QUEUE_DEPTH 8
+#define REMOTE_COMMAND_DEADLINE_US 150000   // Commands older than this when dequeued are dropped
+#define REMOTE_WATCHDOG_US 500000           // Stop if no command arrives for this long
+#define REMOTE_MANEUVER_TIMEOUT_US 10000000 // Give up on a distance/heading maneuver after this
+#define REMOTE_TURN_RATE_RAD_S 2.0f         // Turn rate for left/right
+#define REMOTE_DEFAULT_SPEED_CM_S 40.0f     // Speed when a drive command gives none
+
+typedef struct {
+    command cmd;
+    uint32_t arrival_us;    // time_us_32 when the segment carrying it reached tcp_server_recv
+} remote_command;
+
+typedef struct {
+    uint32_t received;          // Commands submitted by the network side
+    uint32_t applied;
+    uint32_t expired;           // Dequeued after their deadline
+    uint32_t dropped;           // Pushed out of a full queue
+    uint32_t watchdog_stops;
+    uint32_t latency_last_us;   // Packet arrival to PWM update
+    uint32_t latency_max_us;
+    uint64_t latency_sum_us;
+    uint32_t latency_count;
+} remote_drive_stats;
+
+extern remote_drive_stats remote_drive_counters;
+
+// Called after each submitted command, from the network side, so a control
+// task can wake and apply it instead of waiting for its next poll
+typedef void (*remote_drive_notify_fn)(void);
+
+// Line following for the LINE command, supplied by a build with the line
+// sensor (buddy3): start resets the controller, step gives the velocity for
+// this poll, set_gains applies PID LINE. Without one, LINE is ignored and
+// PID LINE is rejected.
+typedef struct {
+    void (*start)(void);
+    void (*step)(float *v_cm_s, float *omega_rad_s);
+    void (*set_gains)(float kp, float ki, float kd);
+} remote_drive_line_follower;
+
+void remote_drive_init(void);
+void remote_drive_set_notify(remote_drive_notify_fn notify);
+void remote_drive_set_line_follower(const remote_drive_line_follower *follower);
+bool remote_drive_submit(const command *cmd, uint32_t arrival_us);
+void remote_drive_poll(float distance_cm, bool obstacle);
+void remote_drive_sample(telemetry_sample *sample);
+void remote_drive_report(void);
+unsigned int remote_drive_queue_level(void);    // Commands waiting, of REMOTE_QUEUE_DEPTH
+
 #endif // BUDDY1_H
@@ -0,0 +1,131 @@
+#include <string.h>
+#include "pico/stdlib.h"
+#include "buddy1.h"
+
+// Ordered from full resolution to the leanest stream that still carries what
+// the dashboard needs to drive: wheel speeds, range and the obstacle flag
+static const adapt_level adapt_levels[] = {
+    {1, 10, TELEMETRY_FIELDS_ALL},                                                 // 200 Hz, 20 frames/s
+    {2, 10, TELEMETRY_FIELDS_ALL},                                                 // 100 Hz, 10 frames/s
+    {4, 10, TELEMETRY_FIELDS_ALL},                                                 // 50 Hz, 5 frames/s
+    {4, 20, TELEMETRY_FIELD_POSE | TELEMETRY_FIELD_SPEED | TELEMETRY_FIELD_RANGE}, // no duty cycles
+    {8, 20, TELEMETRY_FIELD_SPEED | TELEMETRY_FIELD_RANGE},                        // no pose, 25 Hz
+};
+
+#define LEVEL_COUNT (sizeof(adapt_levels) / sizeof(adapt_levels[0]))
+
+void rate_adapter_init(rate_adapter *adapter) {
+    memset(adapter, 0, sizeof(*adapter));
+    adapter->frame.type = TELEMETRY_BATCH;
+}
+
+const adapt_level *rate_adapter_current(const rate_adapter *adapter) {
+    return &adapt_levels[adapter->level];
+}
+
+// Called once per offered batch with the client's link state. Only this
+// stream's own lost batches count as congestion: other frames pushed out of
+// the send queue say nothing about the link that occupancy and RTT do not.
+void rate_adapter_observe(rate_adapter *adapter, float occupancy, uint32_t rtt_us, uint32_t now_us) {
+    bool dropped = adapter->dropped != adapter->last_drops;
+    bool congested = occupancy > ADAPT_OCCUPANCY_HIGH || rtt_us > ADAPT_RTT_HIGH_US || dropped;
+    bool clear = occupancy < ADAPT_OCCUPANCY_LOW && rtt_us < ADAPT_RTT_LOW_US && !dropped;
+    adapter->last_drops = adapter->dropped;
+
+    if (congested) {
+        adapter->clear_since_us = 0;
+        // Step down quickly, but give each step time to take effect
+        if ((size_t)adapter->level + 1 < LEVEL_COUNT && now_us - adapter->last_change_us >= ADAPT_STEP_DOWN_US) {
+            adapter->level++;
+            adapter->last_change_us = now_us;
+        }
+    } else if (clear) {
+        if (adapter->clear_since_us == 0) {
+            adapter->clear_since_us = now_us | 1;   // 0 means "not clear"
+        }
+        // Step back up only after a sustained clear stretch
+        if (adapter->level > 0 && now_us - adapter->clear_since_us >= ADAPT_RECOVER_US) {
+            adapter->level--;
+            adapter->last_change_us = now_us;
+            adapter->clear_since_us = now_us | 1;
+        }
+    }
+}
+
+static void emit_frame(rate_adapter *adapter, adapt_emit_fn emit, void *context) {
+    if (adapter->frame.u.batch.count > 0) {
+        emit(context, &adapter->frame);
+        adapter->frame.u.batch.count = 0;
+    }
+}
+
+// Average the accumulated samples into the batch being built
+static void flush_pending(rate_adapter *adapter, adapt_emit_fn emit, void *context) {
+    telemetry_batch *out = &adapter->frame.u.batch;
+    int n = adapter->pending;
+    if (n == 0) {
+        return;
+    }
+
+    if (out->count == 0) {
+        out->first_sample = adapter->pending_first;
+    }
+    telemetry_sample *s = &out->samples[out->count++];
+    s->x_mm = adapter->sum[0] / n;
+    s->y_mm = adapter->sum[1] / n;
+    s->heading_mrad = (int16_t)(adapter->sum[2] / n);
+    s->left_speed_mm_s = (int16_t)(adapter->sum[3] / n);
+    s->right_speed_mm_s = (int16_t)(adapter->sum[4] / n);
+    s->left_duty = (uint16_t)(adapter->sum[5] / n);
+    s->right_duty = (uint16_t)(adapter->sum[6] / n);
+    s->distance_mm = (uint16_t)(adapter->sum[7] / n);
+    s->flags = adapter->flags;  // Keep an obstacle seen by any of them
+
+    adapter->coalesced += n - 1;
+    adapter->pending = 0;
+    memset(adapter->sum, 0, sizeof(adapter->sum));
+    adapter->flags = 0;
+
+    if (out->count >= adapt_levels[adapter->level].batch || out->count == TELEMETRY_MAX_BATCH) {
+        emit_frame(adapter, emit, context);
+    }
+}
+
+void rate_adapter_feed(rate_adapter *adapter, const telemetry_frame *frame, adapt_emit_fn emit, void *context) {
+    const telemetry_batch *batch = &frame->u.batch;
+    const adapt_level *level = &adapt_levels[adapter->level];
+    telemetry_batch *out = &adapter->frame.u.batch;
+
+    // Output samples must be evenly spaced: a gap in the stream or a level
+    // change closes the batch being built
+    if (batch->first_sample != adapter->next_sample || out->fields != level->fields ||
+        (out->count > 0 && out->period_us != batch->period_us * level->stride)) {
+        flush_pending(adapter, emit, context);
+        emit_frame(adapter, emit, context);
+        out->fields = level->fields;
+        out->period_us = batch->period_us * level->stride;
+    }
+
+    for (int i = 0; i < batch->count; i++) {
+        const telemetry_sample *s = &batch->samples[i];
+        if (adapter->pending == 0) {
+            adapter->pending_first = batch->first_sample + i;
+            if (out->count == 0) {
+                adapter->frame.timestamp_us = frame->timestamp_us + i * batch->period_us;
+            }
+        }
+        adapter->sum[0] += s->x_mm;
+        adapter->sum[1] += s->y_mm;
+        adapter->sum[2] += s->heading_mrad;
+        adapter->sum[3] += s->left_speed_mm_s;
+        adapter->sum[4] += s->right_speed_mm_s;
+        adapter->sum[5] += s->left_duty;
+        adapter->sum[6] += s->right_duty;
+        adapter->sum[7] += s->distance_mm;
+        adapter->flags |= s->flags;
+        if (++adapter->pending >= level->stride) {
+            flush_pending(adapter, emit, context);
+        }
+    }
+    adapter->next_sample = batch->first_sample + batch->count;
+}
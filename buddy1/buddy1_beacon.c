@@ -0,0 +1,84 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+#include "pico/cyw43_arch.h"
+#include "pico/async_context.h"
+#include "lwip/udp.h"
+#include "lwip/netif.h"
+#include "buddy1.h"
+
+#define DEBUG_printf printf
+
+static struct udp_pcb *beacon_pcb = NULL;
+static uint16_t beacon_seq = 0;
+static uint64_t beacon_device_id;
+
+static void beacon_send(async_context_t *context, async_at_time_worker_t *worker);
+
+static async_at_time_worker_t beacon_worker = {
+    .do_work = beacon_send
+};
+
+static uint16_t beacon_capabilities(void) {
+    uint16_t caps = TELEMETRY_CAP_DRIVE | TELEMETRY_CAP_BINARY_COMMANDS | TELEMETRY_CAP_STREAM |
+                    TELEMETRY_CAP_ADAPTIVE;
+#if TELEMETRY_STREAM_DELTA
+    caps |= TELEMETRY_CAP_DELTA;
+#endif
+    return caps;
+}
+
+// Runs in the cyw43/lwIP async context and re-arms itself
+static void beacon_send(async_context_t *context, async_at_time_worker_t *worker) {
+    const ip4_addr_t *ip = netif_ip4_addr(netif_default);
+
+    // Nothing to announce until DHCP has given us an address
+    if (beacon_pcb && !ip4_addr_isany_val(*ip)) {
+        telemetry_frame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.type = TELEMETRY_BEACON;
+        frame.seq = beacon_seq++;
+        frame.timestamp_us = time_us_32();
+        frame.u.beacon.device_id = beacon_device_id;
+        memcpy(frame.u.beacon.ip, &ip->addr, 4);   // lwIP keeps it in network order
+        frame.u.beacon.tcp_port = TCP_PORT;
+        frame.u.beacon.stream_port = TELEMETRY_UDP_PORT;
+        frame.u.beacon.version = FIRMWARE_VERSION;
+        frame.u.beacon.capabilities = beacon_capabilities();
+        frame.u.beacon.clients = (uint8_t)remote_server_clients();
+        frame.u.beacon.max_clients = MAX_CLIENTS;
+
+        tx_buffer *buffer = tx_pool_alloc();
+        if (buffer) {
+            tx_pool_encode(buffer, &frame);
+            tx_pool_send_udp(beacon_pcb, buffer, IP_ADDR_BROADCAST, TELEMETRY_DISCOVERY_PORT);
+        }
+    }
+    async_context_add_at_time_worker_in_ms(context, worker, DISCOVERY_BEACON_INTERVAL_MS);
+}
+
+bool discovery_beacon_start(void) {
+    pico_unique_board_id_t id;
+    pico_get_unique_board_id(&id);
+    beacon_device_id = 0;
+    for (int i = 0; i < PICO_UNIQUE_BOARD_ID_SIZE_BYTES; i++) {
+        beacon_device_id = (beacon_device_id << 8) | id.id[i];
+    }
+
+    cyw43_arch_lwip_begin();
+    beacon_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    if (beacon_pcb) {
+        ip_set_option(beacon_pcb, SOF_BROADCAST);
+    }
+    cyw43_arch_lwip_end();
+    if (!beacon_pcb) {
+        DEBUG_printf("Failed to create beacon pcb\n");
+        return false;
+    }
+
+    async_context_add_at_time_worker_in_ms(cyw43_arch_async_context(), &beacon_worker, 0);
+    DEBUG_printf("Announcing car %016llx on UDP port %u\n", (unsigned long long)beacon_device_id,
+                 TELEMETRY_DISCOVERY_PORT);
+    return true;
+}
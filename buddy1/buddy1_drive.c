@@ -0,0 +1,304 @@
+#include <stdio.h>
+#include <math.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "buddy1.h"
+#include "buddy2.h"
+#include "buddy5.h"
+#include "trace.h"
+
+#define DEBUG_printf printf
+
+// Sent to the clients as a TELEMETRY_LOG line, so the operator sees it
+TRACE_EVENT(pid_rejected_event, TRACE_WARN, "PID loop %u is not run by this build, gains ignored");
+
+remote_drive_stats remote_drive_counters;
+
+// Filled by the network side, drained by remote_drive_poll in the main loop.
+// A static ring under a hardware spin lock: pico_util's queue_t takes its
+// storage from calloc, which the zero-heap build must not link.
+static struct {
+    remote_command entries[REMOTE_QUEUE_DEPTH];
+    uint8_t head;               // Oldest command
+    uint8_t count;
+    spin_lock_t *lock;
+} command_queue;
+static remote_drive_notify_fn command_notify = NULL;
+static const remote_drive_line_follower *line_follower = NULL;
+
+typedef enum {
+    MANEUVER_NONE,
+    MANEUVER_DISTANCE,      // Drive straight until the wheels have covered a distance
+    MANEUVER_HEADING,       // Spin on the spot until the wheels have covered an arc
+    MANEUVER_LINE           // Steered by the line follower until a drive command or an obstacle
+} maneuver_kind;
+
+static struct {
+    float cruise_cm_s;          // Speed used when a drive command gives none
+    float v_cm_s;               // Last commanded forward speed
+    float omega_rad_s;          // Last commanded turn rate
+    uint32_t last_command_us;   // Arrival of the last applied drive command, for the watchdog
+    bool stopped;               // Motors are at rest (watchdog has nothing to do)
+
+    maneuver_kind maneuver;
+    float maneuver_target_cm;   // Wheel travel that completes the maneuver
+    float maneuver_start_cm;    // Mean wheel odometer at the start
+    uint32_t maneuver_start_us;
+
+    float distance_cm;          // Latest filtered range, for telemetry
+    bool obstacle;
+} drive = {
+    .cruise_cm_s = REMOTE_DEFAULT_SPEED_CM_S,
+    .stopped = true
+};
+
+// Dead-reckoned pose from the wheel encoders, x along the heading at power-up
+static struct {
+    float x_cm, y_cm;
+    float heading_rad;          // CCW positive, wrapped to [-pi, pi]
+    float left_cm, right_cm;    // Encoder totals already integrated
+} pose;
+
+void remote_drive_init(void) {
+    command_queue.lock = spin_lock_instance(spin_lock_claim_unused(true));
+    drive_set_velocity(0.0f, 0.0f);
+}
+
+void remote_drive_set_notify(remote_drive_notify_fn notify) {
+    command_notify = notify;
+}
+
+void remote_drive_set_line_follower(const remote_drive_line_follower *follower) {
+    line_follower = follower;
+}
+
+// Network side. A full queue drops the oldest command: the newest joystick
+// position is the one that matters.
+bool remote_drive_submit(const command *cmd, uint32_t arrival_us) {
+    remote_drive_counters.received++;
+
+    uint32_t save = spin_lock_blocking(command_queue.lock);
+    if (command_queue.count == REMOTE_QUEUE_DEPTH) {
+        command_queue.head = (command_queue.head + 1) % REMOTE_QUEUE_DEPTH;
+        command_queue.count--;
+        remote_drive_counters.dropped++;
+    }
+    remote_command *entry = &command_queue.entries[(command_queue.head + command_queue.count) % REMOTE_QUEUE_DEPTH];
+    entry->cmd = *cmd;
+    entry->arrival_us = arrival_us;
+    command_queue.count++;
+    spin_unlock(command_queue.lock, save);
+
+    if (command_notify) {
+        command_notify();
+    }
+    return true;
+}
+
+// Control side: take the oldest command, false when there is none
+static bool command_queue_take(remote_command *entry) {
+    uint32_t save = spin_lock_blocking(command_queue.lock);
+    bool taken = command_queue.count > 0;
+    if (taken) {
+        *entry = command_queue.entries[command_queue.head];
+        command_queue.head = (command_queue.head + 1) % REMOTE_QUEUE_DEPTH;
+        command_queue.count--;
+    }
+    spin_unlock(command_queue.lock, save);
+    return taken;
+}
+
+static float odometer_cm(void) {
+    return (left_total_distance + right_total_distance) / 2.0f;
+}
+
+// Apply a velocity to the motors and account the packet-to-PWM latency
+static void apply_velocity(float v_cm_s, float omega_rad_s, uint32_t arrival_us) {
+    if (drive.obstacle && v_cm_s > 0.0f) {
+        v_cm_s = 0.0f;  // Never drive forward into an obstacle, turning is still allowed
+    }
+    drive.v_cm_s = v_cm_s;
+    drive.omega_rad_s = omega_rad_s;
+    drive.stopped = v_cm_s == 0.0f && omega_rad_s == 0.0f;
+    drive_set_velocity(v_cm_s, omega_rad_s);
+
+    if (arrival_us) {
+        uint32_t latency = time_us_32() - arrival_us;
+        remote_drive_counters.latency_last_us = latency;
+        remote_drive_counters.latency_sum_us += latency;
+        remote_drive_counters.latency_count++;
+        if (latency > remote_drive_counters.latency_max_us) {
+            remote_drive_counters.latency_max_us = latency;
+        }
+    }
+}
+
+static void stop(void) {
+    drive.maneuver = MANEUVER_NONE;
+    apply_velocity(0.0f, 0.0f, 0);
+}
+
+static void start_maneuver(maneuver_kind kind, float travel_cm, float v_cm_s, float omega_rad_s, uint32_t arrival_us) {
+    drive.maneuver = kind;
+    drive.maneuver_target_cm = travel_cm;
+    drive.maneuver_start_cm = odometer_cm();
+    drive.maneuver_start_us = time_us_32();
+    apply_velocity(v_cm_s, omega_rad_s, arrival_us);
+}
+
+static void apply_command(const remote_command *entry) {
+    const command *cmd = &entry->cmd;
+
+    switch (cmd->opcode) {
+        case CMD_DRIVE: {
+            const telemetry_drive *d = &cmd->u.drive;
+            float speed = d->speed > 0 ? (float)d->speed : drive.cruise_cm_s;
+            float v = 0.0f, omega = 0.0f;
+
+            if (d->move == DRIVE_MOVE_FORWARD) v = speed;
+            else if (d->move == DRIVE_MOVE_BACKWARD) v = -speed;
+            if (d->turn == DRIVE_TURN_LEFT) omega = REMOTE_TURN_RATE_RAD_S;
+            else if (d->turn == DRIVE_TURN_RIGHT) omega = -REMOTE_TURN_RATE_RAD_S;
+
+            // Only drive commands that are applied feed the watchdog; expired
+            // ones and settings (SPEED, PID) must not keep the car moving
+            drive.last_command_us = entry->arrival_us;
+            drive.maneuver = MANEUVER_NONE;
+            apply_velocity(v, omega, entry->arrival_us);
+            break;
+        }
+        case CMD_SPEED:
+            drive.cruise_cm_s = fabsf((float)cmd->u.speed_cm_s);
+            break;
+        case CMD_DISTANCE: {
+            float v = cmd->u.distance_cm >= 0 ? drive.cruise_cm_s : -drive.cruise_cm_s;
+            start_maneuver(MANEUVER_DISTANCE, fabsf((float)cmd->u.distance_cm), v, 0.0f, entry->arrival_us);
+            break;
+        }
+        case CMD_HEADING: {
+            // Spinning on the spot, each wheel covers the angle times half the track
+            float angle = cmd->u.heading_deg * (float)M_PI / 180.0f;
+            float omega = angle >= 0.0f ? REMOTE_TURN_RATE_RAD_S : -REMOTE_TURN_RATE_RAD_S;
+            start_maneuver(MANEUVER_HEADING, fabsf(angle) * WHEEL_BASE_CM / 2.0f, 0.0f, omega, entry->arrival_us);
+            break;
+        }
+        case CMD_PID:
+            // Remote builds drive the wheels open loop through drive_set_velocity,
+            // so the buddy2 wheel speed PID (COMMAND_PID_MOTOR) never runs
+            if (cmd->u.pid.loop == COMMAND_PID_LINE && line_follower) {
+                line_follower->set_gains(cmd->u.pid.kp, cmd->u.pid.ki, cmd->u.pid.kd);
+                break;
+            }
+            TRACE(pid_rejected_event, cmd->u.pid.loop);
+            break;
+        case CMD_LINE:
+            if (!line_follower) {
+                DEBUG_printf("Line following is not part of this build\n");
+                break;
+            }
+            line_follower->start();
+            drive.maneuver = MANEUVER_LINE;
+            break;
+        default:
+            break;
+    }
+}
+
+// Integrate the wheel travel since the last poll. The encoders only count
+// slots, so each wheel's travel takes the sign of the direction it was last
+// driven in (coasting after a reversal is counted backwards).
+static void update_pose(void) {
+    float left = left_total_distance;
+    float right = right_total_distance;
+    if (left < pose.left_cm || right < pose.right_cm) {
+        pose.left_cm = left;    // Counters were reset
+        pose.right_cm = right;
+        return;
+    }
+    float left_cm = (left - pose.left_cm) * (left_motor_forward() ? 1.0f : -1.0f);
+    float right_cm = (right - pose.right_cm) * (right_motor_forward() ? 1.0f : -1.0f);
+    pose.left_cm = left;
+    pose.right_cm = right;
+
+    float travel_cm = (left_cm + right_cm) / 2.0f;
+    float turn_rad = (right_cm - left_cm) / WHEEL_BASE_CM;
+    float mid_heading = pose.heading_rad + turn_rad / 2.0f;
+    pose.x_cm += travel_cm * cosf(mid_heading);
+    pose.y_cm += travel_cm * sinf(mid_heading);
+    pose.heading_rad = remainderf(pose.heading_rad + turn_rad, 2.0f * (float)M_PI);
+}
+
+// Main loop side: apply queued commands, run maneuvers and the dead-man watchdog
+void remote_drive_poll(float distance_cm, bool obstacle) {
+    remote_command entry;
+    uint32_t now = time_us_32();
+
+    update_pose();
+
+    drive.distance_cm = distance_cm;
+    drive.obstacle = obstacle;
+    if (obstacle && drive.v_cm_s > 0.0f) {
+        DEBUG_printf("Obstacle at %.1f cm, stopping\n", distance_cm);
+        stop();
+    }
+
+    while (command_queue_take(&entry)) {
+        if (now - entry.arrival_us > REMOTE_COMMAND_DEADLINE_US) {
+            remote_drive_counters.expired++;  // Too stale to act on
+            continue;
+        }
+        apply_command(&entry);
+        remote_drive_counters.applied++;
+    }
+
+    if (drive.maneuver == MANEUVER_LINE) {
+        // Runs until a drive command replaces it or an obstacle stops the car;
+        // no watchdog, the car stops by itself once the line is lost
+        float v_cm_s, omega_rad_s;
+        line_follower->step(&v_cm_s, &omega_rad_s);
+        apply_velocity(v_cm_s, omega_rad_s, 0);
+    } else if (drive.maneuver != MANEUVER_NONE) {
+        // Maneuvers are single commands, so they end on the encoders (or a
+        // timeout if the encoders stop counting) instead of the watchdog
+        if (odometer_cm() - drive.maneuver_start_cm >= drive.maneuver_target_cm) {
+            stop();
+        } else if (now - drive.maneuver_start_us > REMOTE_MANEUVER_TIMEOUT_US) {
+            DEBUG_printf("Maneuver timed out\n");
+            stop();
+        }
+    } else if (!drive.stopped && now - drive.last_command_us > REMOTE_WATCHDOG_US) {
+        remote_drive_counters.watchdog_stops++;
+        DEBUG_printf("No drive command for %lu ms, stopping\n", (unsigned long)((now - drive.last_command_us) / 1000));
+        stop();
+    }
+}
+
+// Telemetry sample source, runs in timer IRQ context so it only copies state.
+// Duty cycles are the ones the motor layer applied, after clamping.
+void remote_drive_sample(telemetry_sample *sample) {
+    sample->x_mm = (int32_t)(pose.x_cm * 10.0f);
+    sample->y_mm = (int32_t)(pose.y_cm * 10.0f);
+    sample->heading_mrad = (int16_t)(pose.heading_rad * 1000.0f);
+    sample->left_speed_mm_s = (int16_t)(left_speed_cm_s * 10.0f);
+    sample->right_speed_mm_s = (int16_t)(right_speed_cm_s * 10.0f);
+    sample->left_duty = (uint16_t)fminf(get_left_motor_duty_cycle() * 10000.0f, 10000.0f);
+    sample->right_duty = (uint16_t)fminf(get_right_motor_duty_cycle() * 10000.0f, 10000.0f);
+    sample->distance_mm = (uint16_t)(drive.distance_cm * 10.0f);
+    sample->flags = (drive.obstacle ? TELEMETRY_FLAG_OBSTACLE : 0) |
+                    (distance_valid ? TELEMETRY_FLAG_DISTANCE_VALID : 0);
+}
+
+unsigned int remote_drive_queue_level(void) {
+    return command_queue.count;
+}
+
+void remote_drive_report(void) {
+    const remote_drive_stats *s = &remote_drive_counters;
+    uint32_t mean = s->latency_count ? (uint32_t)(s->latency_sum_us / s->latency_count) : 0;
+
+    DEBUG_printf("Remote: %lu received, %lu applied, %lu expired, %lu dropped, %lu watchdog stops; "
+                 "latency last %lu us, mean %lu us, max %lu us\n",
+                 (unsigned long)s->received, (unsigned long)s->applied, (unsigned long)s->expired,
+                 (unsigned long)s->dropped, (unsigned long)s->watchdog_stops,
+                 (unsigned long)s->latency_last_us, (unsigned long)mean, (unsigned long)s->latency_max_us);
+}
@@ -0,0 +1,214 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "pico/async_context.h"
+#include "lwip/pbuf.h"
+#include "lwip/udp.h"
+#include "telemetry_delta.h"
+#include "profile.h"
+#include "buddy1.h"
+
+#define DEBUG_printf printf
+
+telemetry_stream_stats telemetry_stream_counters;
+
+static struct udp_pcb *stream_pcb = NULL;
+static ip_addr_t stream_dest;
+static uint16_t stream_port;
+static uint8_t stream_batch_samples;
+static uint16_t stream_seq = 0;
+static uint32_t next_sample = 0;
+static telemetry_source_fn stream_source = NULL;
+static repeating_timer_t stream_timer;
+static bool stream_running = false;
+static telemetry_delta_state stream_delta;
+
+// Double buffer: the timer fills one batch while the other waits to be sent
+static telemetry_frame stream_frames[2];
+static volatile uint8_t fill_index = 0;
+static volatile bool frame_ready[2];
+
+static void stream_send_pending(async_context_t *context, async_when_pending_worker_t *worker);
+
+static async_when_pending_worker_t stream_worker = {
+    .do_work = stream_send_pending
+};
+
+// Encode one batch straight into a pooled buffer and send it
+static void stream_send_frame(telemetry_frame *frame) {
+    tx_buffer *buffer = tx_pool_alloc();
+    if (!buffer) {
+        telemetry_stream_counters.send_errors++;
+        return;
+    }
+    frame->seq = stream_seq++;
+
+    uint32_t start = profile_cycles();
+#if TELEMETRY_STREAM_DELTA
+    buffer->length = (uint16_t)telemetry_delta_encode(&stream_delta, frame, buffer->data, sizeof(buffer->data));
+    if (buffer->length == 0 || stream_delta.since_keyframe == 0) {
+        telemetry_stream_counters.keyframes++;
+    }
+    if (buffer->length == 0) {
+        // Did not compress into one datagram; the next frame is a keyframe
+        tx_pool_encode(buffer, frame);
+    }
+#else
+    tx_pool_encode(buffer, frame);
+    telemetry_stream_counters.keyframes++;
+#endif
+    uint32_t cycles = profile_cycles_since(start);
+    telemetry_stream_counters.encode_cycles_sum += cycles;
+    if (cycles > telemetry_stream_counters.encode_cycles_max) {
+        telemetry_stream_counters.encode_cycles_max = cycles;
+    }
+    telemetry_stream_counters.raw_bytes += (uint32_t)telemetry_encoded_size(frame);
+    telemetry_stream_counters.sent_bytes += buffer->length;
+
+    err_t err = tx_pool_send_udp(stream_pcb, buffer, &stream_dest, stream_port);
+    if (err != ERR_OK) {
+        telemetry_stream_counters.send_errors++;
+    } else {
+        telemetry_stream_counters.datagrams++;
+    }
+}
+
+// Runs in the cyw43/lwIP async context, where lwIP calls are allowed
+static void stream_send_pending(async_context_t *context, async_when_pending_worker_t *worker) {
+    // Send the older batch first if both are waiting
+    int first = (frame_ready[0] && frame_ready[1] &&
+                 stream_frames[1].u.batch.first_sample < stream_frames[0].u.batch.first_sample) ? 1 : 0;
+
+    for (int n = 0; n < 2; n++) {
+        int i = first ^ n;
+        if (frame_ready[i]) {
+            if (stream_pcb) {
+                stream_send_frame(&stream_frames[i]);
+            }
+            telemetry_publish_batch(&stream_frames[i]);
+            stream_frames[i].u.batch.count = 0;
+            frame_ready[i] = false;
+        }
+    }
+}
+
+// Timer IRQ: take one sample and hand full batches to the async context
+static bool stream_sample_callback(repeating_timer_t *timer) {
+    uint8_t index = fill_index;
+    telemetry_frame *frame = &stream_frames[index];
+    telemetry_batch *batch = &frame->u.batch;
+
+    telemetry_stream_counters.samples++;
+    if (frame_ready[index]) {
+        // Previous batch in this buffer is still queued: drop the sample but keep
+        // counting so the receiver sees the gap in sample numbers
+        telemetry_stream_counters.overruns++;
+        next_sample++;
+        return true;
+    }
+
+    if (batch->count == 0) {
+        batch->first_sample = next_sample;
+        frame->timestamp_us = time_us_32();
+    }
+    if (stream_source) {
+        stream_source(&batch->samples[batch->count]);
+    } else {
+        memset(&batch->samples[batch->count], 0, sizeof(telemetry_sample));
+    }
+    batch->count++;
+    next_sample++;
+
+    if (batch->count >= stream_batch_samples) {
+        frame_ready[index] = true;
+        fill_index = index ^ 1;
+        async_context_set_work_pending(cyw43_arch_async_context(), &stream_worker);
+    }
+    return true;
+}
+
+bool telemetry_stream_start(const ip_addr_t *dest, uint16_t port, uint32_t sample_hz, uint8_t batch_samples, telemetry_source_fn source) {
+    if (stream_running || sample_hz == 0 || batch_samples == 0 || batch_samples > TELEMETRY_MAX_BATCH) {
+        return false;
+    }
+
+    cyw43_arch_lwip_begin();
+    stream_pcb = udp_new_ip_type(IPADDR_TYPE_ANY);
+    cyw43_arch_lwip_end();
+    if (!stream_pcb) {
+        DEBUG_printf("Failed to create telemetry pcb\n");
+        return false;
+    }
+
+    ip_addr_copy(stream_dest, *dest);
+    stream_port = port;
+    stream_batch_samples = batch_samples;
+    stream_source = source;
+    for (int i = 0; i < 2; i++) {
+        memset(&stream_frames[i], 0, sizeof(stream_frames[i]));
+        stream_frames[i].type = TELEMETRY_BATCH;
+        stream_frames[i].u.batch.fields = TELEMETRY_FIELDS_ALL;
+        stream_frames[i].u.batch.period_us = (uint16_t)(1000000 / sample_hz);
+        frame_ready[i] = false;
+    }
+    fill_index = 0;
+    telemetry_delta_init(&stream_delta, TELEMETRY_DELTA_KEYFRAME_INTERVAL);
+
+    async_context_add_when_pending_worker(cyw43_arch_async_context(), &stream_worker);
+
+    // Negative period: interval measured between callback starts, so the rate does not drift
+    if (!add_repeating_timer_us(-(int64_t)(1000000 / sample_hz), stream_sample_callback, NULL, &stream_timer)) {
+        DEBUG_printf("Failed to start telemetry timer\n");
+        telemetry_stream_stop();
+        return false;
+    }
+
+    stream_running = true;
+    DEBUG_printf("Streaming telemetry to %s:%u, %lu Hz, %u samples per datagram\n",
+                 ipaddr_ntoa(dest), port, (unsigned long)sample_hz, batch_samples);
+    return true;
+}
+
+void telemetry_stream_stop(void) {
+    if (stream_running) {
+        cancel_repeating_timer(&stream_timer);
+        stream_running = false;
+    }
+
+    async_context_remove_when_pending_worker(cyw43_arch_async_context(), &stream_worker);
+
+    cyw43_arch_lwip_begin();
+    if (stream_pcb) {
+        udp_remove(stream_pcb);
+        stream_pcb = NULL;
+    }
+    cyw43_arch_lwip_end();
+}
+
+void telemetry_stream_retarget(const ip_addr_t *dest) {
+    if (!stream_running) {
+        return;
+    }
+    ip_addr_copy(stream_dest, *dest);
+    // The new receiver has no reference for delta frames
+    telemetry_delta_init(&stream_delta, TELEMETRY_DELTA_KEYFRAME_INTERVAL);
+    DEBUG_printf("Streaming telemetry to %s:%u\n", ipaddr_ntoa(dest), stream_port);
+}
+
+bool telemetry_stream_running(void) {
+    return stream_running;
+}
+
+void telemetry_stream_report(void) {
+    const telemetry_stream_stats *s = &telemetry_stream_counters;
+    uint32_t mean = s->datagrams ? (uint32_t)(s->encode_cycles_sum / s->datagrams) : 0;
+
+    DEBUG_printf("Stream: %lu samples, %lu datagrams (%lu keyframes), %lu overruns, %lu errors; "
+                 "%lu of %lu bytes (%lu%%), encode mean %lu cycles, max %lu cycles\n",
+                 (unsigned long)s->samples, (unsigned long)s->datagrams, (unsigned long)s->keyframes,
+                 (unsigned long)s->overruns, (unsigned long)s->send_errors,
+                 (unsigned long)s->sent_bytes, (unsigned long)s->raw_bytes,
+                 (unsigned long)(s->raw_bytes ? (uint64_t)s->sent_bytes * 100 / s->raw_bytes : 0),
+                 (unsigned long)mean, (unsigned long)s->encode_cycles_max);
+}
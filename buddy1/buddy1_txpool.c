@@ -0,0 +1,156 @@
+#include <string.h>
+#include "pico/stdlib.h"
+#include "buddy1.h"
+
+tx_pool_stats tx_pool_counters;
+
+static tx_buffer tx_pool[TX_POOL_SLOTS];
+
+// Called by lwIP when the last reference to a pooled pbuf is dropped
+static void tx_pool_pbuf_free(struct pbuf *p) {
+    tx_pool_release((tx_buffer *)p);
+}
+
+tx_buffer *tx_pool_alloc(void) {
+    for (int i = 0; i < TX_POOL_SLOTS; i++) {
+        if (tx_pool[i].refs == 0) {
+            tx_pool[i].refs = 1;
+            tx_pool[i].length = 0;
+            tx_pool_counters.allocs++;
+            tx_pool_counters.in_use++;
+            if (tx_pool_counters.in_use > tx_pool_counters.high_water) {
+                tx_pool_counters.high_water = tx_pool_counters.in_use;
+            }
+            return &tx_pool[i];
+        }
+    }
+    tx_pool_counters.exhausted++;
+    return NULL;
+}
+
+void tx_pool_retain(tx_buffer *buffer) {
+    buffer->refs++;
+}
+
+void tx_pool_release(tx_buffer *buffer) {
+    if (buffer && buffer->refs > 0 && --buffer->refs == 0) {
+        tx_pool_counters.in_use--;
+    }
+}
+
+// Encode a frame into the buffer; the caller stamps seq and timestamp.
+// Returns the encoded length, 0 if the frame does not fit.
+size_t tx_pool_encode(tx_buffer *buffer, const telemetry_frame *frame) {
+    buffer->length = (uint16_t)telemetry_encode(frame, buffer->data, sizeof(buffer->data));
+    return buffer->length;
+}
+
+// Send a pooled buffer as one datagram. The caller's reference passes to the
+// pbuf and goes back to the pool when lwIP frees it.
+err_t tx_pool_send_udp(struct udp_pcb *pcb, tx_buffer *buffer, const ip_addr_t *dest, uint16_t port) {
+    buffer->pbuf.custom_free_function = tx_pool_pbuf_free;
+    struct pbuf *p = pbuf_alloced_custom(PBUF_RAW, buffer->length, PBUF_REF, &buffer->pbuf,
+                                         buffer->data, sizeof(buffer->data));
+    if (!p) {
+        tx_pool_release(buffer);
+        return ERR_MEM;
+    }
+
+    err_t err = udp_sendto(pcb, p, dest, port);
+    pbuf_free(p);
+    return err;
+}
+
+void tx_queue_init(tx_queue *queue) {
+    memset(queue, 0, sizeof(*queue));
+}
+
+static tx_buffer **queue_slot(tx_queue *queue, int n) {
+    return &queue->slots[(queue->head + n) % TX_QUEUE_DEPTH];
+}
+
+// Queue a frame for a client, taking a reference. When TX_QUEUE_PENDING
+// frames already wait, the oldest of them makes room (newer telemetry
+// supersedes it). Frames written but not yet acked do not count.
+bool tx_queue_push(tx_queue *queue, tx_buffer *buffer) {
+    if (queue->count == TX_QUEUE_DEPTH) {
+        queue->dropped++;   // Every pool buffer is held: cannot happen for a pooled frame
+        return false;
+    }
+    if (queue->count - queue->written == TX_QUEUE_PENDING) {
+        queue->dropped++;
+        tx_pool_release(*queue_slot(queue, queue->written));
+        for (int n = queue->written; n < queue->count - 1; n++) {
+            *queue_slot(queue, n) = *queue_slot(queue, n + 1);
+        }
+        queue->count--;
+    }
+
+    tx_pool_retain(buffer);
+    *queue_slot(queue, queue->count) = buffer;
+    queue->count++;
+    return true;
+}
+
+// Write pending frames while the connection's send buffer has room. Never
+// blocks: whatever does not fit waits for the next tcp_sent. Returns an error
+// only if the connection is broken.
+err_t tx_queue_flush(tx_queue *queue, struct tcp_pcb *pcb) {
+    bool wrote = false;
+
+    while (queue->written < queue->count) {
+        tx_buffer *buffer = *queue_slot(queue, queue->written);
+        if (tcp_sndbuf(pcb) < buffer->length || tcp_sndqueuelen(pcb) >= TCP_SND_QUEUELEN - 1) {
+            break;
+        }
+        err_t err = tcp_write(pcb, buffer->data, buffer->length, 0);
+        if (err == ERR_MEM) {
+            break;
+        }
+        if (err != ERR_OK) {
+            return err;
+        }
+        queue->written_us[(queue->head + queue->written) % TX_QUEUE_DEPTH] = time_us_32();
+        queue->written++;
+        wrote = true;
+    }
+
+    if (wrote) {
+        tcp_output(pcb);
+    }
+    return ERR_OK;
+}
+
+// tcp_sent callback: release every written frame whose bytes have all been acked
+void tx_queue_acked(tx_queue *queue, uint16_t len) {
+    uint32_t acked = queue->head_acked + len;
+
+    while (queue->written > 0) {
+        tx_buffer *buffer = queue->slots[queue->head];
+        if (acked < buffer->length) {
+            break;
+        }
+        acked -= buffer->length;
+
+        // Write-to-ack time, smoothed like TCP's SRTT (gain 1/8)
+        int32_t sample = (int32_t)(time_us_32() - queue->written_us[queue->head]);
+        queue->rtt_us = queue->rtt_us ? (uint32_t)((int32_t)queue->rtt_us + (sample - (int32_t)queue->rtt_us) / 8) : (uint32_t)sample;
+
+        tx_pool_release(buffer);
+        queue->head = (queue->head + 1) % TX_QUEUE_DEPTH;
+        queue->count--;
+        queue->written--;
+    }
+    queue->head_acked = queue->written > 0 ? (uint16_t)acked : 0;
+}
+
+// Connection gone: lwIP has dropped its references, return everything
+void tx_queue_clear(tx_queue *queue) {
+    while (queue->count > 0) {
+        tx_pool_release(queue->slots[queue->head]);
+        queue->head = (queue->head + 1) % TX_QUEUE_DEPTH;
+        queue->count--;
+    }
+    queue->written = 0;
+    queue->head_acked = 0;
+}
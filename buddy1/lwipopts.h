@@ -0,0 +1,26 @@
+#ifndef _LWIPOPTS_H
+#define _LWIPOPTS_H
+
+// Start from the options shared by the wifi examples
+#include "lwipopts_examples_common.h"
+
+// Telemetry frames are sent from a static buffer pool wrapped in custom
+// PBUF_REF pbufs (see buddy1_txpool.c)
+#define LWIP_SUPPORT_CUSTOM_PBUF    1
+
+// FreeRTOS build (project_rtos): lwIP runs in its own thread at network
+// priority, below the control and sensor tasks (rtos/car_tasks.h)
+#if !NO_SYS
+#define TCPIP_THREAD_STACKSIZE      1024
+#define TCPIP_THREAD_PRIO           2       // tskIDLE_PRIORITY + 2
+#define DEFAULT_THREAD_STACKSIZE    1024
+#define DEFAULT_RAW_RECVMBOX_SIZE   8
+#define DEFAULT_UDP_RECVMBOX_SIZE   8
+#define DEFAULT_TCP_RECVMBOX_SIZE   8
+#define DEFAULT_ACCEPTMBOX_SIZE     8
+#define TCPIP_MBOX_SIZE             8
+#define LWIP_TIMEVAL_PRIVATE        0
+#define LWIP_TCPIP_CORE_LOCKING_INPUT 1
+#endif
+
+#endif
@@ -5,14 +5,11 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <math.h>
+#include "trace.h"
 
 #define RIGHT_MOTOR_CORRECTION_FACTOR 0.98f  // Adjust this value as needed
 
-// PID constants for the left motor
-float Kp = 3.0f;   // Proportional gain
-float Ki = 2.0f;  // Integral gain
-float Kd = 0.02f;  // Derivative gain
-
 // PID variables for left motor adjustment
 float integral_left = 0.0f;
 float prev_error_left = 0.0f;
@@ -21,6 +18,10 @@ float prev_error_left = 0.0f;
 float left_motor_duty_cycle = 0.0f;
 float right_motor_duty_cycle = 0.0f;
 
+// Direction last set on each motor
+static bool left_forward = true;
+static bool right_forward = true;
+
 // Global wrap value for PWM
 uint16_t pwm_wrap_value = 65535; // Use a fixed wrap value
 
@@ -51,8 +52,7 @@ void set_pwm_duty_cycle(uint pwm_pin, float duty_cycle) {
 
 // Function to estimate speed from duty cycle (if needed)
 float estimate_speed_from_duty_cycle(float duty_cycle) {
-    float max_speed = 100.0f; // Adjust based on your motor's specifications
-    return duty_cycle * max_speed;
+    return duty_cycle * MAX_WHEEL_SPEED_CM_S;
 }
 
 // Function to get right motor's duty cycle
@@ -60,6 +60,20 @@ float get_right_motor_duty_cycle() {
     return right_motor_duty_cycle;
 }
 
+float get_left_motor_duty_cycle(void) {
+    return left_motor_duty_cycle;
+}
+
+bool left_motor_forward(void) {
+    return left_forward;
+}
+
+bool right_motor_forward(void) {
+    return right_forward;
+}
+
+TRACE_EVENT(left_speed_event, TRACE_DEBUG, "Left motor speed: %.2f cm/s, target %.2f cm/s");
+
 // Function to adjust left motor speed using PID control
 void adjust_left_motor_speed() {
     if (obstacle_detected) {
@@ -82,8 +96,7 @@ void adjust_left_motor_speed() {
     }
 
     // Debugging output
-    printf("Current Left Motor Speed: %.2f cm/s\n", current_speed_left);
-    printf("Target Left Motor Speed: %.2f cm/s\n", target_speed_left);
+    TRACE(left_speed_event, trace_f(current_speed_left), trace_f(target_speed_left));
 
     // Compute PID adjustment
     float adjusted_duty_cycle = compute_pid(&target_speed_left, &current_speed_left, &integral_left, &prev_error_left);
@@ -120,36 +133,64 @@ void setup_pwm(uint gpio, float freq, float duty_cycle) {
     //       gpio, freq, duty_cycle * 100);
 }
 
-// PID computation function
-float compute_pid(float *target_speed, float *current_speed, float *integral, float *prev_error) {
-    float error = *target_speed - *current_speed;
-    *integral += error;
-
-    // Integral clamping to avoid windup
-    const float MAX_INTEGRAL = 1000.0f; // Adjust as needed
-    if (*integral > MAX_INTEGRAL) *integral = MAX_INTEGRAL;
-    if (*integral < -MAX_INTEGRAL) *integral = -MAX_INTEGRAL;
-
-    float derivative = error - *prev_error;
-    float duty_cycle = Kp * error + Ki * (*integral) + Kd * derivative;
-
-    // Clamp duty cycle to [0, 0.99]
-    if (duty_cycle > 0.99f) duty_cycle = 0.99f;
-    else if (duty_cycle < 0.0f) duty_cycle = 0.0f;
-
-    *prev_error = error;
-    return duty_cycle;
-}
-
 // Motor direction control functions
 void forward_motor_left() { set_motor_direction(DIR_PIN1, DIR_PIN2, true); }
 void forward_motor_right() { set_motor_direction(DIR_PIN3, DIR_PIN4, true); }
 void reverse_motor_left() { set_motor_direction(DIR_PIN1, DIR_PIN2, false); }
 void reverse_motor_right() { set_motor_direction(DIR_PIN3, DIR_PIN4, false); }
 
+// Single motor speed/stop helpers
+void stop_motor_left() { set_pwm_duty_cycle(PWM_PIN, 0.0f); }
+void stop_motor_right() { set_pwm_duty_cycle(PWM_PIN1, 0.0f); }
+void full_speed_left() { set_pwm_duty_cycle(PWM_PIN, 0.99f); }
+void full_speed_right() { set_pwm_duty_cycle(PWM_PIN1, 0.99f); }
+void half_speed_left() { set_pwm_duty_cycle(PWM_PIN, 0.5f); }
+void half_speed_right() { set_pwm_duty_cycle(PWM_PIN1, 0.5f); }
+
+// Control functions for both motors
+void both_stop_motor() { stop_motor_left(); stop_motor_right(); }
+void both_full_motor_forward() { forward_motor_left(); forward_motor_right(); full_speed_left(); full_speed_right(); }
+void both_half_motor_forward() { forward_motor_left(); forward_motor_right(); half_speed_left(); half_speed_right(); }
+void both_full_motor_reverse() { reverse_motor_left(); reverse_motor_right(); full_speed_left(); full_speed_right(); }
+void both_half_motor_reverse() { reverse_motor_left(); reverse_motor_right(); half_speed_left(); half_speed_right(); }
+
+// Drive one wheel at a signed speed in cm/s (negative = reverse)
+void set_wheel_speed(uint pwm_pin, uint pin1, uint pin2, float speed_cm_s) {
+    float duty_cycle = speed_cm_s / MAX_WHEEL_SPEED_CM_S;
+
+    set_motor_direction(pin1, pin2, duty_cycle >= 0.0f);
+    if (duty_cycle < 0.0f) duty_cycle = -duty_cycle;
+
+    // Clamp duty cycle to [0, 0.99] like compute_pid
+    if (duty_cycle > 0.99f) duty_cycle = 0.99f;
+    set_pwm_duty_cycle(pwm_pin, duty_cycle);
+}
+
+// Differential drive: convert forward speed v and turn rate omega into wheel speeds
+void drive_set_velocity(float v_cm_s, float omega_rad_s) {
+    float half_track = omega_rad_s * (WHEEL_BASE_CM / 2.0f);
+    float left_cm_s = v_cm_s - half_track;
+    float right_cm_s = v_cm_s + half_track;
+
+    // Scale both wheels down together so the turn radius is kept when saturating
+    float peak = fabsf(left_cm_s) > fabsf(right_cm_s) ? fabsf(left_cm_s) : fabsf(right_cm_s);
+    if (peak > MAX_WHEEL_SPEED_CM_S) {
+        left_cm_s *= MAX_WHEEL_SPEED_CM_S / peak;
+        right_cm_s *= MAX_WHEEL_SPEED_CM_S / peak;
+    }
+
+    set_wheel_speed(PWM_PIN, DIR_PIN1, DIR_PIN2, left_cm_s);
+    set_wheel_speed(PWM_PIN1, DIR_PIN3, DIR_PIN4, right_cm_s);
+}
+
 void set_motor_direction(uint pin1, uint pin2, bool forward) {
     gpio_put(pin1, forward ? 1 : 0);
     gpio_put(pin2, forward ? 0 : 1);
+    if (pin1 == DIR_PIN1) {
+        left_forward = forward;
+    } else if (pin1 == DIR_PIN3) {
+        right_forward = forward;
+    }
     //printf("Motor direction on pins %d and %d set to %s\n", pin1, pin2, forward ? "forward" : "reverse");
 }
 
@@ -6,6 +6,7 @@
 #include "hardware/pwm.h"
 #include "hardware/clocks.h"
 #include "../buddy5/buddy5.h"
+#include "buddy2_pid.h"
 
 // Define GPIO pins for motors
 #define PWM_PIN 2          // GP2 for PWM (Motor 1 - Left Motor)
@@ -15,18 +16,10 @@
 #define DIR_PIN3 14        // GP14 for direction (Motor 2 - Right Motor)
 #define DIR_PIN4 15        // GP15 for direction (Motor 2 - Right Motor)
 
-// PID control constants
-extern float Kp;
-extern float Ki;
-extern float Kd;
-
 // PID variables for left motor adjustment
 extern float integral_left;
 extern float prev_error_left;
 
-// PID function declaration
-float compute_pid(float *target_speed, float *current_speed, float *integral, float *prev_error);
-
 // Motor control functions
 void motor_control_init(void);
 void forward_motor_right(void); // Set right motor to a constant speed
@@ -40,6 +33,9 @@ void gradual_ramp_up(uint pwm_pin, float start_duty_cycle, float max_duty_cycle,
 float estimate_speed_from_duty_cycle(float duty_cycle);
 float get_right_motor_duty_cycle(void);
 void set_right_motor_duty_cycle(float duty_cycle);
+float get_left_motor_duty_cycle(void);
+bool left_motor_forward(void);     // Direction last set, for signing the unsigned encoder distance
+bool right_motor_forward(void);
 
 
 // Turning functions
@@ -68,6 +64,12 @@ void both_half_motor_forward();
 void both_full_motor_reverse();
 void both_half_motor_reverse();
 
+// Differential drive (v, omega) interface
+#define WHEEL_BASE_CM 13.0f           // Distance between left and right wheel contact points
+#define MAX_WHEEL_SPEED_CM_S 100.0f   // Wheel speed reached at 100% duty cycle
+void drive_set_velocity(float v_cm_s, float omega_rad_s); // Forward speed and turn rate (CCW positive)
+void set_wheel_speed(uint pwm_pin, uint pin1, uint pin2, float speed_cm_s);
+
 void motor_control_init(void);
 
 
@@ -0,0 +1,27 @@
+#include "buddy2_pid.h"
+
+// PID constants for the left motor
+float Kp = 3.0f;   // Proportional gain
+float Ki = 2.0f;  // Integral gain
+float Kd = 0.02f;  // Derivative gain
+
+// PID computation function
+float compute_pid(float *target_speed, float *current_speed, float *integral, float *prev_error) {
+    float error = *target_speed - *current_speed;
+    *integral += error;
+
+    // Integral clamping to avoid windup
+    const float MAX_INTEGRAL = 1000.0f; // Adjust as needed
+    if (*integral > MAX_INTEGRAL) *integral = MAX_INTEGRAL;
+    if (*integral < -MAX_INTEGRAL) *integral = -MAX_INTEGRAL;
+
+    float derivative = error - *prev_error;
+    float duty_cycle = Kp * error + Ki * (*integral) + Kd * derivative;
+
+    // Clamp duty cycle to [0, 0.99]
+    if (duty_cycle > 0.99f) duty_cycle = 0.99f;
+    else if (duty_cycle < 0.0f) duty_cycle = 0.0f;
+
+    *prev_error = error;
+    return duty_cycle;
+}
@@ -0,0 +1,15 @@
+#ifndef BUDDY2_PID_H
+#define BUDDY2_PID_H
+
+// Wheel speed PID controller. Kept free of Pico SDK headers so it can also be
+// built on the host (see host/kernel_bench).
+
+// PID control constants
+extern float Kp;
+extern float Ki;
+extern float Kd;
+
+// PID function declaration
+float compute_pid(float *target_speed, float *current_speed, float *integral, float *prev_error);
+
+#endif // BUDDY2_PID_H
@@ -8,30 +8,32 @@
 #include <string.h> 
 #include "hardware/adc.h"
 #include "hardware/gpio.h"
-#include "buddy3.h"
 #include "buddy2.h"
+#include "buddy3_barcode.h"
+#include "buddy3_line.h"
 
 #define LEFT_IR_SENSOR_ANALOG_PIN 26   // ADC GPIO pin for the left sensor
 #define RIGHT_IR_SENSOR_ANALOG_PIN 27   // ADC GPIO pin for the right sensor
 
-// Fixed threshold for surface detection
-extern const int BLACK_WHITE_THRESHOLD;
-
-// Character and binary code arrays
-extern char array_char[];
-extern char *array_code[];
-extern char *array_reverse_code[];
-
 // Function prototypes
 void setup_adc();                               // Set up ADC for IR sensors
 uint16_t read_adc(int sensor_index);           // Read analog value from specified sensor
 void read_ir_sensors();                         // Read and process IR sensor data
-void line_following(uint16_t analog_values[]); // Control line following based on sensor readings
 void print_detected_state(int sensor_index, bool current_state_black, uint16_t analog_value, float voltage); // Print current sensor state
-int find_binary_index(const char *binary_code, char *code_array[]);
-char map_binary_to_char(const char *binary_code, bool reverse);
-void barcode_detector(uint16_t analog_value);
-void convert_stay_counts(int stay_counts[], int barcount, bool *direction);
 void reset_barcode_detector(uint gpio, uint32_t events);
 void setup_button();
+
+// Barcode decoder fed from the barcode sensor
+extern barcode_decoder ir_barcode_decoder;
+
+extern line_follower line_follower_state;
+
+// Line-follow mode, steered from the line sensor (ADC 1) as sampled by the
+// last read_ir_sensors call. line_follow_start resets the controller;
+// line_follow_step runs one control step and returns the velocity to drive
+// at (zero while the line is lost). Neither touches the motors.
+// line_follow_set_gains replaces the steering PID gains (PID LINE).
+void line_follow_start(void);
+void line_follow_step(float *v_cm_s, float *omega_rad_s);
+void line_follow_set_gains(float kp, float ki, float kd);
 #endif // BUDDY3_H
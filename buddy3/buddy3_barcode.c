@@ -0,0 +1,273 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "buddy3_barcode.h"
+
+// Fixed threshold for surface detection
+const int BLACK_WHITE_THRESHOLD = 200;
+
+#define UNMAPPED_CHAR '?'
+
+#ifndef BARCODE_QUIET
+// Recorded per sample from the IR polling path, formatted later by trace_drain
+TRACE_EVENT(chunk_error_event, TRACE_WARN, "Error: barcount is not a multiple of CHUNK_SIZE.");
+TRACE_EVENT(direction_event, TRACE_DEBUG, "Direction determined: %s");
+TRACE_EVENT(direction_error_event, TRACE_WARN, "Error: Unable to determine direction from the first chunk.");
+TRACE_EVENT(mapped_event, TRACE_DEBUG, "Mapped character from bars 0x%03x: %c");
+TRACE_EVENT(reset_event, TRACE_DEBUG, "Barcode detector has been reset.");
+TRACE_EVENT(stayed_event, TRACE_DEBUG, "Stayed %s for %d readings");
+TRACE_EVENT(start_event, TRACE_DEBUG, "Starting barcode detection on first black detection.");
+TRACE_EVENT(barcount_event, TRACE_DEBUG, "barcount updated to %d");
+TRACE_EVENT(transition_event, TRACE_DEBUG, "Transition detected: %s to %s");
+TRACE_EVENT(sample_event, TRACE_DEBUG, "Current analog value: %d, Current state: %s");
+TRACE_EVENT(converting_event, TRACE_DEBUG, "Detected %d bars, converting to character...");
+TRACE_EVENT(finished_event, TRACE_DEBUG, "Finish detecting barcode with %d transitions");
+TRACE_EVENT(complete_event, TRACE_INFO, "Complete barcode: %c%c%c");
+TRACE_EVENT(resume_event, TRACE_DEBUG, "Detected black bar, resuming counting.");
+#endif
+
+// Literals only: trace arguments are read when the record is drained
+#define STATE_NAME(black) trace_s((black) ? "black" : "white")
+
+// A chunk's binary string as an integer, first bar highest, for the trace
+static inline uint32_t pack_bars(const char *binary_string) {
+    uint32_t bars = 0;
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        bars = (bars << 1) | (uint32_t)(binary_string[i] - '0');
+    }
+    return bars;
+}
+
+// Initialise array used to store each barcode character
+char array_char[] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F', 'G',
+                                'H', 'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X',
+                                'Y', 'Z', '_', '.', '$', '/', '+', '%', ' ', '*'}; 
+
+// Initialise array used to store binary representation of each character
+char *array_code[] = {"000110100", "100100001", "001100001", "101100000", "000110001", "100110000", "001110000",
+                                "000100101", "100100100", "001100100", "100001001", "001001001", "101001000", "000011001",
+                                "100011000", "001011000", "000001101", "100001100", "001001100", "000011100", "100000011",
+                                "001000011", "101000010", "000010011", "100010010", "001010010", "000000111", "100000110",
+                                "001000110", "000010110", "110000001", "011000001", "111000000", "010010001", "110010000",
+                                "011010000", "010000101", "110000100", "010101000", "010100010", "010001010", "000101010",
+                                "011000100", "010010100"}; 
+
+// Initialise array used to store the reversed binary representation of each character
+char *array_reverse_code[] = {"001011000", "100001001", "100001100", "000001101", "100011000", "000011001",
+                                        "000011100", "101001000", "001001001", "001001100", "100100001", "100100100",
+                                        "000100101", "100110000", "000110001", "000110100", "101100000", "001100001",
+                                        "001100100", "001110000", "110000001", "110000100", "010000101", "110010000",
+                                        "010010001", "010010100", "111000000", "011000001", "011000100", "011010000",
+                                        "100000011", "100000110", "000000111", "100010010", "000010011", "000010110",
+                                        "101000010", "001000011", "000101010", "010001010", "010100010", "010101000",
+                                        "001000110", "001010010"};
+
+// Function to find the index of a binary code in the specified code array
+int find_binary_index(const char *binary_code, char *code_array[]) {
+    for (int i = 0; i < sizeof(array_code) / sizeof(array_code[0]); i++) {
+        if (strcmp(code_array[i], binary_code) == 0) {
+            return i; // Return index if binary code is found
+        }
+    }
+    return -1; // Return -1 if binary code is not found
+}
+
+// Function to map binary code to its corresponding character with an option for reverse mapping
+char map_binary_to_char(const char *binary_code, bool reverse) {
+    // Choose the appropriate array based on the reverse flag
+    char **code_array = reverse ? array_reverse_code : array_code;
+    
+    int index = find_binary_index(binary_code, code_array); // Find the index in the selected array
+
+    if (index != -1) {
+        return array_char[index]; // Return the corresponding character
+    }
+    
+    // Return "?" if the binary code is not found
+    return UNMAPPED_CHAR; 
+}
+
+// Function to convert stay counts for each 9-bar chunk and map to character
+void convert_stay_counts(barcode_decoder *dec, const int stay_counts[], int barcount) {
+    // Ensure barcount is a multiple of CHUNK_SIZE
+    if (barcount % CHUNK_SIZE != 0) {
+        BARCODE_TRACE(chunk_error_event);
+        return;
+    }
+
+    // Process each chunk of CHUNK_SIZE
+    for (int chunk_start = 0; chunk_start < barcount; chunk_start += CHUNK_SIZE) {
+        int converted_counts[CHUNK_SIZE] = {0};
+        int top_counts[CHUNK_SIZE];
+
+        // Initialize top_counts array for sorting
+        for (int i = 0; i < CHUNK_SIZE; i++) {
+            top_counts[i] = stay_counts[chunk_start + i];
+        }
+
+        // Sort to find the top K values in the current chunk
+        for (int i = 0; i < CHUNK_SIZE - 1; i++) {
+            for (int j = i + 1; j < CHUNK_SIZE; j++) {
+                if (top_counts[i] < top_counts[j]) {
+                    int temp = top_counts[i];
+                    top_counts[i] = top_counts[j];
+                    top_counts[j] = temp;
+                }
+            }
+        }
+
+        // Convert stay counts based on top K values
+        for (int i = 0; i < CHUNK_SIZE; i++) {
+            int count = 0;
+            for (int j = 0; j < TOP_K && j < CHUNK_SIZE; j++) {
+                if (stay_counts[chunk_start + i] == top_counts[j]) {
+                    count++;
+                }
+            }
+            converted_counts[i] = (count > 0) ? 1 : 0;
+        }
+
+        // Create binary string for the current chunk
+        char binary_string[CHUNK_SIZE + 1];
+        for (int i = 0; i < CHUNK_SIZE; i++) {
+            binary_string[i] = converted_counts[i] + '0';
+        }
+        binary_string[CHUNK_SIZE] = '\0';
+
+        // Map the binary string to a character in both directions for the first chunk
+        if (!dec->direction_determined) {
+            char normal_char = map_binary_to_char(binary_string, false);
+            char reverse_char = map_binary_to_char(binary_string, true);
+
+            if (normal_char == '*') {
+                dec->direction = false;
+                BARCODE_TRACE(direction_event, trace_s("Normal"));
+            } else if (reverse_char == '*') {
+                dec->direction = true;
+                BARCODE_TRACE(direction_event, trace_s("Reverse"));
+            } else {
+                BARCODE_TRACE(direction_error_event);
+                return;
+            }
+        }
+
+        // Map the binary string to a character based on the determined direction
+        char mapped_char = map_binary_to_char(binary_string, dec->direction);
+        BARCODE_TRACE(mapped_event, pack_bars(binary_string), (uint32_t)mapped_char);
+
+        // Store the mapped character
+        if (dec->char_index < CHAR_COUNT) {
+            dec->converted_chars[dec->char_index++] = mapped_char;
+        }
+    }
+}
+
+// Initialise a decoder instance (one per IR sensor used for barcodes)
+void barcode_decoder_init(barcode_decoder *dec) {
+    memset(dec, 0, sizeof(*dec));
+    dec->last_conversion_barcount = -1;
+}
+
+// Clear all decoder state so the next black bar starts a new barcode.
+// Not ISR-safe; from interrupt context use barcode_decoder_request_reset.
+void barcode_reset(barcode_decoder *dec) {
+    dec->barcount = 0;
+    dec->char_index = 0;
+    dec->detecting = false;
+    dec->last_conversion_barcount = -1;
+    dec->waiting_for_black = false;
+    dec->direction_determined = false;
+    dec->stay_count = 0;
+    dec->black_detected = false;
+    dec->reset_requested = false;
+
+    // Clear the stay_counts array
+    memset(dec->stay_counts, 0, sizeof(dec->stay_counts));
+}
+
+// Ask the decoder to reset before it processes its next sample. Only sets a
+// flag, so it is safe to call from an IRQ while barcode_detector is running.
+void barcode_decoder_request_reset(barcode_decoder *dec) {
+    dec->reset_requested = true;
+}
+
+// Feed one ADC sample. Detection starts at the first black reading and the
+// state is cleared again once a complete barcode has been decoded.
+void barcode_detector(barcode_decoder *dec, uint16_t analog_value) {
+    bool current_state_black = (analog_value > BLACK_WHITE_THRESHOLD);
+
+    // Apply a reset requested from interrupt context between samples
+    if (dec->reset_requested) {
+        barcode_reset(dec);
+        BARCODE_TRACE(reset_event);
+    }
+
+    // Start barcode detection on the first black reading
+    if (!dec->detecting) {
+        if (!current_state_black) {
+            return;
+        }
+        dec->detecting = true;
+    }
+
+    // Check for transition only if we're not waiting for the next black bar
+    if (!dec->waiting_for_black && current_state_black != dec->black_detected) {
+        BARCODE_TRACE(stayed_event, STATE_NAME(dec->black_detected), (uint32_t)dec->stay_count);
+
+        // Only start counting when the first black is detected
+        if (current_state_black && dec->barcount == 0 && dec->stay_count == 0) {
+            BARCODE_TRACE(start_event);
+            dec->stay_count = 1;  // Start counting the first black state
+        } else if (dec->stay_count > 0 && dec->barcount < MAX_TRANSITIONS) {
+            dec->stay_counts[dec->barcount] = dec->stay_count;
+            dec->barcount++;
+            BARCODE_TRACE(barcount_event, (uint32_t)dec->barcount);  // Trace barcount after increment
+        }
+
+        dec->stay_count = 1; // Start counting the new state
+        BARCODE_TRACE(transition_event, STATE_NAME(dec->black_detected), STATE_NAME(current_state_black));
+    } else if (!dec->waiting_for_black && dec->stay_count > 0) {
+        dec->stay_count++;
+    }
+
+    dec->black_detected = current_state_black;
+
+    BARCODE_TRACE(sample_event, (uint32_t)analog_value, STATE_NAME(current_state_black));
+
+    // Call convert_stay_counts only once at each multiple of 9 bars
+    if (dec->barcount % CHUNK_SIZE == 0 && dec->barcount > 0 && dec->barcount <= MAX_TRANSITIONS &&
+        dec->barcount != dec->last_conversion_barcount) {
+        BARCODE_TRACE(converting_event, (uint32_t)dec->barcount);
+        convert_stay_counts(dec, dec->stay_counts + (dec->barcount - CHUNK_SIZE), CHUNK_SIZE);
+        dec->direction_determined = true;
+        dec->last_conversion_barcount = dec->barcount;  // Update last conversion barcount
+        dec->waiting_for_black = true;  // Set flag to wait for black bar
+    }
+
+    // Reset and print barcode after MAX_TRANSITIONS transitions
+    if (dec->barcount >= MAX_TRANSITIONS) {
+        BARCODE_TRACE(finished_event, (uint32_t)dec->barcount);
+
+        // Publish the decoded characters for callers polling decoded_count
+        memcpy(dec->result, dec->converted_chars, dec->char_index);
+        dec->result[dec->char_index] = '\0';
+        dec->decoded_count++;
+        BARCODE_TRACE(complete_event, (uint32_t)dec->result[0], (uint32_t)dec->result[1], (uint32_t)dec->result[2]);
+
+        // Reset for next detection
+        dec->barcount = 0;
+        dec->char_index = 0;
+        dec->detecting = false;
+        dec->last_conversion_barcount = -1;  // Reset last conversion barcount for next barcode
+        dec->waiting_for_black = false;  // Reset flag for the next barcode
+        dec->direction_determined = false;  // Reset direction determination for the next barcode
+    }
+
+    // Reset waiting_for_black if a black bar is detected
+    if (dec->waiting_for_black && current_state_black) {
+        dec->waiting_for_black = false;  // Reset to start counting after black bar is detected
+        dec->stay_count = 1;  // Start counting the new black bar
+        BARCODE_TRACE(resume_event);
+    }
+}
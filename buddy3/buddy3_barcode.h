@@ -0,0 +1,59 @@
+#ifndef BUDDY3_BARCODE_H
+#define BUDDY3_BARCODE_H
+
+// Code 39 barcode decoder. Kept free of Pico SDK headers so it can also be
+// built on the host (see host/barcode_replay).
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_TRANSITIONS 27 // Start char, data char and stop char, 9 bars each
+#define CHUNK_SIZE 9       // Every 9 bars will map to a character
+#define TOP_K 3           // Specify the value of k for conversion
+#define CHAR_COUNT (MAX_TRANSITIONS / CHUNK_SIZE) // Number of characters expected
+#define CODE39_CHAR_COUNT 44 // Entries in array_char/array_code, '*' is the last
+
+// Decoder trace events (common/trace.h), compiled out with BARCODE_QUIET
+// (e.g. for the host harness)
+#ifdef BARCODE_QUIET
+#define BARCODE_TRACE(...) ((void)0)
+#else
+#include "trace.h"
+#define BARCODE_TRACE TRACE
+#endif
+
+// Fixed threshold for surface detection
+extern const int BLACK_WHITE_THRESHOLD;
+
+// Character and binary code arrays
+extern char array_char[];
+extern char *array_code[];
+extern char *array_reverse_code[];
+
+// Decoder state for one IR sensor
+typedef struct barcode_decoder_ {
+    bool detecting;                     // Set on the first black reading
+    int barcount;                       // Bars and spaces measured so far
+    bool black_detected;                // Last sensor state
+    int stay_count;                     // Readings spent in the current state
+    int stay_counts[MAX_TRANSITIONS];   // Stay counts for each transition
+    char converted_chars[CHAR_COUNT];   // Each mapped character
+    int char_index;                     // Index for storing characters
+    bool direction_determined;
+    bool direction;                     // false for normal, true for reverse
+    int last_conversion_barcount;
+    bool waiting_for_black;             // Wait for a black bar after every 9 bars
+    volatile bool reset_requested;      // Set from IRQ context, applied on the next sample
+    char result[CHAR_COUNT + 1];        // Last complete barcode, NUL terminated
+    unsigned int decoded_count;         // Incremented each time a barcode completes
+} barcode_decoder;
+
+int find_binary_index(const char *binary_code, char *code_array[]);
+char map_binary_to_char(const char *binary_code, bool reverse);
+void barcode_decoder_init(barcode_decoder *dec);
+void barcode_detector(barcode_decoder *dec, uint16_t analog_value);
+void convert_stay_counts(barcode_decoder *dec, const int stay_counts[], int barcount);
+void barcode_reset(barcode_decoder *dec);
+void barcode_decoder_request_reset(barcode_decoder *dec);
+
+#endif // BUDDY3_BARCODE_H
@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "buddy3_line.h"
+
+// Controller defaults
+#define LINE_KP 3.0f                    // rad/s per unit lateral error
+#define LINE_KI 0.5f
+#define LINE_KD 0.15f
+#define LINE_D_FILTER_S 0.03f           // Derivative low-pass time constant, spans several ADC samples
+#define LINE_MAX_OMEGA_RAD_S 4.0f
+#define LINE_SLOWDOWN 0.6f              // Shed 60% of base speed at full error
+#define LINE_MAX_INTEGRAL 0.5f          // Integral clamp (error * s)
+
+// Lost-line detection and recovery search
+#define LINE_LOST_LEVEL 0.08f           // Normalised intensity below this counts as pure white
+#define LINE_LOST_TIMEOUT_US 60000      // Pure white this long means the line is lost
+#define LINE_SEARCH_OMEGA_RAD_S 2.5f    // Turn rate while sweeping
+#define LINE_SEARCH_FIRST_LEG_US 250000 // First sweep leg, each following leg is twice as long
+#define LINE_SEARCH_MAX_LEGS 5          // Give up after this many legs
+#define LINE_FOUND_LEVEL 0.3f           // Normalised intensity that ends the search
+
+#ifndef LINE_QUIET
+// Mode changes, recorded from the control task and formatted later by trace_drain
+TRACE_EVENT(lost_event, TRACE_INFO, "Line lost, searching...");
+TRACE_EVENT(found_event, TRACE_INFO, "Line found after %d search legs");
+TRACE_EVENT(failed_event, TRACE_WARN, "Line search failed, stopping.");
+TRACE_EVENT(reacquired_event, TRACE_INFO, "Line seen again, tracking");
+#endif
+
+// Initialise the controller with calibrated white/black readings and a cruise speed
+void line_follower_init(line_follower *lf, uint16_t white_level, uint16_t black_level, float base_speed_cm_s) {
+    memset(lf, 0, sizeof(*lf));
+    lf->white_level = white_level;
+    lf->black_level = black_level > white_level ? black_level : white_level + 1;
+    lf->edge_side = 1;
+    lf->kp = LINE_KP;
+    lf->ki = LINE_KI;
+    lf->kd = LINE_KD;
+    lf->base_speed_cm_s = base_speed_cm_s;
+    lf->max_omega_rad_s = LINE_MAX_OMEGA_RAD_S;
+    lf->slowdown = LINE_SLOWDOWN;
+    line_follower_reset(lf);
+}
+
+void line_follower_reset(line_follower *lf) {
+    lf->mode = LINE_TRACKING;
+    lf->integral = 0.0f;
+    lf->prev_error = 0.0f;
+    lf->derivative = 0.0f;
+    lf->error = 0.0f;
+    lf->v_cm_s = 0.0f;
+    lf->omega_rad_s = 0.0f;
+    lf->last_seen_side = 1;
+    lf->last_update_us = 0;
+    lf->lost_since_us = 0;
+    lf->search_leg = 0;
+}
+
+void line_follower_set_gains(line_follower *lf, float kp, float ki, float kd) {
+    lf->kp = kp;
+    lf->ki = ki;
+    lf->kd = kd;
+}
+
+// Normalise a raw reading to [0, 1]: 0 on white, 1 fully on the line
+static float line_intensity(const line_follower *lf, uint16_t analog_value) {
+    float n = (float)((int)analog_value - (int)lf->white_level) / (float)(lf->black_level - lf->white_level);
+    if (n < 0.0f) n = 0.0f;
+    if (n > 1.0f) n = 1.0f;
+    return n;
+}
+
+// Lateral error in [-1, 1]. The sensor is held on the edge of the line (50% coverage),
+// so the analog intensity is proportional to how far the car has drifted off the edge.
+float line_follower_error(const line_follower *lf, uint16_t analog_value) {
+    return (line_intensity(lf, analog_value) - 0.5f) * 2.0f;
+}
+
+static float clampf(float value, float limit) {
+    if (value > limit) return limit;
+    if (value < -limit) return -limit;
+    return value;
+}
+
+// Start a recovery sweep, first towards the side the line was last seen on
+static void line_start_search(line_follower *lf, uint64_t now_us) {
+    lf->mode = LINE_SEARCHING;
+    lf->search_start_us = now_us;
+    lf->search_leg = 0;
+    lf->integral = 0.0f;
+    LINE_TRACE(lost_event);
+}
+
+// Back to tracking from a search or a stop, without a derivative kick
+static void line_reacquire(line_follower *lf, float intensity) {
+    lf->mode = LINE_TRACKING;
+    lf->lost_since_us = 0;
+    lf->prev_error = (intensity - 0.5f) * 2.0f;
+    lf->derivative = 0.0f;
+}
+
+// Run one control step. Outputs forward speed (cm/s) and turn rate (rad/s, CCW positive).
+void line_follower_update(line_follower *lf, uint16_t analog_value, uint64_t now_us, float *v_cm_s, float *omega_rad_s) {
+    float intensity = line_intensity(lf, analog_value);
+    float dt = lf->last_update_us ? (now_us - lf->last_update_us) / 1e6f : 0.0f;
+    lf->last_update_us = now_us;
+
+    switch (lf->mode) {
+        case LINE_TRACKING: {
+            float error = (intensity - 0.5f) * 2.0f;
+
+            // Pure white for too long means the sensor has left the line completely
+            if (intensity < LINE_LOST_LEVEL) {
+                if (lf->lost_since_us == 0) {
+                    lf->lost_since_us = now_us;
+                } else if (now_us - lf->lost_since_us >= LINE_LOST_TIMEOUT_US) {
+                    line_start_search(lf, now_us);
+                    break;
+                }
+            } else {
+                lf->lost_since_us = 0;
+                lf->last_seen_side = error >= 0.0f ? 1 : -1;
+            }
+
+            if (dt > 0.0f) {
+                lf->integral += error * dt;
+                if (lf->integral > LINE_MAX_INTEGRAL) lf->integral = LINE_MAX_INTEGRAL;
+                if (lf->integral < -LINE_MAX_INTEGRAL) lf->integral = -LINE_MAX_INTEGRAL;
+            }
+            // Differencing samples CONTROL_PERIOD_MS apart amplifies ADC noise and
+            // makes the turn rate chatter between its limits, so low-pass it first
+            if (dt > 0.0f) {
+                float alpha = dt / (LINE_D_FILTER_S + dt);
+                lf->derivative += alpha * ((error - lf->prev_error) / dt - lf->derivative);
+            }
+            float steer = lf->kp * error + lf->ki * lf->integral + lf->kd * lf->derivative;
+
+            // Following the left edge the line lies to the right: too much black means
+            // the car drifted right, so turn left (CCW); too much white, turn right
+            lf->omega_rad_s = clampf(lf->edge_side * steer, lf->max_omega_rad_s);
+            lf->v_cm_s = lf->base_speed_cm_s * (1.0f - lf->slowdown * fabsf(error));
+            lf->error = error;
+            lf->prev_error = error;
+            break;
+        }
+
+        case LINE_SEARCHING: {
+            if (intensity >= LINE_FOUND_LEVEL) {
+                LINE_TRACE(found_event, lf->search_leg);
+                line_reacquire(lf, intensity);
+                break;
+            }
+
+            // Sweep legs double in length: 1x towards the last seen side, 2x back, 4x, ...
+            uint64_t leg_us = (uint64_t)LINE_SEARCH_FIRST_LEG_US << lf->search_leg;
+            if (now_us - lf->search_start_us >= leg_us) {
+                lf->search_leg++;
+                lf->search_start_us = now_us;
+                if (lf->search_leg >= LINE_SEARCH_MAX_LEGS) {
+                    LINE_TRACE(failed_event);
+                    lf->mode = LINE_LOST;
+                    lf->v_cm_s = 0.0f;
+                    lf->omega_rad_s = 0.0f;
+                    break;
+                }
+            }
+
+            // Drifting off onto white leaves a negative last error, so the first leg
+            // turns back towards the black side of the edge (clockwise on the left edge)
+            int direction = (lf->search_leg % 2 == 0) ? lf->last_seen_side : -lf->last_seen_side;
+            lf->v_cm_s = 0.0f;
+            lf->omega_rad_s = direction * lf->edge_side * LINE_SEARCH_OMEGA_RAD_S;
+            break;
+        }
+
+        case LINE_LOST:
+            // Stopped until the line is under the sensor again, e.g. the car was put back on it
+            if (intensity >= LINE_FOUND_LEVEL) {
+                LINE_TRACE(reacquired_event);
+                line_reacquire(lf, intensity);
+            }
+            lf->v_cm_s = 0.0f;
+            lf->omega_rad_s = 0.0f;
+            break;
+    }
+
+    *v_cm_s = lf->v_cm_s;
+    *omega_rad_s = lf->omega_rad_s;
+}
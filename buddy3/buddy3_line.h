@@ -0,0 +1,58 @@
+#ifndef BUDDY3_LINE_H
+#define BUDDY3_LINE_H
+
+// Line follower controller for one analog IR sensor held on the edge of the
+// line. Kept free of Pico SDK headers so it can also be built on the host
+// (see host/line_replay).
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Controller trace events (common/trace.h), compiled out with LINE_QUIET
+// (e.g. for the host harness)
+#ifdef LINE_QUIET
+#define LINE_TRACE(...) ((void)0)
+#else
+#include "trace.h"
+#define LINE_TRACE TRACE
+#endif
+
+// Line following controller states
+typedef enum {
+    LINE_TRACKING,      // Sensor sees the line edge, steering PID active
+    LINE_SEARCHING,     // Line lost, sweeping left/right to find it again
+    LINE_LOST           // Search timed out, car stopped until the line is seen again
+} line_follow_mode;
+
+// Line following controller state (single analog sensor following one edge of the line)
+typedef struct line_follower_ {
+    uint16_t white_level;       // Analog reading on white surface
+    uint16_t black_level;       // Analog reading fully on the line
+    int edge_side;              // +1 follows the left edge of the line, -1 the right edge
+    float kp, ki, kd;           // Steering PID gains (rad/s per unit error)
+    float base_speed_cm_s;      // Forward speed on a straight line
+    float max_omega_rad_s;      // Turn rate limit
+    float slowdown;             // Fraction of base speed shed at full error
+    float integral;
+    float prev_error;
+    float derivative;           // Low-passed error rate (1/s)
+    float error;                // Last lateral error in [-1, 1]
+    float v_cm_s;               // Last commanded forward speed
+    float omega_rad_s;          // Last commanded turn rate
+    line_follow_mode mode;
+    int last_seen_side;         // Sign of the error the last time the line was seen
+    uint64_t last_update_us;
+    uint64_t lost_since_us;     // Time the sensor first read pure white
+    uint64_t search_start_us;
+    int search_leg;             // Current sweep leg of the recovery search
+} line_follower;
+
+void line_follower_init(line_follower *lf, uint16_t white_level, uint16_t black_level, float base_speed_cm_s);
+// Back to LINE_TRACKING with the PID history cleared; gains and calibration are kept
+void line_follower_reset(line_follower *lf);
+// New steering gains, used from the next update; the PID history is kept
+void line_follower_set_gains(line_follower *lf, float kp, float ki, float kd);
+float line_follower_error(const line_follower *lf, uint16_t analog_value);
+void line_follower_update(line_follower *lf, uint16_t analog_value, uint64_t now_us, float *v_cm_s, float *omega_rad_s);
+
+#endif // BUDDY3_LINE_H
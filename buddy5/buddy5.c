@@ -4,14 +4,17 @@
 #include "hardware/gpio.h"
 #include "../buddy2/buddy2.h"
 #include "hardware/timer.h"
+#include "hardware/adc.h"
 #include "buddy5.h"
+#include "gpio_irq.h"
+#include "trace.h"
 #include <math.h> // for M_PI
 #include <stdlib.h>
+#include <string.h>
 
 // Constants for measurement limits and filtering
 #define MAX_DISTANCE_CM 400.0
 #define MIN_DISTANCE_CM 2.0
-#define SPEED_OF_SOUND_CM_US 0.0343
 #define MEASUREMENT_TIMEOUT_US 25000
 
 // Constants for the ultrasonic sensor and buzzer
@@ -42,61 +45,34 @@ volatile uint64_t right_last_pulse_time = 0;
 const unsigned int TRIG_PIN = 4;
 const unsigned int ECHO_PIN = 5;
 
-// Kalman filter variables
+// Kalman filter variables, NULL until initializeBuddy5Components
+static kalman_state distance_filter_state;
 static kalman_state *distance_filter = NULL;
 volatile absolute_time_t start_time;
 volatile uint64_t pulse_width = 0;
 volatile bool measurement_valid = false;
+static void (*volatile echo_callback)(void) = NULL;
 
 uint64_t last_distance_check_time = 0;
 
+// Speed of sound compensation. echo_cm_per_us folds in the round trip so each
+// measurement costs a single multiply; it only changes when the temperature is sampled.
+volatile float ambient_temperature_c = 20.0f;
+volatile float speed_of_sound_cm_us = SPEED_OF_SOUND_CM_US;
+static float echo_cm_per_us = SPEED_OF_SOUND_CM_US / 2.0f;
+static bool temperature_sampled = false;
+uint64_t last_temperature_check_time = 0;
+
+// Range prefilter ahead of the Kalman filter
+static range_prefilter range_filter;
+volatile float distance_confidence = 0.0f;
+volatile bool distance_valid = false;
+
 // Obstacle detection and buzzer control
 volatile bool obstacle_detected = false;
 volatile bool buzzer_on = false;
 uint64_t buzzer_start_time = 0;
 
-// Kalman filter functions
-kalman_state *kalman_init(double q, double r, double p, double initial_value) {
-    kalman_state *state = calloc(1, sizeof(kalman_state));
-    if (state == NULL) {
-        return NULL;
-    }
-    
-    state->q = q > 0 ? q : 1.0;
-    state->r = r > 0 ? r : 0.5;
-    state->p = p > 0 ? p : 1.0;
-    state->x = initial_value;
-    return state;
-}
-
-void kalman_update(kalman_state *state, double measurement) {
-    if (state == NULL || measurement < MIN_DISTANCE_CM || measurement > MAX_DISTANCE_CM) {
-        return;
-    }
-
-    double innovation = measurement - state->x;
-    
-    if (fabs(innovation) > 10.0) {
-        state->q *= 2.0;
-    } else {
-        state->q = 1.0;
-    }
-
-    state->p = state->p + state->q;
-    state->k = state->p / (state->p + state->r);
-    
-    if (fabs(innovation) < 50.0) {
-        state->x += state->k * innovation;
-    } else {
-        state->x = 0.7 * measurement + 0.3 * state->x;
-    }
-    
-    if (state->x < MIN_DISTANCE_CM) state->x = MIN_DISTANCE_CM;
-    if (state->x > MAX_DISTANCE_CM) state->x = MAX_DISTANCE_CM;
-    
-    state->p = (1 - state->k) * state->p;
-}
-
 // Modified echo pulse handler
 void get_echo_pulse(uint gpio, uint32_t events) {
     if (gpio == ECHO_PIN) {
@@ -112,16 +88,21 @@ void get_echo_pulse(uint gpio, uint32_t events) {
                 pulse_width = current_time - start_time_us;
                 measurement_valid = (pulse_width < MEASUREMENT_TIMEOUT_US);
             }
+            if (echo_callback) {
+                echo_callback();
+            }
         }
     }
 }
 
-// Modified distance measurement function
-float getCm() {
-    if (distance_filter == NULL) {
-        return 0.0;
-    }
+void ultrasonic_set_echo_callback(void (*callback)(void)) {
+    echo_callback = callback;
+}
+
+TRACE_EVENT(range_event, TRACE_DEBUG, "Raw: %.2f cm, Filtered: %.2f cm");
 
+// Clear the last echo and send the trigger pulse
+void ultrasonic_trigger(void) {
     measurement_valid = false;
     pulse_width = 0;
     
@@ -130,53 +111,130 @@ float getCm() {
     gpio_put(TRIG_PIN, 1);
     sleep_us(10);
     gpio_put(TRIG_PIN, 0);
+}
+
+// Filter the echo of the last trigger, or count a miss if none arrived
+float ultrasonic_finish(void) {
+    if (distance_filter == NULL) {
+        return 0.0;
+    }
+
+    if (!measurement_valid) {
+        range_prefilter_miss(&range_filter);
+        distance_confidence = range_prefilter_confidence(&range_filter);
+        distance_valid = distance_confidence >= MIN_RANGE_CONFIDENCE;
+        return distance_filter->x; // Return last estimate if measurement fails
+    }
     
-    absolute_time_t timeout_time = make_timeout_time_ms(15);
+    double measured = pulse_width * echo_cm_per_us;
+#if ULTRASONIC_PREFILTER != ULTRASONIC_PREFILTER_NONE
+    if (measured < MIN_DISTANCE_CM || measured > MAX_DISTANCE_CM) {
+        range_prefilter_miss(&range_filter);
+    } else {
+        float prefiltered;
+        range_prefilter_update(&range_filter, (float)measured, &prefiltered);
+        kalman_update(distance_filter, prefiltered);
+    }
+    distance_confidence = range_prefilter_confidence(&range_filter);
+    distance_valid = distance_confidence >= MIN_RANGE_CONFIDENCE;
+#else
+    kalman_update(distance_filter, measured);
+    distance_confidence = 1.0f;
+    distance_valid = true;
+#endif
+    
+    TRACE(range_event, trace_f((float)measured), trace_f((float)distance_filter->x));
+    return (float)distance_filter->x;
+}
+
+// Modified distance measurement function, busy-waits for the echo
+float getCm() {
+    if (distance_filter == NULL) {
+        return 0.0;
+    }
+
+    ultrasonic_trigger();
+    absolute_time_t timeout_time = make_timeout_time_ms(ULTRASONIC_WAIT_MS);
     while (!measurement_valid) {
         if (absolute_time_diff_us(get_absolute_time(), timeout_time) <= 0) {
-            return distance_filter->x; // Return last estimate if measurement fails
+            break;
         }
         tight_loop_contents();
     }
-    
-    double measured = (pulse_width * SPEED_OF_SOUND_CM_US) / 2.0;
-    kalman_update(distance_filter, measured);
-    
-    printf("Raw: %.2f cm, Filtered: %.2f cm\n", measured, distance_filter->x);
-    return (float)distance_filter->x;
+    return ultrasonic_finish();
+}
+
+// Read the RP2040 on-die temperature sensor and update the speed of sound
+void updateSpeedOfSound() {
+    uint32_t raw_sum = 0;
+
+    // The IR sensors share the ADC but always select their own input before reading
+    adc_set_temp_sensor_enabled(true);
+    adc_select_input(TEMPERATURE_ADC_INPUT);
+    for (int i = 0; i < TEMPERATURE_SAMPLES; i++) {
+        raw_sum += adc_read();
+    }
+
+    // Convert to voltage, then to temperature (formula from the RP2040 datasheet)
+    float voltage = (raw_sum / (float)TEMPERATURE_SAMPLES) * (3.3f / (1 << 12));
+    float temperature = 27.0f - (voltage - 0.706f) / 0.001721f - TEMPERATURE_DIE_OFFSET_C;
+
+    // Smooth the ADC noise (about 1 degC per reading) with a slow moving average
+    if (temperature_sampled) {
+        temperature = 0.8f * ambient_temperature_c + 0.2f * temperature;
+    }
+    temperature_sampled = true;
+    ambient_temperature_c = temperature;
+
+    // Speed of sound in dry air: 331.3 m/s + 0.606 m/s per degC
+    speed_of_sound_cm_us = (331.3f + 0.606f * temperature) / 10000.0f;
+    echo_cm_per_us = speed_of_sound_cm_us / 2.0f;
 }
 
 // Function to check distance from the ultrasonic sensor and activate the buzzer if object is close
 void measureDistanceAndBuzz() {
     uint64_t current_time = time_us_64();
 
+    // Sample the temperature in the background of the ranging loop
+    if (current_time - last_temperature_check_time > TEMPERATURE_SAMPLE_INTERVAL_MS * 1000ULL) {
+        last_temperature_check_time = current_time;
+        updateSpeedOfSound();
+    }
+
     // Check if it's time to measure distance
     if (current_time - last_distance_check_time > CHECK_INTERVAL_MS * 1000) {
         last_distance_check_time = current_time;
-
-        float distanceCm = getCm();
-        if (distanceCm != 0.0 && distanceCm < DISTANCE_THRESHOLD_CM) {
-            // Obstacle detected
-            obstacle_detected = true;
-
-            // Activate buzzer if not already on
-            if (!buzzer_on) {
-                gpio_put(BUZZER_PIN, 1);
-                buzzer_on = true;
-                buzzer_start_time = current_time;
-            }
-        } else {
-            obstacle_detected = false;
-        }
+        obstacle_update(getCm());
     }
 
-    // Turn off buzzer after 200 ms
-    if (buzzer_on && (current_time - buzzer_start_time >= 200000)) { // 200 ms
+    buzzer_update();
+}
+
+// Turn off buzzer 200 ms after it was switched on
+void buzzer_update(void) {
+    if (buzzer_on && (time_us_64() - buzzer_start_time >= 200000)) { // 200 ms
         gpio_put(BUZZER_PIN, 0);
         buzzer_on = false;
     }
 }
 
+// Set the obstacle flag from a fresh distance and sound the buzzer when too close
+void obstacle_update(float distanceCm) {
+    if (distance_valid && distanceCm != 0.0 && distanceCm < DISTANCE_THRESHOLD_CM) {
+        // Obstacle detected
+        obstacle_detected = true;
+
+        // Activate buzzer if not already on
+        if (!buzzer_on) {
+            gpio_put(BUZZER_PIN, 1);
+            buzzer_on = true;
+            buzzer_start_time = time_us_64();
+        }
+    } else {
+        obstacle_detected = false;
+    }
+}
+
 // Interrupt callback for encoder to calculate speed and distance
 void encoder_callback(uint gpio, uint32_t events) {
     uint64_t current_time = time_us_64(); // Get the current time in microseconds
@@ -207,61 +265,15 @@ void encoder_callback(uint gpio, uint32_t events) {
     }
 }
 
-// Combined GPIO interrupt handler for both ultrasonic sensor and encoders
-void gpio_interrupt_handler(uint gpio, uint32_t events) {
-    // Handle ultrasonic sensor interrupts
-    if (gpio == ECHO_PIN) {
-        if (events & GPIO_IRQ_EDGE_RISE) {
-            start_time = get_absolute_time();
-            measurement_valid = false;
-        }
-        else if (events & GPIO_IRQ_EDGE_FALL) {
-            uint64_t current_time = to_us_since_boot(get_absolute_time());
-            uint64_t start_time_us = to_us_since_boot(start_time);
-            
-            if (current_time > start_time_us) {
-                pulse_width = current_time - start_time_us;
-                measurement_valid = (pulse_width < MEASUREMENT_TIMEOUT_US);
-            }
-        }
-    }
-    // Handle encoder interrupts
-    else if (gpio == LEFT_ENCODER_PIN || gpio == RIGHT_ENCODER_PIN) {
-        uint64_t current_time = time_us_64();
-
-        if (gpio == LEFT_ENCODER_PIN) {
-            left_pulse_count++;
-            left_incremental_distance += DISTANCE_PER_PULSE_CM;
-            left_total_distance += DISTANCE_PER_PULSE_CM;
-
-            if (left_last_pulse_time != 0) {
-                float time_diff_s = (current_time - left_last_pulse_time) / 1e6;
-                left_speed_cm_s = DISTANCE_PER_PULSE_CM / time_diff_s;
-            }
-            left_last_pulse_time = current_time;
-        } else {
-            right_pulse_count++;
-            right_incremental_distance += DISTANCE_PER_PULSE_CM;
-            right_total_distance += DISTANCE_PER_PULSE_CM;
-
-            if (right_last_pulse_time != 0) {
-                float time_diff_s = (current_time - right_last_pulse_time) / 1e6;
-                right_speed_cm_s = DISTANCE_PER_PULSE_CM / time_diff_s;
-            }
-            right_last_pulse_time = current_time;
-        }
-    }
-}
-
 // Modified setupEncoderPins function
 void setupEncoderPins() {
     gpio_init(LEFT_ENCODER_PIN);
     gpio_set_dir(LEFT_ENCODER_PIN, GPIO_IN);
-    gpio_set_irq_enabled_with_callback(LEFT_ENCODER_PIN, GPIO_IRQ_EDGE_RISE, true, &gpio_interrupt_handler);
+    gpio_irq_register(LEFT_ENCODER_PIN, GPIO_IRQ_EDGE_RISE, &encoder_callback);
 
     gpio_init(RIGHT_ENCODER_PIN);
     gpio_set_dir(RIGHT_ENCODER_PIN, GPIO_IN);
-    gpio_set_irq_enabled(RIGHT_ENCODER_PIN, GPIO_IRQ_EDGE_RISE, true); // Note: no callback parameter here
+    gpio_irq_register(RIGHT_ENCODER_PIN, GPIO_IRQ_EDGE_RISE, &encoder_callback);
 }
 
 
@@ -272,7 +284,7 @@ void setupUltrasonicPins() {
     gpio_set_dir(TRIG_PIN, GPIO_OUT);
     gpio_set_dir(ECHO_PIN, GPIO_IN);
     gpio_pull_down(ECHO_PIN);
-    gpio_set_irq_enabled(ECHO_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, true); // Note: no callback parameter here
+    gpio_irq_register(ECHO_PIN, GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL, &get_echo_pulse);
 }
 // Helper function to set up buzzer pin
 void setupBuzzerPin() {
@@ -340,6 +352,11 @@ void initializeBuddy5Components() {
     setupUltrasonicPins();
     setupEncoderPins();
     setupBuzzerPin();
-    distance_filter = kalman_init(1.0, 0.5, 1.0, 20.0);
+    kalman_state_init(&distance_filter_state, 1.0, 0.5, 1.0, 20.0);
+    distance_filter = &distance_filter_state;
+    range_prefilter_init(&range_filter);
+    adc_init();
+    updateSpeedOfSound();
     last_distance_check_time = time_us_64();
+    last_temperature_check_time = last_distance_check_time;
 }
\ No newline at end of file
@@ -4,21 +4,18 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "../buddy2/buddy2.h"
-
-// Kalman filter state structure
-typedef struct kalman_state_ {
-    double q; // Process noise covariance
-    double r; // Measurement noise covariance
-    double x; // Estimated value
-    double p; // Estimation error covariance
-    double k; // Kalman gain
-} kalman_state;
+#include "buddy5_filter.h"
 
 // Constants for measurement limits and filtering
-#define MAX_DISTANCE_CM 400.0
-#define MIN_DISTANCE_CM 2.0
-#define SPEED_OF_SOUND_CM_US 0.0343
+#define SPEED_OF_SOUND_CM_US 0.0343     // At 20 degC, used until the first temperature sample
 #define MEASUREMENT_TIMEOUT_US 25000
+#define ULTRASONIC_WAIT_MS 15           // Longest wait for the echo after a trigger
+
+// Temperature compensation of the speed of sound (RP2040 on-die sensor, ADC input 4)
+#define TEMPERATURE_ADC_INPUT 4
+#define TEMPERATURE_SAMPLE_INTERVAL_MS 5000  // Air temperature changes slowly
+#define TEMPERATURE_SAMPLES 8                // ADC readings averaged per sample
+#define TEMPERATURE_DIE_OFFSET_C 0.0f        // Die runs warmer than the air; calibrate per board
 
 // Ultrasonic sensor pin definitions
 extern const unsigned int TRIG_PIN;        // GPIO pin for ultrasonic trigger (GP4)
@@ -59,18 +56,34 @@ extern volatile absolute_time_t start_time;
 extern volatile uint64_t pulse_width;
 extern volatile bool measurement_valid;
 
+// Temperature compensated speed of sound
+extern volatile float ambient_temperature_c;
+extern volatile float speed_of_sound_cm_us;
+
 // Obstacle detection flag
 extern volatile bool obstacle_detected;
 
-// Function declarations for Kalman filter
-kalman_state *kalman_init(double q, double r, double p, double initial_value);
-void kalman_update(kalman_state *state, double measurement);
+// Share of recent sonar readings accepted by the prefilter (0..1) and
+// whether the filtered distance is trustworthy enough to act on
+extern volatile float distance_confidence;
+extern volatile bool distance_valid;
+
 void get_echo_pulse(uint gpio, uint32_t events);
 
 // Main function declarations
 void initializeBuddy5Components(void);    // Initializes ultrasonic, encoder, and buzzer components
 void measureDistanceAndBuzz(void);        // Measures distance and activates buzzer if too close
 void updateLastCheckTime(void);           // Manually updates the last check time
+void updateSpeedOfSound(void);            // Samples the temperature sensor and recomputes the speed of sound
+void obstacle_update(float distance_cm);  // Sets the obstacle flag and sounds the buzzer when too close
+void buzzer_update(void);                 // Silences the buzzer once it has sounded long enough
+
+// Split measurement for callers that wait for the echo without spinning (the
+// FreeRTOS sonar task): trigger, wait up to ULTRASONIC_WAIT_MS, then finish.
+// The callback runs in the echo IRQ once the pulse has ended.
+void ultrasonic_trigger(void);
+float ultrasonic_finish(void);
+void ultrasonic_set_echo_callback(void (*callback)(void));
 
 // Internal helper functions
 void setupUltrasonicPins(void);
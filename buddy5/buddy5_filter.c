@@ -0,0 +1,141 @@
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "buddy5_filter.h"
+
+// Kalman filter functions
+void kalman_state_init(kalman_state *state, double q, double r, double p, double initial_value) {
+    memset(state, 0, sizeof(*state));
+    state->q = q > 0 ? q : 1.0;
+    state->r = r > 0 ? r : 0.5;
+    state->p = p > 0 ? p : 1.0;
+    state->x = initial_value;
+}
+
+kalman_state *kalman_init(double q, double r, double p, double initial_value) {
+    kalman_state *state = calloc(1, sizeof(kalman_state));
+    if (state == NULL) {
+        return NULL;
+    }
+    
+    kalman_state_init(state, q, r, p, initial_value);
+    return state;
+}
+
+void kalman_update(kalman_state *state, double measurement) {
+    if (state == NULL || measurement < MIN_DISTANCE_CM || measurement > MAX_DISTANCE_CM) {
+        return;
+    }
+
+    double innovation = measurement - state->x;
+    
+    if (fabs(innovation) > 10.0) {
+        state->q *= 2.0;
+    } else {
+        state->q = 1.0;
+    }
+
+    state->p = state->p + state->q;
+    state->k = state->p / (state->p + state->r);
+    
+    if (fabs(innovation) < 50.0) {
+        state->x += state->k * innovation;
+    } else {
+        state->x = 0.7 * measurement + 0.3 * state->x;
+    }
+    
+    if (state->x < MIN_DISTANCE_CM) state->x = MIN_DISTANCE_CM;
+    if (state->x > MAX_DISTANCE_CM) state->x = MAX_DISTANCE_CM;
+    
+    state->p = (1 - state->k) * state->p;
+}
+
+// Range prefilter functions
+void range_prefilter_init(range_prefilter *f) {
+    memset(f, 0, sizeof(*f));
+}
+
+// Record whether the latest reading was accepted in the confidence history
+static void range_prefilter_record(range_prefilter *f, bool accepted) {
+    f->history = (uint8_t)((f->history << 1) | (accepted ? 1 : 0));
+}
+
+// Share of the last PREFILTER_WINDOW readings that were accepted
+float range_prefilter_confidence(const range_prefilter *f) {
+    uint8_t bits = f->history & ((1u << PREFILTER_WINDOW) - 1);
+    int accepted = 0;
+    while (bits) {
+        accepted += bits & 1;
+        bits >>= 1;
+    }
+    return (float)accepted / PREFILTER_WINDOW;
+}
+
+// A reading that produced no usable range (timeout or out of sensor range)
+void range_prefilter_miss(range_prefilter *f) {
+    range_prefilter_record(f, false);
+}
+
+// Median of a sorted array of n values
+static float sorted_median(const float *sorted, int n) {
+    return (n % 2) ? sorted[n / 2] : 0.5f * (sorted[n / 2 - 1] + sorted[n / 2]);
+}
+
+// Push a raw range into the ring and produce the value for the Kalman filter.
+// Cost is bounded by PREFILTER_WINDOW, independent of how long it has run.
+// Returns false if the range was rejected as an outlier.
+bool range_prefilter_update(range_prefilter *f, float range_cm, float *filtered_cm) {
+    int n = f->count;
+
+    // Drop the oldest range from the sorted copy once the ring is full
+    if (n == PREFILTER_WINDOW) {
+        float oldest = f->window[f->head];
+        int i = 0;
+        while (i < n - 1 && f->sorted[i] != oldest) i++;
+        for (; i < n - 1; i++) f->sorted[i] = f->sorted[i + 1];
+        n--;
+    }
+
+    // Insert the new range keeping the copy sorted
+    int i = n;
+    while (i > 0 && f->sorted[i - 1] > range_cm) {
+        f->sorted[i] = f->sorted[i - 1];
+        i--;
+    }
+    f->sorted[i] = range_cm;
+    n++;
+
+    f->window[f->head] = range_cm;
+    f->head = (f->head + 1) % PREFILTER_WINDOW;
+    f->count = n;
+
+    float median = sorted_median(f->sorted, n);
+    bool accepted = true;
+
+#if ULTRASONIC_PREFILTER == ULTRASONIC_PREFILTER_MEDIAN
+    *filtered_cm = median;
+#elif ULTRASONIC_PREFILTER == ULTRASONIC_PREFILTER_HAMPEL
+    // Median absolute deviation, scaled to a standard deviation estimate
+    float deviations[PREFILTER_WINDOW];
+    for (int j = 0; j < n; j++) {
+        float d = fabsf(f->sorted[j] - median);
+        int k = j;
+        while (k > 0 && deviations[k - 1] > d) {
+            deviations[k] = deviations[k - 1];
+            k--;
+        }
+        deviations[k] = d;
+    }
+    float limit = HAMPEL_THRESHOLD * 1.4826f * sorted_median(deviations, n);
+    if (limit < HAMPEL_MIN_DEVIATION_CM) limit = HAMPEL_MIN_DEVIATION_CM;
+
+    // Needs a few ranges before anything can be called an outlier
+    accepted = n < 3 || fabsf(range_cm - median) <= limit;
+    *filtered_cm = accepted ? range_cm : median;
+#else
+    *filtered_cm = range_cm;
+#endif
+
+    range_prefilter_record(f, accepted);
+    return accepted;
+}
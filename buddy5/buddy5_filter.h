@@ -0,0 +1,57 @@
+#ifndef BUDDY5_FILTER_H
+#define BUDDY5_FILTER_H
+
+// Range filtering for the ultrasonic sensor: outlier prefilter and Kalman
+// filter. Kept free of Pico SDK headers so it can also be built on the host
+// (see host/kernel_bench).
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Kalman filter state structure
+typedef struct kalman_state_ {
+    double q; // Process noise covariance
+    double r; // Measurement noise covariance
+    double x; // Estimated value
+    double p; // Estimation error covariance
+    double k; // Kalman gain
+} kalman_state;
+
+// Outlier prefilter run on raw ranges ahead of the Kalman update
+#define ULTRASONIC_PREFILTER_NONE 0    // Raw ranges go straight to the Kalman filter
+#define ULTRASONIC_PREFILTER_MEDIAN 1  // Kalman filter sees the running median of the window
+#define ULTRASONIC_PREFILTER_HAMPEL 2  // Ranges far from the median (in MADs) are replaced by it
+#ifndef ULTRASONIC_PREFILTER
+#define ULTRASONIC_PREFILTER ULTRASONIC_PREFILTER_HAMPEL
+#endif
+#define PREFILTER_WINDOW 5             // Ranges kept in the ring (odd, at most 8)
+#define HAMPEL_THRESHOLD 3.0f          // Outlier threshold in scaled MADs
+#define HAMPEL_MIN_DEVIATION_CM 2.0f   // Never reject ranges closer than this to the median
+#define MIN_RANGE_CONFIDENCE 0.6f      // Below this the filtered distance is not trusted
+
+// Fixed-size ring of raw ranges with a running median
+typedef struct range_prefilter_ {
+    float window[PREFILTER_WINDOW];    // Raw ranges in arrival order
+    float sorted[PREFILTER_WINDOW];    // The same ranges kept sorted
+    uint8_t head;                      // Slot the next range overwrites
+    uint8_t count;                     // Ranges in the window
+    uint8_t history;                   // One bit per recent reading, 1 = accepted
+} range_prefilter;
+
+// Measurement limits, readings outside are not filtered
+#define MAX_DISTANCE_CM 400.0
+#define MIN_DISTANCE_CM 2.0
+
+// Function declarations for Kalman filter. kalman_state_init sets up caller
+// storage (the firmware's filters are static); kalman_init allocates it.
+void kalman_state_init(kalman_state *state, double q, double r, double p, double initial_value);
+kalman_state *kalman_init(double q, double r, double p, double initial_value);
+void kalman_update(kalman_state *state, double measurement);
+
+// Function declarations for the range prefilter
+void range_prefilter_init(range_prefilter *f);
+bool range_prefilter_update(range_prefilter *f, float range_cm, float *filtered_cm);
+void range_prefilter_miss(range_prefilter *f);
+float range_prefilter_confidence(const range_prefilter *f);
+
+#endif // BUDDY5_FILTER_H
@@ -0,0 +1,49 @@
+#include "pico/stdlib.h"
+#include "hardware/gpio.h"
+#include "hardware/irq.h"
+#include "gpio_irq.h"
+#include "profile.h"
+
+// Handler and enabled events for each bank 0 GPIO
+static gpio_irq_handler_t gpio_handlers[NUM_BANK0_GPIOS];
+static uint32_t gpio_event_masks[NUM_BANK0_GPIOS];
+static bool dispatcher_installed = false;
+static int irq_profile = -1;            // Entry to exit of every dispatched event
+
+// The only callback registered with the SDK
+static void gpio_irq_dispatch(uint gpio, uint32_t events) {
+    PROFILE_SCOPE(irq_profile);
+    if (gpio < NUM_BANK0_GPIOS && gpio_handlers[gpio] != NULL) {
+        gpio_handlers[gpio](gpio, events);
+    }
+}
+
+bool gpio_irq_register(uint gpio, uint32_t event_mask, gpio_irq_handler_t handler) {
+    if (gpio >= NUM_BANK0_GPIOS || handler == NULL) {
+        return false;
+    }
+
+    // Install the handler before enabling events so the first edge is not lost
+    gpio_handlers[gpio] = handler;
+    gpio_event_masks[gpio] = event_mask;
+
+    if (!dispatcher_installed) {
+        irq_profile = profile_register("gpio_irq");
+        gpio_set_irq_callback(&gpio_irq_dispatch);
+        irq_set_enabled(IO_IRQ_BANK0, true);
+        dispatcher_installed = true;
+    }
+
+    gpio_set_irq_enabled(gpio, event_mask, true);
+    return true;
+}
+
+void gpio_irq_unregister(uint gpio) {
+    if (gpio >= NUM_BANK0_GPIOS) {
+        return;
+    }
+
+    gpio_set_irq_enabled(gpio, gpio_event_masks[gpio], false);
+    gpio_event_masks[gpio] = 0;
+    gpio_handlers[gpio] = NULL;
+}
@@ -0,0 +1,22 @@
+#ifndef GPIO_IRQ_H
+#define GPIO_IRQ_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "pico/stdlib.h"
+
+// The RP2040 has a single GPIO IRQ callback per core, so
+// gpio_set_irq_enabled_with_callback from one module replaces the callback of
+// every other module. Register per-pin handlers here instead; one dispatcher
+// owns the SDK callback and routes each event to the handler for its pin.
+
+typedef void (*gpio_irq_handler_t)(uint gpio, uint32_t events);
+
+// Route events on gpio to handler and enable the given event mask
+// (e.g. GPIO_IRQ_EDGE_RISE | GPIO_IRQ_EDGE_FALL). Returns false for an invalid pin.
+bool gpio_irq_register(uint gpio, uint32_t event_mask, gpio_irq_handler_t handler);
+
+// Disable events on gpio and drop its handler
+void gpio_irq_unregister(uint gpio);
+
+#endif // GPIO_IRQ_H
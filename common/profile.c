@@ -0,0 +1,180 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#include "profile.h"
+
+typedef struct {
+    char name[PROFILE_NAME_MAX];
+    volatile uint32_t count;
+    uint32_t min_cycles;
+    uint32_t max_cycles;
+    uint64_t total_cycles;
+    uint32_t buckets[PROFILE_BUCKETS];
+} profile_section;
+
+static profile_section sections[PROFILE_MAX_SECTIONS];
+static int section_count = 0;
+static uint32_t cycles_per_us = 125;
+
+void profile_init(void) {
+    cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+    if (!(systick_hw->csr & M0PLUS_SYST_CSR_ENABLE_BITS)) {
+        systick_hw->rvr = 0x00FFFFFF;
+        systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+    }
+}
+
+uint32_t __not_in_flash_func(profile_cycles)(void) {
+    return systick_hw->cvr;
+}
+
+// SysTick counts down and reloads from rvr: 0xFFFFFF when free running, one
+// tick period less one when it drives the FreeRTOS tick
+uint32_t __not_in_flash_func(profile_cycles_since)(uint32_t stamp) {
+    uint32_t now = systick_hw->cvr;
+    return stamp >= now ? stamp - now : stamp + systick_hw->rvr + 1 - now;
+}
+
+int profile_register(const char *name) {
+    if (section_count >= PROFILE_MAX_SECTIONS) {
+        return -1;
+    }
+    profile_section *section = &sections[section_count];
+    memset(section, 0, sizeof(*section));
+    strncpy(section->name, name, PROFILE_NAME_MAX - 1);
+    section->min_cycles = UINT32_MAX;
+    return section_count++;
+}
+
+// Values below PROFILE_SUB_BUCKETS have a bucket each; above, every power of
+// two is split into PROFILE_SUB_BUCKETS by the bits after the leading one
+static int bucket_of(uint32_t cycles) {
+    if (cycles < PROFILE_SUB_BUCKETS) {
+        return (int)cycles;
+    }
+    int octave = 31 - __builtin_clz(cycles);
+    int sub = (int)(cycles >> (octave - 2)) & (PROFILE_SUB_BUCKETS - 1);
+    return (octave - 1) * PROFILE_SUB_BUCKETS + sub;
+}
+
+// Largest value that falls into a bucket
+static uint32_t bucket_upper(int bucket) {
+    if (bucket < PROFILE_SUB_BUCKETS) {
+        return (uint32_t)bucket;
+    }
+    int octave = bucket / PROFILE_SUB_BUCKETS + 1;
+    uint32_t width = 1u << (octave - 2);
+    uint32_t lower = (uint32_t)(PROFILE_SUB_BUCKETS + bucket % PROFILE_SUB_BUCKETS) << (octave - 2);
+    return lower + (width - 1);
+}
+
+void __not_in_flash_func(profile_record_cycles)(int id, uint32_t cycles) {
+    if (id < 0 || id >= section_count) {
+        return;
+    }
+    profile_section *section = &sections[id];
+    section->buckets[bucket_of(cycles)]++;
+    section->total_cycles += cycles;
+    if (cycles < section->min_cycles) {
+        section->min_cycles = cycles;
+    }
+    if (cycles > section->max_cycles) {
+        section->max_cycles = cycles;
+    }
+    section->count++;
+}
+
+profile_scope __not_in_flash_func(profile_begin)(int id) {
+    profile_scope scope = {.id = (int8_t)id};
+    scope.start_ticks = profile_cycles();
+    scope.start_us = time_us_32();
+    return scope;
+}
+
+void __not_in_flash_func(profile_end)(const profile_scope *scope) {
+    uint32_t ticks = profile_cycles_since(scope->start_ticks);
+    uint32_t elapsed_us = time_us_32() - scope->start_us;
+    // Past half the reload period the count may have wrapped; the first test
+    // also keeps the product below 2^32
+    if (elapsed_us >= PROFILE_SYSTICK_SPAN_US || elapsed_us * cycles_per_us > (systick_hw->rvr >> 1) ||
+        !(systick_hw->csr & M0PLUS_SYST_CSR_ENABLE_BITS)) {
+        ticks = elapsed_us * cycles_per_us;
+    }
+    profile_record_cycles(scope->id, ticks);
+}
+
+int profile_section_count(void) {
+    return section_count;
+}
+
+static uint32_t cycles_to_ns(uint32_t cycles, uint32_t cycles_per_us) {
+    uint64_t ns = (uint64_t)cycles * 1000 / cycles_per_us;
+    return ns > UINT32_MAX ? UINT32_MAX : (uint32_t)ns;
+}
+
+// Upper edge of the bucket holding the given share of the samples, capped at the max
+static uint32_t percentile_cycles(const profile_section *section, uint32_t count, uint32_t per_mille) {
+    uint64_t rank = ((uint64_t)count * per_mille + 999) / 1000;
+    uint64_t seen = 0;
+    for (int i = 0; i < PROFILE_BUCKETS; i++) {
+        seen += section->buckets[i];
+        if (seen >= rank) {
+            uint32_t upper = bucket_upper(i);
+            return upper < section->max_cycles ? upper : section->max_cycles;
+        }
+    }
+    return section->max_cycles;
+}
+
+bool profile_summarise(int id, profile_summary *summary) {
+    if (id < 0 || id >= section_count) {
+        return false;
+    }
+    const profile_section *section = &sections[id];
+    uint32_t cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+    uint32_t count = section->count;
+
+    memset(summary, 0, sizeof(*summary));
+    memcpy(summary->name, section->name, PROFILE_NAME_MAX);
+    summary->count = count;
+    if (count == 0) {
+        return true;
+    }
+    summary->min_ns = cycles_to_ns(section->min_cycles, cycles_per_us);
+    summary->mean_ns = cycles_to_ns((uint32_t)(section->total_cycles / count), cycles_per_us);
+    summary->p50_ns = cycles_to_ns(percentile_cycles(section, count, 500), cycles_per_us);
+    summary->p99_ns = cycles_to_ns(percentile_cycles(section, count, 990), cycles_per_us);
+    summary->max_ns = cycles_to_ns(section->max_cycles, cycles_per_us);
+    return true;
+}
+
+void profile_dump(void) {
+    uint32_t cycles_per_us = clock_get_hz(clk_sys) / 1000000;
+
+    for (int id = 0; id < section_count; id++) {
+        profile_summary s;
+        profile_summarise(id, &s);
+        printf("Profile %-11s %8lu runs, min %lu, mean %lu, p50 %lu, p99 %lu, max %lu ns\n", s.name,
+               (unsigned long)s.count, (unsigned long)s.min_ns, (unsigned long)s.mean_ns,
+               (unsigned long)s.p50_ns, (unsigned long)s.p99_ns, (unsigned long)s.max_ns);
+        for (int i = 0; i < PROFILE_BUCKETS; i++) {
+            if (sections[id].buckets[i]) {
+                printf("  <= %lu ns: %lu\n", (unsigned long)cycles_to_ns(bucket_upper(i), cycles_per_us),
+                       (unsigned long)sections[id].buckets[i]);
+            }
+        }
+    }
+}
+
+void profile_reset(void) {
+    for (int id = 0; id < section_count; id++) {
+        profile_section *section = &sections[id];
+        memset(section->buckets, 0, sizeof(section->buckets));
+        section->total_cycles = 0;
+        section->min_cycles = UINT32_MAX;
+        section->max_cycles = 0;
+        section->count = 0;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Latency profiler. A section is a named piece of code (a main loop stage,
+// an ISR); every pass through it adds its duration to a log-bucketed
+// histogram, from which min/mean/p50/p99/max are read.
+//
+//   static int pid_profile = -1;
+//   pid_profile = profile_register("pid");     // once, at init
+//   ...
+//   {
+//       PROFILE_SCOPE(pid_profile);            // timed until the end of the block
+//       adjust_left_motor_speed();
+//   }
+//
+// Durations are counted in core cycles on SysTick. profile_init leaves it
+// free running over 2^24 cycles (134 ms at 125 MHz), but under FreeRTOS it
+// drives the tick and reloads every tick period, so the reload value is read
+// back rather than assumed: sections longer than half the SysTick period, or
+// timed on a core where SysTick is off, fall back to the microsecond timer.
+// SysTick is per core, so a section must begin and end on the same core. A
+// section's histogram is updated without locking, so each section must only
+// be timed from one context (one core, or one IRQ, or one task).
+//
+// Histogram buckets cover each power of two in PROFILE_SUB_BUCKETS steps, so
+// percentiles are within 25% and read as the upper edge of their bucket.
+//
+// Build with PROFILE_DISABLED to compile the scopes out.
+
+#define PROFILE_MAX_SECTIONS 8
+#define PROFILE_NAME_MAX 12             // Including the terminator
+#define PROFILE_SUB_BUCKETS 4
+#define PROFILE_BUCKETS 124             // Up to 2^32 cycles
+#define PROFILE_SYSTICK_SPAN_US 100000  // Below the SysTick wrap at up to 167 MHz
+
+typedef struct {
+    uint32_t start_us;
+    uint32_t start_ticks;
+    int8_t id;
+} profile_scope;
+
+typedef struct {
+    char name[PROFILE_NAME_MAX];
+    uint32_t count;
+    uint32_t min_ns;
+    uint32_t mean_ns;
+    uint32_t p50_ns;
+    uint32_t p99_ns;
+    uint32_t max_ns;
+} profile_summary;
+
+// Start SysTick free running on the processor clock unless something (the
+// FreeRTOS tick) already runs it; safe to call again
+void profile_init(void);
+
+// Add a section, returns its id or -1 when all PROFILE_MAX_SECTIONS are used.
+// Names longer than PROFILE_NAME_MAX - 1 are cut.
+int profile_register(const char *name);
+
+profile_scope profile_begin(int id);
+void profile_end(const profile_scope *scope);
+
+// Add a duration measured elsewhere
+void profile_record_cycles(int id, uint32_t cycles);
+
+// Raw SysTick stamp and the core cycles since it, for intervals shorter than
+// half the SysTick period (the telemetry stream's encode counter)
+uint32_t profile_cycles(void);
+uint32_t profile_cycles_since(uint32_t stamp);
+
+int profile_section_count(void);
+bool profile_summarise(int id, profile_summary *summary);
+
+// Print every section's summary and non-empty buckets on stdio
+void profile_dump(void);
+
+// Clear the histograms, keeping the sections
+void profile_reset(void);
+
+#ifdef PROFILE_DISABLED
+#define PROFILE_SCOPE(id) ((void)(id))
+#else
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_NAME_(line) PROFILE_CONCAT_(profile_scope_, line)
+#define PROFILE_SCOPE(id) \
+    profile_scope PROFILE_NAME_(__LINE__) __attribute__((cleanup(profile_end), unused)) = profile_begin(id)
+#endif
+
+#endif // PROFILE_H
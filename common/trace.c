@@ -0,0 +1,184 @@
+#include <stdio.h>
+#include "pico/stdlib.h"
+#include "hardware/sync.h"
+#include "trace.h"
+
+typedef struct {
+    uint32_t time_us;
+    const trace_event *event;
+    uint32_t args[TRACE_MAX_ARGS];
+} trace_record;
+
+// Written only by its own core (code and ISRs, serialised by disabling
+// interrupts); head is published after the record, tail after it is copied out
+typedef struct {
+    trace_record records[TRACE_RING_SIZE];
+    volatile uint32_t head;         // Records written
+    volatile uint32_t tail;         // Records drained
+    volatile uint32_t dropped;
+} trace_ring;
+
+static trace_ring rings[NUM_CORES];
+static uint32_t reported_drops[NUM_CORES];
+static uint32_t drained_count = 0;
+static trace_sink_fn trace_sink = NULL;
+
+volatile uint8_t trace_threshold = TRACE_DEFAULT_LEVEL;
+
+// In RAM: called from ISRs, where a flash cache miss would cost more than the record
+void __not_in_flash_func(trace_write)(const trace_event *event, const uint32_t *args) {
+    uint32_t saved = save_and_disable_interrupts();
+    trace_ring *ring = &rings[get_core_num()];
+    uint32_t head = ring->head;
+
+    if (head - ring->tail >= TRACE_RING_SIZE) {
+        ring->dropped++;
+    } else {
+        trace_record *record = &ring->records[head & (TRACE_RING_SIZE - 1)];
+        record->time_us = time_us_32();
+        record->event = event;
+        record->args[0] = args[0];
+        record->args[1] = args[1];
+        record->args[2] = args[2];
+        __dmb();
+        ring->head = head + 1;
+    }
+    restore_interrupts(saved);
+}
+
+void trace_set_sink(trace_sink_fn sink) {
+    trace_sink = sink;
+}
+
+void trace_set_level(trace_level level) {
+    trace_threshold = (uint8_t)level;
+}
+
+static void stdio_sink(uint8_t level, uint32_t time_us, const char *line) {
+    static const char level_chars[] = "-EWID";
+    printf("[%5lu.%06lu] %c %s\n", (unsigned long)(time_us / 1000000), (unsigned long)(time_us % 1000000),
+           level_chars[level <= TRACE_DEBUG ? level : 0], line);
+}
+
+static void emit(uint8_t level, uint32_t time_us, const char *line) {
+    (trace_sink ? trace_sink : stdio_sink)(level, time_us, line);
+}
+
+// printf the record's format with its arguments, one conversion at a time so
+// each argument is read as the type its conversion expects
+static void format_record(const trace_record *record, char *out, size_t cap) {
+    const char *f = record->event->format;
+    size_t n = 0;
+    int arg = 0;
+
+    while (*f && n + 1 < cap) {
+        if (*f != '%') {
+            out[n++] = *f++;
+            continue;
+        }
+        if (f[1] == '%') {
+            out[n++] = '%';
+            f += 2;
+            continue;
+        }
+
+        // Flags, width and precision are kept; length modifiers are dropped
+        // because every argument is 32 bits
+        char spec[16];
+        size_t k = 0;
+        spec[k++] = *f++;
+        while (*f && strchr("-+ #0123456789.hlzjtL", *f)) {
+            if (!strchr("hlzjtL", *f) && k < sizeof(spec) - 2) {
+                spec[k++] = *f;
+            }
+            f++;
+        }
+        char conversion = *f ? *f++ : '\0';
+        spec[k++] = conversion;
+        spec[k] = '\0';
+
+        uint32_t value = arg < TRACE_MAX_ARGS ? record->args[arg] : 0;
+        arg++;
+        int written = 0;
+        switch (conversion) {
+            case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+                float real;
+                memcpy(&real, &value, sizeof(real));
+                written = snprintf(out + n, cap - n, spec, (double)real);
+                break;
+            }
+            case 'd': case 'i':
+                written = snprintf(out + n, cap - n, spec, (int)(int32_t)value);
+                break;
+            case 'u': case 'x': case 'X': case 'o': case 'c':
+                written = snprintf(out + n, cap - n, spec, (unsigned)value);
+                break;
+            case 's':
+                written = snprintf(out + n, cap - n, spec, value ? (const char *)(uintptr_t)value : "(null)");
+                break;
+            default:
+                break;
+        }
+        if (written > 0) {
+            n += (size_t)written < cap - n ? (size_t)written : cap - n - 1;
+        }
+    }
+    out[n] = '\0';
+}
+
+int trace_drain(int max_records) {
+    char line[TRACE_LINE_MAX];
+    int drained = 0;
+
+    for (int core = 0; core < NUM_CORES; core++) {
+        uint32_t dropped = rings[core].dropped;
+        if (dropped != reported_drops[core]) {
+            snprintf(line, sizeof(line), "trace: %lu records dropped on core %d",
+                     (unsigned long)(dropped - reported_drops[core]), core);
+            reported_drops[core] = dropped;
+            emit(TRACE_WARN, time_us_32(), line);
+        }
+    }
+
+    while (drained < max_records) {
+        // Oldest pending record of the two cores, so lines come out in time order
+        trace_ring *next = NULL;
+        const trace_record *oldest = NULL;
+        for (int core = 0; core < NUM_CORES; core++) {
+            trace_ring *ring = &rings[core];
+            if (ring->tail == ring->head) {
+                continue;
+            }
+            __dmb();
+            const trace_record *record = &ring->records[ring->tail & (TRACE_RING_SIZE - 1)];
+            if (!oldest || (int32_t)(record->time_us - oldest->time_us) < 0) {
+                oldest = record;
+                next = ring;
+            }
+        }
+        if (!next) {
+            break;
+        }
+
+        // Copy out before releasing the slot to the writer
+        trace_record record = *oldest;
+        __dmb();
+        next->tail++;
+
+        format_record(&record, line, sizeof(line));
+        emit(record.event->level, record.time_us, line);
+        drained++;
+    }
+    drained_count += (uint32_t)drained;
+    return drained;
+}
+
+void trace_get_stats(trace_stats *stats) {
+    stats->recorded = 0;
+    stats->dropped = 0;
+    for (int core = 0; core < NUM_CORES; core++) {
+        stats->recorded += rings[core].head;
+        stats->dropped += rings[core].dropped;
+    }
+    stats->drained = drained_count;
+}
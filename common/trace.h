@@ -0,0 +1,99 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+// Binary event trace for hot paths. TRACE() stores an event descriptor, a
+// timestamp and up to three 32-bit arguments in a RAM ring; the text is only
+// formatted later by trace_drain, called from the main loop, and passed to a
+// sink (stdio by default, or telemetry). Recording costs a few tens of cycles
+// instead of a printf blocking on USB/UART stdio.
+//
+// The M0+ has no exclusive load/store, so each core has its own ring and a
+// record is written with that core's interrupts disabled for a handful of
+// instructions. TRACE() is therefore safe from either core and from ISRs.
+// trace_drain is the only consumer and must not run on both cores at once.
+// A full ring drops new records and counts them.
+//
+// Events are defined once, the format string stays in flash:
+//   TRACE_EVENT(range_event, TRACE_DEBUG, "Raw: %.2f cm, Filtered: %.2f cm");
+//   TRACE(range_event, trace_f(raw), trace_f(filtered));
+// Integers are passed as they are, floats through trace_f and strings through
+// trace_s (literals only: the text is read when the record is drained). The
+// conversions in the format decide how each argument is printed.
+//
+// Levels are filtered twice: TRACE_COMPILE_LEVEL removes events at build
+// time, trace_set_level at run time (e.g. from the TRACE remote command).
+
+typedef enum {
+    TRACE_OFF = 0,
+    TRACE_ERROR,
+    TRACE_WARN,
+    TRACE_INFO,
+    TRACE_DEBUG
+} trace_level;
+
+#ifndef TRACE_COMPILE_LEVEL
+#define TRACE_COMPILE_LEVEL TRACE_DEBUG
+#endif
+#ifndef TRACE_DEFAULT_LEVEL
+#define TRACE_DEFAULT_LEVEL TRACE_INFO
+#endif
+
+#define TRACE_RING_SIZE 256         // Records per core (20 bytes each), power of two
+#define TRACE_MAX_ARGS 3
+#define TRACE_LINE_MAX 120          // Formatted line, without the timestamp
+#define TRACE_DRAIN_BUDGET 8        // Records formatted per main loop pass
+
+typedef struct {
+    const char *format;
+    uint8_t level;                  // trace_level
+} trace_event;
+
+#define TRACE_EVENT(name, level, format) static const trace_event name = {format, level}
+
+// Run-time level; events above it are skipped before anything is written
+extern volatile uint8_t trace_threshold;
+
+void trace_write(const trace_event *event, const uint32_t *args);
+
+#define TRACE(event, ...)                                                          \
+    do {                                                                           \
+        if ((event).level <= TRACE_COMPILE_LEVEL && (event).level <= trace_threshold) { \
+            const uint32_t trace_args_[TRACE_MAX_ARGS + 1] = {0, ##__VA_ARGS__};   \
+            trace_write(&(event), trace_args_ + 1);                                \
+        }                                                                          \
+    } while (0)
+
+static inline uint32_t trace_f(float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static inline uint32_t trace_s(const char *text) {
+    return (uint32_t)(uintptr_t)text;
+}
+
+// Receives every drained line (NUL terminated, no newline)
+typedef void (*trace_sink_fn)(uint8_t level, uint32_t time_us, const char *line);
+
+// NULL restores the stdio sink
+void trace_set_sink(trace_sink_fn sink);
+void trace_set_level(trace_level level);
+
+// Format and pass on up to max_records of the oldest records of both cores.
+// Returns the number drained.
+int trace_drain(int max_records);
+
+typedef struct {
+    uint32_t recorded;
+    uint32_t dropped;               // Ring full
+    uint32_t drained;
+} trace_stats;
+
+void trace_get_stats(trace_stats *stats);
+
+#endif // TRACE_H
@@ -0,0 +1,889 @@
+// Fleet telemetry aggregator: one host process collecting every car's
+// telemetry and fanning it out to subscribers (dashboards, recorders).
+//
+// Cars are found from their discovery beacons (or given on the command line)
+// and connected over TCP. The UDP sample streams of all cars arrive on one
+// socket and are routed by source address. Every frame is decoded (delta
+// batches expanded), its samples appended to the car's ring and the frame
+// re-encoded once as a fleet_stream record for all subscribers. A subscriber
+// whose socket cannot keep up has records dropped from its bounded buffer; it
+// never stalls the cars.
+//
+// The main thread owns discovery, the UDP socket, the subscriber sockets and
+// the statistics. Cars are spread over -w worker threads, each with its own
+// epoll loop over its cars' TCP connections and a queue of the UDP datagrams
+// routed to it. With -w 0 the single worker runs inside the main loop.
+//
+// Usage:
+//   fleet_aggregator [-w WORKERS] [-p PORT] [-i SECONDS] [HOST[:PORT]...]
+//     -w N    worker threads (default 0: everything on the main thread)
+//     -p PORT subscriber port (default FLEET_SUBSCRIBER_PORT)
+//     -i S    statistics interval in seconds (default 5, 0 = off)
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include "car_client.h"
+#include "car_discovery.h"
+#include "fleet_stream.h"
+
+#define CAR_MAX 256
+#define RING_SAMPLES 4096           // Per car, about 20 s at 200 Hz (power of two)
+#define UDP_QUEUE_DEPTH 1024        // Datagrams waiting for each worker
+#define WORKER_MAX 16
+#define SUBSCRIBER_MAX 32
+#define SUBSCRIBER_BUFFER (256 * 1024)
+#define SUBSCRIBER_FILTER_MAX 16
+#define RECONNECT_S 2.0
+#define MAX_EVENTS 64
+
+typedef struct worker worker;
+
+typedef struct {
+    telemetry_sample sample;
+    uint32_t number;                // Sample number from the batch
+    uint32_t timestamp_us;          // Device time the sample was taken
+} ring_entry;
+
+typedef struct {
+    uint64_t id;
+    in_addr_t ip;                   // Source address of its datagrams (main thread)
+    worker *owner;
+    telemetry_beacon beacon;        // Main thread
+    bool have_beacon;
+
+    // Worker side
+    car_client client;
+    char host[INET_ADDRSTRLEN];
+    uint16_t tcp_port;
+    double connect_after;
+
+    // Address change from a new beacon, taken over by the worker (worker lock)
+    char pending_host[INET_ADDRSTRLEN];
+    uint16_t pending_port;
+    bool pending_move;
+
+    // Newest samples; written by the worker, read for subscriber backlogs
+    pthread_mutex_t ring_lock;
+    ring_entry ring[RING_SAMPLES];
+    uint64_t ring_head;             // Entries ever written
+    uint16_t period_us;
+} car;
+
+typedef struct {
+    atomic_uint_fast64_t frames;
+    atomic_uint_fast64_t samples;
+    atomic_uint_fast64_t lost_samples;
+    atomic_uint_fast64_t udp_dropped;   // Datagrams dropped because the worker queue was full
+    atomic_uint_fast32_t connected;     // Cars with an open TCP connection
+} worker_stats;
+
+typedef struct {
+    car *car;
+    uint16_t length;
+    uint8_t data[TELEMETRY_MAX_FRAME];
+} queued_datagram;
+
+struct worker {
+    pthread_t thread;
+    int epoll_fd;
+    int event_fd;                   // Signalled when the queue or incoming list gets work
+    int timer_fd;                   // Reconnect checks
+
+    pthread_mutex_t lock;           // Protects everything up to cars
+    queued_datagram *queue;
+    unsigned queue_head;
+    unsigned queue_count;
+    car *incoming[CAR_MAX];         // New or moved cars for this worker
+    int incoming_count;
+
+    car *cars[CAR_MAX];             // Worker thread only
+    int car_count;
+    worker_stats stats;
+};
+
+typedef struct {
+    int fd;                         // -1 when the slot is free
+    pthread_mutex_t lock;           // Protects the output buffer and the filter
+    uint8_t *out;
+    size_t out_head;
+    size_t out_count;
+    bool want_write;                // Registered for EPOLLOUT
+    uint64_t filter[SUBSCRIBER_FILTER_MAX];
+    int filter_count;               // 0 = every car
+    char line[128];                 // Partial command line
+    size_t line_length;
+    uint64_t records;
+    uint64_t dropped;               // Records dropped because out was full
+} subscriber;
+
+static volatile sig_atomic_t stopping = 0;
+static int main_epoll = -1;
+static int udp_fd = -1;
+static int listen_fd = -1;
+static int stats_fd = -1;
+static car_discovery discovery;
+
+static car *cars[CAR_MAX];          // Main thread; entries are never freed
+static int car_count = 0;
+static worker workers[WORKER_MAX];
+static int worker_count = 0;
+static bool threaded = false;
+
+static subscriber subscribers[SUBSCRIBER_MAX];
+static pthread_rwlock_t subscribers_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+// epoll tags of the main loop's fixed descriptors
+static int tag_listen, tag_udp, tag_discovery, tag_stats, tag_worker;
+
+static void on_signal(int signal) {
+    (void)signal;
+    stopping = 1;
+}
+
+// ---- Subscribers ----------------------------------------------------------
+
+static bool subscriber_wants(const subscriber *sub, uint64_t id) {
+    if (sub->filter_count == 0) {
+        return true;
+    }
+    for (int i = 0; i < sub->filter_count; i++) {
+        if (sub->filter[i] == id) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void subscriber_write_interest(subscriber *sub, bool want) {
+    if (sub->want_write != want) {
+        struct epoll_event event = {.events = EPOLLIN | (want ? EPOLLOUT : 0), .data.ptr = sub};
+        epoll_ctl(main_epoll, EPOLL_CTL_MOD, sub->fd, &event);
+        sub->want_write = want;
+    }
+}
+
+// Send what the socket takes from the output buffer. Called with sub->lock held.
+static void subscriber_flush(subscriber *sub) {
+    while (sub->out_count > 0) {
+        size_t chunk = SUBSCRIBER_BUFFER - sub->out_head;
+        if (chunk > sub->out_count) {
+            chunk = sub->out_count;
+        }
+        ssize_t sent = send(sub->fd, sub->out + sub->out_head, chunk, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent <= 0) {
+            break;
+        }
+        sub->out_head = (sub->out_head + (size_t)sent) % SUBSCRIBER_BUFFER;
+        sub->out_count -= (size_t)sent;
+    }
+    subscriber_write_interest(sub, sub->out_count > 0);
+}
+
+// Queue a whole record or drop it. Called with sub->lock held.
+static void subscriber_append(subscriber *sub, const uint8_t *record, size_t length) {
+    if (SUBSCRIBER_BUFFER - sub->out_count < length) {
+        sub->dropped++;
+        return;
+    }
+    size_t tail = (sub->out_head + sub->out_count) % SUBSCRIBER_BUFFER;
+    size_t first = SUBSCRIBER_BUFFER - tail < length ? SUBSCRIBER_BUFFER - tail : length;
+    memcpy(sub->out + tail, record, first);
+    memcpy(sub->out, record + first, length - first);
+    sub->out_count += length;
+    sub->records++;
+
+    // Straight to the socket when nothing is waiting, so an idle link adds no latency
+    if (sub->out_count == length) {
+        subscriber_flush(sub);
+    }
+}
+
+// Fan one encoded record out to every subscriber that wants the car
+static void publish(uint64_t id, const uint8_t *record, size_t length) {
+    pthread_rwlock_rdlock(&subscribers_lock);
+    for (int i = 0; i < SUBSCRIBER_MAX; i++) {
+        subscriber *sub = &subscribers[i];
+        pthread_mutex_lock(&sub->lock);
+        if (sub->fd >= 0 && subscriber_wants(sub, id)) {
+            subscriber_append(sub, record, length);
+        }
+        pthread_mutex_unlock(&sub->lock);
+    }
+    pthread_rwlock_unlock(&subscribers_lock);
+}
+
+static void publish_frame(uint64_t id, const telemetry_frame *frame) {
+    uint8_t record[FLEET_RECORD_MAX];
+    size_t length = fleet_record_encode(id, frame, record, sizeof(record));
+    if (length) {
+        publish(id, record, length);
+    }
+}
+
+static void publish_beacon(const car *c) {
+    telemetry_frame frame = {.type = TELEMETRY_BEACON};
+    frame.u.beacon = c->beacon;
+    publish_frame(c->id, &frame);
+}
+
+// Newest samples of a car as batches for one subscriber (sub->lock held)
+static void send_backlog(subscriber *sub, car *c, uint32_t wanted) {
+    static ring_entry entries[RING_SAMPLES];
+    uint8_t record[FLEET_RECORD_MAX];
+    telemetry_frame frame = {.type = TELEMETRY_BATCH};
+    uint32_t count;
+
+    pthread_mutex_lock(&c->ring_lock);
+    count = c->ring_head < wanted ? (uint32_t)c->ring_head : wanted;
+    if (count > RING_SAMPLES) {
+        count = RING_SAMPLES;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        entries[i] = c->ring[(c->ring_head - count + i) % RING_SAMPLES];
+    }
+    frame.u.batch.period_us = c->period_us;
+    pthread_mutex_unlock(&c->ring_lock);
+
+    // Consecutive sample numbers go in one batch
+    telemetry_batch *batch = &frame.u.batch;
+    batch->fields = TELEMETRY_FIELDS_ALL;
+    for (uint32_t i = 0; i < count; i++) {
+        if (batch->count > 0 && (batch->count == TELEMETRY_MAX_BATCH ||
+                                 entries[i].number != batch->first_sample + batch->count)) {
+            size_t length = fleet_record_encode(c->id, &frame, record, sizeof(record));
+            subscriber_append(sub, record, length);
+            batch->count = 0;
+        }
+        if (batch->count == 0) {
+            batch->first_sample = entries[i].number;
+            frame.timestamp_us = entries[i].timestamp_us;
+        }
+        batch->samples[batch->count++] = entries[i].sample;
+    }
+    if (batch->count > 0) {
+        size_t length = fleet_record_encode(c->id, &frame, record, sizeof(record));
+        subscriber_append(sub, record, length);
+    }
+}
+
+static void subscriber_command(subscriber *sub, const char *line) {
+    unsigned long long value;
+    if (sscanf(line, "car %llx", &value) == 1) {
+        if (sub->filter_count < SUBSCRIBER_FILTER_MAX) {
+            sub->filter[sub->filter_count++] = value;
+        }
+    } else if (strncmp(line, "all", 3) == 0) {
+        sub->filter_count = 0;
+    } else if (sscanf(line, "backlog %llu", &value) == 1) {
+        for (int i = 0; i < car_count; i++) {
+            if (subscriber_wants(sub, cars[i]->id)) {
+                send_backlog(sub, cars[i], value > RING_SAMPLES ? RING_SAMPLES : (uint32_t)value);
+            }
+        }
+    }
+}
+
+static void subscriber_close(subscriber *sub) {
+    pthread_rwlock_wrlock(&subscribers_lock);
+    pthread_mutex_lock(&sub->lock);
+    close(sub->fd);
+    sub->fd = -1;
+    free(sub->out);
+    sub->out = NULL;
+    pthread_mutex_unlock(&sub->lock);
+    pthread_rwlock_unlock(&subscribers_lock);
+}
+
+static void subscriber_read(subscriber *sub) {
+    char buffer[512];
+    ssize_t received = recv(sub->fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)) {
+        subscriber_close(sub);
+        return;
+    }
+
+    pthread_mutex_lock(&sub->lock);
+    for (ssize_t i = 0; i < received; i++) {
+        if (buffer[i] == '\n' || buffer[i] == '\r') {
+            sub->line[sub->line_length] = '\0';
+            if (sub->line_length > 0) {
+                subscriber_command(sub, sub->line);
+            }
+            sub->line_length = 0;
+        } else if (sub->line_length < sizeof(sub->line) - 1) {
+            sub->line[sub->line_length++] = buffer[i];
+        }
+    }
+    pthread_mutex_unlock(&sub->lock);
+}
+
+static void subscriber_accept(void) {
+    int fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return;
+    }
+
+    subscriber *sub = NULL;
+    pthread_rwlock_wrlock(&subscribers_lock);
+    for (int i = 0; i < SUBSCRIBER_MAX && !sub; i++) {
+        if (subscribers[i].fd < 0) {
+            sub = &subscribers[i];
+            sub->out = malloc(SUBSCRIBER_BUFFER);
+            if (!sub->out) {
+                sub = NULL;
+                break;
+            }
+            sub->fd = fd;
+            sub->out_head = sub->out_count = 0;
+            sub->want_write = false;
+            sub->filter_count = 0;
+            sub->line_length = 0;
+            sub->records = sub->dropped = 0;
+        }
+    }
+    pthread_rwlock_unlock(&subscribers_lock);
+    if (!sub) {
+        close(fd);
+        return;
+    }
+
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = sub};
+    epoll_ctl(main_epoll, EPOLL_CTL_ADD, fd, &event);
+
+    // Tell the new subscriber which cars exist
+    pthread_mutex_lock(&sub->lock);
+    for (int i = 0; i < car_count; i++) {
+        if (cars[i]->have_beacon) {
+            uint8_t record[FLEET_RECORD_MAX];
+            telemetry_frame frame = {.type = TELEMETRY_BEACON};
+            frame.u.beacon = cars[i]->beacon;
+            size_t length = fleet_record_encode(cars[i]->id, &frame, record, sizeof(record));
+            subscriber_append(sub, record, length);
+        }
+    }
+    pthread_mutex_unlock(&sub->lock);
+}
+
+// ---- Workers --------------------------------------------------------------
+
+// Runs on the car's worker for every decoded frame
+static void car_frame(car_client *client, const telemetry_frame *frame, void *context) {
+    car *c = context;
+    worker *w = c->owner;
+    (void)client;
+
+    atomic_fetch_add_explicit(&w->stats.frames, 1, memory_order_relaxed);
+    if (frame->type == TELEMETRY_BATCH) {
+        const telemetry_batch *batch = &frame->u.batch;
+        pthread_mutex_lock(&c->ring_lock);
+        for (int i = 0; i < batch->count; i++) {
+            ring_entry *entry = &c->ring[c->ring_head++ % RING_SAMPLES];
+            entry->sample = batch->samples[i];
+            entry->number = batch->first_sample + (uint32_t)i;
+            entry->timestamp_us = frame->timestamp_us + (uint32_t)i * batch->period_us;
+        }
+        c->period_us = batch->period_us;
+        pthread_mutex_unlock(&c->ring_lock);
+        atomic_fetch_add_explicit(&w->stats.samples, batch->count, memory_order_relaxed);
+    }
+    publish_frame(c->id, frame);
+}
+
+static void worker_connect(worker *w, car *c, double now) {
+    c->connect_after = now + RECONNECT_S;
+    if (car_client_open(&c->client, c->host, c->tcp_port, 0) < 0) {
+        return;
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = c};
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, car_client_fd(&c->client), &event);
+}
+
+// Take over new cars and decode queued datagrams. Returns true if more arrived meanwhile.
+static bool worker_drain(worker *w) {
+    car *incoming[CAR_MAX];
+    int incoming_count;
+
+    pthread_mutex_lock(&w->lock);
+    incoming_count = w->incoming_count;
+    memcpy(incoming, w->incoming, sizeof(car *) * (size_t)incoming_count);
+    w->incoming_count = 0;
+    for (int i = 0; i < incoming_count; i++) {
+        car *c = incoming[i];
+        if (c->pending_move) {
+            memcpy(c->host, c->pending_host, sizeof(c->host));
+            c->tcp_port = c->pending_port;
+            c->pending_move = false;
+        }
+    }
+    unsigned head = w->queue_head, count = w->queue_count;
+    pthread_mutex_unlock(&w->lock);
+
+    double now = car_client_now();
+    for (int i = 0; i < incoming_count; i++) {
+        car *c = incoming[i];
+        bool known = false;
+        for (int k = 0; k < w->car_count; k++) {
+            known |= w->cars[k] == c;
+        }
+        if (!known) {
+            w->cars[w->car_count++] = c;
+        }
+        worker_connect(w, c, now);
+    }
+
+    // The main thread only writes slots past head + count, so these are stable
+    for (unsigned i = 0; i < count; i++) {
+        queued_datagram *d = &w->queue[(head + i) % UDP_QUEUE_DEPTH];
+        telemetry_rx *rx = &d->car->client.udp_rx;
+        uint32_t lost = rx->stats.lost_samples;
+        telemetry_rx_datagram(rx, d->data, d->length);
+        atomic_fetch_add_explicit(&w->stats.lost_samples, rx->stats.lost_samples - lost, memory_order_relaxed);
+    }
+
+    // The main thread only signals an empty queue, so go round until it is one
+    pthread_mutex_lock(&w->lock);
+    w->queue_head = (head + count) % UDP_QUEUE_DEPTH;
+    w->queue_count -= count;
+    bool more = w->queue_count > 0 || w->incoming_count > 0;
+    pthread_mutex_unlock(&w->lock);
+    return more;
+}
+
+static void worker_tick(worker *w) {
+    double now = car_client_now();
+    uint32_t connected = 0;
+    for (int i = 0; i < w->car_count; i++) {
+        car *c = w->cars[i];
+        if (c->client.state == CAR_CLOSED && now >= c->connect_after) {
+            worker_connect(w, c, now);
+        }
+        connected += c->client.state == CAR_CONNECTED;
+    }
+    atomic_store_explicit(&w->stats.connected, connected, memory_order_relaxed);
+}
+
+static void worker_poll(worker *w, int timeout_ms) {
+    struct epoll_event events[MAX_EVENTS];
+    int count = epoll_wait(w->epoll_fd, events, MAX_EVENTS, timeout_ms);
+
+    for (int i = 0; i < count; i++) {
+        void *ptr = events[i].data.ptr;
+        if (ptr == &w->event_fd) {
+            uint64_t value;
+            if (read(w->event_fd, &value, sizeof(value)) > 0) {
+                while (worker_drain(w)) {
+                }
+            }
+        } else if (ptr == &w->timer_fd) {
+            uint64_t expirations;
+            if (read(w->timer_fd, &expirations, sizeof(expirations)) > 0) {
+                worker_tick(w);
+            }
+        } else {
+            car *c = ptr;
+            bool was_connected = c->client.state == CAR_CONNECTED;
+            if (car_client_poll(&c->client, 0) < 0) {
+                // Failed reconnects of a car that is away are not worth a line each
+                if (was_connected) {
+                    fprintf(stderr, "car %016llx (%s): %s\n", (unsigned long long)c->id, c->host, strerror(errno));
+                }
+                c->connect_after = car_client_now() + RECONNECT_S;
+            }
+        }
+    }
+}
+
+static void *worker_main(void *arg) {
+    worker *w = arg;
+    while (!stopping) {
+        worker_poll(w, -1);
+    }
+    return NULL;
+}
+
+static void worker_signal(worker *w) {
+    uint64_t one = 1;
+    if (write(w->event_fd, &one, sizeof(one)) < 0) {
+        perror("eventfd");
+    }
+}
+
+static bool worker_init(worker *w) {
+    memset(w, 0, sizeof(*w));
+    pthread_mutex_init(&w->lock, NULL);
+    w->queue = calloc(UDP_QUEUE_DEPTH, sizeof(queued_datagram));
+    w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    w->event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    w->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (!w->queue || w->epoll_fd < 0 || w->event_fd < 0 || w->timer_fd < 0) {
+        return false;
+    }
+
+    struct itimerspec period = {.it_interval = {0, 500000000}, .it_value = {0, 500000000}};
+    timerfd_settime(w->timer_fd, 0, &period, NULL);
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = &w->event_fd};
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->event_fd, &event);
+    event.data.ptr = &w->timer_fd;
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->timer_fd, &event);
+    return true;
+}
+
+// ---- Cars (main thread) ---------------------------------------------------
+
+static car *find_car(uint64_t id) {
+    for (int i = 0; i < car_count; i++) {
+        if (cars[i]->id == id) {
+            return cars[i];
+        }
+    }
+    return NULL;
+}
+
+static car *find_car_by_ip(in_addr_t ip) {
+    for (int i = 0; i < car_count; i++) {
+        if (cars[i]->ip == ip) {
+            return cars[i];
+        }
+    }
+    return NULL;
+}
+
+// Hand a new car, or a car with a new address, to its worker
+static void assign_car(car *c, const char *host, uint16_t port) {
+    worker *w = c->owner;
+    pthread_mutex_lock(&w->lock);
+    snprintf(c->pending_host, sizeof(c->pending_host), "%s", host);
+    c->pending_port = port;
+    c->pending_move = true;
+    bool queued = false;
+    for (int i = 0; i < w->incoming_count; i++) {
+        queued |= w->incoming[i] == c;
+    }
+    if (!queued) {
+        w->incoming[w->incoming_count++] = c;
+    }
+    pthread_mutex_unlock(&w->lock);
+    worker_signal(w);
+}
+
+static car *add_car(uint64_t id, const char *host, uint16_t port) {
+    struct in_addr address;
+    if (car_count == CAR_MAX || inet_pton(AF_INET, host, &address) != 1) {
+        return NULL;
+    }
+    car *c = calloc(1, sizeof(car));
+    if (!c) {
+        return NULL;
+    }
+    c->id = id;
+    c->ip = address.s_addr;
+    c->owner = &workers[car_count % worker_count];
+    pthread_mutex_init(&c->ring_lock, NULL);
+    car_client_init(&c->client, car_frame, c);
+    cars[car_count++] = c;
+    assign_car(c, host, port);
+    return c;
+}
+
+static void on_discovery(void *context, const car_entry *entry, car_event event) {
+    (void)context;
+    if (event == CAR_LOST) {
+        return;     // The TCP connection notices by itself; keep retrying in case it returns
+    }
+
+    car *c = find_car(entry->beacon.device_id);
+    if (!c) {
+        // Ignore a car already given on the command line by address
+        struct in_addr address;
+        inet_pton(AF_INET, entry->address, &address);
+        if (find_car_by_ip(address.s_addr)) {
+            return;
+        }
+        c = add_car(entry->beacon.device_id, entry->address, entry->beacon.tcp_port);
+        if (!c) {
+            return;
+        }
+        printf("Car %016llx at %s:%u\n", (unsigned long long)c->id, entry->address, entry->beacon.tcp_port);
+    } else {
+        struct in_addr address;
+        inet_pton(AF_INET, entry->address, &address);
+        if (address.s_addr != c->ip || entry->beacon.tcp_port != c->beacon.tcp_port) {
+            printf("Car %016llx moved to %s:%u\n", (unsigned long long)c->id, entry->address, entry->beacon.tcp_port);
+            c->ip = address.s_addr;
+            assign_car(c, entry->address, entry->beacon.tcp_port);
+        }
+    }
+    c->beacon = entry->beacon;
+    c->have_beacon = true;
+    publish_beacon(c);
+}
+
+// Route one datagram to its car's worker
+static void udp_read(void) {
+    for (;;) {
+        struct sockaddr_in from;
+        socklen_t from_length = sizeof(from);
+        uint8_t buffer[TELEMETRY_MAX_FRAME];
+        ssize_t received = recvfrom(udp_fd, buffer, sizeof(buffer), MSG_DONTWAIT, (struct sockaddr *)&from, &from_length);
+        if (received < 0) {
+            return;
+        }
+        car *c = find_car_by_ip(from.sin_addr.s_addr);
+        if (!c) {
+            continue;
+        }
+        worker *w = c->owner;
+        if (!threaded) {
+            // Same thread as the worker: decode in place
+            telemetry_rx *rx = &c->client.udp_rx;
+            uint32_t lost = rx->stats.lost_samples;
+            telemetry_rx_datagram(rx, buffer, (size_t)received);
+            atomic_fetch_add_explicit(&w->stats.lost_samples, rx->stats.lost_samples - lost, memory_order_relaxed);
+            continue;
+        }
+
+        pthread_mutex_lock(&w->lock);
+        bool was_empty = w->queue_count == 0;
+        if (w->queue_count == UDP_QUEUE_DEPTH) {
+            atomic_fetch_add_explicit(&w->stats.udp_dropped, 1, memory_order_relaxed);
+            pthread_mutex_unlock(&w->lock);
+            continue;
+        }
+        queued_datagram *d = &w->queue[(w->queue_head + w->queue_count) % UDP_QUEUE_DEPTH];
+        d->car = c;
+        d->length = (uint16_t)received;
+        memcpy(d->data, buffer, (size_t)received);
+        w->queue_count++;
+        pthread_mutex_unlock(&w->lock);
+        if (was_empty) {
+            worker_signal(w);
+        }
+    }
+}
+
+// ---- Statistics -----------------------------------------------------------
+
+static double cpu_seconds(void) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+}
+
+static void print_stats(void) {
+    static uint64_t last_frames, last_samples;
+    static double last_time, last_cpu;
+    uint64_t frames = 0, samples = 0, lost = 0, udp_dropped = 0, records = 0, dropped = 0;
+    uint32_t connected = 0;
+    int subscriber_count = 0;
+
+    for (int i = 0; i < worker_count; i++) {
+        frames += atomic_load_explicit(&workers[i].stats.frames, memory_order_relaxed);
+        samples += atomic_load_explicit(&workers[i].stats.samples, memory_order_relaxed);
+        lost += atomic_load_explicit(&workers[i].stats.lost_samples, memory_order_relaxed);
+        udp_dropped += atomic_load_explicit(&workers[i].stats.udp_dropped, memory_order_relaxed);
+        connected += atomic_load_explicit(&workers[i].stats.connected, memory_order_relaxed);
+    }
+    pthread_rwlock_rdlock(&subscribers_lock);
+    for (int i = 0; i < SUBSCRIBER_MAX; i++) {
+        pthread_mutex_lock(&subscribers[i].lock);
+        if (subscribers[i].fd >= 0) {
+            subscriber_count++;
+            records += subscribers[i].records;
+            dropped += subscribers[i].dropped;
+        }
+        pthread_mutex_unlock(&subscribers[i].lock);
+    }
+    pthread_rwlock_unlock(&subscribers_lock);
+
+    double now = car_client_now(), cpu = cpu_seconds();
+    double elapsed = last_time > 0 ? now - last_time : 0;
+    if (elapsed > 0) {
+        printf("cars %u/%d  frames %.0f/s  samples %.0f/s  lost %llu  udp_dropped %llu  "
+               "subscribers %d  records %llu  dropped %llu  cpu %.1f%%\n",
+               connected, car_count, (frames - last_frames) / elapsed, (samples - last_samples) / elapsed,
+               (unsigned long long)lost, (unsigned long long)udp_dropped, subscriber_count,
+               (unsigned long long)records, (unsigned long long)dropped, 100.0 * (cpu - last_cpu) / elapsed);
+        fflush(stdout);
+    }
+    last_frames = frames;
+    last_samples = samples;
+    last_time = now;
+    last_cpu = cpu;
+}
+
+// ---- Setup ----------------------------------------------------------------
+
+static int open_udp(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int size = 4 * 1024 * 1024;
+    struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY)};
+    if (fd < 0) {
+        return -1;
+    }
+    // Room for bursts from many cars while the main thread is busy
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int open_listener(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY)};
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0 || listen(fd, SUBSCRIBER_MAX) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void watch(int fd, void *tag) {
+    struct epoll_event event = {.events = EPOLLIN, .data.ptr = tag};
+    epoll_ctl(main_epoll, EPOLL_CTL_ADD, fd, &event);
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: fleet_aggregator [-w WORKERS] [-p PORT] [-i SECONDS] [HOST[:PORT]...]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int threads = 0, interval = 5, opt;
+    uint16_t port = FLEET_SUBSCRIBER_PORT;
+
+    while ((opt = getopt(argc, argv, "w:p:i:")) != -1) {
+        switch (opt) {
+            case 'w': threads = atoi(optarg); break;
+            case 'p': port = (uint16_t)atoi(optarg); break;
+            case 'i': interval = atoi(optarg); break;
+            default: usage();
+        }
+    }
+    if (threads < 0 || threads > WORKER_MAX) {
+        usage();
+    }
+
+    struct sigaction action = {.sa_handler = on_signal};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (int i = 0; i < SUBSCRIBER_MAX; i++) {
+        subscribers[i].fd = -1;
+        pthread_mutex_init(&subscribers[i].lock, NULL);
+    }
+
+    threaded = threads > 0;
+    worker_count = threaded ? threads : 1;
+    for (int i = 0; i < worker_count; i++) {
+        if (!worker_init(&workers[i])) {
+            perror("worker");
+            return 1;
+        }
+    }
+
+    main_epoll = epoll_create1(EPOLL_CLOEXEC);
+    udp_fd = open_udp(CAR_UDP_PORT);
+    listen_fd = open_listener(port);
+    if (main_epoll < 0 || udp_fd < 0 || listen_fd < 0) {
+        perror("setup");
+        return 1;
+    }
+    watch(udp_fd, &tag_udp);
+    watch(listen_fd, &tag_listen);
+    if (car_discovery_open(&discovery, TELEMETRY_DISCOVERY_PORT, on_discovery, NULL) == 0) {
+        watch(car_discovery_fd(&discovery), &tag_discovery);
+    } else {
+        perror("discovery");
+    }
+    if (interval > 0) {
+        stats_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        struct itimerspec period = {.it_interval = {interval, 0}, .it_value = {interval, 0}};
+        timerfd_settime(stats_fd, 0, &period, NULL);
+        watch(stats_fd, &tag_stats);
+    }
+    if (!threaded) {
+        watch(workers[0].epoll_fd, &tag_worker);
+    }
+
+    // Cars given by address get an ID from it, as they may not send beacons
+    for (int i = optind; i < argc; i++) {
+        char host[INET_ADDRSTRLEN];
+        unsigned car_port = CAR_TCP_PORT;
+        if (sscanf(argv[i], "%15[^:]:%u", host, &car_port) < 1) {
+            usage();
+        }
+        struct in_addr address;
+        if (inet_pton(AF_INET, host, &address) != 1) {
+            fprintf(stderr, "%s: not an IPv4 address\n", host);
+            return 1;
+        }
+        add_car(((uint64_t)ntohl(address.s_addr) << 16) | car_port, host, (uint16_t)car_port);
+    }
+
+    for (int i = 0; threaded && i < worker_count; i++) {
+        pthread_create(&workers[i].thread, NULL, worker_main, &workers[i]);
+    }
+    printf("Aggregating on UDP %u, subscribers on TCP %u, %d worker thread(s)\n", CAR_UDP_PORT, port, threads);
+
+    while (!stopping) {
+        struct epoll_event events[MAX_EVENTS];
+        int count = epoll_wait(main_epoll, events, MAX_EVENTS, -1);
+        for (int i = 0; i < count; i++) {
+            void *tag = events[i].data.ptr;
+            if (tag == &tag_udp) {
+                udp_read();
+            } else if (tag == &tag_listen) {
+                subscriber_accept();
+            } else if (tag == &tag_discovery) {
+                car_discovery_poll(&discovery);
+            } else if (tag == &tag_worker) {
+                worker_poll(&workers[0], 0);
+            } else if (tag == &tag_stats) {
+                uint64_t expirations;
+                if (read(stats_fd, &expirations, sizeof(expirations)) > 0) {
+                    car_discovery_expire(&discovery, car_client_now());
+                    print_stats();
+                }
+            } else {
+                subscriber *sub = tag;
+                if (events[i].events & EPOLLOUT) {
+                    pthread_mutex_lock(&sub->lock);
+                    subscriber_flush(sub);
+                    pthread_mutex_unlock(&sub->lock);
+                }
+                if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+                    subscriber_read(sub);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; threaded && i < worker_count; i++) {
+        worker_signal(&workers[i]);
+        pthread_join(workers[i].thread, NULL);
+    }
+    printf("\n");
+    print_stats();
+    return 0;
+}
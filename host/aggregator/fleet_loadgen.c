@@ -0,0 +1,351 @@
+// Load generator for fleet_aggregator: N fake cars on one host, plus a
+// subscriber that measures what comes out of the aggregator.
+//
+// Car i lives on its own loopback address (127.1.x.y) so the aggregator can
+// tell the streams apart by source address as it does on the real network.
+// Each car announces itself with beacons to the discovery port on 127.0.0.1
+// (loopback does not carry broadcasts), accepts the aggregator's TCP
+// connection on CAR_TCP_PORT and then streams delta batches to the
+// connecting address on CAR_UDP_PORT, exactly like the firmware.
+//
+// The newest sample of every batch carries the send time in timestamp_us, so
+// the subscriber side reports the end-to-end latency of the aggregator (UDP
+// receive, routing, decode, ring, re-encode, fan-out) next to the sample
+// throughput and loss.
+//
+// Usage:
+//   fleet_loadgen [-n CARS] [-d SECONDS] [-r HZ] [-b BATCH] [-a AGGREGATOR]
+//     -n N    fake cars (default 16, up to 256)
+//     -d S    measurement time after a 2 s warm-up (default 10)
+//     -r HZ   samples per second per car (default 200)
+//     -b N    samples per datagram (default 10)
+//     -a HOST aggregator address (default 127.0.0.1)
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include "car_client.h"
+#include "fleet_stream.h"
+#include "telemetry_delta.h"
+
+#define CAR_MAX 256
+#define WARMUP_S 2.0
+#define DRAIN_S 0.5
+#define BEACON_INTERVAL_S 1.0
+#define MAX_EVENTS 64
+
+typedef struct {
+    struct sockaddr_in address;     // 127.1.x.y
+    int listen_fd;
+    int tcp_fd;                     // Connection from the aggregator, -1 if none
+    int udp_fd;                     // Beacons and the sample stream, bound to address
+    struct sockaddr_in stream_to;   // Aggregator address, CAR_UDP_PORT
+    telemetry_delta_state delta;
+    uint16_t beacon_seq;
+    uint16_t stream_seq;
+    uint32_t next_sample;
+    double next_batch;
+    double next_beacon;
+} fake_car;
+
+static fake_car cars[CAR_MAX];
+static int car_count = 16;
+static int rate_hz = 200;
+static int batch_size = 10;
+
+// Measurement window, counted only for samples taken inside it
+static uint32_t window_start_us;
+static bool measuring = false;
+static uint64_t sent_samples;
+static uint64_t received_samples;
+static uint32_t *latencies;
+static size_t latency_count, latency_capacity;
+
+static uint32_t now_us(void) {
+    return (uint32_t)(car_client_now() * 1e6);
+}
+
+static bool car_open(fake_car *car, int index) {
+    int one = 1;
+    car->address = (struct sockaddr_in){.sin_family = AF_INET, .sin_port = htons(CAR_TCP_PORT)};
+    car->address.sin_addr.s_addr = htonl(0x7F010001u + (uint32_t)((index / 250) << 8) + (uint32_t)(index % 250));
+    car->tcp_fd = -1;
+    telemetry_delta_init(&car->delta, TELEMETRY_DELTA_KEYFRAME_INTERVAL);
+
+    car->listen_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    car->udp_fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (car->listen_fd < 0 || car->udp_fd < 0) {
+        return false;
+    }
+    setsockopt(car->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(car->listen_fd, (struct sockaddr *)&car->address, sizeof(car->address)) < 0 ||
+        listen(car->listen_fd, 1) < 0) {
+        return false;
+    }
+    struct sockaddr_in local = car->address;
+    local.sin_port = 0;
+    return bind(car->udp_fd, (struct sockaddr *)&local, sizeof(local)) == 0;
+}
+
+static void send_beacon(fake_car *car) {
+    uint8_t buffer[TELEMETRY_MAX_FRAME];
+    telemetry_frame frame = {.type = TELEMETRY_BEACON, .seq = car->beacon_seq++, .timestamp_us = now_us()};
+    telemetry_beacon *beacon = &frame.u.beacon;
+    beacon->device_id = 0x4C4F414400000000ull | ntohl(car->address.sin_addr.s_addr);   // "LOAD"
+    memcpy(beacon->ip, &car->address.sin_addr.s_addr, 4);
+    beacon->tcp_port = CAR_TCP_PORT;
+    beacon->stream_port = CAR_UDP_PORT;
+    beacon->version = 0x0100;
+    beacon->capabilities = TELEMETRY_CAP_STREAM | TELEMETRY_CAP_DELTA;
+    beacon->clients = car->tcp_fd >= 0;
+    beacon->max_clients = 1;
+
+    struct sockaddr_in to = {.sin_family = AF_INET, .sin_port = htons(TELEMETRY_DISCOVERY_PORT)};
+    to.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    size_t length = telemetry_encode(&frame, buffer, sizeof(buffer));
+    sendto(car->udp_fd, buffer, length, 0, (struct sockaddr *)&to, sizeof(to));
+}
+
+// A drive around a circle: every field changes a little from sample to sample
+static void fill_sample(telemetry_sample *s, uint32_t n) {
+    s->x_mm = (int32_t)(n * 3 % 4000);
+    s->y_mm = (int32_t)(n * 2 % 3000);
+    s->heading_mrad = (int16_t)(n * 7 % 6283);
+    s->left_speed_mm_s = (int16_t)(200 + n % 16);
+    s->right_speed_mm_s = (int16_t)(210 - n % 16);
+    s->left_duty = (uint16_t)(6000 + n % 50);
+    s->right_duty = (uint16_t)(6100 - n % 50);
+    s->distance_mm = (uint16_t)(1500 - n % 1000);
+    s->flags = TELEMETRY_FLAG_DISTANCE_VALID;
+}
+
+static void send_batch(fake_car *car) {
+    uint8_t buffer[TELEMETRY_MAX_FRAME];
+    telemetry_frame frame = {.type = TELEMETRY_BATCH, .seq = car->stream_seq++};
+    telemetry_batch *batch = &frame.u.batch;
+    batch->first_sample = car->next_sample;
+    batch->period_us = (uint16_t)(1000000 / rate_hz);
+    batch->count = (uint8_t)batch_size;
+    batch->fields = TELEMETRY_FIELDS_ALL;
+    for (int i = 0; i < batch_size; i++) {
+        fill_sample(&batch->samples[i], car->next_sample++);
+    }
+    // The newest sample is stamped with the send time
+    frame.timestamp_us = now_us() - (uint32_t)(batch_size - 1) * batch->period_us;
+
+    size_t length = telemetry_delta_encode(&car->delta, &frame, buffer, sizeof(buffer));
+    if (length == 0) {
+        length = telemetry_encode(&frame, buffer, sizeof(buffer));
+    }
+    if (sendto(car->udp_fd, buffer, length, 0, (struct sockaddr *)&car->stream_to, sizeof(car->stream_to)) > 0 &&
+        measuring) {
+        sent_samples += (uint64_t)batch_size;
+    }
+}
+
+// Take the aggregator's connection; the stream goes to where it came from
+static bool car_accept(fake_car *car) {
+    struct sockaddr_in peer;
+    socklen_t peer_length = sizeof(peer);
+    int fd = accept4(car->listen_fd, (struct sockaddr *)&peer, &peer_length, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    if (car->tcp_fd >= 0) {
+        close(car->tcp_fd);
+    }
+    car->tcp_fd = fd;
+    car->stream_to = peer;
+    car->stream_to.sin_port = htons(CAR_UDP_PORT);
+    telemetry_delta_reset(&car->delta);
+    return true;
+}
+
+static void car_read(fake_car *car) {
+    char buffer[256];
+    ssize_t received = recv(car->tcp_fd, buffer, sizeof(buffer), 0);
+    if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)) {
+        close(car->tcp_fd);
+        car->tcp_fd = -1;
+    }
+}
+
+static void on_record(void *context, uint64_t device_id, const telemetry_frame *frame) {
+    (void)context;
+    (void)device_id;
+    if (frame->type != TELEMETRY_BATCH || !measuring) {
+        return;
+    }
+    const telemetry_batch *batch = &frame->u.batch;
+    uint32_t newest = frame->timestamp_us + (uint32_t)(batch->count - 1) * batch->period_us;
+    if ((int32_t)(newest - window_start_us) < 0) {
+        return;
+    }
+    received_samples += batch->count;
+
+    if (latency_count == latency_capacity) {
+        latency_capacity = latency_capacity ? latency_capacity * 2 : 65536;
+        latencies = realloc(latencies, latency_capacity * sizeof(uint32_t));
+        if (!latencies) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    latencies[latency_count++] = now_us() - newest;
+}
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static int connect_subscriber(const char *host) {
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(FLEET_SUBSCRIBER_PORT)};
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || inet_pton(AF_INET, host, &address.sin_addr) != 1 ||
+        connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        return -1;
+    }
+    return fd;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: fleet_loadgen [-n CARS] [-d SECONDS] [-r HZ] [-b BATCH] [-a AGGREGATOR]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    const char *aggregator = "127.0.0.1";
+    double duration = 10;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:d:r:b:a:")) != -1) {
+        switch (opt) {
+            case 'n': car_count = atoi(optarg); break;
+            case 'd': duration = atof(optarg); break;
+            case 'r': rate_hz = atoi(optarg); break;
+            case 'b': batch_size = atoi(optarg); break;
+            case 'a': aggregator = optarg; break;
+            default: usage();
+        }
+    }
+    if (car_count < 1 || car_count > CAR_MAX || rate_hz < 16 || rate_hz > 100000 ||
+        batch_size < 1 || batch_size > TELEMETRY_MAX_BATCH || duration <= 0) {
+        usage();
+    }
+
+    // Three descriptors per car
+    struct rlimit limit;
+    getrlimit(RLIMIT_NOFILE, &limit);
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &limit);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int subscriber_fd = connect_subscriber(aggregator);
+    if (subscriber_fd < 0) {
+        fprintf(stderr, "%s:%u: %s\n", aggregator, FLEET_SUBSCRIBER_PORT, strerror(errno));
+        return 1;
+    }
+    fleet_rx rx;
+    fleet_rx_init(&rx, on_record, NULL);
+    struct epoll_event event = {.events = EPOLLIN, .data.u64 = (uint64_t)-1};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, subscriber_fd, &event);
+
+    double start = car_client_now();
+    double batch_period = (double)batch_size / rate_hz;
+    for (int i = 0; i < car_count; i++) {
+        if (!car_open(&cars[i], i)) {
+            fprintf(stderr, "car %d: %s\n", i, strerror(errno));
+            return 1;
+        }
+        // Spread the cars over the batch period, as independent cars would be
+        cars[i].next_batch = start + batch_period * i / car_count;
+        cars[i].next_beacon = start + BEACON_INTERVAL_S * i / car_count;
+        event.data.u64 = (uint64_t)i;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, cars[i].listen_fd, &event);
+    }
+
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec tick = {.it_interval = {0, 1000000}, .it_value = {0, 1000000}};
+    timerfd_settime(timer_fd, 0, &tick, NULL);
+    event.data.u64 = (uint64_t)-2;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+
+    double measure_start = start + WARMUP_S, measure_end = measure_start + duration;
+    double now = start;
+    while (now < measure_end + DRAIN_S) {
+        struct epoll_event events[MAX_EVENTS];
+        int count = epoll_wait(epoll_fd, events, MAX_EVENTS, 100);
+        for (int i = 0; i < count; i++) {
+            uint64_t tag = events[i].data.u64;
+            if (tag == (uint64_t)-1) {
+                uint8_t buffer[16384];
+                ssize_t received = recv(subscriber_fd, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (received <= 0 || fleet_rx_feed(&rx, buffer, (size_t)received) < 0) {
+                    fprintf(stderr, "aggregator closed the subscription\n");
+                    return 1;
+                }
+            } else if (tag == (uint64_t)-2) {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+                    continue;
+                }
+            } else if (tag < CAR_MAX) {
+                fake_car *car = &cars[tag];
+                if (car_accept(car)) {
+                    event.data.u64 = tag + CAR_MAX;
+                    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, car->tcp_fd, &event);
+                }
+            } else {
+                car_read(&cars[tag - CAR_MAX]);
+            }
+        }
+
+        now = car_client_now();
+        if (!measuring && now >= measure_start && now < measure_end) {
+            measuring = true;
+            window_start_us = now_us();
+        }
+        for (int i = 0; i < car_count; i++) {
+            fake_car *car = &cars[i];
+            if (now >= car->next_beacon) {
+                send_beacon(car);
+                car->next_beacon += BEACON_INTERVAL_S;
+            }
+            while (now >= car->next_batch && now < measure_end) {
+                if (car->tcp_fd >= 0) {
+                    send_batch(car);
+                }
+                car->next_batch += batch_period;
+            }
+        }
+        if (measuring && now >= measure_end + DRAIN_S * 0.9) {
+            measuring = false;
+        }
+    }
+
+    int connected = 0;
+    for (int i = 0; i < car_count; i++) {
+        connected += cars[i].tcp_fd >= 0;
+    }
+    if (latency_count > 0) {
+        qsort(latencies, latency_count, sizeof(uint32_t), compare_u32);
+    }
+    double loss = sent_samples ? 100.0 * (double)(sent_samples - (received_samples < sent_samples ? received_samples : sent_samples)) / sent_samples : 0;
+    printf("cars %d (connected %d)  rate %d Hz  batch %d\n", car_count, connected, rate_hz, batch_size);
+    printf("sent %.0f samples/s  received %.0f samples/s  loss %.2f%%\n",
+           sent_samples / duration, received_samples / duration, loss);
+    if (latency_count > 0) {
+        printf("latency us  p50 %u  p99 %u  max %u  (%zu batches)\n", latencies[latency_count / 2],
+               latencies[latency_count * 99 / 100], latencies[latency_count - 1], latency_count);
+    }
+    return 0;
+}
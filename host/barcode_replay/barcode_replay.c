@@ -0,0 +1,253 @@
+// Offline replay harness for the buddy3 barcode decoder.
+//
+// Without arguments it synthesises a corpus of ADC traces ("*X*" for all 44
+// Code 39 characters, both scan orientations, several speeds and noise
+// levels), feeds every trace through barcode_detector exactly like
+// read_ir_sensors does, and reports the decode rate and decoder throughput.
+// It exits non-zero if the decode rate at any noise level falls below that
+// level's baseline in min_decode_percent.
+//
+// Usage:
+//   barcode_replay                      run the synthetic corpus
+//   barcode_replay -w DIR               also write the corpus to DIR (fuzzer seeds)
+//   barcode_replay TRACE...             replay recorded traces
+//
+// A recorded trace is a text file with one ADC reading per line (a captured
+// "Current analog value: N, ..." serial log also works). A line of the form
+// "# expect: *A*" sets the expected decode result.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <time.h>
+#include "buddy3_barcode.h"
+
+#define WHITE_LEVEL 100         // Typical reading on white paper
+#define BLACK_LEVEL 1500        // Typical reading on a printed bar
+#define WIDE_RATIO 3            // Wide element width in narrow modules
+#define QUIET_MODULES 10        // White margin before and after the barcode
+#define MAX_TRACE_SAMPLES 65536
+#define REPEAT_RUNS 20          // Replays of the corpus for the throughput figure
+
+// Samples per narrow module (lower = car moving faster)
+static const int speeds[] = {2, 3, 5, 8, 12};
+// Standard deviation of the ADC noise in counts
+static const int noise_levels[] = {0, 30, 60};
+// Lowest decode rate accepted at each noise level, a little under what the
+// decoder achieves on this corpus (100%, 91.8%, 4.1%). At 60 counts the bars
+// are lost in the noise; that floor only catches the decoder getting worse.
+static const double min_decode_percent[] = {100.0, 90.0, 3.0};
+
+typedef struct {
+    uint16_t samples[MAX_TRACE_SAMPLES];
+    int length;
+    char expected[CHAR_COUNT + 1];
+} trace;
+
+// Small deterministic PRNG so every run generates the same corpus
+static uint32_t rng_state = 12345;
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double rng_gaussian(void) {
+    double u1 = (rng_next() + 1.0) / 4294967297.0;
+    double u2 = (rng_next() + 1.0) / 4294967297.0;
+    return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+static void trace_append(trace *t, bool black, int count, int noise) {
+    for (int i = 0; i < count && t->length < MAX_TRACE_SAMPLES; i++) {
+        double value = (black ? BLACK_LEVEL : WHITE_LEVEL) + noise * rng_gaussian();
+        if (value < 0) value = 0;
+        if (value > 4095) value = 4095;
+        t->samples[t->length++] = (uint16_t)value;
+    }
+}
+
+// Append the 9 elements of one Code 39 character (bar first) and a narrow gap
+static void trace_append_char(trace *t, const char *code, int module, int noise, bool gap) {
+    for (int i = 0; i < CHUNK_SIZE; i++) {
+        int width = (code[i] == '1') ? WIDE_RATIO * module : module;
+        // Jitter the printed/scanned width by up to +-1 sample once noise is enabled
+        if (noise > 0) width += (int)(rng_next() % 3) - 1;
+        if (width < 1) width = 1;
+        trace_append(t, i % 2 == 0, width, noise);
+    }
+    if (gap) trace_append(t, false, module, noise);
+}
+
+static void synthesise(trace *t, int char_index, int module, int noise, bool reverse) {
+    const int star = CODE39_CHAR_COUNT - 1; // '*' start/stop character
+
+    t->length = 0;
+    trace_append(t, false, QUIET_MODULES * module, noise);
+    trace_append_char(t, array_code[star], module, noise, true);
+    trace_append_char(t, array_code[char_index], module, noise, true);
+    trace_append_char(t, array_code[star], module, noise, false);
+    trace_append(t, false, QUIET_MODULES * module, noise);
+
+    if (reverse) {
+        for (int i = 0, j = t->length - 1; i < j; i++, j--) {
+            uint16_t tmp = t->samples[i];
+            t->samples[i] = t->samples[j];
+            t->samples[j] = tmp;
+        }
+    }
+    snprintf(t->expected, sizeof(t->expected), "*%c*", array_char[char_index]);
+}
+
+// Feed one trace through the decoder the way read_ir_sensors does. Returns true
+// if a barcode completed and matched the expected string (if any).
+static bool replay(const trace *t, char *decoded) {
+    static barcode_decoder dec;
+
+    barcode_decoder_init(&dec);
+    for (int i = 0; i < t->length; i++) {
+        barcode_detector(&dec, t->samples[i]);
+    }
+
+    if (dec.decoded_count == 0) {
+        strcpy(decoded, "-");
+        return false;
+    }
+    strcpy(decoded, dec.result);
+    return t->expected[0] == '\0' || strcmp(t->expected, dec.result) == 0;
+}
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static bool write_trace(const char *dir, const trace *t, int char_index, int module, int noise, bool reverse) {
+    char path[512];
+    snprintf(path, sizeof(path), "%s/c%02d_%s_m%02d_n%02d.bin", dir, char_index, reverse ? "rev" : "fwd", module, noise);
+    FILE *f = fopen(path, "wb");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+    // Little-endian uint16 samples, the input format of barcode_fuzz
+    for (int i = 0; i < t->length; i++) {
+        uint8_t bytes[2] = {t->samples[i] & 0xFF, t->samples[i] >> 8};
+        fwrite(bytes, 1, 2, f);
+    }
+    fclose(f);
+    return true;
+}
+
+static bool load_trace(const char *path, trace *t) {
+    char line[256];
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return false;
+    }
+
+    t->length = 0;
+    t->expected[0] = '\0';
+    while (fgets(line, sizeof(line), f) && t->length < MAX_TRACE_SAMPLES) {
+        char *p = line;
+        if (sscanf(line, "# expect: %3[^\n]", t->expected) == 1) {
+            continue;
+        }
+        // Take the first number on the line
+        while (*p && !isdigit((unsigned char)*p)) p++;
+        if (*p) {
+            t->samples[t->length++] = (uint16_t)strtoul(p, NULL, 10);
+        }
+    }
+    fclose(f);
+    return true;
+}
+
+static int run_recorded(int argc, char **argv) {
+    static trace t;
+    int passed = 0;
+    char decoded[CHAR_COUNT + 2];
+
+    for (int i = 0; i < argc; i++) {
+        if (!load_trace(argv[i], &t)) {
+            return 1;
+        }
+        bool ok = replay(&t, decoded);
+        passed += ok;
+        printf("%-40s %5d samples  decoded %-4s %s\n", argv[i], t.length, decoded, ok ? "ok" : "FAIL");
+    }
+    printf("Decode rate: %d/%d\n", passed, argc);
+    return passed == argc ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+    static trace t;
+    const char *corpus_dir = NULL;
+    const int char_total = CODE39_CHAR_COUNT;
+    char decoded[CHAR_COUNT + 2];
+
+    if (argc > 2 && strcmp(argv[1], "-w") == 0) {
+        corpus_dir = argv[2];
+    } else if (argc > 1) {
+        return run_recorded(argc - 1, argv + 1);
+    }
+
+    int speed_count = sizeof(speeds) / sizeof(speeds[0]);
+    int noise_count = sizeof(noise_levels) / sizeof(noise_levels[0]);
+    int total_all = 0, passed_all = 0;
+    int noise_passed[sizeof(noise_levels) / sizeof(noise_levels[0])] = {0};
+    long long samples = 0;
+    double decode_time = 0.0;
+
+    printf("%-8s %-6s %-7s %s\n", "module", "noise", "orient", "decoded");
+    for (int s = 0; s < speed_count; s++) {
+        for (int n = 0; n < noise_count; n++) {
+            for (int r = 0; r < 2; r++) {
+                int passed = 0;
+                for (int c = 0; c < char_total; c++) {
+                    synthesise(&t, c, speeds[s], noise_levels[n], r);
+                    if (corpus_dir && !write_trace(corpus_dir, &t, c, speeds[s], noise_levels[n], r)) {
+                        return 1;
+                    }
+
+                    bool ok = replay(&t, decoded);
+                    passed += ok;
+
+                    // Time repeated replays separately from synthesis
+                    double start = now_s();
+                    for (int k = 0; k < REPEAT_RUNS; k++) {
+                        replay(&t, decoded);
+                    }
+                    decode_time += now_s() - start;
+                    samples += (long long)t.length * REPEAT_RUNS;
+                }
+                printf("%-8d %-6d %-7s %d/%d\n", speeds[s], noise_levels[n], r ? "reverse" : "forward", passed, char_total);
+                passed_all += passed;
+                total_all += char_total;
+                noise_passed[n] += passed;
+            }
+        }
+    }
+
+    printf("Decode rate: %d/%d (%.1f%%)\n", passed_all, total_all, 100.0 * passed_all / total_all);
+    printf("Throughput: %.2f Msamples/s (%lld samples in %.3f s)\n", samples / decode_time / 1e6, samples, decode_time);
+
+    int noise_total = speed_count * 2 * char_total;
+    bool below = false;
+    for (int n = 0; n < noise_count; n++) {
+        double percent = 100.0 * noise_passed[n] / noise_total;
+        bool ok = percent >= min_decode_percent[n];
+        printf("Noise %-3d %d/%d (%.1f%%, minimum %.1f%%) %s\n", noise_levels[n], noise_passed[n], noise_total, percent,
+               min_decode_percent[n], ok ? "ok" : "FAIL");
+        below |= !ok;
+    }
+    return below ? 1 : 0;
+}
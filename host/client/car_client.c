@@ -0,0 +1,305 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/tcp.h>
+#include "command_stream.h"
+#include "car_client.h"
+
+#define MAX_EVENTS 4
+
+double car_client_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Append to a CAR_STATS_HISTORY chart, dropping the oldest point when full
+static void history_push(uint16_t *history, uint8_t *count, uint16_t value) {
+    if (*count == CAR_STATS_HISTORY) {
+        memmove(history, history + 1, (CAR_STATS_HISTORY - 1) * sizeof(*history));
+        (*count)--;
+    }
+    history[(*count)++] = value;
+}
+
+void car_view_apply(car_view *view, const telemetry_frame *frame) {
+    switch (frame->type) {
+        case TELEMETRY_DRIVE:
+            view->drive = frame->u.drive;
+            view->have_drive = true;
+            break;
+        case TELEMETRY_SAMPLE:
+            view->sample = frame->u.sample;
+            view->sample_timestamp_us = frame->timestamp_us;
+            view->have_sample = true;
+            break;
+        case TELEMETRY_BATCH:
+            // Only the newest sample is shown; absent field groups keep their last value
+            if (frame->u.batch.count > 0) {
+                const telemetry_batch *batch = &frame->u.batch;
+                const telemetry_sample *s = &batch->samples[batch->count - 1];
+                if (batch->fields & TELEMETRY_FIELD_POSE) {
+                    view->sample.x_mm = s->x_mm;
+                    view->sample.y_mm = s->y_mm;
+                    view->sample.heading_mrad = s->heading_mrad;
+                }
+                if (batch->fields & TELEMETRY_FIELD_SPEED) {
+                    view->sample.left_speed_mm_s = s->left_speed_mm_s;
+                    view->sample.right_speed_mm_s = s->right_speed_mm_s;
+                }
+                if (batch->fields & TELEMETRY_FIELD_DUTY) {
+                    view->sample.left_duty = s->left_duty;
+                    view->sample.right_duty = s->right_duty;
+                }
+                if (batch->fields & TELEMETRY_FIELD_RANGE) {
+                    view->sample.distance_mm = s->distance_mm;
+                    view->sample.flags = s->flags;
+                }
+                view->sample_timestamp_us = frame->timestamp_us + (uint32_t)(batch->count - 1) * batch->period_us;
+                view->have_sample = true;
+            }
+            break;
+        case TELEMETRY_BARCODE:
+            memcpy(view->barcode, frame->u.barcode.chars, 3);
+            view->barcode[3] = '\0';
+            break;
+        case TELEMETRY_LOG:
+            memcpy(view->log, frame->u.log.text, frame->u.log.length + 1u);
+            view->log_level = frame->u.log.level;
+            break;
+        case TELEMETRY_PROFILE:
+            if (frame->u.profile.section < CAR_PROFILE_SECTIONS) {
+                view->profile[frame->u.profile.section] = frame->u.profile;
+                if (frame->u.profile.section >= view->profile_sections) {
+                    view->profile_sections = frame->u.profile.section + 1;
+                }
+            }
+            break;
+        case TELEMETRY_SYSTEM:
+            // The car sends it ahead of the report's task frames
+            view->system = frame->u.system;
+            view->stats_reports++;
+            history_push(view->busy_history, &view->busy_count, frame->u.system.busy_permille);
+            break;
+        case TELEMETRY_TASK:
+            if (frame->u.task.task < CAR_TASKS) {
+                car_task_view *task = &view->tasks[frame->u.task.task];
+                if (task->report && strncmp(task->stats.name, frame->u.task.name, TELEMETRY_TASK_NAME) != 0) {
+                    task->history_count = 0;    // Number reused by a new task
+                }
+                task->stats = frame->u.task;
+                task->report = view->stats_reports;
+                history_push(task->cpu_history, &task->history_count, frame->u.task.cpu_permille);
+            }
+            break;
+    }
+    view->updated = car_client_now();
+}
+
+static void client_frame(void *context, const telemetry_frame *frame) {
+    car_client *client = context;
+    car_view_apply(&client->view, frame);
+    if (client->on_frame) {
+        client->on_frame(client, frame, client->context);
+    }
+}
+
+void car_client_init(car_client *client, car_frame_fn on_frame, void *context) {
+    memset(client, 0, sizeof(*client));
+    client->epoll_fd = -1;
+    client->tcp_fd = -1;
+    client->udp_fd = -1;
+    client->on_frame = on_frame;
+    client->context = context;
+}
+
+static int resolve(const char *host, uint16_t port, struct sockaddr_in *address) {
+    struct addrinfo hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+    struct addrinfo *result;
+    int err = getaddrinfo(host, NULL, &hints, &result);
+    if (err != 0) {
+        fprintf(stderr, "%s: %s\n", host, gai_strerror(err));
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+    memcpy(address, result->ai_addr, sizeof(*address));
+    address->sin_port = htons(port);
+    freeaddrinfo(result);
+    return 0;
+}
+
+static int open_udp(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    // Not shared (SO_REUSEPORT): the car sends each datagram once, so clients
+    // sharing the port would each get only some of them. A second client on
+    // the host fails to bind instead.
+    struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY)};
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int car_client_open(car_client *client, const char *host, uint16_t tcp_port, uint16_t udp_port) {
+    car_client_close(client);
+    if (resolve(host, tcp_port, &client->address) < 0) {
+        return -1;
+    }
+
+    client->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    client->tcp_fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (client->epoll_fd < 0 || client->tcp_fd < 0) {
+        goto fail;
+    }
+    int one = 1;
+    setsockopt(client->tcp_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (connect(client->tcp_fd, (struct sockaddr *)&client->address, sizeof(client->address)) < 0 && errno != EINPROGRESS) {
+        goto fail;
+    }
+    client->state = CAR_CONNECTING;
+
+    // Writable once the connect has completed or failed
+    struct epoll_event event = {.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP, .data.fd = client->tcp_fd};
+    if (epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, client->tcp_fd, &event) < 0) {
+        goto fail;
+    }
+
+    if (udp_port) {
+        client->udp_fd = open_udp(udp_port);
+        event = (struct epoll_event){.events = EPOLLIN, .data.fd = client->udp_fd};
+        if (client->udp_fd < 0 || epoll_ctl(client->epoll_fd, EPOLL_CTL_ADD, client->udp_fd, &event) < 0) {
+            goto fail;
+        }
+    }
+
+    telemetry_rx_init(&client->tcp_rx, client_frame, client);
+    telemetry_rx_init(&client->udp_rx, client_frame, client);
+    return 0;
+
+fail:;
+    int saved = errno;
+    car_client_close(client);
+    errno = saved;
+    return -1;
+}
+
+int car_client_fd(const car_client *client) {
+    return client->epoll_fd;
+}
+
+static int handle_tcp(car_client *client, uint32_t events) {
+    if (client->state == CAR_CONNECTING && (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))) {
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(client->tcp_fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error != 0) {
+            errno = error;
+            return -1;
+        }
+        client->state = CAR_CONNECTED;
+
+        // Only wait for data from now on
+        struct epoll_event event = {.events = EPOLLIN | EPOLLRDHUP, .data.fd = client->tcp_fd};
+        epoll_ctl(client->epoll_fd, EPOLL_CTL_MOD, client->tcp_fd, &event);
+    }
+
+    if (events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+        uint8_t buffer[4096];
+        for (;;) {
+            ssize_t received = recv(client->tcp_fd, buffer, sizeof(buffer), 0);
+            if (received > 0) {
+                telemetry_rx_stream(&client->tcp_rx, buffer, (size_t)received);
+            } else if (received == 0) {
+                errno = ECONNRESET;
+                return -1;
+            } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            } else if (errno != EINTR) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void handle_udp(car_client *client) {
+    uint8_t buffer[TELEMETRY_MAX_FRAME];
+    struct sockaddr_in from;
+    socklen_t from_length = sizeof(from);
+    ssize_t received;
+
+    while ((received = recvfrom(client->udp_fd, buffer, sizeof(buffer), 0, (struct sockaddr *)&from, &from_length)) >= 0) {
+        // Other cars may stream to the same port
+        if (from.sin_addr.s_addr == client->address.sin_addr.s_addr) {
+            telemetry_rx_datagram(&client->udp_rx, buffer, (size_t)received);
+        }
+        from_length = sizeof(from);
+    }
+}
+
+int car_client_poll(car_client *client, int timeout_ms) {
+    struct epoll_event events[MAX_EVENTS];
+    if (client->state == CAR_CLOSED) {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    int count = epoll_wait(client->epoll_fd, events, MAX_EVENTS, timeout_ms);
+    if (count < 0) {
+        return errno == EINTR ? 0 : -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (events[i].data.fd == client->tcp_fd) {
+            if (handle_tcp(client, events[i].events) < 0) {
+                int saved = errno;
+                car_client_close(client);
+                errno = saved;
+                return -1;
+            }
+        } else if (events[i].data.fd == client->udp_fd) {
+            handle_udp(client);
+        }
+    }
+    return 0;
+}
+
+int car_client_send(car_client *client, const char *command) {
+    char line[COMMAND_MAX_LENGTH];
+    if (client->state != CAR_CONNECTED) {
+        errno = ENOTCONN;
+        return -1;
+    }
+    int length = snprintf(line, sizeof(line), "%s\n", command);
+    if (length < 0 || (size_t)length >= sizeof(line)) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    // Commands are short, a full socket buffer means the car stopped reading
+    return send(client->tcp_fd, line, (size_t)length, MSG_NOSIGNAL) == length ? 0 : -1;
+}
+
+void car_client_close(car_client *client) {
+    if (client->tcp_fd >= 0) {
+        close(client->tcp_fd);
+    }
+    if (client->udp_fd >= 0) {
+        close(client->udp_fd);
+    }
+    if (client->epoll_fd >= 0) {
+        close(client->epoll_fd);
+    }
+    client->tcp_fd = client->udp_fd = client->epoll_fd = -1;
+    client->state = CAR_CLOSED;
+}
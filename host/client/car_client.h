@@ -0,0 +1,102 @@
+#ifndef CAR_CLIENT_H
+#define CAR_CLIENT_H
+
+// POSIX client for one car: the TCP command/telemetry connection and the UDP
+// sample stream, multiplexed on one epoll instance.
+//
+// The client never blocks: car_client_open starts a non-blocking connect and
+// car_client_poll handles whatever is ready. The epoll descriptor from
+// car_client_fd can be added to the caller's own epoll set (or poll/select),
+// so a UI can wait on the car, its timers and the keyboard together and
+// refresh at its own rate instead of on every packet.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "telemetry_rx.h"
+
+#define CAR_TCP_PORT 4242       // buddy1 command server
+#define CAR_UDP_PORT 4243       // TELEMETRY_UDP_PORT, the car streams batches here
+#define CAR_PROFILE_SECTIONS 8  // PROFILE_MAX_SECTIONS on the car
+#define CAR_TASKS 32            // FreeRTOS task numbers tracked; the car numbers tasks from 1 as it creates them
+#define CAR_STATS_HISTORY 30    // Reports of CPU share kept for the charts
+
+// One task's run-time stats and its recent CPU share, oldest first
+typedef struct {
+    telemetry_task stats;
+    uint16_t cpu_history[CAR_STATS_HISTORY];
+    uint8_t history_count;
+    uint32_t report;                // Report it was last seen in, see car_view.stats_reports
+} car_task_view;
+
+// Latest known state of a car, built from its frames
+typedef struct {
+    telemetry_drive drive;          // Last drive command the car applied
+    telemetry_sample sample;        // Newest control loop sample
+    char barcode[4];                // Last decoded barcode
+    char log[TELEMETRY_LOG_MAX + 1];    // Last trace line
+    uint8_t log_level;              // trace_level of log
+    telemetry_profile profile[CAR_PROFILE_SECTIONS];    // Latest summary per section
+    uint8_t profile_sections;       // Highest section seen + 1
+    telemetry_system system;        // Latest kernel-wide run-time stats (project_rtos)
+    uint16_t busy_history[CAR_STATS_HISTORY];   // busy_permille per report, oldest first
+    uint8_t busy_count;
+    uint32_t stats_reports;         // TELEMETRY_SYSTEM frames seen; each opens a report
+    car_task_view tasks[CAR_TASKS]; // By task number
+    bool have_drive;
+    bool have_sample;
+    uint32_t sample_timestamp_us;   // Device time of sample
+    double updated;                 // Host CLOCK_MONOTONIC seconds of the last frame, 0 if none
+} car_view;
+
+void car_view_apply(car_view *view, const telemetry_frame *frame);
+
+typedef enum {
+    CAR_CLOSED = 0,
+    CAR_CONNECTING,
+    CAR_CONNECTED
+} car_client_state;
+
+typedef struct car_client car_client;
+
+// Called for every frame after the view has been updated
+typedef void (*car_frame_fn)(car_client *client, const telemetry_frame *frame, void *context);
+
+struct car_client {
+    int epoll_fd;
+    int tcp_fd;
+    int udp_fd;
+    struct sockaddr_in address;
+    car_client_state state;
+    telemetry_rx tcp_rx;
+    telemetry_rx udp_rx;
+    car_view view;
+    car_frame_fn on_frame;
+    void *context;
+};
+
+void car_client_init(car_client *client, car_frame_fn on_frame, void *context);
+
+// Start connecting to host (name or address). udp_port 0 skips the sample
+// stream; only one client per local host can bind the stream port, others
+// fail with EADDRINUSE and should pass 0 (and subscribe to TELEMETRY_BATCH
+// for samples over TCP). Returns 0, or -1 with errno set; the result of the
+// connect is seen through car_client_poll / client->state.
+int car_client_open(car_client *client, const char *host, uint16_t tcp_port, uint16_t udp_port);
+
+// Descriptor that becomes readable when car_client_poll has work
+int car_client_fd(const car_client *client);
+
+// Handle ready sockets, waiting up to timeout_ms (0 = do not wait, -1 =
+// forever). Returns 0, or -1 once the TCP connection failed or closed.
+int car_client_poll(car_client *client, int timeout_ms);
+
+// Send one text command, a newline is appended
+int car_client_send(car_client *client, const char *command);
+
+void car_client_close(car_client *client);
+
+// CLOCK_MONOTONIC in seconds, the time base of car_view.updated
+double car_client_now(void);
+
+#endif // CAR_CLIENT_H
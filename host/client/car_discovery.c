@@ -0,0 +1,117 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "car_client.h"
+#include "car_discovery.h"
+
+int car_discovery_open(car_discovery *discovery, uint16_t port, car_discovery_fn on_event, void *context) {
+    memset(discovery, 0, sizeof(*discovery));
+    discovery->on_event = on_event;
+    discovery->context = context;
+
+    discovery->fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (discovery->fd < 0) {
+        return -1;
+    }
+    // Every dashboard and aggregator on the host listens to the same broadcasts
+    int one = 1;
+    setsockopt(discovery->fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(discovery->fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY)};
+    if (bind(discovery->fd, (struct sockaddr *)&local, sizeof(local)) < 0) {
+        close(discovery->fd);
+        discovery->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+int car_discovery_fd(const car_discovery *discovery) {
+    return discovery->fd;
+}
+
+const car_entry *car_discovery_find(const car_discovery *discovery, uint64_t device_id) {
+    for (int i = 0; i < discovery->count; i++) {
+        if (discovery->cars[i].beacon.device_id == device_id) {
+            return &discovery->cars[i];
+        }
+    }
+    return NULL;
+}
+
+static void notify(car_discovery *discovery, const car_entry *car, car_event event) {
+    if (discovery->on_event) {
+        discovery->on_event(discovery->context, car, event);
+    }
+}
+
+static void update(car_discovery *discovery, const telemetry_frame *frame, double now) {
+    const telemetry_beacon *beacon = &frame->u.beacon;
+    car_entry *car = (car_entry *)car_discovery_find(discovery, beacon->device_id);
+    car_event event = CAR_CHANGED;
+
+    if (!car) {
+        if (discovery->count == CAR_DISCOVERY_MAX) {
+            return;
+        }
+        car = &discovery->cars[discovery->count++];
+        memset(car, 0, sizeof(*car));
+        car->first_seen = now;
+        event = CAR_FOUND;
+    } else {
+        uint16_t gap = (uint16_t)(frame->seq - car->last_seq - 1);
+        if (gap < 0x8000) {
+            car->missed += gap;
+        }
+    }
+
+    // Client count changes do not count as a change of the car
+    bool changed = event == CAR_FOUND || memcmp(car->beacon.ip, beacon->ip, 4) != 0 ||
+                   car->beacon.tcp_port != beacon->tcp_port || car->beacon.stream_port != beacon->stream_port ||
+                   car->beacon.version != beacon->version || car->beacon.capabilities != beacon->capabilities;
+    car->beacon = *beacon;
+    car->last_seen = now;
+    car->last_seq = frame->seq;
+    car->beacons++;
+    inet_ntop(AF_INET, beacon->ip, car->address, sizeof(car->address));
+    if (changed) {
+        notify(discovery, car, event);
+    }
+}
+
+void car_discovery_poll(car_discovery *discovery) {
+    uint8_t buffer[TELEMETRY_MAX_FRAME];
+    ssize_t received;
+    double now = car_client_now();
+
+    while ((received = recv(discovery->fd, buffer, sizeof(buffer), 0)) >= 0) {
+        telemetry_frame frame;
+        if (telemetry_decode(buffer, (size_t)received, &frame) <= 0 || frame.type != TELEMETRY_BEACON) {
+            discovery->invalid++;
+            continue;
+        }
+        update(discovery, &frame, now);
+    }
+}
+
+void car_discovery_expire(car_discovery *discovery, double now) {
+    for (int i = 0; i < discovery->count;) {
+        car_entry *car = &discovery->cars[i];
+        if (now - car->last_seen > CAR_DISCOVERY_TIMEOUT_S) {
+            notify(discovery, car, CAR_LOST);
+            *car = discovery->cars[--discovery->count];
+        } else {
+            i++;
+        }
+    }
+}
+
+void car_discovery_close(car_discovery *discovery) {
+    if (discovery->fd >= 0) {
+        close(discovery->fd);
+    }
+    discovery->fd = -1;
+    discovery->count = 0;
+}
@@ -0,0 +1,60 @@
+#ifndef CAR_DISCOVERY_H
+#define CAR_DISCOVERY_H
+
+// Listener for the cars' discovery beacons (TELEMETRY_BEACON broadcast to
+// TELEMETRY_DISCOVERY_PORT), keeping a live table of the cars on the network.
+//
+// The socket is non-blocking; add car_discovery_fd to an epoll set and call
+// car_discovery_poll when it is readable, and car_discovery_expire now and then
+// so cars that stopped announcing are dropped.
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <netinet/in.h>
+#include "telemetry.h"
+
+#define CAR_DISCOVERY_MAX 256
+#define CAR_DISCOVERY_TIMEOUT_S 3.5     // About three missed beacons
+
+typedef struct {
+    telemetry_beacon beacon;        // Latest announcement
+    char address[INET_ADDRSTRLEN];  // beacon.ip as text, for car_client_open
+    double first_seen;              // car_client_now() seconds
+    double last_seen;
+    uint32_t beacons;
+    uint32_t missed;                // Gaps in the beacon sequence numbers
+    uint16_t last_seq;
+} car_entry;
+
+typedef enum {
+    CAR_FOUND,
+    CAR_CHANGED,    // Address, ports or capabilities differ from the last beacon
+    CAR_LOST        // Timed out; the entry is removed after the callback
+} car_event;
+
+typedef void (*car_discovery_fn)(void *context, const car_entry *car, car_event event);
+
+typedef struct {
+    int fd;
+    car_entry cars[CAR_DISCOVERY_MAX];
+    int count;
+    uint32_t invalid;               // Datagrams on the port that were not beacons
+    car_discovery_fn on_event;
+    void *context;
+} car_discovery;
+
+// Bind the beacon port (shared with other listeners on the host). Returns 0 or -1 with errno.
+int car_discovery_open(car_discovery *discovery, uint16_t port, car_discovery_fn on_event, void *context);
+int car_discovery_fd(const car_discovery *discovery);
+
+// Read every pending beacon and update the table
+void car_discovery_poll(car_discovery *discovery);
+
+// Drop cars not heard from for CAR_DISCOVERY_TIMEOUT_S
+void car_discovery_expire(car_discovery *discovery, double now);
+
+const car_entry *car_discovery_find(const car_discovery *discovery, uint64_t device_id);
+
+void car_discovery_close(car_discovery *discovery);
+
+#endif // CAR_DISCOVERY_H
@@ -0,0 +1,63 @@
+#include <string.h>
+#include "fleet_stream.h"
+
+size_t fleet_record_encode(uint64_t device_id, const telemetry_frame *frame, uint8_t *buf, size_t cap) {
+    if (cap < FLEET_RECORD_HEADER) {
+        return 0;
+    }
+    size_t length = telemetry_encode(frame, buf + FLEET_RECORD_HEADER, cap - FLEET_RECORD_HEADER);
+    if (length == 0) {
+        return 0;
+    }
+    length += FLEET_RECORD_HEADER;
+    put_u16(buf, (uint16_t)length);
+    put_u32(buf + 2, (uint32_t)device_id);
+    put_u32(buf + 6, (uint32_t)(device_id >> 32));
+    return length;
+}
+
+void fleet_rx_init(fleet_rx *rx, fleet_record_fn on_record, void *context) {
+    memset(rx, 0, sizeof(*rx));
+    rx->on_record = on_record;
+    rx->context = context;
+}
+
+int fleet_rx_feed(fleet_rx *rx, const uint8_t *data, size_t len) {
+    while (len > 0) {
+        size_t chunk = sizeof(rx->buffer) - rx->length;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(rx->buffer + rx->length, data, chunk);
+        rx->length += chunk;
+        data += chunk;
+        len -= chunk;
+
+        size_t offset = 0;
+        while (rx->length - offset >= FLEET_RECORD_HEADER) {
+            const uint8_t *record = rx->buffer + offset;
+            size_t length = get_u16(record);
+            if (length < FLEET_RECORD_HEADER + TELEMETRY_OVERHEAD || length > FLEET_RECORD_MAX) {
+                return -1;
+            }
+            if (rx->length - offset < length) {
+                break;
+            }
+
+            telemetry_frame frame;
+            uint64_t device_id = get_u32(record + 2) | ((uint64_t)get_u32(record + 6) << 32);
+            if (telemetry_decode(record + FLEET_RECORD_HEADER, length - FLEET_RECORD_HEADER, &frame) > 0) {
+                rx->records++;
+                if (rx->on_record) {
+                    rx->on_record(rx->context, device_id, &frame);
+                }
+            } else {
+                rx->errors++;
+            }
+            offset += length;
+        }
+        memmove(rx->buffer, rx->buffer + offset, rx->length - offset);
+        rx->length -= offset;
+    }
+    return 0;
+}
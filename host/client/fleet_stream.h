@@ -0,0 +1,46 @@
+#ifndef FLEET_STREAM_H
+#define FLEET_STREAM_H
+
+// Record stream from the fleet aggregator to its subscribers (TCP,
+// FLEET_SUBSCRIBER_PORT). Each record is one telemetry frame of one car:
+//   offset  size  field
+//   0       2     record length including this header (little-endian)
+//   2       8     device ID of the car (little-endian)
+//   10      n     telemetry frame as encoded by telemetry_encode
+// Batches are always sent expanded (TELEMETRY_BATCH, never the delta form), so
+// a subscriber can start anywhere and skip records without losing its place.
+// A car's TELEMETRY_BEACON is sent when it connects and to new subscribers.
+//
+// A subscriber may send text lines: "car ID" (hex) to receive only the given
+// cars (repeatable), "all" to receive every car again, and "backlog N" for the
+// newest N samples of each car it receives, from the aggregator's rings.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry.h"
+
+#define FLEET_SUBSCRIBER_PORT 4250
+#define FLEET_RECORD_HEADER 10
+#define FLEET_RECORD_MAX (FLEET_RECORD_HEADER + TELEMETRY_MAX_FRAME)
+
+// Encode a record into buf, returns its length or 0 if it does not fit
+size_t fleet_record_encode(uint64_t device_id, const telemetry_frame *frame, uint8_t *buf, size_t cap);
+
+typedef void (*fleet_record_fn)(void *context, uint64_t device_id, const telemetry_frame *frame);
+
+typedef struct {
+    uint8_t buffer[4 * FLEET_RECORD_MAX];
+    size_t length;
+    uint64_t records;
+    uint32_t errors;            // Records whose frame did not decode (skipped)
+    fleet_record_fn on_record;
+    void *context;
+} fleet_rx;
+
+void fleet_rx_init(fleet_rx *rx, fleet_record_fn on_record, void *context);
+
+// Append stream bytes and pass every complete record to the callback. Returns
+// -1 if the stream is corrupt (bad record length); the connection should be dropped.
+int fleet_rx_feed(fleet_rx *rx, const uint8_t *data, size_t len);
+
+#endif // FLEET_STREAM_H
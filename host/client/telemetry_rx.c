@@ -0,0 +1,95 @@
+#include <string.h>
+#include "telemetry_rx.h"
+
+void telemetry_rx_init(telemetry_rx *rx, telemetry_rx_fn on_frame, void *context) {
+    memset(rx, 0, sizeof(*rx));
+    telemetry_delta_init(&rx->delta, 0);
+    rx->on_frame = on_frame;
+    rx->context = context;
+}
+
+static void deliver(telemetry_rx *rx, telemetry_frame *frame) {
+    if (frame->type == TELEMETRY_BATCH || frame->type == TELEMETRY_BATCH_DELTA) {
+        int count = telemetry_delta_decode(&rx->delta, frame, frame);
+        if (count == TELEMETRY_ERR_REFERENCE) {
+            rx->stats.reference_drops++;
+            return;
+        }
+        if (count < 0) {
+            rx->stats.decode_errors++;
+            return;
+        }
+
+        // Sample numbers wrap, so compare by difference
+        const telemetry_batch *batch = &frame->u.batch;
+        int32_t gap = (int32_t)(batch->first_sample - rx->next_sample);
+        if (rx->have_sample && gap > 0) {
+            rx->stats.lost_samples += (uint32_t)gap;
+        }
+        rx->next_sample = batch->first_sample + batch->count;
+        rx->have_sample = true;
+        rx->stats.samples += batch->count;
+    } else if (frame->type == TELEMETRY_SAMPLE) {
+        rx->stats.samples++;
+    }
+
+    rx->stats.frames++;
+    if (rx->on_frame) {
+        rx->on_frame(rx->context, frame);
+    }
+}
+
+// Decode the frames at the start of data, returns the bytes consumed
+static size_t decode_frames(telemetry_rx *rx, const uint8_t *data, size_t len) {
+    size_t offset = 0;
+    while (offset < len) {
+        telemetry_frame frame;
+        int result = telemetry_decode(data + offset, len - offset, &frame);
+        if (result == TELEMETRY_NEED_MORE) {
+            break;
+        } else if (result == TELEMETRY_ERR_VERSION) {
+            // The header is the same in every version: skip the frame, not a byte at a time
+            size_t length = data[offset + 2] | (size_t)data[offset + 3] << 8;
+            if (length < TELEMETRY_OVERHEAD || length > TELEMETRY_MAX_FRAME) {
+                length = 1;
+            } else if (length > len - offset) {
+                break;
+            }
+            rx->stats.version_errors++;
+            rx->stats.other_version = data[offset + 1];
+            offset += length;
+        } else if (result < 0) {
+            rx->stats.decode_errors++;
+            offset++;  // Resynchronise on the next magic byte
+        } else {
+            deliver(rx, &frame);
+            offset += (size_t)result;
+        }
+    }
+    return offset;
+}
+
+void telemetry_rx_stream(telemetry_rx *rx, const uint8_t *data, size_t len) {
+    rx->stats.bytes += len;
+    while (len > 0) {
+        size_t chunk = sizeof(rx->buffer) - rx->length;
+        if (chunk > len) {
+            chunk = len;
+        }
+        memcpy(rx->buffer + rx->length, data, chunk);
+        rx->length += chunk;
+        data += chunk;
+        len -= chunk;
+
+        size_t used = decode_frames(rx, rx->buffer, rx->length);
+        memmove(rx->buffer, rx->buffer + used, rx->length - used);
+        rx->length -= used;
+    }
+}
+
+void telemetry_rx_datagram(telemetry_rx *rx, const uint8_t *data, size_t len) {
+    rx->stats.bytes += len;
+    if (decode_frames(rx, data, len) < len) {
+        rx->stats.decode_errors++;
+    }
+}
@@ -0,0 +1,51 @@
+#ifndef TELEMETRY_RX_H
+#define TELEMETRY_RX_H
+
+// Receive side of the telemetry protocol, independent of any socket.
+//
+// Feed it TCP bytes as they arrive (frames may be split or merged) or whole
+// UDP datagrams. Every decoded frame is passed to the callback, with
+// TELEMETRY_BATCH_DELTA already expanded to TELEMETRY_BATCH, and sample
+// numbers of batches are tracked to count lost samples. Keep one telemetry_rx
+// per transport: the TCP and UDP batches of a car are numbered separately.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry.h"
+#include "telemetry_delta.h"
+
+#define TELEMETRY_RX_BUFFER 4096
+
+typedef void (*telemetry_rx_fn)(void *context, const telemetry_frame *frame);
+
+typedef struct {
+    uint64_t bytes;
+    uint32_t frames;            // Frames passed to the callback
+    uint32_t samples;           // Samples in those frames (1 per TELEMETRY_SAMPLE)
+    uint32_t lost_samples;      // Gaps in batch sample numbers
+    uint32_t decode_errors;     // Bad magic, CRC or length, resynchronised by skipping bytes
+    uint32_t reference_drops;   // Delta frames dropped while waiting for a keyframe
+    uint32_t version_errors;    // Frames of another TELEMETRY_VERSION, skipped whole
+    uint8_t other_version;      // Version of the last of those
+} telemetry_rx_stats;
+
+typedef struct {
+    uint8_t buffer[TELEMETRY_RX_BUFFER];    // Partial TCP frame kept between reads
+    size_t length;
+    telemetry_delta_state delta;
+    uint32_t next_sample;
+    bool have_sample;
+    telemetry_rx_stats stats;
+    telemetry_rx_fn on_frame;
+    void *context;
+} telemetry_rx;
+
+void telemetry_rx_init(telemetry_rx *rx, telemetry_rx_fn on_frame, void *context);
+
+// Append TCP stream bytes and decode every complete frame
+void telemetry_rx_stream(telemetry_rx *rx, const uint8_t *data, size_t len);
+
+// Decode the frames of one datagram; a partial frame at the end is dropped
+void telemetry_rx_datagram(telemetry_rx *rx, const uint8_t *data, size_t len);
+
+#endif // TELEMETRY_RX_H
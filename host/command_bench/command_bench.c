@@ -0,0 +1,143 @@
+// Benchmark for the remote command parser.
+//
+// Parses a fixed mix of commands many times with each front-end and reports
+// the mean and worst-case time per command. The "legacy" column is the
+// strstr/sscanf parser buddy1 used before the command table, kept here for
+// comparison.
+//
+// Usage: command_bench [iterations]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "command.h"
+
+#define DEFAULT_ITERATIONS 200000
+
+static const char *const corpus[] = {
+    "Forward 50",
+    "Forward Left 50",
+    "Backward Right 30",
+    "Left 20",
+    "Stop Movement",
+    "Stop Turning",
+    "SPEED 40",
+    "HEADING -90",
+    "DISTANCE 120",
+    "PID MOTOR 3.0 0.05 0.01",
+};
+
+#define CORPUS_SIZE (sizeof(corpus) / sizeof(corpus[0]))
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// The parser buddy1 used before the command table
+static void legacy_parse(const char *received_data, telemetry_drive *drive) {
+    int speed = 0;
+
+    if (strstr(received_data, "Forward")) {
+        drive->move = DRIVE_MOVE_FORWARD;
+    } else if (strstr(received_data, "Backward")) {
+        drive->move = DRIVE_MOVE_BACKWARD;
+    } else if (strstr(received_data, "Stop Movement")) {
+        drive->move = DRIVE_MOVE_STOP;
+    } else {
+        drive->move = DRIVE_MOVE_NONE;
+    }
+
+    if (strstr(received_data, "Left")) {
+        drive->turn = DRIVE_TURN_LEFT;
+    } else if (strstr(received_data, "Right")) {
+        drive->turn = DRIVE_TURN_RIGHT;
+    } else if (strstr(received_data, "Stop Turning")) {
+        drive->turn = DRIVE_TURN_STOP;
+    } else {
+        drive->turn = DRIVE_TURN_NONE;
+    }
+
+    if (sscanf(received_data, "%*[^0-9]%d", &speed) != 1) {
+        speed = 0;
+    }
+    drive->speed = (int16_t)speed;
+}
+
+typedef struct {
+    const char *name;
+    uint64_t total_ns;
+    uint64_t worst_ns;
+    long count;
+    long errors;
+} result;
+
+static void record(result *r, uint64_t elapsed, int status) {
+    r->total_ns += elapsed;
+    if (elapsed > r->worst_ns) {
+        r->worst_ns = elapsed;
+    }
+    r->count++;
+    r->errors += status != COMMAND_OK;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+    uint8_t binary[CORPUS_SIZE][32];
+    size_t binary_length[CORPUS_SIZE];
+    size_t text_length[CORPUS_SIZE];
+    volatile uint8_t sink = 0;
+    command cmd;
+
+    // Build the binary corpus from the text one so both describe the same commands
+    for (size_t i = 0; i < CORPUS_SIZE; i++) {
+        text_length[i] = strlen(corpus[i]);
+        if (command_parse_text(corpus[i], text_length[i], &cmd) != COMMAND_OK) {
+            fprintf(stderr, "corpus entry does not parse: %s\n", corpus[i]);
+            return 1;
+        }
+        binary_length[i] = command_encode_binary(&cmd, binary[i], sizeof(binary[i]));
+    }
+
+    result results[] = {{.name = "legacy"}, {.name = "text"}, {.name = "binary"}};
+
+    // Time each command individually (batched 16x to stay above clock resolution)
+    for (long it = 0; it < iterations; it++) {
+        for (size_t i = 0; i < CORPUS_SIZE; i++) {
+            telemetry_drive drive;
+            uint64_t start = now_ns();
+            for (int k = 0; k < 16; k++) {
+                legacy_parse(corpus[i], &drive);
+                sink ^= drive.move;
+            }
+            record(&results[0], (now_ns() - start) / 16, COMMAND_OK);
+
+            int status = COMMAND_OK;
+            start = now_ns();
+            for (int k = 0; k < 16; k++) {
+                status = command_parse_text(corpus[i], text_length[i], &cmd);
+                sink ^= cmd.opcode;
+            }
+            record(&results[1], (now_ns() - start) / 16, status);
+
+            start = now_ns();
+            for (int k = 0; k < 16; k++) {
+                status = command_parse_binary(binary[i], binary_length[i], &cmd);
+                sink ^= cmd.opcode;
+            }
+            record(&results[2], (now_ns() - start) / 16, status);
+        }
+    }
+
+    // One line per front-end, easy to grep or paste into a spreadsheet
+    printf("%-8s %12s %12s %10s %8s\n", "parser", "mean_ns", "worst_ns", "commands", "errors");
+    for (size_t r = 0; r < sizeof(results) / sizeof(results[0]); r++) {
+        printf("%-8s %12.1f %12llu %10ld %8ld\n", results[r].name,
+               (double)results[r].total_ns / results[r].count,
+               (unsigned long long)results[r].worst_ns, results[r].count * 16, results[r].errors);
+    }
+    (void)sink;
+    return 0;
+}
@@ -0,0 +1,71 @@
+// Regression check of the switch from text to binary commands.
+//
+// A command stream switched to binary by "BINARY\r\n" or "BINARY\n" (the way
+// buddy1 does) must read the length-prefixed command after it, both when the
+// stream arrives whole and when it arrives one byte at a time. Prints one
+// line per failed stream and the program exits non-zero if any failed.
+//
+// Usage: command_stream_test
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "command.h"
+#include "command_stream.h"
+
+typedef struct {
+    command_stream stream;
+    char last[COMMAND_MAX_LENGTH + 1];
+} framing_check;
+
+// Same switch as buddy1's CMD_BINARY: everything after the line is binary
+static void framing_handler(void *context, const char *text, size_t length) {
+    framing_check *check = context;
+    command cmd;
+    if (check->stream.framing == COMMAND_FRAMING_NEWLINE && command_parse_text(text, length, &cmd) == COMMAND_OK &&
+        cmd.opcode == CMD_BINARY) {
+        check->stream.framing = COMMAND_FRAMING_LENGTH;
+    }
+    memcpy(check->last, text, length + 1);
+}
+
+// Feed data in chunks of chunk bytes; true if "abc" came out as the second command
+static bool check_binary_switch(const char *data, size_t length, size_t chunk) {
+    framing_check check = {0};
+    command_stream_init(&check.stream, COMMAND_FRAMING_NEWLINE);
+    for (size_t i = 0; i < length; i += chunk) {
+        command_stream_push(&check.stream, data + i, length - i < chunk ? length - i : chunk);
+        command_stream_dispatch(&check.stream, framing_handler, &check);
+    }
+    return check.stream.dispatched == 2 && check.stream.oversized == 0 && strcmp(check.last, "abc") == 0;
+}
+
+#define SWITCH(name, text) {name, text, sizeof(text) - 1}     // The length prefix holds a NUL
+
+static const struct {
+    const char *name;
+    const char *data;
+    size_t length;
+} switches[] = {
+    SWITCH("CRLF", "BINARY\r\n\x03\x00" "abc"),
+    SWITCH("LF", "BINARY\n\x03\x00" "abc"),
+};
+
+#define SWITCH_COUNT (sizeof(switches) / sizeof(switches[0]))
+
+int main(void) {
+    int failed = 0;
+    for (size_t i = 0; i < SWITCH_COUNT; i++) {
+        size_t length = switches[i].length;
+        if (!check_binary_switch(switches[i].data, length, length)) {
+            printf("%-5s %-12s FAILED\n", switches[i].name, "whole");
+            failed++;
+        }
+        if (!check_binary_switch(switches[i].data, length, 1)) {
+            printf("%-5s %-12s FAILED\n", switches[i].name, "byte-by-byte");
+            failed++;
+        }
+    }
+    printf("%d of %zu streams failed\n", failed, SWITCH_COUNT * 2);
+    return failed ? 1 : 0;
+}
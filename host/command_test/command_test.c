@@ -0,0 +1,56 @@
+// Checks of the remote command front-ends.
+//
+// Each case parses one command and compares the status with the expected one,
+// so the text and binary front-ends keep accepting and rejecting the same
+// parameters. Prints one line per failed case and the program exits non-zero
+// if any failed.
+//
+// Usage: command_test
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "command.h"
+
+typedef struct {
+    const char *name;
+    const char *data;
+    size_t length;
+    bool binary;
+    int expected;
+} parse_case;
+
+#define TEXT(name, text, expected) {name, text, sizeof(text) - 1, false, expected}
+#define BINARY(name, bytes, expected) {name, bytes, sizeof(bytes) - 1, true, expected}
+
+static const parse_case cases[] = {
+    TEXT("text drive", "Forward Left 50", COMMAND_OK),
+    TEXT("text drive full speed", "Backward 100", COMMAND_OK),
+    TEXT("text drive too fast", "Forward 101", COMMAND_ERR_RANGE),
+    TEXT("text drive too fast back", "Backward -101", COMMAND_ERR_RANGE),
+    // u8 opcode, u8 move, u8 turn, i16 speed (little-endian)
+    BINARY("binary drive", "\x01\x01\x01\x32\x00", COMMAND_OK),
+    BINARY("binary drive full speed", "\x01\x02\x00\x9c\xff", COMMAND_OK),
+    BINARY("binary drive too fast", "\x01\x01\x00\x65\x00", COMMAND_ERR_RANGE),
+    BINARY("binary drive too fast back", "\x01\x02\x00\x9b\xff", COMMAND_ERR_RANGE),
+    BINARY("binary drive bad move", "\x01\x09\x00\x32\x00", COMMAND_ERR_RANGE),
+    BINARY("binary drive short", "\x01\x01\x00\x32", COMMAND_ERR_ARGS),
+};
+
+#define CASE_COUNT (sizeof(cases) / sizeof(cases[0]))
+
+int main(void) {
+    int failed = 0;
+    for (size_t i = 0; i < CASE_COUNT; i++) {
+        const parse_case *c = &cases[i];
+        command cmd;
+        int status = c->binary ? command_parse_binary((const uint8_t *)c->data, c->length, &cmd)
+                               : command_parse_text(c->data, c->length, &cmd);
+        if (status != c->expected) {
+            printf("%-28s FAILED: status %d, expected %d\n", c->name, status, c->expected);
+            failed++;
+        }
+    }
+    printf("%d of %zu cases failed\n", failed, CASE_COUNT);
+    return failed ? 1 : 0;
+}
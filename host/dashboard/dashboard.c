@@ -0,0 +1,469 @@
+// Terminal dashboard for one car, the Linux counterpart of interface.c.
+//
+// Network I/O, the keyboard and a refresh timer share one epoll loop. Frames
+// only update the car_view; the screen is redrawn from it at a fixed rate, so
+// a burst of packets costs no extra rendering and a quiet link still shows how
+// old the data is. The connection is retried every RECONNECT_S while down.
+//
+// Without HOST the car is found from its discovery beacon: the first car
+// announced (or the one given with -c) is connected, and if it comes back with
+// a new address the dashboard follows it.
+//
+// Usage:
+//   dashboard [-r HZ] [-H] [-n] [-c ID | -l] [HOST [TCP_PORT]]
+//     -r HZ   refresh rate (default 10, or 1 in headless mode)
+//     -H      headless: print one status line per refresh instead of drawing
+//     -n      do not listen for the UDP sample stream
+//     -c ID   connect to the discovered car with this device ID (hex)
+//     -l      only list the discovered cars
+// Keys: q quits; w/a/s/d drive, space stops, l follows the line (sent as text
+// commands). A drive key stays in effect and is resent every DRIVE_RESEND_S
+// until space, l or another drive key, so the car's dead-man watchdog does not
+// stop it between terminal key repeats.
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <termios.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "car_client.h"
+#include "car_discovery.h"
+
+#define DEFAULT_REFRESH_HZ 10
+#define HEADLESS_REFRESH_HZ 1
+#define RECONNECT_S 2.0
+#define DRIVE_SPEED 40
+#define DRIVE_RESEND_S 0.2          // Well inside the car's REMOTE_WATCHDOG_US (500 ms)
+
+static volatile sig_atomic_t quit = 0;
+static struct termios saved_termios;
+static bool raw_terminal = false;
+
+static void on_signal(int signal) {
+    (void)signal;
+    quit = 1;
+}
+
+static void restore_terminal(void) {
+    if (raw_terminal) {
+        tcsetattr(STDIN_FILENO, TCSANOW, &saved_termios);
+        printf("\033[?25h\n");  // Show the cursor again
+        raw_terminal = false;
+    }
+}
+
+// Keys without Enter and without echo, so single keypresses drive the car
+static void raw_mode(void) {
+    struct termios raw;
+    if (!isatty(STDIN_FILENO) || tcgetattr(STDIN_FILENO, &saved_termios) < 0) {
+        return;
+    }
+    raw = saved_termios;
+    raw.c_lflag &= ~(tcflag_t)(ICANON | ECHO);
+    raw.c_cc[VMIN] = 0;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSANOW, &raw);
+    raw_terminal = true;
+    atexit(restore_terminal);
+    printf("\033[?25l\033[2J");  // Hide the cursor, clear once
+}
+
+typedef struct {
+    const char *host;
+    char discovered_host[INET_ADDRSTRLEN];
+    uint16_t tcp_port;
+    uint16_t udp_port;
+    bool headless;
+    bool discover;              // No HOST given: take it from the beacons
+    bool list_only;
+    bool want_stream;
+    uint64_t car_id;            // Car to follow, 0 = the first one found
+    uint16_t car_version;
+    car_discovery discovery;
+    car_client client;
+    double next_connect;
+    uint32_t last_samples;      // For the sample rate between refreshes
+    double last_refresh;
+    double refresh_s;           // Redraw period; the timer may tick faster to resend drive commands
+    char drive_command[32];     // Held drive key's command, "" when none
+    double drive_sent;
+} dashboard;
+
+static uint32_t total_samples(const car_client *client) {
+    return client->tcp_rx.stats.samples + client->udp_rx.stats.samples;
+}
+
+static const char *state_name(car_client_state state) {
+    switch (state) {
+        case CAR_CONNECTED: return "connected";
+        case CAR_CONNECTING: return "connecting";
+        default: return "disconnected";
+    }
+}
+
+// The live car table of -l
+static void render_cars(dashboard *d, double now) {
+    // No escape codes in headless output
+    const char *eol = d->headless ? "" : "\033[K";
+    if (!d->headless) {
+        printf("\033[H");
+    }
+    printf("%-16s %-15s %5s %5s %-7s %-6s %7s %6s %6s%s\n", "car", "address", "tcp", "udp", "version",
+           "caps", "clients", "missed", "age_s", eol);
+    for (int i = 0; i < d->discovery.count; i++) {
+        const car_entry *car = &d->discovery.cars[i];
+        const telemetry_beacon *b = &car->beacon;
+        printf("%016llx %-15s %5u %5u %3u.%-3u 0x%04x %3u/%-3u %6u %6.1f%s\n", (unsigned long long)b->device_id,
+               car->address, b->tcp_port, b->stream_port, b->version >> 8, b->version & 0xFF, b->capabilities,
+               b->clients, b->max_clients, car->missed, now - car->last_seen, eol);
+    }
+    if (d->headless) {
+        printf("\n");
+    } else {
+        printf("\033[K\nq quit\033[J");
+    }
+    fflush(stdout);
+}
+
+// One character per report, taller for a larger share of the CPU
+static void sparkline(const uint16_t *history, int count, char *out) {
+    static const char levels[] = " .:-=+*#%@";
+    for (int i = 0; i < count; i++) {
+        int level = (history[i] * (int)(sizeof(levels) - 2) + 500) / 1000;
+        out[i] = levels[level < (int)sizeof(levels) - 2 ? level : (int)sizeof(levels) - 2];
+    }
+    out[count] = '\0';
+}
+
+// Run-time stats of project_rtos: the tasks of the latest report, then the queues
+static void render_tasks(const car_view *v) {
+    char chart[CAR_STATS_HISTORY + 1];
+    const telemetry_system *sys = &v->system;
+
+    sparkline(v->busy_history, v->busy_count, chart);
+    printf("CPU %5.1f%% busy |%-*s| heap %u B free, %u lowest\033[K\n", sys->busy_permille / 10.0,
+           CAR_STATS_HISTORY, chart, sys->heap_free, sys->heap_min);
+    if (sys->cores > 1) {
+        printf("Cores:");
+        for (int i = 0; i < sys->cores; i++) {
+            printf(" %d %.1f%%", i, sys->core_busy_permille[i] / 10.0);
+        }
+        printf("\033[K\n");
+    }
+    printf("%-12s %3s %6s %-*s %6s\033[K\n", "Task", "pri", "cpu%", CAR_STATS_HISTORY + 2, "", "stack");
+    for (int i = 0; i < CAR_TASKS; i++) {
+        const car_task_view *t = &v->tasks[i];
+        if (t->report != v->stats_reports) {
+            continue;   // Not in the latest report: deleted, or never seen
+        }
+        sparkline(t->cpu_history, t->history_count, chart);
+        printf("%-12.12s %3u %6.1f |%-*s| %6u\033[K\n", t->stats.name, t->stats.priority,
+               t->stats.cpu_permille / 10.0, CAR_STATS_HISTORY, chart, t->stats.stack_free);
+    }
+    printf("Queues:");
+    for (int i = 0; i < sys->queue_count; i++) {
+        printf(" %.8s %u/%u", sys->queues[i].name, sys->queues[i].level, sys->queues[i].capacity);
+    }
+    printf("\033[K\n\033[K\n");
+}
+
+static void render(dashboard *d, double now) {
+    const car_client *c = &d->client;
+    const car_view *v = &c->view;
+    const telemetry_sample *s = &v->sample;
+    char direction[40] = "-";
+    double elapsed = now - d->last_refresh;
+    uint32_t samples = total_samples(c);
+    double rate = elapsed > 0 ? (samples - d->last_samples) / elapsed : 0;
+    double age = v->updated > 0 ? now - v->updated : -1;
+
+    d->last_samples = samples;
+    d->last_refresh = now;
+    if (v->have_drive) {
+        telemetry_drive_direction(&v->drive, direction, sizeof(direction));
+    }
+
+    if (d->list_only) {
+        render_cars(d, now);
+        return;
+    }
+    if (!d->host) {
+        if (d->headless) {
+            printf("%.3f waiting for a car beacon on port %u\n", now, TELEMETRY_DISCOVERY_PORT);
+        } else {
+            printf("\033[HWaiting for a car beacon on UDP port %u...\033[K\033[J", TELEMETRY_DISCOVERY_PORT);
+        }
+        fflush(stdout);
+        return;
+    }
+
+    if (d->headless) {
+        printf("%.3f %s:%u %s dir=\"%s\" speed=%d dist_cm=%.1f left_cm_s=%.1f right_cm_s=%.1f "
+               "x_mm=%d y_mm=%d heading_mrad=%d barcode=%s samples_s=%.0f lost=%u errors=%u cpu_busy=%.1f age_s=%.2f\n",
+               now, d->host, d->tcp_port, state_name(c->state), direction, v->drive.speed,
+               s->distance_mm / 10.0, s->left_speed_mm_s / 10.0, s->right_speed_mm_s / 10.0,
+               s->x_mm, s->y_mm, s->heading_mrad, v->barcode[0] ? v->barcode : "-", rate,
+               c->udp_rx.stats.lost_samples + c->tcp_rx.stats.lost_samples,
+               c->udp_rx.stats.decode_errors + c->tcp_rx.stats.decode_errors, v->system.busy_permille / 10.0, age);
+        fflush(stdout);
+        return;
+    }
+
+    // Redraw in place: home the cursor and clear each line's tail, no full clear
+    printf("\033[H");
+    printf("Robotic Car Dashboard  %s:%u  %s\033[K\n", d->host, d->tcp_port, state_name(c->state));
+    if (d->car_id) {
+        printf("Car %016llx, firmware %u.%u\033[K\n", (unsigned long long)d->car_id,
+               d->car_version >> 8, d->car_version & 0xFF);
+    }
+    printf("\033[K\n");
+    printf("Direction: %s\033[K\n", direction);
+    printf("Speed: %d\033[K\n", v->drive.speed);
+    printf("Distance: %.1f cm%s\033[K\n", s->distance_mm / 10.0,
+           (s->flags & TELEMETRY_FLAG_OBSTACLE) ? "  OBSTACLE" : "");
+    printf("Wheels: L %.1f cm/s, R %.1f cm/s\033[K\n", s->left_speed_mm_s / 10.0, s->right_speed_mm_s / 10.0);
+    printf("Duty: L %.1f%%, R %.1f%%\033[K\n", s->left_duty / 100.0, s->right_duty / 100.0);
+    printf("Pose: x %d mm, y %d mm, heading %.1f deg\033[K\n", s->x_mm, s->y_mm, s->heading_mrad * 0.0572958);
+    printf("Barcode: %s\033[K\n", v->barcode);
+    printf("Log: %c %s\033[K\n\033[K\n", "-EWID"[v->log_level <= 4 ? v->log_level : 0], v->log);
+    if (v->profile_sections) {
+        printf("%-12s %9s %9s %9s %9s %9s\033[K\n", "Section (us)", "runs", "mean", "p50", "p99", "max");
+        for (int i = 0; i < v->profile_sections; i++) {
+            const telemetry_profile *p = &v->profile[i];
+            printf("%-12.12s %9u %9.1f %9.1f %9.1f %9.1f\033[K\n", p->name, p->count, p->mean_ns / 1e3,
+                   p->p50_ns / 1e3, p->p99_ns / 1e3, p->max_ns / 1e3);
+        }
+        printf("\033[K\n");
+    }
+    if (v->stats_reports) {
+        render_tasks(v);
+    }
+    printf("Samples: %.0f/s, %u lost, %u waiting for keyframe\033[K\n", rate,
+           c->udp_rx.stats.lost_samples + c->tcp_rx.stats.lost_samples, c->udp_rx.stats.reference_drops);
+    printf("Frames: TCP %u, UDP %u, %u decode errors\033[K\n", c->tcp_rx.stats.frames, c->udp_rx.stats.frames,
+           c->udp_rx.stats.decode_errors + c->tcp_rx.stats.decode_errors);
+    if (c->tcp_rx.stats.version_errors + c->udp_rx.stats.version_errors) {
+        uint8_t version = c->tcp_rx.stats.other_version ? c->tcp_rx.stats.other_version : c->udp_rx.stats.other_version;
+        printf("Car sends telemetry version %u, this dashboard reads %u: %u frames skipped\033[K\n", version,
+               TELEMETRY_VERSION, c->tcp_rx.stats.version_errors + c->udp_rx.stats.version_errors);
+    }
+    if (age >= 0) {
+        printf("Last frame: %.1f s ago\033[K\n", age);
+    } else {
+        printf("Last frame: none\033[K\n");
+    }
+    printf("\033[K\nw/a/s/d drive, space stop, l follow line, p profile, q quit\033[J");
+    fflush(stdout);
+}
+
+static void handle_key(dashboard *d, char key, double now) {
+    char command[32];
+    bool drive = false;
+    switch (key) {
+        case 'q': quit = 1; return;
+        case 'w': snprintf(command, sizeof(command), "Forward %d", DRIVE_SPEED); drive = true; break;
+        case 's': snprintf(command, sizeof(command), "Backward %d", DRIVE_SPEED); drive = true; break;
+        case 'a': snprintf(command, sizeof(command), "Left %d", DRIVE_SPEED); drive = true; break;
+        case 'd': snprintf(command, sizeof(command), "Right %d", DRIVE_SPEED); drive = true; break;
+        case ' ': snprintf(command, sizeof(command), "Stop Movement"); d->drive_command[0] = '\0'; break;
+        case 'p': snprintf(command, sizeof(command), "PROFILE 0"); break;
+        case 'l': snprintf(command, sizeof(command), "LINE"); d->drive_command[0] = '\0'; break;
+        default: return;
+    }
+    if (drive) {
+        snprintf(d->drive_command, sizeof(d->drive_command), "%s", command);
+        d->drive_sent = now;
+    }
+    car_client_send(&d->client, command);
+}
+
+// Keep the held drive command alive on the car
+static void resend_drive(dashboard *d, double now) {
+    if (d->drive_command[0] == '\0') {
+        return;
+    }
+    if (d->client.state != CAR_CONNECTED) {
+        d->drive_command[0] = '\0';    // Do not drive off again after a reconnect
+        return;
+    }
+    if (now - d->drive_sent >= DRIVE_RESEND_S * 0.9) {    // Not a whole tick late on timer jitter
+        car_client_send(&d->client, d->drive_command);
+        d->drive_sent = now;
+    }
+}
+
+static void try_connect(dashboard *d, int epoll_fd, double now) {
+    d->next_connect = now + RECONNECT_S;
+    if (!d->host || d->list_only) {
+        return;
+    }
+    if (car_client_open(&d->client, d->host, d->tcp_port, d->udp_port) < 0) {
+        if (d->headless) {
+            fprintf(stderr, "connect %s:%u: %s\n", d->host, d->tcp_port, strerror(errno));
+        }
+        return;
+    }
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = car_client_fd(&d->client)};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event);
+}
+
+// Follow the chosen car's beacons: connect when it appears or moves
+static void on_car(void *context, const car_entry *car, car_event event) {
+    dashboard *d = context;
+    if (event == CAR_LOST || d->list_only || (d->car_id && car->beacon.device_id != d->car_id)) {
+        return;
+    }
+    if (d->host && car->beacon.device_id != d->car_id) {
+        return;     // Already following another car
+    }
+
+    bool moved = !d->host || strcmp(d->discovered_host, car->address) != 0 ||
+                 d->tcp_port != car->beacon.tcp_port;
+    d->car_id = car->beacon.device_id;
+    d->car_version = car->beacon.version;
+    snprintf(d->discovered_host, sizeof(d->discovered_host), "%s", car->address);
+    d->host = d->discovered_host;
+    d->tcp_port = car->beacon.tcp_port;
+    if (d->want_stream) {
+        d->udp_port = car->beacon.stream_port;
+    }
+    if (moved) {
+        // Reconnect on the next timer tick
+        car_client_close(&d->client);
+        d->next_connect = 0;
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: dashboard [-r HZ] [-H] [-n] [-c ID | -l] [HOST [TCP_PORT]]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    static dashboard d;
+    double refresh_hz = 0;
+    int opt;
+
+    d.udp_port = CAR_UDP_PORT;
+    d.want_stream = true;
+    while ((opt = getopt(argc, argv, "r:Hnc:l")) != -1) {
+        switch (opt) {
+            case 'r': refresh_hz = atof(optarg); break;
+            case 'H': d.headless = true; break;
+            case 'n': d.udp_port = 0; d.want_stream = false; break;
+            case 'c': d.car_id = strtoull(optarg, NULL, 16); break;
+            case 'l': d.list_only = true; break;
+            default: usage();
+        }
+    }
+    if (optind < argc) {
+        d.host = argv[optind];
+        d.tcp_port = optind + 1 < argc ? (uint16_t)atoi(argv[optind + 1]) : CAR_TCP_PORT;
+    } else {
+        d.discover = true;
+    }
+    if (refresh_hz <= 0) {
+        refresh_hz = d.headless ? HEADLESS_REFRESH_HZ : DEFAULT_REFRESH_HZ;
+    }
+
+    struct sigaction action = {.sa_handler = on_signal};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (epoll_fd < 0 || timer_fd < 0) {
+        perror("epoll/timerfd");
+        return 1;
+    }
+    // Interactive, tick at least twice per DRIVE_RESEND_S so held keys are resent on time
+    d.refresh_s = 1.0 / refresh_hz;
+    double tick_s = !d.headless && d.refresh_s > DRIVE_RESEND_S / 2 ? DRIVE_RESEND_S / 2 : d.refresh_s;
+    long period_ns = (long)(1e9 * tick_s);
+    struct itimerspec period = {
+        .it_interval = {period_ns / 1000000000, period_ns % 1000000000},
+        .it_value = {period_ns / 1000000000, period_ns % 1000000000},
+    };
+    timerfd_settime(timer_fd, 0, &period, NULL);
+
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = timer_fd};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+    if (!d.headless) {
+        raw_mode();
+        event.data.fd = STDIN_FILENO;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &event);
+    }
+
+    if (d.discover || d.list_only) {
+        if (car_discovery_open(&d.discovery, TELEMETRY_DISCOVERY_PORT, on_car, &d) < 0) {
+            perror("discovery");
+            return 1;
+        }
+        event.data.fd = car_discovery_fd(&d.discovery);
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, event.data.fd, &event);
+    } else {
+        d.discovery.fd = -1;
+    }
+
+    car_client_init(&d.client, NULL, NULL);
+    d.last_refresh = car_client_now();
+    try_connect(&d, epoll_fd, d.last_refresh);
+
+    while (!quit) {
+        struct epoll_event events[4];
+        int count = epoll_wait(epoll_fd, events, 4, -1);
+        if (count < 0 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+
+        for (int i = 0; i < count; i++) {
+            int fd = events[i].data.fd;
+            if (fd == timer_fd) {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) < 0) {
+                    continue;
+                }
+                double now = car_client_now();
+                if (d.discover || d.list_only) {
+                    car_discovery_expire(&d.discovery, now);
+                }
+                if (d.client.state == CAR_CLOSED && now >= d.next_connect) {
+                    try_connect(&d, epoll_fd, now);
+                }
+                resend_drive(&d, now);
+                if (now - d.last_refresh >= d.refresh_s - tick_s / 2) {
+                    render(&d, now);
+                }
+            } else if (fd == d.discovery.fd) {
+                car_discovery_poll(&d.discovery);
+            } else if (fd == STDIN_FILENO) {
+                char keys[16];
+                ssize_t n = read(STDIN_FILENO, keys, sizeof(keys));
+                for (ssize_t k = 0; k < n; k++) {
+                    handle_key(&d, keys[k], car_client_now());
+                }
+            } else if (fd == car_client_fd(&d.client)) {
+                if (car_client_poll(&d.client, 0) < 0) {
+                    // Closing the descriptor also removes it from epoll_fd
+                    if (d.headless) {
+                        fprintf(stderr, "%s:%u: %s\n", d.host, d.tcp_port, strerror(errno));
+                    }
+                    d.next_connect = car_client_now() + RECONNECT_S;
+                }
+            }
+        }
+    }
+
+    car_client_close(&d.client);
+    car_discovery_close(&d.discovery);
+    restore_terminal();
+    close(timer_fd);
+    close(epoll_fd);
+    return 0;
+}
@@ -0,0 +1,367 @@
+// Micro-benchmarks for the car's numeric kernels and the command parser.
+//
+// Each kernel runs over a fixed set of representative inputs generated from a
+// deterministic PRNG (noisy sonar ranges with outliers, PID errors, Code 39
+// bar widths, command lines), in batches of BATCH calls. Every batch is timed,
+// so besides the mean the report gives the p50/p99/max time per call within a
+// batch. The "empty" row is the cost of the timing loop itself.
+//
+// The same file builds for the Pico (BUILD_KERNEL_BENCH in the top-level
+// CMakeLists.txt); there batches are timed in core cycles on SysTick and the
+// results are printed on stdio once at boot.
+//
+// Output is a table, or with -j one JSON object per kernel and line, tagged
+// with the source revision so results can be collected across commits:
+//   {"bench":"kernel_bench","revision":"abc1234","target":"host","kernel":"kalman_update",
+//    "unit":"ns","batch":16,"batches":20000,"mean":..,"p50":..,"p99":..,"max":..,"calls_per_s":..}
+//
+// Usage: kernel_bench [-j] [-n BATCHES] [-r REVISION] [KERNEL...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include "buddy2_pid.h"
+#include "buddy5_filter.h"
+#include "buddy3_barcode.h"
+#include "command.h"
+
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+#include "pico/stdlib.h"
+#include "hardware/clocks.h"
+#include "hardware/structs/systick.h"
+#define BENCH_TARGET "pico"
+#define BENCH_UNIT "cycles"
+#define DEFAULT_BATCHES 2000
+#else
+#include <time.h>
+#include <unistd.h>
+#define BENCH_TARGET "host"
+#define BENCH_UNIT "ns"
+#define DEFAULT_BATCHES 20000
+#endif
+
+#ifndef KERNEL_BENCH_REVISION
+#define KERNEL_BENCH_REVISION "unknown"
+#endif
+
+#define BATCH 16
+#define INPUTS 1024             // Inputs per kernel, used round robin (power of two)
+#define CODE_INPUTS 64
+
+#define COUNT(a) (int)(sizeof(a) / sizeof(a[0]))
+
+// Time source: a free running counter and the elapsed count since a start value
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+static void clock_start(void) {
+    systick_hw->rvr = 0x00FFFFFF;
+    systick_hw->csr = M0PLUS_SYST_CSR_CLKSOURCE_BITS | M0PLUS_SYST_CSR_ENABLE_BITS;
+}
+
+static inline uint32_t clock_now(void) {
+    return systick_hw->cvr;
+}
+
+// SysTick counts down and wraps at 2^24 cycles, far above a batch
+static inline uint32_t clock_elapsed(uint32_t start) {
+    return (start - systick_hw->cvr) & 0x00FFFFFF;
+}
+
+static double units_per_second(void) {
+    return clock_get_hz(clk_sys);
+}
+#else
+static void clock_start(void) {
+}
+
+static inline uint32_t clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint32_t)((uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec);
+}
+
+static inline uint32_t clock_elapsed(uint32_t start) {
+    return clock_now() - start;
+}
+
+static double units_per_second(void) {
+    return 1e9;
+}
+#endif
+
+// Small deterministic PRNG so every run sees the same inputs
+static uint32_t rng_state = 12345;
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static float rng_range(float low, float high) {
+    return low + (high - low) * (float)(rng_next() >> 8) / 16777216.0f;
+}
+
+static volatile uint32_t sink;
+
+// Inputs
+static float ranges[INPUTS];            // Sonar readings in cm
+static float targets[INPUTS];           // PID target and measured wheel speeds
+static float speeds[INPUTS];
+static int stay_counts[CODE_INPUTS][CHUNK_SIZE];
+static const char *codes[CODE_INPUTS];
+static bool code_reverse[CODE_INPUTS];
+
+static kalman_state *filter;
+static range_prefilter prefilter;
+static float pid_integral, pid_prev_error;
+static barcode_decoder decoder;
+
+static const char *const command_corpus[] = {
+    "Forward 50",
+    "Forward Left 50",
+    "Backward Right 30",
+    "Stop Movement",
+    "SPEED 40",
+    "HEADING -90",
+    "DISTANCE 120",
+    "PID MOTOR 3.0 0.05 0.01",
+    "SUBSCRIBE 255",
+    "TRACE 3",
+};
+
+#define COMMANDS COUNT(command_corpus)
+
+static size_t command_length[COMMANDS];
+static uint8_t command_binary[COMMANDS][32];
+static size_t command_binary_length[COMMANDS];
+
+static void make_inputs(void) {
+    // A target that drifts between 20 and 200 cm, read with a few cm of noise;
+    // 2% of the readings are echoes from elsewhere and 1% out of range
+    float distance = 100.0f;
+    for (int i = 0; i < INPUTS; i++) {
+        distance += rng_range(-2.0f, 2.0f);
+        distance = distance < 20.0f ? 20.0f : distance > 200.0f ? 200.0f : distance;
+        uint32_t kind = rng_next() % 100;
+        ranges[i] = kind < 1 ? rng_range(400.0f, 450.0f)
+                  : kind < 3 ? rng_range((float)MIN_DISTANCE_CM, (float)MAX_DISTANCE_CM)
+                             : distance + rng_range(-1.5f, 1.5f);
+    }
+
+    // Wheel speed loop around a cruise speed with encoder noise
+    for (int i = 0; i < INPUTS; i++) {
+        targets[i] = rng_range(15.0f, 35.0f);
+        speeds[i] = targets[i] + rng_range(-8.0f, 8.0f);
+    }
+
+    // Bar widths of random Code 39 characters: narrow bars 3-5 readings, wide 8-12
+    for (int i = 0; i < CODE_INPUTS; i++) {
+        const char *code = array_code[rng_next() % CODE39_CHAR_COUNT];
+        for (int j = 0; j < CHUNK_SIZE; j++) {
+            stay_counts[i][j] = code[j] == '1' ? 8 + (int)(rng_next() % 5) : 3 + (int)(rng_next() % 3);
+        }
+    }
+
+    // Lookups in both orientations; one in eight is a misread that maps to nothing
+    for (int i = 0; i < CODE_INPUTS; i++) {
+        code_reverse[i] = rng_next() & 1;
+        char **table = code_reverse[i] ? array_reverse_code : array_code;
+        codes[i] = (rng_next() % 8 == 0) ? "111111111" : table[rng_next() % CODE39_CHAR_COUNT];
+    }
+
+    command cmd;
+    for (int i = 0; i < COMMANDS; i++) {
+        command_length[i] = strlen(command_corpus[i]);
+        command_parse_text(command_corpus[i], command_length[i], &cmd);
+        command_binary_length[i] = command_encode_binary(&cmd, command_binary[i], sizeof(command_binary[i]));
+    }
+
+    filter = kalman_init(1.0, 0.5, 1.0, 100.0);
+    range_prefilter_init(&prefilter);
+    barcode_decoder_init(&decoder);
+    decoder.direction_determined = true;    // Time the mapping, not direction detection
+}
+
+// Kernels, one call on input i
+static void run_empty(uint32_t i) {
+    sink += i;
+}
+
+static void run_kalman_update(uint32_t i) {
+    kalman_update(filter, ranges[i % INPUTS]);
+    sink += (uint32_t)filter->x;
+}
+
+static void run_range_prefilter(uint32_t i) {
+    float filtered;
+    sink += range_prefilter_update(&prefilter, ranges[i % INPUTS], &filtered);
+}
+
+static void run_compute_pid(uint32_t i) {
+    sink += (uint32_t)(compute_pid(&targets[i % INPUTS], &speeds[i % INPUTS], &pid_integral, &pid_prev_error) * 100);
+}
+
+static void run_convert_stay_counts(uint32_t i) {
+    decoder.char_index = 0;
+    convert_stay_counts(&decoder, stay_counts[i % CODE_INPUTS], CHUNK_SIZE);
+    sink += (uint32_t)decoder.converted_chars[0];
+}
+
+static void run_map_binary_to_char(uint32_t i) {
+    sink += (uint32_t)map_binary_to_char(codes[i % CODE_INPUTS], code_reverse[i % CODE_INPUTS]);
+}
+
+static void run_command_text(uint32_t i) {
+    command cmd;
+    sink += (uint32_t)command_parse_text(command_corpus[i % COMMANDS], command_length[i % COMMANDS], &cmd) + cmd.opcode;
+}
+
+static void run_command_binary(uint32_t i) {
+    command cmd;
+    sink += (uint32_t)command_parse_binary(command_binary[i % COMMANDS], command_binary_length[i % COMMANDS], &cmd) +
+            cmd.opcode;
+}
+
+static const struct {
+    const char *name;
+    void (*run)(uint32_t i);
+} kernels[] = {
+    {"empty", run_empty},
+    {"kalman_update", run_kalman_update},
+    {"range_prefilter", run_range_prefilter},
+    {"compute_pid", run_compute_pid},
+    {"convert_stay_counts", run_convert_stay_counts},
+    {"map_binary_to_char", run_map_binary_to_char},
+    {"command_text", run_command_text},
+    {"command_binary", run_command_binary},
+};
+
+typedef struct {
+    double mean, p50, p99, max;     // Per call, in BENCH_UNIT
+} result;
+
+static int compare_u32(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void measure(void (*run)(uint32_t), uint32_t *samples, int batches, result *r) {
+    uint32_t input = 0;
+
+    // Warm up caches and branch predictors (flash XIP cache on the Pico)
+    for (int k = 0; k < INPUTS; k++) {
+        run(input++);
+    }
+
+    uint64_t total = 0;
+    for (int b = 0; b < batches; b++) {
+        uint32_t start = clock_now();
+        for (int k = 0; k < BATCH; k++) {
+            run(input++);
+        }
+        samples[b] = clock_elapsed(start);
+        total += samples[b];
+    }
+
+    qsort(samples, (size_t)batches, sizeof(samples[0]), compare_u32);
+    r->mean = (double)total / batches / BATCH;
+    r->p50 = (double)samples[batches / 2] / BATCH;
+    r->p99 = (double)samples[(int)((batches - 1) * 0.99)] / BATCH;
+    r->max = (double)samples[batches - 1] / BATCH;
+}
+
+static bool selected(const char *name, int argc, char **argv, int first) {
+    if (first >= argc) {
+        return true;
+    }
+    for (int i = first; i < argc; i++) {
+        if (strcmp(argv[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static int run_benchmarks(bool json, int batches, const char *revision, int argc, char **argv, int first) {
+    uint32_t *samples = malloc(sizeof(uint32_t) * (size_t)batches);
+    if (!samples) {
+        return 1;
+    }
+
+    make_inputs();
+    clock_start();
+
+    if (!json) {
+        printf("%-20s %10s %10s %10s %10s %14s  (%s per call, %s)\n", "kernel", "mean", "p50", "p99", "max",
+               "calls_per_s", BENCH_UNIT, BENCH_TARGET);
+    }
+    for (int k = 0; k < COUNT(kernels); k++) {
+        if (!selected(kernels[k].name, argc, argv, first)) {
+            continue;
+        }
+        result r;
+        measure(kernels[k].run, samples, batches, &r);
+        double rate = r.mean > 0 ? units_per_second() / r.mean : 0;
+        if (json) {
+            printf("{\"bench\":\"kernel_bench\",\"revision\":\"%s\",\"target\":\"%s\",\"kernel\":\"%s\","
+                   "\"unit\":\"%s\",\"batch\":%d,\"batches\":%d,\"mean\":%.2f,\"p50\":%.2f,\"p99\":%.2f,"
+                   "\"max\":%.2f,\"calls_per_s\":%.0f}\n",
+                   revision, BENCH_TARGET, kernels[k].name, BENCH_UNIT, BATCH, batches, r.mean, r.p50, r.p99,
+                   r.max, rate);
+        } else {
+            printf("%-20s %10.1f %10.1f %10.1f %10.1f %14.0f\n", kernels[k].name, r.mean, r.p50, r.p99, r.max,
+                   rate);
+        }
+    }
+    free(samples);
+    return 0;
+}
+
+#if defined(PICO_ON_DEVICE) && PICO_ON_DEVICE
+int main(void) {
+    stdio_init_all();
+    sleep_ms(3000);     // Time to open the USB serial port
+    run_benchmarks(false, DEFAULT_BATCHES, KERNEL_BENCH_REVISION, 0, NULL, 0);
+    run_benchmarks(true, DEFAULT_BATCHES, KERNEL_BENCH_REVISION, 0, NULL, 0);
+    while (true) {
+        sleep_ms(1000);
+    }
+}
+#else
+static void usage(void) {
+    fprintf(stderr, "usage: kernel_bench [-j] [-n BATCHES] [-r REVISION] [KERNEL...]\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    bool json = false;
+    int batches = DEFAULT_BATCHES;
+    const char *revision = KERNEL_BENCH_REVISION;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "jn:r:")) != -1) {
+        switch (opt) {
+            case 'j': json = true; break;
+            case 'n': batches = atoi(optarg); break;
+            case 'r': revision = optarg; break;
+            default: usage();
+        }
+    }
+    if (batches < 1) {
+        usage();
+    }
+    for (int i = optind; i < argc; i++) {
+        bool known = false;
+        for (int k = 0; k < COUNT(kernels); k++) {
+            known |= strcmp(argv[i], kernels[k].name) == 0;
+        }
+        if (!known) {
+            fprintf(stderr, "unknown kernel: %s\n", argv[i]);
+            return 2;
+        }
+    }
+    return run_benchmarks(json, batches, revision, argc, argv, optind);
+}
+#endif
@@ -0,0 +1,186 @@
+// Closed-loop check of the buddy3 line follower.
+//
+// A kinematic model of the car (unicycle, the line sensor SENSOR_AHEAD_CM in
+// front of the axle) runs along a straight line edge. line_follower_update is
+// called every CONTROL_PERIOD_US with the reading the sensor would give, the
+// way line_follow_step does in the control task, and its velocity is applied
+// to the model. The scenarios cover the controller's states:
+//
+//   drift      start beside the edge, converge onto it while driving
+//   loss       a knock turns the car off the line: search, reacquire, track
+//   lost       pushed far off: the search gives up, then the car is put back
+//              on the line and tracking resumes
+//
+// Each scenario checks the mode sequence and the final tracking error, prints
+// one line and the program exits non-zero if any failed.
+//
+// Usage: line_replay [-v]     -v prints the simulated trace every 50 ms
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <math.h>
+#include "buddy3_line.h"
+
+#define WHITE_LEVEL 120             // Same calibration as buddy3.c
+#define BLACK_LEVEL 1400
+#define BASE_SPEED_CM_S 30.0f
+#define CONTROL_PERIOD_US 5000      // CONTROL_PERIOD_MS of the control task
+#define SENSOR_AHEAD_CM 5.0         // Sensor position in front of the axle
+#define SENSOR_SPOT_CM 1.0          // Width over which the reading goes white to black
+#define TRACKING_ERROR_MAX 0.25f    // |error| allowed at the end of a scenario
+
+typedef struct {
+    double x_cm, y_cm;              // Axle position, y to the left; the line edge is y = 0, the line at y < 0
+    double heading_rad;             // CCW from the line direction
+} car_pose;
+
+static bool verbose = false;
+
+// Lateral position of the sensor relative to the edge
+static double sensor_offset_cm(const car_pose *car) {
+    return car->y_cm + SENSOR_AHEAD_CM * sin(car->heading_rad);
+}
+
+// Raw ADC reading: white left of the edge, black on the line, linear across the spot
+static uint16_t sensor_reading(const car_pose *car) {
+    double coverage = 0.5 - sensor_offset_cm(car) / SENSOR_SPOT_CM;
+    if (coverage < 0.0) coverage = 0.0;
+    if (coverage > 1.0) coverage = 1.0;
+    return (uint16_t)(WHITE_LEVEL + coverage * (BLACK_LEVEL - WHITE_LEVEL));
+}
+
+static const char *mode_name(line_follow_mode mode) {
+    switch (mode) {
+        case LINE_TRACKING: return "tracking";
+        case LINE_SEARCHING: return "searching";
+        case LINE_LOST: return "lost";
+    }
+    return "?";
+}
+
+typedef struct {
+    line_follow_mode modes[16];     // Modes entered, in order, starting with the first
+    int mode_count;
+    float error;                    // Tracking error at the end
+} run_result;
+
+// Drive the model for a while. The line edge runs along +x with the line on
+// the car's right, as the follower expects for edge_side +1.
+static void run(line_follower *lf, car_pose *car, uint64_t *now_us, double seconds, run_result *result) {
+    uint64_t end_us = *now_us + (uint64_t)(seconds * 1e6);
+    double dt = CONTROL_PERIOD_US / 1e6;
+
+    while (*now_us < end_us) {
+        float v_cm_s, omega_rad_s;
+        line_follower_update(lf, sensor_reading(car), *now_us, &v_cm_s, &omega_rad_s);
+        if (result->mode_count == 0 || result->modes[result->mode_count - 1] != lf->mode) {
+            if (result->mode_count < (int)(sizeof(result->modes) / sizeof(result->modes[0]))) {
+                result->modes[result->mode_count++] = lf->mode;
+            }
+        }
+        if (verbose && *now_us % 50000 == 0) {
+            printf("  %6.2f s  %-9s y %6.2f cm  heading %6.1f deg  v %5.1f cm/s  omega %5.2f rad/s\n",
+                   *now_us / 1e6, mode_name(lf->mode), sensor_offset_cm(car), car->heading_rad * 180.0 / M_PI,
+                   v_cm_s, omega_rad_s);
+        }
+
+        car->heading_rad += omega_rad_s * dt;
+        car->x_cm += v_cm_s * cos(car->heading_rad) * dt;
+        car->y_cm += v_cm_s * sin(car->heading_rad) * dt;
+        *now_us += CONTROL_PERIOD_US;
+    }
+    result->error = lf->error;
+}
+
+static bool modes_are(const run_result *result, const line_follow_mode *expected, int count) {
+    if (result->mode_count != count) {
+        return false;
+    }
+    return memcmp(result->modes, expected, (size_t)count * sizeof(*expected)) == 0;
+}
+
+static void print_modes(const run_result *result) {
+    for (int i = 0; i < result->mode_count; i++) {
+        printf("%s%s", i ? " > " : "", mode_name(result->modes[i]));
+    }
+}
+
+static bool report(const char *name, const run_result *result, const line_follow_mode *expected, int count,
+                   bool tracking_at_end) {
+    bool ok = modes_are(result, expected, count) &&
+              (!tracking_at_end || fabsf(result->error) <= TRACKING_ERROR_MAX);
+    printf("%-6s %s  modes: ", name, ok ? "ok  " : "FAIL");
+    print_modes(result);
+    printf(", final error %.3f\n", result->error);
+    return ok;
+}
+
+// Start 0.4 cm onto the white side and converge onto the edge
+static bool scenario_drift(void) {
+    line_follower lf;
+    car_pose car = {.y_cm = 0.4};
+    uint64_t now_us = CONTROL_PERIOD_US;
+    run_result result = {0};
+
+    line_follower_init(&lf, WHITE_LEVEL, BLACK_LEVEL, BASE_SPEED_CM_S);
+    run(&lf, &car, &now_us, 3.0, &result);
+    static const line_follow_mode expected[] = {LINE_TRACKING};
+    return report("drift", &result, expected, 1, true);
+}
+
+// Track, then a knock turns the car 45 degrees off the line onto white
+static bool scenario_loss(void) {
+    line_follower lf;
+    car_pose car = {0};
+    uint64_t now_us = CONTROL_PERIOD_US;
+    run_result result = {0};
+
+    line_follower_init(&lf, WHITE_LEVEL, BLACK_LEVEL, BASE_SPEED_CM_S);
+    run(&lf, &car, &now_us, 1.0, &result);
+    car.heading_rad += M_PI / 4;    // CCW knock: the sensor swings out onto white
+    car.y_cm += 2.0;
+    run(&lf, &car, &now_us, 4.0, &result);
+    static const line_follow_mode expected[] = {LINE_TRACKING, LINE_SEARCHING, LINE_TRACKING};
+    return report("loss", &result, expected, 3, true);
+}
+
+// Pushed far off the line: every search leg misses, the car stops in
+// LINE_LOST, then it is put back on the edge and resumes
+static bool scenario_lost(void) {
+    line_follower lf;
+    car_pose car = {0};
+    uint64_t now_us = CONTROL_PERIOD_US;
+    run_result result = {0};
+
+    line_follower_init(&lf, WHITE_LEVEL, BLACK_LEVEL, BASE_SPEED_CM_S);
+    run(&lf, &car, &now_us, 1.0, &result);
+    car.y_cm += 30.0;
+    run(&lf, &car, &now_us, 12.0, &result);
+    if (lf.mode != LINE_LOST || lf.v_cm_s != 0.0f || lf.omega_rad_s != 0.0f) {
+        printf("lost   FAIL  not stopped in lost mode after the search (%s)\n", mode_name(lf.mode));
+        return false;
+    }
+    car = (car_pose){.x_cm = car.x_cm};
+    run(&lf, &car, &now_us, 3.0, &result);
+    static const line_follow_mode expected[] = {LINE_TRACKING, LINE_SEARCHING, LINE_LOST, LINE_TRACKING};
+    return report("lost", &result, expected, 4, true);
+}
+
+int main(int argc, char **argv) {
+    if (argc > 1 && strcmp(argv[1], "-v") == 0) {
+        verbose = true;
+    } else if (argc > 1) {
+        fprintf(stderr, "usage: %s [-v]\n", argv[0]);
+        return 2;
+    }
+
+    int failed = 0;
+    failed += !scenario_drift();
+    failed += !scenario_loss();
+    failed += !scenario_lost();
+    printf("%d of 3 scenarios failed\n", failed);
+    return failed ? 1 : 0;
+}
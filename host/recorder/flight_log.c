@@ -0,0 +1,396 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "fleet_stream.h"
+#include "flight_log.h"
+
+// Header fields
+#define HEADER_MAGIC 0
+#define HEADER_VERSION 4
+#define HEADER_SEGMENT 8
+#define HEADER_RECORDS 12
+#define HEADER_USED 16
+#define HEADER_FIRST_TIME 24
+#define HEADER_LAST_TIME 32
+#define HEADER_INDEX_COUNT 40
+
+#define INDEX_ENTRY_SIZE 16
+#define RECORD_TIME_SIZE 8
+
+static void put_u64(uint8_t *p, uint64_t v) {
+    put_u32(p, (uint32_t)v);
+    put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+}
+
+static void segment_path(char *path, size_t cap, const char *dir, uint32_t number) {
+    snprintf(path, cap, "%s/segment-%06u.flog", dir, number);
+}
+
+// ---- Writer ---------------------------------------------------------------
+
+static int segment_start(flight_writer *writer) {
+    char path[4200];
+    segment_path(path, sizeof(path), writer->dir, writer->segment);
+
+    // O_EXCL: never append to or overwrite an earlier session
+    writer->fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if (writer->fd < 0) {
+        return -1;
+    }
+    if (ftruncate(writer->fd, (off_t)writer->segment_size) < 0) {
+        goto fail;
+    }
+    writer->map = mmap(NULL, writer->segment_size, PROT_READ | PROT_WRITE, MAP_SHARED, writer->fd, 0);
+    if (writer->map == MAP_FAILED) {
+        writer->map = NULL;
+        goto fail;
+    }
+    put_u32(writer->map + HEADER_MAGIC, FLIGHT_MAGIC);
+    put_u16(writer->map + HEADER_VERSION, FLIGHT_VERSION);
+    put_u32(writer->map + HEADER_SEGMENT, writer->segment);
+    writer->used = 0;
+    writer->records = 0;
+    writer->index_count = 0;
+    writer->next_index = 0;
+    return 0;
+
+fail:;
+    int saved = errno;
+    close(writer->fd);
+    writer->fd = -1;
+    unlink(path);
+    errno = saved;
+    return -1;
+}
+
+// Unmap the segment and give back the unused preallocated space
+static void segment_finish(flight_writer *writer) {
+    if (writer->map) {
+        munmap(writer->map, writer->segment_size);
+        writer->map = NULL;
+    }
+    if (writer->fd >= 0) {
+        if (ftruncate(writer->fd, (off_t)(FLIGHT_DATA_OFFSET + writer->used)) < 0) {
+            perror("flight log");
+        }
+        close(writer->fd);
+        writer->fd = -1;
+    }
+}
+
+int flight_writer_open(flight_writer *writer, const char *dir, size_t segment_size) {
+    memset(writer, 0, sizeof(*writer));
+    writer->fd = -1;
+    writer->segment_size = segment_size ? segment_size : FLIGHT_SEGMENT_SIZE;
+    if (writer->segment_size < FLIGHT_DATA_OFFSET + 16 * FLEET_RECORD_MAX ||
+        strlen(dir) >= sizeof(writer->dir)) {
+        errno = EINVAL;
+        return -1;
+    }
+    snprintf(writer->dir, sizeof(writer->dir), "%s", dir);
+    if (mkdir(dir, 0755) < 0 && errno != EEXIST) {
+        return -1;
+    }
+    return segment_start(writer);
+}
+
+int flight_writer_append(flight_writer *writer, uint64_t time_ns, uint64_t device_id, const telemetry_frame *frame) {
+    uint8_t record[RECORD_TIME_SIZE + FLEET_RECORD_MAX];
+    size_t length = fleet_record_encode(device_id, frame, record + RECORD_TIME_SIZE, FLEET_RECORD_MAX);
+    if (length == 0) {
+        errno = EMSGSIZE;
+        return -1;
+    }
+    length += RECORD_TIME_SIZE;
+
+    if (FLIGHT_DATA_OFFSET + writer->used + length > writer->segment_size) {
+        segment_finish(writer);
+        if (writer->segment + 1 == FLIGHT_SEGMENT_MAX) {
+            errno = EFBIG;
+            return -1;
+        }
+        writer->segment++;
+        if (segment_start(writer) < 0) {
+            return -1;
+        }
+    }
+    if (!writer->map) {
+        errno = EBADF;
+        return -1;
+    }
+
+    // Seeking relies on times that never go backwards
+    if (time_ns < writer->last_time_ns) {
+        time_ns = writer->last_time_ns;
+    }
+    put_u64(record, time_ns);
+
+    uint8_t *map = writer->map;
+    if (writer->used >= writer->next_index && writer->index_count < FLIGHT_INDEX_ENTRIES) {
+        uint8_t *entry = map + FLIGHT_HEADER_SIZE + writer->index_count * INDEX_ENTRY_SIZE;
+        put_u64(entry, time_ns);
+        put_u64(entry + 8, writer->used);
+        writer->index_count++;
+        writer->next_index = writer->used + FLIGHT_INDEX_STRIDE;
+        put_u32(map + HEADER_INDEX_COUNT, writer->index_count);
+    }
+    memcpy(map + FLIGHT_DATA_OFFSET + writer->used, record, length);
+    writer->used += length;
+    writer->records++;
+    writer->last_time_ns = time_ns;
+    writer->total_records++;
+    writer->total_bytes += length;
+
+    if (writer->records == 1) {
+        put_u64(map + HEADER_FIRST_TIME, time_ns);
+    }
+    put_u64(map + HEADER_LAST_TIME, time_ns);
+    put_u32(map + HEADER_RECORDS, writer->records);
+    // The used size goes last: a reader of a live log never sees a partial record
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    put_u64(map + HEADER_USED, writer->used);
+    return 0;
+}
+
+void flight_writer_close(flight_writer *writer) {
+    segment_finish(writer);
+}
+
+// ---- Reader ---------------------------------------------------------------
+
+static int compare_segments(const void *a, const void *b) {
+    uint32_t x = ((const flight_segment *)a)->number, y = ((const flight_segment *)b)->number;
+    return (x > y) - (x < y);
+}
+
+// Read and check one segment header without mapping the segment. A segment
+// of another FLIGHT_VERSION is refused and its version stored in *version.
+static bool read_segment(const char *path, flight_segment *segment, uint16_t *version) {
+    uint8_t header[FLIGHT_HEADER_SIZE];
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    bool ok = pread(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) && fstat(fd, &st) == 0;
+    close(fd);
+    if (!ok || get_u32(header + HEADER_MAGIC) != FLIGHT_MAGIC) {
+        return false;
+    }
+    if (get_u16(header + HEADER_VERSION) != FLIGHT_VERSION) {
+        *version = get_u16(header + HEADER_VERSION);
+        return false;
+    }
+    segment->number = get_u32(header + HEADER_SEGMENT);
+    segment->records = get_u32(header + HEADER_RECORDS);
+    segment->used = get_u64(header + HEADER_USED);
+    segment->first_time_ns = get_u64(header + HEADER_FIRST_TIME);
+    segment->last_time_ns = get_u64(header + HEADER_LAST_TIME);
+    return segment->records > 0 && (uint64_t)st.st_size >= FLIGHT_DATA_OFFSET + segment->used;
+}
+
+int flight_reader_open(flight_reader *reader, const char *dir) {
+    memset(reader, 0, sizeof(*reader));
+    reader->fd = -1;
+    reader->current = -1;
+    if (strlen(dir) >= sizeof(reader->dir)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    snprintf(reader->dir, sizeof(reader->dir), "%s", dir);
+
+    DIR *d = opendir(dir);
+    if (!d) {
+        return -1;
+    }
+    int capacity = 0;
+    struct dirent *de;
+    while ((de = readdir(d)) != NULL) {
+        unsigned number;
+        char path[4400];
+        flight_segment segment;
+        if (sscanf(de->d_name, "segment-%6u.flog", &number) != 1) {
+            continue;
+        }
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (!read_segment(path, &segment, &reader->other_version) || segment.number != number) {
+            continue;
+        }
+        if (reader->segment_count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            flight_segment *grown = realloc(reader->segments, (size_t)capacity * sizeof(flight_segment));
+            if (!grown) {
+                closedir(d);
+                flight_reader_close(reader);
+                errno = ENOMEM;
+                return -1;
+            }
+            reader->segments = grown;
+        }
+        reader->segments[reader->segment_count++] = segment;
+        reader->records += segment.records;
+    }
+    closedir(d);
+    qsort(reader->segments, (size_t)reader->segment_count, sizeof(flight_segment), compare_segments);
+    return 0;
+}
+
+uint64_t flight_reader_start(const flight_reader *reader) {
+    return reader->segment_count ? reader->segments[0].first_time_ns : 0;
+}
+
+uint64_t flight_reader_end(const flight_reader *reader) {
+    return reader->segment_count ? reader->segments[reader->segment_count - 1].last_time_ns : 0;
+}
+
+static void unmap_segment(flight_reader *reader) {
+    if (reader->map) {
+        munmap((void *)reader->map, reader->map_size);
+        reader->map = NULL;
+    }
+    if (reader->fd >= 0) {
+        close(reader->fd);
+        reader->fd = -1;
+    }
+    reader->current = -1;
+}
+
+static int map_segment(flight_reader *reader, int index) {
+    char path[4200];
+    const flight_segment *segment = &reader->segments[index];
+
+    unmap_segment(reader);
+    segment_path(path, sizeof(path), reader->dir, segment->number);
+    reader->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (reader->fd < 0) {
+        return -1;
+    }
+    reader->map_size = FLIGHT_DATA_OFFSET + segment->used;
+    void *map = mmap(NULL, reader->map_size, PROT_READ, MAP_SHARED, reader->fd, 0);
+    if (map == MAP_FAILED) {
+        int saved = errno;
+        unmap_segment(reader);
+        errno = saved;
+        return -1;
+    }
+    madvise(map, reader->map_size, MADV_SEQUENTIAL);
+    reader->map = map;
+    reader->current = index;
+    reader->offset = 0;
+    return 0;
+}
+
+static uint64_t record_time(const flight_reader *reader, size_t offset) {
+    return get_u64(reader->map + FLIGHT_DATA_OFFSET + offset);
+}
+
+// Length of the record at offset, 0 if it does not fit in the segment
+static size_t record_length(const flight_reader *reader, size_t offset) {
+    uint64_t used = reader->segments[reader->current].used;
+    if (offset + RECORD_TIME_SIZE + FLEET_RECORD_HEADER > used) {
+        return 0;
+    }
+    size_t length = get_u16(reader->map + FLIGHT_DATA_OFFSET + offset + RECORD_TIME_SIZE);
+    if (length < FLEET_RECORD_HEADER + TELEMETRY_OVERHEAD || offset + RECORD_TIME_SIZE + length > used) {
+        return 0;
+    }
+    return RECORD_TIME_SIZE + length;
+}
+
+int flight_reader_seek(flight_reader *reader, uint64_t time_ns) {
+    // Last segment starting at or before the time
+    int low = 0, high = reader->segment_count - 1, index = 0;
+    while (low <= high) {
+        int middle = (low + high) / 2;
+        if (reader->segments[middle].first_time_ns <= time_ns) {
+            index = middle;
+            low = middle + 1;
+        } else {
+            high = middle - 1;
+        }
+    }
+    if (reader->segment_count > 0 && reader->segments[index].last_time_ns < time_ns) {
+        index++;
+    }
+    if (index >= reader->segment_count) {
+        unmap_segment(reader);
+        return -1;
+    }
+    if (map_segment(reader, index) < 0) {
+        return -1;
+    }
+
+    // Last index entry before the time, then scan at most one stride
+    const uint8_t *entries = reader->map + FLIGHT_HEADER_SIZE;
+    uint32_t count = get_u32(reader->map + HEADER_INDEX_COUNT);
+    uint32_t first = 0, last = count;
+    if (count > FLIGHT_INDEX_ENTRIES) {
+        count = last = FLIGHT_INDEX_ENTRIES;
+    }
+    while (first < last) {
+        uint32_t middle = first + (last - first) / 2;
+        if (get_u64(entries + middle * INDEX_ENTRY_SIZE) < time_ns) {
+            first = middle + 1;
+        } else {
+            last = middle;
+        }
+    }
+    size_t offset = first > 0 ? get_u64(entries + (first - 1) * INDEX_ENTRY_SIZE + 8) : 0;
+    size_t length;
+    while ((length = record_length(reader, offset)) != 0 && record_time(reader, offset) < time_ns) {
+        offset += length;
+    }
+    reader->offset = offset;
+    return 0;
+}
+
+int flight_reader_next(flight_reader *reader, flight_entry *entry) {
+    for (;;) {
+        if (reader->current < 0 || reader->offset >= reader->segments[reader->current].used) {
+            int next = reader->current + 1;
+            if (next >= reader->segment_count) {
+                return 0;
+            }
+            if (map_segment(reader, next) < 0) {
+                return -1;
+            }
+            continue;
+        }
+
+        size_t length = record_length(reader, reader->offset);
+        if (length == 0) {
+            // A bad length loses the rest of the segment, not the log
+            reader->corrupt++;
+            reader->offset = reader->segments[reader->current].used;
+            continue;
+        }
+        const uint8_t *record = reader->map + FLIGHT_DATA_OFFSET + reader->offset;
+        reader->offset += length;
+        entry->time_ns = get_u64(record);
+        entry->device_id = get_u64(record + RECORD_TIME_SIZE + 2);
+        if (telemetry_decode(record + RECORD_TIME_SIZE + FLEET_RECORD_HEADER,
+                             length - RECORD_TIME_SIZE - FLEET_RECORD_HEADER, &entry->frame) <= 0) {
+            reader->corrupt++;
+            continue;
+        }
+        return 1;
+    }
+}
+
+void flight_reader_close(flight_reader *reader) {
+    unmap_segment(reader);
+    free(reader->segments);
+    reader->segments = NULL;
+    reader->segment_count = 0;
+}
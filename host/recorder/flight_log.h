@@ -0,0 +1,110 @@
+#ifndef FLIGHT_LOG_H
+#define FLIGHT_LOG_H
+
+// Flight recorder log: decoded telemetry of a whole session, kept on disk in a
+// directory of fixed-size, memory-mapped segment files (segment-NNNNNN.flog).
+//
+// A segment is a header, a sparse time index and the records:
+//   offset  size                    field
+//   0       FLIGHT_HEADER_SIZE      magic "FLOG", version, segment number,
+//                                   record count, used bytes, first/last time
+//   64      FLIGHT_INDEX_ENTRIES*16 index entries: u64 time_ns, u64 record offset
+//   ...     used                    records: u64 time_ns, then a fleet_stream
+//                                   record (u16 length, u64 device ID, frame)
+// All fields are little-endian. Record times are host receive times in
+// CLOCK_REALTIME nanoseconds and never decrease, within and across segments.
+// An index entry is added every FLIGHT_INDEX_STRIDE bytes of records, so a
+// seek is a binary search over the segments, one over the segment's index and
+// a scan of at most one stride. Batches are stored expanded, like on the fleet
+// stream, so any record decodes on its own.
+//
+// The writer maps one segment at a time and updates the header after every
+// record, so a crashed recorder leaves a log readable up to its last record.
+// The reader maps only the segment it is in, so an hour-long log is replayed
+// or analysed without being loaded into memory.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include "telemetry.h"
+
+#define FLIGHT_MAGIC 0x474F4C46u            // "FLOG"
+#define FLIGHT_VERSION 2                    // Follows TELEMETRY_VERSION of the stored frames
+#define FLIGHT_HEADER_SIZE 64
+#define FLIGHT_INDEX_ENTRIES 4096
+#define FLIGHT_INDEX_STRIDE (16 * 1024)
+#define FLIGHT_DATA_OFFSET (FLIGHT_HEADER_SIZE + FLIGHT_INDEX_ENTRIES * 16)
+#define FLIGHT_SEGMENT_SIZE (64u * 1024 * 1024)  // Default, header and index included
+#define FLIGHT_SEGMENT_MAX 100000
+
+// One recorded frame
+typedef struct {
+    uint64_t time_ns;
+    uint64_t device_id;
+    telemetry_frame frame;
+} flight_entry;
+
+typedef struct {
+    char dir[4096];
+    size_t segment_size;
+    uint32_t segment;               // Number of the mapped segment
+    int fd;
+    uint8_t *map;
+    size_t used;                    // Record bytes in the segment
+    uint32_t records;
+    uint32_t index_count;
+    size_t next_index;              // Record offset at which the next index entry is due
+    uint64_t last_time_ns;
+    uint64_t total_records;
+    uint64_t total_bytes;
+} flight_writer;
+
+// Start a new log in dir (created if missing; must not already hold segments).
+// segment_size 0 means FLIGHT_SEGMENT_SIZE. Returns 0 or -1 with errno.
+int flight_writer_open(flight_writer *writer, const char *dir, size_t segment_size);
+
+// Append one frame, starting a new segment when the current one is full.
+// A time earlier than the previous record's is raised to it. Returns 0 or -1 with errno.
+int flight_writer_append(flight_writer *writer, uint64_t time_ns, uint64_t device_id, const telemetry_frame *frame);
+
+// Finish the log; the last segment is truncated to its used size
+void flight_writer_close(flight_writer *writer);
+
+typedef struct {
+    uint32_t number;
+    uint32_t records;
+    uint64_t used;
+    uint64_t first_time_ns;
+    uint64_t last_time_ns;
+} flight_segment;
+
+typedef struct {
+    char dir[4096];
+    flight_segment *segments;       // Sorted by number, empty segments left out
+    int segment_count;
+    int current;                    // Index into segments of the mapped one, -1 if none
+    int fd;
+    const uint8_t *map;
+    size_t map_size;
+    size_t offset;                  // Next record, relative to FLIGHT_DATA_OFFSET
+    uint64_t records;               // In all segments
+    uint32_t corrupt;               // Records that failed to decode (skipped)
+    uint16_t other_version;         // Version of a segment left out for not being FLIGHT_VERSION, 0 if none
+} flight_reader;
+
+// Open a log for reading; only the segment headers are read. Returns 0 or -1 with errno.
+int flight_reader_open(flight_reader *reader, const char *dir);
+
+// Time of the first and last record, 0 for an empty log
+uint64_t flight_reader_start(const flight_reader *reader);
+uint64_t flight_reader_end(const flight_reader *reader);
+
+// Position at the first record at or after time_ns. Returns 0, or -1 past the end.
+int flight_reader_seek(flight_reader *reader, uint64_t time_ns);
+
+// Read the next record. Returns 1, 0 at the end of the log or -1 with errno.
+int flight_reader_next(flight_reader *reader, flight_entry *entry);
+
+void flight_reader_close(flight_reader *reader);
+
+#endif // FLIGHT_LOG_H
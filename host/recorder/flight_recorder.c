@@ -0,0 +1,201 @@
+// Flight recorder: keeps every frame of a session in a flight_log directory.
+//
+// By default it subscribes to the fleet aggregator and records every car; with
+// -c it connects to one car directly (TCP and the UDP sample stream) and
+// records it under an ID made from its address, as the aggregator does for
+// cars given by address. Lost connections are retried every RECONNECT_S.
+//
+// Usage:
+//   flight_recorder [-a HOST[:PORT] | -c HOST[:PORT]] [-s MB] [-q] DIR
+//     -a      aggregator to subscribe to (default 127.0.0.1:FLEET_SUBSCRIBER_PORT)
+//     -c      record one car directly instead
+//     -s MB   segment size (default FLIGHT_SEGMENT_SIZE)
+//     -q      no status line
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include "car_client.h"
+#include "fleet_stream.h"
+#include "flight_log.h"
+
+#define RECONNECT_S 2.0
+#define STATUS_INTERVAL_S 5
+
+static volatile sig_atomic_t quit = 0;
+static flight_writer writer;
+static uint64_t write_errors = 0;
+
+static void on_signal(int signal) {
+    (void)signal;
+    quit = 1;
+}
+
+static uint64_t realtime_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void record(uint64_t device_id, const telemetry_frame *frame) {
+    if (flight_writer_append(&writer, realtime_ns(), device_id, frame) < 0) {
+        if (write_errors++ == 0) {
+            perror("flight log");
+        }
+    }
+}
+
+static void on_record(void *context, uint64_t device_id, const telemetry_frame *frame) {
+    (void)context;
+    record(device_id, frame);
+}
+
+static void on_car_frame(car_client *client, const telemetry_frame *frame, void *context) {
+    (void)client;
+    record(*(const uint64_t *)context, frame);
+}
+
+static int connect_aggregator(const char *host, uint16_t port) {
+    struct sockaddr_in address = {.sin_family = AF_INET, .sin_port = htons(port)};
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    if (inet_pton(AF_INET, host, &address.sin_addr) != 1) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0) {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+    return fd;
+}
+
+static void print_status(bool quiet) {
+    static uint64_t last_records;
+    if (quiet) {
+        return;
+    }
+    printf("records %llu (%.0f/s)  %.1f MB  segment %u  errors %llu\n", (unsigned long long)writer.total_records,
+           (double)(writer.total_records - last_records) / STATUS_INTERVAL_S, writer.total_bytes / 1e6,
+           writer.segment, (unsigned long long)write_errors);
+    fflush(stdout);
+    last_records = writer.total_records;
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: flight_recorder [-a HOST[:PORT] | -c HOST[:PORT]] [-s MB] [-q] DIR\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    char host[INET_ADDRSTRLEN] = "127.0.0.1";
+    unsigned port = FLEET_SUBSCRIBER_PORT;
+    bool direct = false, quiet = false;
+    size_t segment_size = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:c:s:q")) != -1) {
+        switch (opt) {
+            case 'a':
+            case 'c':
+                direct = opt == 'c';
+                port = direct ? CAR_TCP_PORT : FLEET_SUBSCRIBER_PORT;
+                if (sscanf(optarg, "%15[^:]:%u", host, &port) < 1) {
+                    usage();
+                }
+                break;
+            case 's': segment_size = (size_t)atol(optarg) * 1024 * 1024; break;
+            case 'q': quiet = true; break;
+            default: usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+    if (flight_writer_open(&writer, argv[optind], segment_size) < 0) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+
+    struct sigaction action = {.sa_handler = on_signal};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    struct itimerspec period = {.it_interval = {STATUS_INTERVAL_S, 0}, .it_value = {STATUS_INTERVAL_S, 0}};
+    timerfd_settime(timer_fd, 0, &period, NULL);
+    struct epoll_event event = {.events = EPOLLIN, .data.fd = timer_fd};
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &event);
+
+    // Cars given by address are named by it, like in fleet_aggregator
+    struct in_addr car_address = {0};
+    inet_pton(AF_INET, host, &car_address);
+    uint64_t car_id = ((uint64_t)ntohl(car_address.s_addr) << 16) | port;
+    car_client car;
+    car_client_init(&car, on_car_frame, &car_id);
+    fleet_rx rx;
+    int source_fd = -1;
+    double retry_at = 0;
+
+    printf("Recording %s:%u to %s\n", host, port, argv[optind]);
+    while (!quit) {
+        double now = car_client_now();
+        if (source_fd < 0 && now >= retry_at) {
+            retry_at = now + RECONNECT_S;
+            if (direct) {
+                source_fd = car_client_open(&car, host, (uint16_t)port, CAR_UDP_PORT) == 0 ? car_client_fd(&car) : -1;
+            } else {
+                source_fd = connect_aggregator(host, (uint16_t)port);
+                fleet_rx_init(&rx, on_record, NULL);
+            }
+            if (source_fd >= 0) {
+                event.data.fd = source_fd;
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, source_fd, &event);
+            }
+        }
+
+        struct epoll_event events[4];
+        int count = epoll_wait(epoll_fd, events, 4, source_fd < 0 ? (int)(RECONNECT_S * 1000) : -1);
+        for (int i = 0; i < count; i++) {
+            if (events[i].data.fd == timer_fd) {
+                uint64_t expirations;
+                if (read(timer_fd, &expirations, sizeof(expirations)) > 0) {
+                    print_status(quiet);
+                }
+            } else if (direct) {
+                if (car_client_poll(&car, 0) < 0) {
+                    fprintf(stderr, "%s: %s\n", host, strerror(errno));
+                    source_fd = -1;     // Closed with the client's epoll set
+                }
+            } else {
+                uint8_t buffer[16384];
+                ssize_t received = recv(source_fd, buffer, sizeof(buffer), 0);
+                if (received <= 0 || fleet_rx_feed(&rx, buffer, (size_t)received) < 0) {
+                    fprintf(stderr, "%s: aggregator connection lost\n", host);
+                    close(source_fd);
+                    source_fd = -1;
+                }
+            }
+        }
+    }
+
+    flight_writer_close(&writer);
+    print_status(quiet);
+    return write_errors ? 1 : 0;
+}
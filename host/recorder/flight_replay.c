@@ -0,0 +1,375 @@
+// Replay and inspection of a flight_log recording.
+//
+// The log is read through flight_reader, so only the segment being replayed is
+// mapped and a seek (-t) costs a binary search, not a read of everything
+// before it. Frames are paced by their recorded times, scaled by -x.
+//
+// Outputs:
+//   -i         summary: time range, segments, records and samples per car
+//   -p         one text line per frame on stdout (default when no server is given)
+//   -l PORT    act as a car on TCP PORT: the frames of one car (-c, or the first
+//              recorded) go to every client, so "dashboard -n 127.0.0.1 PORT"
+//              shows the run again
+//   -f PORT    act as the fleet aggregator on TCP PORT: every car's frames go to
+//              subscribers as fleet_stream records
+// A server waits for its first client before it starts playing.
+//
+// Usage:
+//   flight_replay [-i] [-p] [-l PORT | -f PORT] [-c ID] [-t SECONDS] [-x SPEED] DIR
+//     -t S    start S seconds into the recording
+//     -x N    speed factor (default 1 = real time, 0 = as fast as possible;
+//             -p and -i default to 0)
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include "car_client.h"
+#include "fleet_stream.h"
+#include "flight_log.h"
+
+#define CLIENT_MAX 8
+#define SUMMARY_CARS 256
+
+static volatile sig_atomic_t quit = 0;
+
+static int listen_fd = -1;
+static int epoll_fd = -1;
+static int clients[CLIENT_MAX];
+static int client_count = 0;
+static uint64_t dropped_frames = 0;
+
+static void on_signal(int signal) {
+    (void)signal;
+    quit = 1;
+}
+
+static void print_entry(const flight_entry *entry) {
+    const telemetry_frame *frame = &entry->frame;
+    printf("%llu.%06llu %016llx ", (unsigned long long)(entry->time_ns / 1000000000u),
+           (unsigned long long)(entry->time_ns % 1000000000u / 1000), (unsigned long long)entry->device_id);
+    switch (frame->type) {
+        case TELEMETRY_DRIVE: {
+            char direction[32];
+            printf("drive %s speed %d\n", telemetry_drive_direction(&frame->u.drive, direction, sizeof(direction)),
+                   frame->u.drive.speed);
+            break;
+        }
+        case TELEMETRY_BARCODE:
+            printf("barcode %.3s%s\n", frame->u.barcode.chars, frame->u.barcode.reverse ? " reverse" : "");
+            break;
+        case TELEMETRY_SAMPLE:
+        case TELEMETRY_BATCH: {
+            const telemetry_batch *batch = &frame->u.batch;
+            const telemetry_sample *s = frame->type == TELEMETRY_SAMPLE ? &frame->u.sample : &batch->samples[0];
+            int count = frame->type == TELEMETRY_SAMPLE ? 1 : batch->count;
+            for (int i = 0; i < count; i++, s++) {
+                printf("%ssample %u x %d y %d heading %d speed %d %d duty %u %u distance %u flags %u\n",
+                       i ? "  " : "", frame->type == TELEMETRY_BATCH ? batch->first_sample + (uint32_t)i : 0,
+                       s->x_mm, s->y_mm, s->heading_mrad, s->left_speed_mm_s, s->right_speed_mm_s, s->left_duty,
+                       s->right_duty, s->distance_mm, s->flags);
+            }
+            break;
+        }
+        case TELEMETRY_BEACON: {
+            char address[INET_ADDRSTRLEN];
+            inet_ntop(AF_INET, frame->u.beacon.ip, address, sizeof(address));
+            printf("beacon %s:%u version %u.%u\n", address, frame->u.beacon.tcp_port, frame->u.beacon.version >> 8,
+                   frame->u.beacon.version & 0xFF);
+            break;
+        }
+        case TELEMETRY_LOG:
+            printf("log %c %s\n", "-EWID"[frame->u.log.level <= 4 ? frame->u.log.level : 0], frame->u.log.text);
+            break;
+        case TELEMETRY_PROFILE: {
+            const telemetry_profile *p = &frame->u.profile;
+            printf("profile %.12s runs %u min %u mean %u p50 %u p99 %u max %u ns\n", p->name, p->count, p->min_ns,
+                   p->mean_ns, p->p50_ns, p->p99_ns, p->max_ns);
+            break;
+        }
+        case TELEMETRY_TASK: {
+            const telemetry_task *t = &frame->u.task;
+            printf("task %u %.12s priority %u cpu %.1f%% stack free %u words\n", t->task, t->name, t->priority,
+                   t->cpu_permille / 10.0, t->stack_free);
+            break;
+        }
+        case TELEMETRY_SYSTEM: {
+            const telemetry_system *sys = &frame->u.system;
+            printf("system busy %.1f%% tasks %u heap %u free %u lowest", sys->busy_permille / 10.0, sys->tasks,
+                   sys->heap_free, sys->heap_min);
+            for (int i = 0; i < sys->queue_count; i++) {
+                printf(" %.8s %u/%u", sys->queues[i].name, sys->queues[i].level, sys->queues[i].capacity);
+            }
+            for (int i = 0; i < sys->cores; i++) {
+                printf(" core%d %.1f%%", i, sys->core_busy_permille[i] / 10.0);
+            }
+            printf("\n");
+            break;
+        }
+        default:
+            printf("type %u\n", frame->type);
+    }
+}
+
+typedef struct {
+    uint64_t id;
+    uint64_t records;
+    uint64_t samples;
+} car_summary;
+
+static int summary(flight_reader *reader) {
+    car_summary cars[SUMMARY_CARS];
+    int car_count = 0;
+    uint64_t start = flight_reader_start(reader), end = flight_reader_end(reader);
+    flight_entry entry;
+
+    printf("%d segments, %llu records, %.1f s\n", reader->segment_count, (unsigned long long)reader->records,
+           (end - start) / 1e9);
+    time_t start_s = (time_t)(start / 1000000000u);
+    printf("start %s", ctime(&start_s));
+
+    // Time one seek into the middle, it should not depend on the log length
+    double before = car_client_now();
+    flight_reader_seek(reader, start + (end - start) / 2);
+    printf("seek to the middle took %.1f us\n", (car_client_now() - before) * 1e6);
+
+    flight_reader_seek(reader, start);
+    int result;
+    while ((result = flight_reader_next(reader, &entry)) > 0) {
+        int i = 0;
+        while (i < car_count && cars[i].id != entry.device_id) {
+            i++;
+        }
+        if (i == car_count) {
+            if (car_count == SUMMARY_CARS) {
+                continue;
+            }
+            cars[car_count++] = (car_summary){.id = entry.device_id};
+        }
+        cars[i].records++;
+        cars[i].samples += entry.frame.type == TELEMETRY_BATCH ? entry.frame.u.batch.count
+                                                               : entry.frame.type == TELEMETRY_SAMPLE;
+    }
+    for (int i = 0; i < car_count; i++) {
+        printf("car %016llx  records %llu  samples %llu\n", (unsigned long long)cars[i].id,
+               (unsigned long long)cars[i].records, (unsigned long long)cars[i].samples);
+    }
+    if (reader->corrupt) {
+        printf("%u corrupt records skipped\n", reader->corrupt);
+    }
+    return result < 0 ? 1 : 0;
+}
+
+// ---- Server ---------------------------------------------------------------
+
+static int open_listener(uint16_t port) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    struct sockaddr_in local = {.sin_family = AF_INET, .sin_port = htons(port), .sin_addr.s_addr = htonl(INADDR_ANY)};
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) < 0 || listen(fd, CLIENT_MAX) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void drop_client(int index) {
+    epoll_ctl(epoll_fd, EPOLL_CTL_DEL, clients[index], NULL);
+    close(clients[index]);
+    clients[index] = clients[--client_count];
+}
+
+// Accept clients and discard what they send (drive keys, subscriptions)
+static void serve(int timeout_ms) {
+    struct epoll_event events[CLIENT_MAX + 1];
+    int count = epoll_wait(epoll_fd, events, CLIENT_MAX + 1, timeout_ms);
+    for (int i = 0; i < count; i++) {
+        int fd = events[i].data.fd;
+        if (fd == listen_fd) {
+            int client = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (client >= 0 && client_count < CLIENT_MAX) {
+                struct epoll_event event = {.events = EPOLLIN, .data.fd = client};
+                epoll_ctl(epoll_fd, EPOLL_CTL_ADD, client, &event);
+                clients[client_count++] = client;
+            } else if (client >= 0) {
+                close(client);
+            }
+            continue;
+        }
+        char buffer[256];
+        ssize_t received = recv(fd, buffer, sizeof(buffer), 0);
+        if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)) {
+            for (int k = 0; k < client_count; k++) {
+                if (clients[k] == fd) {
+                    drop_client(k);
+                    break;
+                }
+            }
+        }
+    }
+}
+
+// A client that cannot take a whole frame misses it, like a slow link to a car
+static void broadcast(const uint8_t *data, size_t length) {
+    for (int i = 0; i < client_count;) {
+        ssize_t sent = send(clients[i], data, length, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            dropped_frames++;
+        } else if (sent >= 0 && (size_t)sent < length) {
+            drop_client(i);     // A partial frame would desynchronise it
+            continue;
+        } else if (sent < 0) {
+            drop_client(i);
+            continue;
+        }
+        i++;
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: flight_replay [-i] [-p] [-l PORT | -f PORT] [-c ID] [-t SECONDS] [-x SPEED] DIR\n");
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    bool info = false, print = false, fleet = false, have_car = false;
+    double offset_s = 0, speed = -1;
+    unsigned long long car_id = 0;
+    int port = 0, opt;
+
+    while ((opt = getopt(argc, argv, "ipl:f:c:t:x:")) != -1) {
+        switch (opt) {
+            case 'i': info = true; break;
+            case 'p': print = true; break;
+            case 'l':
+            case 'f':
+                port = atoi(optarg);
+                fleet = opt == 'f';
+                break;
+            case 'c':
+                if (sscanf(optarg, "%llx", &car_id) != 1) {
+                    usage();
+                }
+                have_car = true;
+                break;
+            case 't': offset_s = atof(optarg); break;
+            case 'x': speed = atof(optarg); break;
+            default: usage();
+        }
+    }
+    if (optind != argc - 1) {
+        usage();
+    }
+    if (port == 0 && !info) {
+        print = true;
+    }
+    if (speed < 0) {
+        speed = port ? 1 : 0;
+    }
+
+    flight_reader reader;
+    if (flight_reader_open(&reader, argv[optind]) < 0) {
+        fprintf(stderr, "%s: %s\n", argv[optind], strerror(errno));
+        return 1;
+    }
+    if (reader.other_version) {
+        fprintf(stderr, "%s: segments of flight log version %u skipped, this build reads version %u\n",
+                argv[optind], reader.other_version, FLIGHT_VERSION);
+    }
+    if (reader.segment_count == 0) {
+        fprintf(stderr, "%s: no recording\n", argv[optind]);
+        return 1;
+    }
+    if (info) {
+        int status = summary(&reader);
+        flight_reader_close(&reader);
+        return status;
+    }
+
+    struct sigaction action = {.sa_handler = on_signal};
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+    signal(SIGPIPE, SIG_IGN);
+
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (port) {
+        listen_fd = open_listener((uint16_t)port);
+        if (listen_fd < 0) {
+            perror("listen");
+            return 1;
+        }
+        struct epoll_event event = {.events = EPOLLIN, .data.fd = listen_fd};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &event);
+        fprintf(stderr, "Waiting for a client on port %d\n", port);
+        while (!quit && client_count == 0) {
+            serve(-1);
+        }
+    }
+
+    uint64_t start = flight_reader_start(&reader) + (uint64_t)(offset_s * 1e9);
+    if (flight_reader_seek(&reader, start) < 0) {
+        fprintf(stderr, "%s: nothing after %.1f s\n", argv[optind], offset_s);
+        return 1;
+    }
+
+    flight_entry entry;
+    double wall_start = car_client_now();
+    uint64_t played = 0;
+    int result = 0;
+    while (!quit && (result = flight_reader_next(&reader, &entry)) > 0) {
+        // Wait until the frame is due, serving clients meanwhile
+        if (speed > 0) {
+            double due = wall_start + (double)(entry.time_ns - start) / 1e9 / speed;
+            double now;
+            while (!quit && (now = car_client_now()) < due) {
+                if (port) {
+                    serve((int)((due - now) * 1000) + 1);
+                } else {
+                    struct timespec pause = {0, (long)((due - now) * 1e9)};
+                    nanosleep(&pause, NULL);
+                }
+            }
+        } else if (port) {
+            serve(0);
+        }
+
+        if (port && !fleet) {
+            if (!have_car) {
+                car_id = entry.device_id;   // First car recorded
+                have_car = true;
+            }
+            if (entry.device_id == car_id) {
+                uint8_t buffer[TELEMETRY_MAX_FRAME];
+                size_t length = telemetry_encode(&entry.frame, buffer, sizeof(buffer));
+                broadcast(buffer, length);
+            }
+        } else if (port) {
+            uint8_t buffer[FLEET_RECORD_MAX];
+            size_t length = fleet_record_encode(entry.device_id, &entry.frame, buffer, sizeof(buffer));
+            broadcast(buffer, length);
+        }
+        if (print && (!have_car || entry.device_id == car_id)) {
+            print_entry(&entry);
+        }
+        played++;
+    }
+
+    fprintf(stderr, "Replayed %llu records in %.1f s", (unsigned long long)played, car_client_now() - wall_start);
+    if (port) {
+        fprintf(stderr, ", %llu frames dropped by slow clients", (unsigned long long)dropped_frames);
+    }
+    fprintf(stderr, "\n");
+    flight_reader_close(&reader);
+    return result < 0 ? 1 : 0;
+}
@@ -0,0 +1,236 @@
+// Benchmark for the delta compressed telemetry batches.
+//
+// Generates a deterministic drive (accelerate, cruise, turn, brake for an
+// obstacle) sampled at 200 Hz with encoder and PWM noise, and for several
+// batch sizes and field sets reports the raw TELEMETRY_BATCH size, the
+// TELEMETRY_BATCH_DELTA size, the compression ratio and the encode/decode time
+// per frame. Every frame is decoded again and compared with the original, so a
+// mismatch between the encoder and the decoder fails the run. A second table
+// drops datagrams at random and shows how many samples the receiver loses
+// while it waits for the next keyframe.
+//
+// Encode cost on the car itself is in telemetry_stream_counters
+// (encode_cycles_max, mean from encode_cycles_sum / datagrams).
+//
+// Usage: telemetry_bench [seconds of drive]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "telemetry.h"
+#include "telemetry_delta.h"
+
+#define SAMPLE_HZ 200
+#define DEFAULT_SECONDS 600
+#define MM_PER_PULSE 1.07       // Wheel circumference / encoder slots
+#define LOSS_PERCENT 2
+
+static const int batch_sizes[] = {5, 10, 20};
+static const struct {
+    const char *name;
+    uint8_t fields;
+} field_sets[] = {
+    {"all", TELEMETRY_FIELDS_ALL},
+    {"pose+speed+range", TELEMETRY_FIELD_POSE | TELEMETRY_FIELD_SPEED | TELEMETRY_FIELD_RANGE},
+    {"speed+range", TELEMETRY_FIELD_SPEED | TELEMETRY_FIELD_RANGE},
+};
+static const int keyframe_intervals[] = {1, 5, 10, 20};
+
+#define COUNT(a) (int)(sizeof(a) / sizeof(a[0]))
+
+// Small deterministic PRNG so every run generates the same drive
+static uint32_t rng_state = 12345;
+
+static uint32_t rng_next(void) {
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static double rng_uniform(void) {
+    return (rng_next() + 0.5) / 4294967296.0;
+}
+
+static double rng_gaussian(void) {
+    return sqrt(-2.0 * log(rng_uniform())) * cos(2.0 * M_PI * rng_uniform());
+}
+
+// Fill samples with a drive of repeating 20 s laps
+static void generate_drive(telemetry_sample *samples, int count) {
+    const double dt = 1.0 / SAMPLE_HZ;
+    double x = 0, y = 0, heading = 0, left = 0, right = 0, wall = 2000;
+
+    for (int i = 0; i < count; i++) {
+        double t = fmod(i * dt, 20.0);
+        double target = 0, turn = 0;
+        if (t < 2) target = 100 * t;                    // Accelerate
+        else if (t < 10) target = 200;                  // Cruise
+        else if (t < 13) { target = 120; turn = 60; }   // Turn
+        else if (t < 17) target = 200;
+        if (wall < 150) target = 0;                     // Obstacle ahead
+
+        // First order response of the wheels to the target speed
+        left += (target - turn - left) * 0.05;
+        right += (target + turn - right) * 0.05;
+        double v = (left + right) / 2;
+        x += v * cos(heading) * dt;
+        y += v * sin(heading) * dt;
+        heading = remainder(heading + (right - left) / 110.0 * dt, 2 * M_PI);
+        wall -= v * dt;
+        if (wall < 100 || t < dt) wall = 1500 + 1000 * rng_uniform();
+
+        // Encoder speed is counted in whole pulses per 20 ms window
+        telemetry_sample *s = &samples[i];
+        s->x_mm = (int32_t)lround(x);
+        s->y_mm = (int32_t)lround(y);
+        s->heading_mrad = (int16_t)lround(heading * 1000);
+        s->left_speed_mm_s = (int16_t)(lround(left * 0.02 / MM_PER_PULSE + rng_gaussian() * 0.4) * MM_PER_PULSE / 0.02);
+        s->right_speed_mm_s = (int16_t)(lround(right * 0.02 / MM_PER_PULSE + rng_gaussian() * 0.4) * MM_PER_PULSE / 0.02);
+        s->left_duty = (uint16_t)(target > 0 ? 3000 + left * 20 + rng_gaussian() * 40 : 0);
+        s->right_duty = (uint16_t)(target > 0 ? 3000 + right * 20 + rng_gaussian() * 40 : 0);
+        s->distance_mm = (uint16_t)lround(wall + rng_gaussian() * 2);
+        s->flags = TELEMETRY_FLAG_DISTANCE_VALID | (wall < 150 ? TELEMETRY_FLAG_OBSTACLE : 0);
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void make_batch(telemetry_frame *frame, const telemetry_sample *samples, int first, int count, uint8_t fields) {
+    memset(frame, 0, sizeof(*frame));
+    frame->type = TELEMETRY_BATCH;
+    frame->seq = (uint16_t)(first / count);
+    frame->timestamp_us = (uint32_t)((uint64_t)first * 1000000 / SAMPLE_HZ);
+    frame->u.batch.first_sample = (uint32_t)first;
+    frame->u.batch.period_us = 1000000 / SAMPLE_HZ;
+    frame->u.batch.count = (uint8_t)count;
+    frame->u.batch.fields = fields;
+    for (int i = 0; i < count; i++) {
+        frame->u.batch.samples[i] = samples[first + i];
+    }
+}
+
+// Field groups that are absent decode as 0
+static bool same_samples(const telemetry_batch *a, const telemetry_batch *b) {
+    for (int i = 0; i < a->count; i++) {
+        const telemetry_sample *s = &a->samples[i], *t = &b->samples[i];
+        if (((a->fields & TELEMETRY_FIELD_POSE) && (s->x_mm != t->x_mm || s->y_mm != t->y_mm || s->heading_mrad != t->heading_mrad)) ||
+            ((a->fields & TELEMETRY_FIELD_SPEED) && (s->left_speed_mm_s != t->left_speed_mm_s || s->right_speed_mm_s != t->right_speed_mm_s)) ||
+            ((a->fields & TELEMETRY_FIELD_DUTY) && (s->left_duty != t->left_duty || s->right_duty != t->right_duty)) ||
+            ((a->fields & TELEMETRY_FIELD_RANGE) && (s->distance_mm != t->distance_mm || s->flags != t->flags))) {
+            return false;
+        }
+    }
+    return a->count == b->count && a->first_sample == b->first_sample && a->fields == b->fields;
+}
+
+// Compress the whole drive with one batch size and field set; false on a round trip mismatch
+static bool run_ratio(const telemetry_sample *samples, int total, int batch_size, uint8_t fields, const char *name) {
+    static uint8_t buf[TELEMETRY_MAX_FRAME];
+    static telemetry_frame frame, decoded;
+    telemetry_delta_state encoder, decoder;
+    uint64_t raw_bytes = 0, delta_bytes = 0, encode_ns = 0, decode_ns = 0;
+    int frames = 0, fallbacks = 0;
+
+    telemetry_delta_init(&encoder, TELEMETRY_DELTA_KEYFRAME_INTERVAL);
+    telemetry_delta_init(&decoder, 0);
+    for (int first = 0; first + batch_size <= total; first += batch_size) {
+        make_batch(&frame, samples, first, batch_size, fields);
+        raw_bytes += telemetry_encoded_size(&frame);
+
+        uint64_t start = now_ns();
+        size_t length = telemetry_delta_encode(&encoder, &frame, buf, sizeof(buf));
+        encode_ns += now_ns() - start;
+        if (length == 0) {
+            // Too big compressed; the streamer sends it raw
+            length = telemetry_encode(&frame, buf, sizeof(buf));
+            fallbacks++;
+        }
+        delta_bytes += length;
+
+        start = now_ns();
+        int result = telemetry_decode(buf, length, &decoded);
+        if (result > 0) {
+            result = telemetry_delta_decode(&decoder, &decoded, &decoded);
+        }
+        decode_ns += now_ns() - start;
+        if (result != batch_size || !same_samples(&frame.u.batch, &decoded.u.batch)) {
+            printf("Round trip mismatch at sample %d (batch %d, %s): %d\n", first, batch_size, name, result);
+            return false;
+        }
+        frames++;
+    }
+
+    printf("%-6d %-17s %9.1f %9.1f %7.2fx %10.1f %10.1f %6d\n", batch_size, name,
+           (double)raw_bytes / frames, (double)delta_bytes / frames, (double)raw_bytes / delta_bytes,
+           (double)encode_ns / frames, (double)decode_ns / frames, fallbacks);
+    return true;
+}
+
+// Drop LOSS_PERCENT of the datagrams and count the samples the receiver cannot decode
+static void run_loss(const telemetry_sample *samples, int total, int keyframe_interval) {
+    static uint8_t buf[TELEMETRY_MAX_FRAME];
+    static telemetry_frame frame, decoded;
+    telemetry_delta_state encoder, decoder;
+    uint64_t bytes = 0;
+    int lost = 0, unusable = 0, frames = 0;
+
+    rng_state = 777;
+    telemetry_delta_init(&encoder, (uint8_t)keyframe_interval);
+    telemetry_delta_init(&decoder, 0);
+    for (int first = 0; first + 10 <= total; first += 10) {
+        make_batch(&frame, samples, first, 10, TELEMETRY_FIELDS_ALL);
+        size_t length = telemetry_delta_encode(&encoder, &frame, buf, sizeof(buf));
+        bytes += length;
+        frames++;
+        if (rng_next() % 100 < LOSS_PERCENT) {
+            lost += 10;
+            continue;
+        }
+        if (telemetry_decode(buf, length, &decoded) <= 0 ||
+            telemetry_delta_decode(&decoder, &decoded, &decoded) < 0) {
+            unusable += 10;
+        }
+    }
+    printf("%-9d %9.1f %10d %10d\n", keyframe_interval, (double)bytes / frames, lost, unusable);
+}
+
+int main(int argc, char **argv) {
+    int seconds = argc > 1 ? atoi(argv[1]) : DEFAULT_SECONDS;
+    if (seconds <= 0) {
+        fprintf(stderr, "usage: telemetry_bench [seconds]\n");
+        return 2;
+    }
+    int total = seconds * SAMPLE_HZ;
+    telemetry_sample *samples = calloc((size_t)total, sizeof(telemetry_sample));
+    if (!samples) {
+        perror("calloc");
+        return 1;
+    }
+    generate_drive(samples, total);
+
+    printf("%d s drive at %d Hz, keyframe every %d frames\n", seconds, SAMPLE_HZ, TELEMETRY_DELTA_KEYFRAME_INTERVAL);
+    printf("%-6s %-17s %9s %9s %8s %10s %10s %6s\n", "batch", "fields", "raw B", "delta B", "ratio",
+           "enc ns", "dec ns", "raw");
+    bool ok = true;
+    for (int f = 0; f < COUNT(field_sets) && ok; f++) {
+        for (int b = 0; b < COUNT(batch_sizes) && ok; b++) {
+            ok = run_ratio(samples, total, batch_sizes[b], field_sets[f].fields, field_sets[f].name);
+        }
+    }
+
+    printf("\n%d%% datagram loss, batch 10, all fields\n", LOSS_PERCENT);
+    printf("%-9s %9s %10s %10s\n", "keyframe", "bytes", "lost", "unusable");
+    for (int k = 0; k < COUNT(keyframe_intervals); k++) {
+        run_loss(samples, total, keyframe_intervals[k]);
+    }
+
+    free(samples);
+    return ok ? 0 : 1;
+}
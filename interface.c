@@ -3,16 +3,27 @@
 #include <ws2tcpip.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "protocol/telemetry.h"     // Build with protocol/telemetry.c
 
 #pragma comment(lib, "ws2_32.lib")  // Link with Winsock library
 
-#define SERVER_IP "172.20.10.10"   // Replace with your Pico W server IP
+#define SERVER_IP "172.20.10.10"   // Fallback when no car beacon is heard
 #define SERVER_PORT 4242           // Port on which picow_tcp_server.c listens
+#define DISCOVERY_TIMEOUT_MS 5000  // How long to listen for a car's beacon
+
+// Frame types shown in the window. Samples only come in batches; the car
+// leaves TELEMETRY_BATCH out of its default TCP subscription.
+#define SUBSCRIPTIONS ((1u << TELEMETRY_DRIVE) | (1u << TELEMETRY_BATCH) | (1u << TELEMETRY_BARCODE))
 
 // Global variable to store telemetry data
 typedef struct {
     char direction[40];  // Holds combined movement and turn direction
     int speed;           // Holds speed value
+    float distance_cm;   // Filtered ultrasonic distance from the last sample
+    float left_speed_cm_s;
+    float right_speed_cm_s;
+    char barcode[4];     // Last decoded barcode
+    unsigned long decode_errors;  // Resynchronisations after corrupt bytes
 } TelemetryData;
 
 TelemetryData telemetry_data = {0};
@@ -20,11 +31,53 @@ HWND hwnd;  // Declare the window handle as a global variable
 
 CRITICAL_SECTION telemetryLock;  // Critical section for thread safety
 
+// Wait for the first car beacon and take its address and port from it.
+// Returns false if none arrives within DISCOVERY_TIMEOUT_MS.
+static bool discover_server(char *ip, size_t ip_size, int *port) {
+    SOCKET sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    struct sockaddr_in local = {0};
+    DWORD timeout = 500;
+    DWORD start = GetTickCount();
+    bool found = false;
+
+    if (sock == INVALID_SOCKET) {
+        return false;
+    }
+    BOOL reuse = TRUE;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, (const char *)&reuse, sizeof(reuse));
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, (const char *)&timeout, sizeof(timeout));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(TELEMETRY_DISCOVERY_PORT);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (struct sockaddr *)&local, sizeof(local)) == SOCKET_ERROR) {
+        closesocket(sock);
+        return false;
+    }
+
+    printf("Listening for a car beacon on UDP port %d...\n", TELEMETRY_DISCOVERY_PORT);
+    while (!found && GetTickCount() - start < DISCOVERY_TIMEOUT_MS) {
+        uint8_t buf[TELEMETRY_MAX_FRAME];
+        telemetry_frame frame;
+        int received = recv(sock, (char *)buf, sizeof(buf), 0);
+        if (received > 0 && telemetry_decode(buf, received, &frame) > 0 && frame.type == TELEMETRY_BEACON) {
+            inet_ntop(AF_INET, frame.u.beacon.ip, ip, ip_size);
+            *port = frame.u.beacon.tcp_port;
+            printf("Found car %016llx at %s:%d, firmware %d.%d\n", (unsigned long long)frame.u.beacon.device_id,
+                   ip, *port, frame.u.beacon.version >> 8, frame.u.beacon.version & 0xFF);
+            found = true;
+        }
+    }
+    closesocket(sock);
+    return found;
+}
+
 // Function to initialize Winsock and connect to the server
 SOCKET connect_to_server() {
     WSADATA wsaData;
     SOCKET ConnectSocket = INVALID_SOCKET;
     struct sockaddr_in server_addr;
+    char server_ip[INET_ADDRSTRLEN] = SERVER_IP;
+    int server_port = SERVER_PORT;
 
     // Initialize Winsock
     if (WSAStartup(MAKEWORD(2, 2), &wsaData) != 0) {
@@ -32,6 +85,11 @@ SOCKET connect_to_server() {
         return INVALID_SOCKET;
     }
 
+    // Prefer the address the car announces; fall back to SERVER_IP
+    if (!discover_server(server_ip, sizeof(server_ip), &server_port)) {
+        printf("No car beacon heard, using %s:%d\n", server_ip, server_port);
+    }
+
     // Create a socket
     ConnectSocket = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
     if (ConnectSocket == INVALID_SOCKET) {
@@ -42,8 +100,8 @@ SOCKET connect_to_server() {
 
     // Set up the server address struct
     server_addr.sin_family = AF_INET;
-    server_addr.sin_port = htons(SERVER_PORT);
-    inet_pton(AF_INET, SERVER_IP, &server_addr.sin_addr);
+    server_addr.sin_port = htons(server_port);
+    inet_pton(AF_INET, server_ip, &server_addr.sin_addr);
 
     // Connect to the server
     if (connect(ConnectSocket, (struct sockaddr *)&server_addr, sizeof(server_addr)) == SOCKET_ERROR) {
@@ -53,41 +111,93 @@ SOCKET connect_to_server() {
         return INVALID_SOCKET;
     }
 
-    printf("Connected to server at %s:%d\n", SERVER_IP, SERVER_PORT);
+    printf("Connected to server at %s:%d\n", server_ip, server_port);
+
+    char subscribe[32];
+    int length = snprintf(subscribe, sizeof(subscribe), "SUBSCRIBE %u\n", SUBSCRIPTIONS);
+    send(ConnectSocket, subscribe, length, 0);
     return ConnectSocket;
 }
 
+// Apply one decoded telemetry frame to the displayed data
+static void apply_frame(const telemetry_frame *frame) {
+    EnterCriticalSection(&telemetryLock);
+    switch (frame->type) {
+        case TELEMETRY_DRIVE:
+            telemetry_drive_direction(&frame->u.drive, telemetry_data.direction, sizeof(telemetry_data.direction));
+            telemetry_data.speed = frame->u.drive.speed;
+            break;
+        case TELEMETRY_BATCH: {
+            // Only the newest sample is shown; field groups the car left out keep their value
+            const telemetry_batch *batch = &frame->u.batch;
+            if (batch->count == 0) {
+                break;
+            }
+            const telemetry_sample *sample = &batch->samples[batch->count - 1];
+            if (batch->fields & TELEMETRY_FIELD_RANGE) {
+                telemetry_data.distance_cm = sample->distance_mm / 10.0f;
+            }
+            if (batch->fields & TELEMETRY_FIELD_SPEED) {
+                telemetry_data.left_speed_cm_s = sample->left_speed_mm_s / 10.0f;
+                telemetry_data.right_speed_cm_s = sample->right_speed_mm_s / 10.0f;
+            }
+            break;
+        }
+        case TELEMETRY_BARCODE:
+            memcpy(telemetry_data.barcode, frame->u.barcode.chars, 3);
+            telemetry_data.barcode[3] = '\0';
+            break;
+    }
+    LeaveCriticalSection(&telemetryLock);
+}
+
 // Function to receive telemetry data from the server
 DWORD WINAPI receive_telemetry(LPVOID lpParam) {
     SOCKET ConnectSocket = *(SOCKET *)lpParam;
-    char recvbuf[2048];
+    uint8_t recvbuf[2048];
+    int buffered = 0;   // Bytes of a partial frame kept from the previous recv
     int bytes_received;
 
     while (1) {
-        // Clear the buffer before each receive to avoid leftover data
-        memset(recvbuf, 0, sizeof(recvbuf));
-
-        bytes_received = recv(ConnectSocket, recvbuf, sizeof(recvbuf) - 1, 0);
+        bytes_received = recv(ConnectSocket, (char *)recvbuf + buffered, sizeof(recvbuf) - buffered, 0);
 
         if (bytes_received > 0) {
-            recvbuf[bytes_received] = '\0';
-
-            // Debug statement to verify data after receiving
-            printf("Debug: Received parsed telemetry data: %s\n", recvbuf);
-
-            EnterCriticalSection(&telemetryLock);
-            
-            // Clear telemetry data before updating
-            memset(telemetry_data.direction, 0, sizeof(telemetry_data.direction));
-            
-            // Parse the direction and speed from the received buffer
-            sscanf(recvbuf, "Direction: %39[^;]; Speed: %d", telemetry_data.direction, &telemetry_data.speed);
-
-            LeaveCriticalSection(&telemetryLock);
+            buffered += bytes_received;
+
+            // Decode every complete frame, keep a trailing partial frame for the next recv
+            int offset = 0;
+            bool updated = false;
+            bool resyncing = false;
+            while (offset < buffered) {
+                telemetry_frame frame;
+                int result = telemetry_decode(recvbuf + offset, buffered - offset, &frame);
+                if (result == TELEMETRY_NEED_MORE) {
+                    break;
+                } else if (result < 0) {
+                    // Resynchronise on the next magic byte, counting each corrupt run once
+                    if (!resyncing) {
+                        EnterCriticalSection(&telemetryLock);
+                        telemetry_data.decode_errors++;
+                        LeaveCriticalSection(&telemetryLock);
+                        resyncing = true;
+                        updated = true;
+                    }
+                    offset++;
+                } else {
+                    apply_frame(&frame);
+                    updated = true;
+                    resyncing = false;
+                    offset += result;
+                }
+            }
+            memmove(recvbuf, recvbuf + offset, buffered - offset);
+            buffered -= offset;
 
             // Trigger the window to repaint with the new data
-            InvalidateRect(hwnd, NULL, TRUE);
-            UpdateWindow(hwnd);
+            if (updated) {
+                InvalidateRect(hwnd, NULL, TRUE);
+                UpdateWindow(hwnd);
+            }
         } else if (bytes_received == 0) {
             printf("Connection closed by server\n");
             break;
@@ -126,6 +236,16 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             // Display the speed data on the next line
             sprintf(buffer, "Speed: %d", telemetry_data.speed);
             TextOut(hdc, 10, 30, buffer, strlen(buffer));
+
+            // Display the latest control loop sample
+            sprintf(buffer, "Distance: %.1f cm", telemetry_data.distance_cm);
+            TextOut(hdc, 10, 50, buffer, strlen(buffer));
+            sprintf(buffer, "Wheels: L %.1f cm/s, R %.1f cm/s", telemetry_data.left_speed_cm_s, telemetry_data.right_speed_cm_s);
+            TextOut(hdc, 10, 70, buffer, strlen(buffer));
+            sprintf(buffer, "Barcode: %s", telemetry_data.barcode);
+            TextOut(hdc, 10, 90, buffer, strlen(buffer));
+            sprintf(buffer, "Decode errors: %lu", telemetry_data.decode_errors);
+            TextOut(hdc, 10, 110, buffer, strlen(buffer));
             LeaveCriticalSection(&telemetryLock);
 
             EndPaint(hwnd, &ps);
@@ -4,6 +4,14 @@
 #include "pico/stdlib.h"
 #include "hardware/pwm.h"
 #include "buddy5/buddy5.h"         // Buddy5 motor control functions
+#include "common/trace.h"          // Deferred formatting of hot-path trace events
+#include "common/profile.h"        // Latency histograms of the loop stages
+#ifdef REMOTE_DRIVE
+#include "buddy1/buddy1.h"         // Buddy1 Wi-Fi command server and remote drive
+#endif
+#ifdef CAR_RTOS
+#include "rtos/car_tasks.h"        // FreeRTOS tasks of the remote drive firmware
+#endif
 
 // Define robot states
 typedef enum {
@@ -21,6 +29,14 @@ uint64_t turning_start_time = 0;
 
 float target_distance_cm = 90.0f; // Distance to move forward in cm
 
+// Profiled stages of the main loop, the GPIO IRQ registers its own
+static int loop_profile = -1;
+static int sonar_profile = -1;
+static int control_profile = -1;
+static int trace_profile = -1;
+
+#define PROFILE_DUMP_INTERVAL_MS 30000
+
 // Function prototypes
 void start_turning_right(void);
 void reset_distance_counters(void);
@@ -35,13 +51,81 @@ void reset_distance_counters() {
     right_total_distance = 0.0f;
 }
 
+#ifdef REMOTE_DRIVE
+// Remote drive firmware (project_remote): the car only moves on commands from the client
+#define REMOTE_RANGE_INTERVAL_MS 50   // Sonar is polled less often so commands are applied promptly
+
+static void run_remote_drive(void) {
+    control_profile = profile_register("drive");
+    remote_drive_init();
+    if (!remote_server_start()) {
+        printf("Remote server failed to start\n");
+        return;
+    }
+    trace_set_sink(telemetry_log_sink);   // Trace lines also go to the clients
+
+    float current_distance = 0.0f;
+    uint32_t last_range_time = 0;
+    uint32_t last_report_time = 0;
+
+    while (true) {
+        profile_scope loop_scope = profile_begin(loop_profile);
+        uint32_t current_time = time_us_64() / 1000;
+
+        if (current_time - last_range_time >= REMOTE_RANGE_INTERVAL_MS) {
+            PROFILE_SCOPE(sonar_profile);
+            measureDistanceAndBuzz();
+            current_distance = getCm();
+            last_range_time = current_time;
+        }
+
+        {
+            PROFILE_SCOPE(control_profile);
+            remote_drive_poll(current_distance, distance_valid && current_distance <= 15);
+        }
+
+        // Print latency, queue and stream statistics every 5 s, and send the profile
+        if (current_time - last_report_time >= 5000) {
+            remote_drive_report();
+            telemetry_stream_report();
+            telemetry_profile_publish();
+            last_report_time = current_time;
+        }
+
+        {
+            PROFILE_SCOPE(trace_profile);
+            trace_drain(TRACE_DRAIN_BUDGET);
+        }
+        profile_end(&loop_scope);
+        sleep_ms(1);
+    }
+}
+#endif
+
 int main() {
     stdio_init_all();
+    profile_init();
     motor_control_init();
     
     // Initialize all Buddy5 components (includes Kalman filter)
     initializeBuddy5Components();
+
+#ifdef CAR_RTOS
+    car_tasks_start();  // Registers its own profile sections and never returns
+    return 0;
+#endif
+
+    loop_profile = profile_register("loop");
+    sonar_profile = profile_register("sonar");
+    trace_profile = profile_register("trace");
+
+#ifdef REMOTE_DRIVE
+    run_remote_drive();
+    return 0;
+#endif
     
+    control_profile = profile_register("pid");
+
     // Reset PID controller variables
     integral_left = 0.0f;
     prev_error_left = 0.0f;
@@ -56,11 +140,17 @@ int main() {
 
     float current_distance = 0.0f;
     uint32_t last_print_time = 0;
+    uint32_t last_profile_time = 0;
 
     while (true) {
+        profile_scope loop_scope = profile_begin(loop_profile);
+
         // Measure distance and handle buzzer using Kalman-filtered measurements
-        measureDistanceAndBuzz();
-        current_distance = getCm();  // Get current filtered distance
+        {
+            PROFILE_SCOPE(sonar_profile);
+            measureDistanceAndBuzz();
+            current_distance = getCm();  // Get current filtered distance
+        }
         
         // Print debug information every 500ms
         uint32_t current_time = time_us_64() / 1000;
@@ -74,7 +164,7 @@ int main() {
         switch (current_state) {
             case STATE_MOVING_FORWARD:
                 // Check if obstacle is detected at or before threshold
-                if (current_distance <= 15) {
+                if (distance_valid && current_distance <= 15) {
                     // Stop immediately when reaching threshold
                     printf("Obstacle detected at threshold (%.2f cm)! Stopping motors and starting turn.\n", current_distance);
                     set_pwm_duty_cycle(PWM_PIN, 0.0f);   // Left motor
@@ -90,6 +180,7 @@ int main() {
                     current_state = STATE_TURNING_RIGHT;
                 } else {
                     // No obstacle at threshold, continue forward with speed adjustment
+                    PROFILE_SCOPE(control_profile);
                     adjust_left_motor_speed();
                     
                     // Optional: Print distance for debugging
@@ -141,6 +232,19 @@ int main() {
                 break;
         }
 
+        // Format trace events recorded since the last pass
+        {
+            PROFILE_SCOPE(trace_profile);
+            trace_drain(TRACE_DRAIN_BUDGET);
+        }
+
+        // Histograms of the loop stages and the GPIO IRQ
+        if (current_time - last_profile_time >= PROFILE_DUMP_INTERVAL_MS) {
+            profile_dump();
+            last_profile_time = current_time;
+        }
+        profile_end(&loop_scope);
+
         // Add a small delay to prevent CPU overutilization
         sleep_ms(1);
     }
@@ -0,0 +1,418 @@
+#include <string.h>
+#include <stdbool.h>
+#include "command.h"
+
+typedef enum {
+    KW_NONE,
+    KW_FORWARD,
+    KW_BACKWARD,
+    KW_LEFT,
+    KW_RIGHT,
+    KW_STOP,
+    KW_MOVEMENT,
+    KW_TURNING,
+    KW_SPEED,
+    KW_HEADING,
+    KW_DISTANCE,
+    KW_PID,
+    KW_MOTOR,
+    KW_LINE,
+    KW_BINARY,
+    KW_SUBSCRIBE,
+    KW_TRACE,
+    KW_PROFILE
+} keyword;
+
+static const struct {
+    const char *word;
+    uint8_t length;
+    uint8_t id;
+} keyword_table[] = {
+    {"FORWARD", 7, KW_FORWARD},
+    {"BACKWARD", 8, KW_BACKWARD},
+    {"LEFT", 4, KW_LEFT},
+    {"RIGHT", 5, KW_RIGHT},
+    {"STOP", 4, KW_STOP},
+    {"MOVEMENT", 8, KW_MOVEMENT},
+    {"TURNING", 7, KW_TURNING},
+    {"SPEED", 5, KW_SPEED},
+    {"HEADING", 7, KW_HEADING},
+    {"DISTANCE", 8, KW_DISTANCE},
+    {"PID", 3, KW_PID},
+    {"MOTOR", 5, KW_MOTOR},
+    {"LINE", 4, KW_LINE},
+    {"BINARY", 6, KW_BINARY},
+    {"SUBSCRIBE", 9, KW_SUBSCRIBE},
+    {"TRACE", 5, KW_TRACE},
+    {"PROFILE", 7, KW_PROFILE},
+};
+
+// Parameter types for the opcode table
+typedef enum {
+    ARG_INT16,      // Text: integer; binary: i16
+    ARG_LOOP,       // Text: MOTOR|LINE; binary: u8
+    ARG_GAIN        // Text: decimal; binary: i32 in 1/1000 units
+} arg_type;
+
+#define MAX_ARGS 4
+
+// One row per opcode: the text keyword that selects it and its parameters.
+// CMD_DRIVE is selected by any motion word and parsed separately.
+static const struct {
+    uint8_t opcode;
+    uint8_t keyword;
+    uint8_t arg_count;
+    uint8_t args[MAX_ARGS];
+    int32_t min, max;       // Range of ARG_INT16 parameters
+} opcode_table[] = {
+    {CMD_DRIVE,     KW_NONE,      0, {0},                                      0, 0},
+    {CMD_SPEED,     KW_SPEED,     1, {ARG_INT16},                              -100, 100},
+    {CMD_HEADING,   KW_HEADING,   1, {ARG_INT16},                              -360, 360},
+    {CMD_DISTANCE,  KW_DISTANCE,  1, {ARG_INT16},                              -1000, 1000},
+    {CMD_PID,       KW_PID,       4, {ARG_LOOP, ARG_GAIN, ARG_GAIN, ARG_GAIN}, 0, 0},
+    {CMD_BINARY,    KW_BINARY,    0, {0},                                      0, 0},
+    {CMD_SUBSCRIBE, KW_SUBSCRIBE, 1, {ARG_INT16},                              0, 0x7FFF},
+    {CMD_TRACE,     KW_TRACE,     1, {ARG_INT16},                              0, 4},
+    {CMD_PROFILE,   KW_PROFILE,   1, {ARG_INT16},                              0, 1},
+    {CMD_LINE,      KW_LINE,      0, {0},                                      0, 0},
+};
+
+#define OPCODE_ROWS (sizeof(opcode_table) / sizeof(opcode_table[0]))
+
+typedef struct {
+    uint8_t keyword;        // KW_NONE for numbers
+    bool is_number;
+    int32_t milli;          // Numeric value in 1/1000 units
+} token;
+
+static uint8_t lookup_keyword(const char *word, size_t length) {
+    for (size_t i = 0; i < sizeof(keyword_table) / sizeof(keyword_table[0]); i++) {
+        if (keyword_table[i].length != length) {
+            continue;
+        }
+        size_t j = 0;
+        while (j < length && (word[j] & ~0x20) == keyword_table[i].word[j]) {
+            j++;
+        }
+        if (j == length) {
+            return keyword_table[i].id;
+        }
+    }
+    return KW_NONE;
+}
+
+static bool is_separator(char c) {
+    return c == ' ' || c == '\t' || c == ':' || c == ';' || c == ',' || c == '\r' || c == '\n';
+}
+
+// Fixed-point decimal: [+-]digits[.digits], at most 3 decimals kept
+static bool parse_number(const char *s, size_t length, int32_t *milli) {
+    size_t i = 0;
+    bool negative = false;
+    int32_t whole = 0, fraction = 0, scale = 1000;
+
+    if (i < length && (s[i] == '-' || s[i] == '+')) {
+        negative = s[i] == '-';
+        i++;
+    }
+    if (i == length) {
+        return false;
+    }
+    for (; i < length && s[i] >= '0' && s[i] <= '9'; i++) {
+        if (whole >= 100000) {      // Keeps whole * 1000 inside int32
+            return false;
+        }
+        whole = whole * 10 + (s[i] - '0');
+    }
+    if (i < length && s[i] == '.') {
+        for (i++; i < length && s[i] >= '0' && s[i] <= '9'; i++) {
+            if (scale > 1) {
+                scale /= 10;
+                fraction += (s[i] - '0') * scale;
+            }
+        }
+    }
+    if (i != length) {
+        return false;
+    }
+    *milli = (whole * 1000 + fraction) * (negative ? -1 : 1);
+    return true;
+}
+
+// Split into tokens in one pass. Returns the token count or an error.
+static int tokenise(const char *text, size_t length, token *tokens) {
+    int count = 0;
+    size_t i = 0;
+
+    while (i < length) {
+        while (i < length && is_separator(text[i])) {
+            i++;
+        }
+        size_t start = i;
+        while (i < length && !is_separator(text[i]) && text[i] != '\0') {
+            i++;
+        }
+        if (i == start) {
+            break;      // Trailing separators or NUL
+        }
+        if (count == COMMAND_MAX_TOKENS) {
+            return COMMAND_ERR_ARGS;
+        }
+
+        token *t = &tokens[count++];
+        char c = text[start];
+        if ((c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.') {
+            if (!parse_number(&text[start], i - start, &t->milli)) {
+                return COMMAND_ERR_ARGS;
+            }
+            t->is_number = true;
+            t->keyword = KW_NONE;
+        } else {
+            t->keyword = lookup_keyword(&text[start], i - start);
+            t->is_number = false;
+            if (t->keyword == KW_NONE) {
+                return COMMAND_ERR_UNKNOWN;
+            }
+        }
+    }
+    return count;
+}
+
+// Joystick sentence: any order of motion words plus an optional speed
+static int parse_drive(const token *tokens, int count, command *out) {
+    telemetry_drive *drive = &out->u.drive;
+    drive->move = DRIVE_MOVE_NONE;
+    drive->turn = DRIVE_TURN_NONE;
+    drive->speed = 0;
+
+    for (int i = 0; i < count; i++) {
+        const token *t = &tokens[i];
+        if (t->is_number) {
+            int32_t speed = t->milli / 1000;
+            if (speed < -100 || speed > 100) {
+                return COMMAND_ERR_RANGE;
+            }
+            drive->speed = (int16_t)speed;
+            continue;
+        }
+        switch (t->keyword) {
+            case KW_FORWARD: drive->move = DRIVE_MOVE_FORWARD; break;
+            case KW_BACKWARD: drive->move = DRIVE_MOVE_BACKWARD; break;
+            case KW_LEFT: drive->turn = DRIVE_TURN_LEFT; break;
+            case KW_RIGHT: drive->turn = DRIVE_TURN_RIGHT; break;
+            case KW_SPEED: break;   // "Forward Speed 50"
+            case KW_STOP: {
+                // "Stop Movement", "Stop Turning", or "Stop" for both
+                uint8_t next = (i + 1 < count) ? tokens[i + 1].keyword : KW_NONE;
+                if (next == KW_MOVEMENT) {
+                    drive->move = DRIVE_MOVE_STOP;
+                    i++;
+                } else if (next == KW_TURNING) {
+                    drive->turn = DRIVE_TURN_STOP;
+                    i++;
+                } else {
+                    drive->move = DRIVE_MOVE_STOP;
+                    drive->turn = DRIVE_TURN_STOP;
+                }
+                break;
+            }
+            default:
+                return COMMAND_ERR_ARGS;
+        }
+    }
+    out->opcode = CMD_DRIVE;
+    return COMMAND_OK;
+}
+
+static bool is_motion_keyword(uint8_t kw) {
+    return kw == KW_FORWARD || kw == KW_BACKWARD || kw == KW_LEFT || kw == KW_RIGHT || kw == KW_STOP;
+}
+
+// Store parameter n of a table-driven opcode from a milli-unit value
+static int store_arg(command *out, int row, int n, int32_t value) {
+    switch (opcode_table[row].args[n]) {
+        case ARG_INT16:
+            if (value < opcode_table[row].min || value > opcode_table[row].max) {
+                return COMMAND_ERR_RANGE;
+            }
+            // Every ARG_INT16 opcode has exactly one parameter sharing the union slot
+            out->u.speed_cm_s = (int16_t)value;
+            break;
+        case ARG_LOOP:
+            if (value != COMMAND_PID_MOTOR && value != COMMAND_PID_LINE) {
+                return COMMAND_ERR_RANGE;
+            }
+            out->u.pid.loop = (uint8_t)value;
+            break;
+        case ARG_GAIN: {
+            float gain = value / 1000.0f;
+            if (n == 1) out->u.pid.kp = gain;
+            else if (n == 2) out->u.pid.ki = gain;
+            else out->u.pid.kd = gain;
+            break;
+        }
+    }
+    return COMMAND_OK;
+}
+
+int command_parse_text(const char *text, size_t length, command *out) {
+    token tokens[COMMAND_MAX_TOKENS];
+    int count = tokenise(text, length, tokens);
+
+    memset(out, 0, sizeof(*out));
+    if (count < 0) {
+        return count;
+    }
+    if (count == 0) {
+        return COMMAND_ERR_EMPTY;
+    }
+    if (is_motion_keyword(tokens[0].keyword)) {
+        return parse_drive(tokens, count, out);
+    }
+
+    for (size_t row = 0; row < OPCODE_ROWS; row++) {
+        if (opcode_table[row].keyword == KW_NONE || opcode_table[row].keyword != tokens[0].keyword) {
+            continue;
+        }
+        if (count - 1 != opcode_table[row].arg_count) {
+            return COMMAND_ERR_ARGS;
+        }
+        for (int n = 0; n < opcode_table[row].arg_count; n++) {
+            const token *t = &tokens[n + 1];
+            int32_t value;
+            if (opcode_table[row].args[n] == ARG_LOOP) {
+                if (t->keyword == KW_MOTOR) value = COMMAND_PID_MOTOR;
+                else if (t->keyword == KW_LINE) value = COMMAND_PID_LINE;
+                else return COMMAND_ERR_ARGS;
+            } else if (t->is_number) {
+                value = opcode_table[row].args[n] == ARG_GAIN ? t->milli : t->milli / 1000;
+            } else {
+                return COMMAND_ERR_ARGS;
+            }
+            int err = store_arg(out, (int)row, n, value);
+            if (err != COMMAND_OK) {
+                return err;
+            }
+        }
+        out->opcode = opcode_table[row].opcode;
+        return COMMAND_OK;
+    }
+    return COMMAND_ERR_UNKNOWN;
+}
+
+static size_t arg_size(uint8_t type) {
+    switch (type) {
+        case ARG_INT16: return 2;
+        case ARG_LOOP: return 1;
+        case ARG_GAIN: return 4;
+        default: return 0;
+    }
+}
+
+static int find_row(uint8_t opcode) {
+    for (size_t row = 0; row < OPCODE_ROWS; row++) {
+        if (opcode_table[row].opcode == opcode) {
+            return (int)row;
+        }
+    }
+    return -1;
+}
+
+int command_parse_binary(const uint8_t *data, size_t length, command *out) {
+    memset(out, 0, sizeof(*out));
+    if (length == 0) {
+        return COMMAND_ERR_EMPTY;
+    }
+
+    uint8_t opcode = data[0];
+    const uint8_t *p = data + 1;
+    if (opcode == CMD_DRIVE) {
+        if (length != 1 + TELEMETRY_DRIVE_SIZE) {
+            return COMMAND_ERR_ARGS;
+        }
+        if (p[0] > DRIVE_MOVE_STOP || p[1] > DRIVE_TURN_STOP) {
+            return COMMAND_ERR_RANGE;
+        }
+        int16_t speed = (int16_t)get_u16(p + 2);
+        if (speed < -100 || speed > 100) {
+            return COMMAND_ERR_RANGE;   // Same limit as the text front-end
+        }
+        out->u.drive.move = p[0];
+        out->u.drive.turn = p[1];
+        out->u.drive.speed = speed;
+        out->opcode = CMD_DRIVE;
+        return COMMAND_OK;
+    }
+
+    int row = find_row(opcode);
+    if (row < 0 || opcode == CMD_BINARY) {
+        return COMMAND_ERR_UNKNOWN;
+    }
+    size_t expected = 1;
+    for (int n = 0; n < opcode_table[row].arg_count; n++) {
+        expected += arg_size(opcode_table[row].args[n]);
+    }
+    if (length != expected) {
+        return COMMAND_ERR_ARGS;
+    }
+
+    for (int n = 0; n < opcode_table[row].arg_count; n++) {
+        int32_t value;
+        switch (opcode_table[row].args[n]) {
+            case ARG_INT16: value = (int16_t)get_u16(p); break;
+            case ARG_LOOP: value = p[0]; break;
+            default: value = (int32_t)get_u32(p); break;
+        }
+        p += arg_size(opcode_table[row].args[n]);
+        int err = store_arg(out, row, n, value);
+        if (err != COMMAND_OK) {
+            return err;
+        }
+    }
+    out->opcode = opcode;
+    return COMMAND_OK;
+}
+
+size_t command_encode_binary(const command *cmd, uint8_t *buf, size_t cap) {
+    if (cmd->opcode == CMD_DRIVE) {
+        if (cap < 1 + TELEMETRY_DRIVE_SIZE) {
+            return 0;
+        }
+        buf[0] = CMD_DRIVE;
+        buf[1] = cmd->u.drive.move;
+        buf[2] = cmd->u.drive.turn;
+        put_u16(buf + 3, (uint16_t)cmd->u.drive.speed);
+        return 1 + TELEMETRY_DRIVE_SIZE;
+    }
+
+    int row = find_row(cmd->opcode);
+    if (row < 0 || cmd->opcode == CMD_BINARY || cap < 1) {
+        return 0;
+    }
+    size_t length = 1;
+    buf[0] = cmd->opcode;
+    for (int n = 0; n < opcode_table[row].arg_count; n++) {
+        uint8_t type = opcode_table[row].args[n];
+        if (length + arg_size(type) > cap) {
+            return 0;
+        }
+        if (type == ARG_INT16) {
+            put_u16(buf + length, (uint16_t)cmd->u.speed_cm_s);
+        } else if (type == ARG_LOOP) {
+            buf[length] = cmd->u.pid.loop;
+        } else {
+            float gain = n == 1 ? cmd->u.pid.kp : n == 2 ? cmd->u.pid.ki : cmd->u.pid.kd;
+            int32_t milli = (int32_t)(gain * 1000.0f + (gain < 0 ? -0.5f : 0.5f));
+            put_u32(buf + length, (uint32_t)milli);
+        }
+        length += arg_size(type);
+    }
+    return length;
+}
+
+const char *command_opcode_name(uint8_t opcode) {
+    static const char *const names[CMD_COUNT] = {
+        "none", "drive", "speed", "heading", "distance", "pid", "binary", "subscribe", "trace", "profile", "line"
+    };
+    return opcode < CMD_COUNT ? names[opcode] : "unknown";
+}
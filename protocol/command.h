@@ -0,0 +1,91 @@
+#ifndef COMMAND_H
+#define COMMAND_H
+
+// Remote commands sent from the client to the car.
+//
+// Text front-end, one command per line, case-insensitive, tokens separated by
+// spaces or ':' ';' ',' (so "Speed: 40" works):
+//   Forward|Backward|Left|Right|Stop [Movement|Turning] [speed]
+//                                  drive, e.g. "Forward Left 50", "Stop Movement"
+//   SPEED <cm/s>                   set the cruise speed
+//   HEADING <degrees>              turn on the spot to a heading (CCW positive)
+//   DISTANCE <cm>                  drive a distance and stop
+//   PID MOTOR|LINE <kp> <ki> <kd>  set controller gains; the remote drive firmware
+//                                  logs a warning for loops it does not run
+//   BINARY                         switch the connection to binary commands
+//   SUBSCRIBE <mask>               telemetry frame types this connection wants,
+//                                  bit (1 << telemetry_type) each
+//   TRACE <level>                  trace level, 0 off .. 4 debug (trace_level)
+//   PROFILE <reset>                send the latency profile now, then clear it if 1
+//   LINE                           follow the line until a drive command or an obstacle
+//
+// Binary front-end, one command per length-prefixed frame, little-endian:
+//   u8 opcode, then the fixed-size parameters from the opcode table
+//   (PID gains as i32 in 1/1000 units)
+//
+// Both front-ends fill the same command struct. Parsing is a single pass over
+// at most COMMAND_MAX_LENGTH bytes and COMMAND_MAX_TOKENS tokens with no
+// allocation, so its cost is bounded.
+
+#include <stdint.h>
+#include <stddef.h>
+#include "telemetry.h"
+
+#define COMMAND_MAX_TOKENS 8
+
+// Parse results
+#define COMMAND_OK 0
+#define COMMAND_ERR_EMPTY (-1)      // No tokens
+#define COMMAND_ERR_UNKNOWN (-2)    // Unknown keyword or opcode
+#define COMMAND_ERR_ARGS (-3)       // Wrong number or type of parameters
+#define COMMAND_ERR_RANGE (-4)      // Parameter out of range
+
+typedef enum {
+    CMD_NONE = 0,
+    CMD_DRIVE = 1,      // Joystick style move/turn/speed
+    CMD_SPEED = 2,
+    CMD_HEADING = 3,
+    CMD_DISTANCE = 4,
+    CMD_PID = 5,
+    CMD_BINARY = 6,     // Text only: following commands are binary frames
+    CMD_SUBSCRIBE = 7,  // Per-connection telemetry subscription mask
+    CMD_TRACE = 8,      // Run-time trace level
+    CMD_PROFILE = 9,    // Latency profile report
+    CMD_LINE = 10,      // Line-follow mode (buddy3), ended by any drive command
+    CMD_COUNT
+} command_opcode;
+
+typedef enum {
+    COMMAND_PID_MOTOR = 0,  // Wheel speed loop (buddy2)
+    COMMAND_PID_LINE = 1    // Line follower steering (buddy3)
+} command_pid_loop;
+
+typedef struct {
+    uint8_t loop;           // command_pid_loop
+    float kp, ki, kd;
+} command_pid;
+
+typedef struct {
+    uint8_t opcode;         // command_opcode
+    union {
+        telemetry_drive drive;
+        int16_t speed_cm_s;
+        int16_t heading_deg;
+        int16_t distance_cm;
+        uint16_t subscriptions;
+        int16_t trace_level;
+        int16_t profile_reset;
+        command_pid pid;
+    } u;
+} command;
+
+int command_parse_text(const char *text, size_t length, command *out);
+int command_parse_binary(const uint8_t *data, size_t length, command *out);
+
+// Encode a command as a binary payload (without the length prefix).
+// Returns the payload length, or 0 if it does not fit or has no binary form.
+size_t command_encode_binary(const command *cmd, uint8_t *buf, size_t cap);
+
+const char *command_opcode_name(uint8_t opcode);
+
+#endif // COMMAND_H
@@ -0,0 +1,147 @@
+#include <string.h>
+#include "command_stream.h"
+
+#define RING_MASK (COMMAND_STREAM_SIZE - 1)
+
+void command_stream_init(command_stream *cs, command_framing framing) {
+    memset(cs, 0, sizeof(*cs));
+    cs->framing = framing;
+}
+
+size_t command_stream_space(const command_stream *cs) {
+    return COMMAND_STREAM_SIZE - (cs->head - cs->tail);
+}
+
+uint8_t *command_stream_write_ptr(command_stream *cs, size_t *contiguous) {
+    size_t offset = cs->head & RING_MASK;
+    size_t to_end = COMMAND_STREAM_SIZE - offset;
+    size_t space = command_stream_space(cs);
+    *contiguous = space < to_end ? space : to_end;
+    return &cs->ring[offset];
+}
+
+void command_stream_commit(command_stream *cs, size_t length) {
+    cs->head += (uint32_t)length;
+}
+
+size_t command_stream_push(command_stream *cs, const void *data, size_t length) {
+    const uint8_t *src = (const uint8_t *)data;
+    size_t pushed = 0;
+
+    // At most two copies: up to the end of the ring, then from the start
+    while (pushed < length) {
+        size_t contiguous;
+        uint8_t *dst = command_stream_write_ptr(cs, &contiguous);
+        if (contiguous == 0) {
+            break;
+        }
+        size_t n = length - pushed < contiguous ? length - pushed : contiguous;
+        memcpy(dst, src + pushed, n);
+        command_stream_commit(cs, n);
+        pushed += n;
+    }
+    cs->overflow += (uint32_t)(length - pushed);
+    return pushed;
+}
+
+static uint8_t ring_at(const command_stream *cs, uint32_t position) {
+    return cs->ring[position & RING_MASK];
+}
+
+// Copy a command out of the ring (it may wrap) into a linear, terminated buffer
+static void copy_out(const command_stream *cs, uint32_t start, size_t length, char *out) {
+    size_t offset = start & RING_MASK;
+    size_t first = COMMAND_STREAM_SIZE - offset;
+    if (first > length) {
+        first = length;
+    }
+    memcpy(out, &cs->ring[offset], first);
+    memcpy(out + first, cs->ring, length - first);
+    out[length] = '\0';
+}
+
+static bool is_terminator(uint8_t c) {
+    return c == '\n' || c == '\r' || c == '\0';
+}
+
+int command_stream_dispatch(command_stream *cs, command_handler handler, void *context) {
+    char command[COMMAND_MAX_LENGTH + 1];
+    int count = 0;
+
+    for (;;) {
+        // Finish dropping an oversized length-framed command
+        if (cs->skip > 0) {
+            uint32_t available = cs->head - cs->tail;
+            uint32_t n = cs->skip < available ? cs->skip : available;
+            cs->tail += n;
+            cs->skip -= n;
+            if (cs->skip > 0) {
+                break;
+            }
+            cs->scan = cs->tail;
+        }
+
+        if (cs->framing == COMMAND_FRAMING_NEWLINE) {
+            while (cs->scan != cs->head && !is_terminator(ring_at(cs, cs->scan))) {
+                cs->scan++;
+            }
+            if (cs->scan == cs->head) {
+                // No terminator yet; drop what we have once it can no longer fit
+                if (cs->discarding || cs->scan - cs->tail > COMMAND_MAX_LENGTH) {
+                    if (!cs->discarding) {
+                        cs->oversized++;
+                        cs->discarding = true;
+                    }
+                    cs->tail = cs->scan;
+                }
+                break;
+            }
+
+            size_t length = cs->scan - cs->tail;
+            if (cs->discarding) {
+                cs->discarding = false;     // Terminator of the dropped command
+            } else if (length > COMMAND_MAX_LENGTH) {
+                cs->oversized++;            // Arrived whole but too long
+            } else if (length > 0) {        // Empty lines (e.g. the '\n' of "\r\n") are ignored
+                copy_out(cs, cs->tail, length, command);
+                handler(context, command, length);
+                cs->dispatched++;
+                count++;
+                // The handler switched to binary: the rest of a "\r\n" is not a length byte
+                cs->line_feed = cs->framing != COMMAND_FRAMING_NEWLINE && ring_at(cs, cs->scan) == '\r';
+            }
+            cs->tail = cs->scan + 1;
+            cs->scan = cs->tail;
+        } else {
+            if (cs->line_feed) {
+                if (cs->head == cs->tail) {
+                    break;                  // The '\n' may come in the next segment
+                }
+                if (ring_at(cs, cs->tail) == '\n') {
+                    cs->tail++;
+                }
+                cs->line_feed = false;
+            }
+            if (cs->head - cs->tail < COMMAND_LENGTH_PREFIX) {
+                break;
+            }
+            size_t length = ring_at(cs, cs->tail) | (ring_at(cs, cs->tail + 1) << 8);
+            if (length > COMMAND_MAX_LENGTH) {
+                cs->oversized++;
+                cs->tail += COMMAND_LENGTH_PREFIX;
+                cs->skip = (uint32_t)length;
+                continue;
+            }
+            if (cs->head - cs->tail < COMMAND_LENGTH_PREFIX + length) {
+                break;
+            }
+            copy_out(cs, cs->tail + COMMAND_LENGTH_PREFIX, length, command);
+            handler(context, command, length);
+            cs->dispatched++;
+            count++;
+            cs->tail += COMMAND_LENGTH_PREFIX + (uint32_t)length;
+            cs->scan = cs->tail;
+        }
+    }
+    return count;
+}
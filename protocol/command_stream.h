@@ -0,0 +1,71 @@
+#ifndef COMMAND_STREAM_H
+#define COMMAND_STREAM_H
+
+// Reassembles commands from a TCP byte stream.
+//
+// TCP delivers bytes, not messages: one segment can carry several commands and
+// one command can be split across segments (or across pbufs in a chain). Bytes
+// are appended to a ring and complete commands are handed out one at a time.
+//
+// Framing, chosen per connection:
+//   COMMAND_FRAMING_NEWLINE  text, each command ends with '\n', '\r' or '\0'
+//   COMMAND_FRAMING_LENGTH   binary, u16 little-endian payload length then payload
+//
+// A handler may switch a text stream to COMMAND_FRAMING_LENGTH (e.g. on
+// BINARY). The switch takes effect after the terminator of the command being
+// handled; if that was the '\r' of a "\r\n", the '\n' is dropped as well, so
+// it is not read as the first byte of a length prefix.
+//
+// Commands longer than COMMAND_MAX_LENGTH are dropped whole and counted; the
+// stream stays in sync. Because a partial command never holds more than
+// COMMAND_MAX_LENGTH bytes, dispatching always frees most of the ring.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define COMMAND_STREAM_SIZE 1024    // Ring size, must be a power of two
+#define COMMAND_MAX_LENGTH 128      // Longest command payload
+#define COMMAND_LENGTH_PREFIX 2     // Size of the length field with COMMAND_FRAMING_LENGTH
+
+typedef enum {
+    COMMAND_FRAMING_NEWLINE,
+    COMMAND_FRAMING_LENGTH
+} command_framing;
+
+// Called once per complete command. command is NUL-terminated (binary payloads
+// may also contain NULs, so use length).
+typedef void (*command_handler)(void *context, const char *command, size_t length);
+
+typedef struct {
+    uint8_t ring[COMMAND_STREAM_SIZE];
+    uint32_t head;          // Write position (free running)
+    uint32_t tail;          // Start of the oldest unconsumed byte (free running)
+    uint32_t scan;          // Newline search resumes here so bytes are scanned once
+    uint32_t skip;          // Bytes still to drop from an oversized command
+    bool discarding;        // Dropping an oversized text command up to its terminator
+    bool line_feed;         // Drop a '\n' left over from the "\r\n" before a framing switch
+    command_framing framing;
+
+    uint32_t dispatched;    // Commands handed to the handler
+    uint32_t oversized;     // Commands dropped for exceeding COMMAND_MAX_LENGTH
+    uint32_t overflow;      // Bytes dropped because the ring was full
+} command_stream;
+
+void command_stream_init(command_stream *cs, command_framing framing);
+
+// Free space in the ring
+size_t command_stream_space(const command_stream *cs);
+
+// Contiguous free region at the write position, for copying in place (e.g.
+// with pbuf_copy_partial). Follow with command_stream_commit.
+uint8_t *command_stream_write_ptr(command_stream *cs, size_t *contiguous);
+void command_stream_commit(command_stream *cs, size_t length);
+
+// Copy bytes into the ring. Returns how many fit; the rest count as overflow.
+size_t command_stream_push(command_stream *cs, const void *data, size_t length);
+
+// Hand every complete command to handler. Returns the number dispatched.
+int command_stream_dispatch(command_stream *cs, command_handler handler, void *context);
+
+#endif // COMMAND_STREAM_H
@@ -0,0 +1,378 @@
+#include <stdio.h>
+#include <string.h>
+#include "telemetry.h"
+
+// CRC-16/CCITT-FALSE (poly 0x1021, init 0xFFFF), nibble table to keep flash use small
+uint16_t telemetry_crc16(const uint8_t *data, size_t len) {
+    static const uint16_t table[16] = {
+        0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+        0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+    };
+    uint16_t crc = 0xFFFF;
+
+    for (size_t i = 0; i < len; i++) {
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] >> 4)]);
+        crc = (uint16_t)((crc << 4) ^ table[(crc >> 12) ^ (data[i] & 0x0F)]);
+    }
+    return crc;
+}
+
+size_t telemetry_sample_size(uint8_t fields) {
+    return ((fields & TELEMETRY_FIELD_POSE) ? 10 : 0) +
+           ((fields & TELEMETRY_FIELD_SPEED) ? 4 : 0) +
+           ((fields & TELEMETRY_FIELD_DUTY) ? 4 : 0) +
+           ((fields & TELEMETRY_FIELD_RANGE) ? 3 : 0);
+}
+
+// Payload size for each frame type, 0 for unknown types
+static size_t payload_size(uint8_t type, uint8_t batch_count, uint8_t fields) {
+    switch (type) {
+        case TELEMETRY_SAMPLE: return TELEMETRY_SAMPLE_SIZE;
+        case TELEMETRY_BARCODE: return TELEMETRY_BARCODE_SIZE;
+        case TELEMETRY_DRIVE: return TELEMETRY_DRIVE_SIZE;
+        case TELEMETRY_BATCH: return TELEMETRY_BATCH_HEADER_SIZE + (size_t)batch_count * telemetry_sample_size(fields);
+        case TELEMETRY_BEACON: return TELEMETRY_BEACON_SIZE;
+        case TELEMETRY_PROFILE: return TELEMETRY_PROFILE_SIZE;
+        case TELEMETRY_TASK: return TELEMETRY_TASK_SIZE;
+        case TELEMETRY_SYSTEM: return TELEMETRY_SYSTEM_SIZE;
+        default: return 0;  // TELEMETRY_BATCH_DELTA and TELEMETRY_LOG are variable length, handled by the callers
+    }
+}
+
+// Encode the selected field groups of a sample, returns the bytes written
+static size_t encode_sample(const telemetry_sample *s, uint8_t fields, uint8_t *p) {
+    uint8_t *start = p;
+    if (fields & TELEMETRY_FIELD_POSE) {
+        put_u32(p + 0, (uint32_t)s->x_mm);
+        put_u32(p + 4, (uint32_t)s->y_mm);
+        put_u16(p + 8, (uint16_t)s->heading_mrad);
+        p += 10;
+    }
+    if (fields & TELEMETRY_FIELD_SPEED) {
+        put_u16(p + 0, (uint16_t)s->left_speed_mm_s);
+        put_u16(p + 2, (uint16_t)s->right_speed_mm_s);
+        p += 4;
+    }
+    if (fields & TELEMETRY_FIELD_DUTY) {
+        put_u16(p + 0, s->left_duty);
+        put_u16(p + 2, s->right_duty);
+        p += 4;
+    }
+    if (fields & TELEMETRY_FIELD_RANGE) {
+        put_u16(p + 0, s->distance_mm);
+        p[2] = s->flags;
+        p += 3;
+    }
+    return (size_t)(p - start);
+}
+
+static size_t decode_sample(const uint8_t *p, uint8_t fields, telemetry_sample *s) {
+    const uint8_t *start = p;
+    memset(s, 0, sizeof(*s));
+    if (fields & TELEMETRY_FIELD_POSE) {
+        s->x_mm = (int32_t)get_u32(p + 0);
+        s->y_mm = (int32_t)get_u32(p + 4);
+        s->heading_mrad = (int16_t)get_u16(p + 8);
+        p += 10;
+    }
+    if (fields & TELEMETRY_FIELD_SPEED) {
+        s->left_speed_mm_s = (int16_t)get_u16(p + 0);
+        s->right_speed_mm_s = (int16_t)get_u16(p + 2);
+        p += 4;
+    }
+    if (fields & TELEMETRY_FIELD_DUTY) {
+        s->left_duty = get_u16(p + 0);
+        s->right_duty = get_u16(p + 2);
+        p += 4;
+    }
+    if (fields & TELEMETRY_FIELD_RANGE) {
+        s->distance_mm = get_u16(p + 0);
+        s->flags = p[2];
+        p += 3;
+    }
+    return (size_t)(p - start);
+}
+
+size_t telemetry_encoded_size(const telemetry_frame *frame) {
+    if (frame->type == TELEMETRY_BATCH_DELTA) {
+        return frame->u.delta.length ? TELEMETRY_OVERHEAD + frame->u.delta.length : 0;
+    }
+    if (frame->type == TELEMETRY_LOG) {
+        return frame->u.log.length <= TELEMETRY_LOG_MAX ? TELEMETRY_OVERHEAD + 1 + frame->u.log.length : 0;
+    }
+    bool batch = frame->type == TELEMETRY_BATCH;
+    size_t payload = payload_size(frame->type, batch ? frame->u.batch.count : 0, batch ? frame->u.batch.fields : 0);
+    return payload ? TELEMETRY_OVERHEAD + payload : 0;
+}
+
+size_t telemetry_encode(const telemetry_frame *frame, uint8_t *buf, size_t cap) {
+    bool batch = frame->type == TELEMETRY_BATCH;
+    uint8_t batch_count = batch ? frame->u.batch.count : 0;
+    uint8_t fields = batch ? frame->u.batch.fields : 0;
+    size_t payload = frame->type == TELEMETRY_BATCH_DELTA ? frame->u.delta.length
+                   : frame->type == TELEMETRY_LOG         ? 1u + frame->u.log.length
+                                                          : payload_size(frame->type, batch_count, fields);
+    size_t length = TELEMETRY_OVERHEAD + payload;
+    uint8_t *p = buf + TELEMETRY_HEADER_SIZE;
+
+    if (payload == 0 || length > cap || batch_count > TELEMETRY_MAX_BATCH || (fields & ~TELEMETRY_FIELDS_ALL) ||
+        (frame->type == TELEMETRY_LOG && frame->u.log.length > TELEMETRY_LOG_MAX)) {
+        return 0;
+    }
+
+    buf[0] = TELEMETRY_MAGIC;
+    buf[1] = TELEMETRY_VERSION;
+    put_u16(buf + 2, (uint16_t)length);
+    buf[4] = frame->type;
+    put_u16(buf + 5, frame->seq);
+    put_u32(buf + 7, frame->timestamp_us);
+
+    switch (frame->type) {
+        case TELEMETRY_SAMPLE:
+            encode_sample(&frame->u.sample, TELEMETRY_FIELDS_ALL, p);
+            break;
+        case TELEMETRY_BARCODE:
+            memcpy(p, frame->u.barcode.chars, 3);
+            p[3] = frame->u.barcode.reverse;
+            break;
+        case TELEMETRY_DRIVE:
+            p[0] = frame->u.drive.move;
+            p[1] = frame->u.drive.turn;
+            put_u16(p + 2, (uint16_t)frame->u.drive.speed);
+            break;
+        case TELEMETRY_BATCH:
+            put_u32(p, frame->u.batch.first_sample);
+            put_u16(p + 4, frame->u.batch.period_us);
+            p[6] = batch_count;
+            p[7] = fields;
+            p += TELEMETRY_BATCH_HEADER_SIZE;
+            for (int i = 0; i < batch_count; i++) {
+                p += encode_sample(&frame->u.batch.samples[i], fields, p);
+            }
+            break;
+        case TELEMETRY_BEACON:
+            put_u32(p, (uint32_t)frame->u.beacon.device_id);
+            put_u32(p + 4, (uint32_t)(frame->u.beacon.device_id >> 32));
+            memcpy(p + 8, frame->u.beacon.ip, 4);
+            put_u16(p + 12, frame->u.beacon.tcp_port);
+            put_u16(p + 14, frame->u.beacon.stream_port);
+            put_u16(p + 16, frame->u.beacon.version);
+            put_u16(p + 18, frame->u.beacon.capabilities);
+            p[20] = frame->u.beacon.clients;
+            p[21] = frame->u.beacon.max_clients;
+            break;
+        case TELEMETRY_BATCH_DELTA:
+            // telemetry_delta_encode builds the payload in place
+            if (frame->u.delta.payload != p) {
+                memcpy(p, frame->u.delta.payload, payload);
+            }
+            break;
+        case TELEMETRY_LOG:
+            p[0] = frame->u.log.level;
+            memcpy(p + 1, frame->u.log.text, frame->u.log.length);
+            break;
+        case TELEMETRY_PROFILE:
+            p[0] = frame->u.profile.section;
+            memcpy(p + 1, frame->u.profile.name, TELEMETRY_PROFILE_NAME);
+            p += 1 + TELEMETRY_PROFILE_NAME;
+            put_u32(p, frame->u.profile.count);
+            put_u32(p + 4, frame->u.profile.min_ns);
+            put_u32(p + 8, frame->u.profile.mean_ns);
+            put_u32(p + 12, frame->u.profile.p50_ns);
+            put_u32(p + 16, frame->u.profile.p99_ns);
+            put_u32(p + 20, frame->u.profile.max_ns);
+            break;
+        case TELEMETRY_TASK:
+            p[0] = frame->u.task.task;
+            memcpy(p + 1, frame->u.task.name, TELEMETRY_TASK_NAME);
+            p += 1 + TELEMETRY_TASK_NAME;
+            p[0] = frame->u.task.priority;
+            put_u16(p + 1, frame->u.task.cpu_permille);
+            put_u16(p + 3, frame->u.task.stack_free);
+            break;
+        case TELEMETRY_SYSTEM:
+            put_u32(p, frame->u.system.heap_free);
+            put_u32(p + 4, frame->u.system.heap_min);
+            put_u16(p + 8, frame->u.system.busy_permille);
+            p[10] = frame->u.system.tasks;
+            p[11] = frame->u.system.queue_count;
+            p += 12;
+            for (int i = 0; i < TELEMETRY_SYSTEM_QUEUES; i++) {
+                const telemetry_queue *q = &frame->u.system.queues[i];
+                memcpy(p, q->name, TELEMETRY_QUEUE_NAME);
+                p[TELEMETRY_QUEUE_NAME] = q->level;
+                p[TELEMETRY_QUEUE_NAME + 1] = q->capacity;
+                p += TELEMETRY_QUEUE_NAME + 2;
+            }
+            p[0] = frame->u.system.cores;
+            for (int i = 0; i < TELEMETRY_CORES; i++) {
+                put_u16(p + 1 + i * 2, frame->u.system.core_busy_permille[i]);
+            }
+            break;
+    }
+
+    put_u16(buf + length - TELEMETRY_CRC_SIZE, telemetry_crc16(buf, length - TELEMETRY_CRC_SIZE));
+    return length;
+}
+
+int telemetry_decode(const uint8_t *buf, size_t len, telemetry_frame *frame) {
+    if (len < 1) {
+        return TELEMETRY_NEED_MORE;
+    }
+    if (buf[0] != TELEMETRY_MAGIC) {
+        return TELEMETRY_ERR_MAGIC;
+    }
+    if (len < TELEMETRY_HEADER_SIZE) {
+        return TELEMETRY_NEED_MORE;
+    }
+    if (buf[1] != TELEMETRY_VERSION) {
+        return TELEMETRY_ERR_VERSION;
+    }
+
+    size_t length = get_u16(buf + 2);
+    if (length < TELEMETRY_OVERHEAD || length > TELEMETRY_MAX_FRAME) {
+        return TELEMETRY_ERR_LENGTH;
+    }
+    if (len < length) {
+        return TELEMETRY_NEED_MORE;
+    }
+    if (get_u16(buf + length - TELEMETRY_CRC_SIZE) != telemetry_crc16(buf, length - TELEMETRY_CRC_SIZE)) {
+        return TELEMETRY_ERR_CRC;
+    }
+
+    frame->type = buf[4];
+    frame->seq = get_u16(buf + 5);
+    frame->timestamp_us = get_u32(buf + 7);
+
+    const uint8_t *p = buf + TELEMETRY_HEADER_SIZE;
+    uint8_t batch_count = 0, fields = 0;
+    if (frame->type == TELEMETRY_BATCH) {
+        if (length < TELEMETRY_OVERHEAD + TELEMETRY_BATCH_HEADER_SIZE) {
+            return TELEMETRY_ERR_LENGTH;
+        }
+        batch_count = p[6];
+        fields = p[7];
+        if (batch_count > TELEMETRY_MAX_BATCH || (fields & ~TELEMETRY_FIELDS_ALL)) {
+            return TELEMETRY_ERR_LENGTH;
+        }
+    }
+    if (frame->type == TELEMETRY_BATCH_DELTA) {
+        // Variable length; the payload is checked when it is expanded
+        frame->u.delta.payload = p;
+        frame->u.delta.length = (uint16_t)(length - TELEMETRY_OVERHEAD);
+        return (int)length;
+    }
+    if (frame->type == TELEMETRY_LOG) {
+        size_t text = length - TELEMETRY_OVERHEAD - 1;
+        if (length < TELEMETRY_OVERHEAD + 1 || text > TELEMETRY_LOG_MAX) {
+            return TELEMETRY_ERR_LENGTH;
+        }
+        frame->u.log.level = p[0];
+        frame->u.log.length = (uint8_t)text;
+        memcpy(frame->u.log.text, p + 1, text);
+        frame->u.log.text[text] = '\0';
+        return (int)length;
+    }
+    size_t payload = payload_size(frame->type, batch_count, fields);
+    if (payload == 0) {
+        return TELEMETRY_ERR_TYPE;
+    }
+    if (length != TELEMETRY_OVERHEAD + payload) {
+        return TELEMETRY_ERR_LENGTH;
+    }
+
+    switch (frame->type) {
+        case TELEMETRY_SAMPLE:
+            decode_sample(p, TELEMETRY_FIELDS_ALL, &frame->u.sample);
+            break;
+        case TELEMETRY_BARCODE:
+            memcpy(frame->u.barcode.chars, p, 3);
+            frame->u.barcode.reverse = p[3];
+            break;
+        case TELEMETRY_DRIVE:
+            frame->u.drive.move = p[0];
+            frame->u.drive.turn = p[1];
+            frame->u.drive.speed = (int16_t)get_u16(p + 2);
+            break;
+        case TELEMETRY_BATCH:
+            frame->u.batch.first_sample = get_u32(p);
+            frame->u.batch.period_us = get_u16(p + 4);
+            frame->u.batch.count = batch_count;
+            frame->u.batch.fields = fields;
+            p += TELEMETRY_BATCH_HEADER_SIZE;
+            for (int i = 0; i < batch_count; i++) {
+                p += decode_sample(p, fields, &frame->u.batch.samples[i]);
+            }
+            break;
+        case TELEMETRY_BEACON:
+            frame->u.beacon.device_id = get_u32(p) | ((uint64_t)get_u32(p + 4) << 32);
+            memcpy(frame->u.beacon.ip, p + 8, 4);
+            frame->u.beacon.tcp_port = get_u16(p + 12);
+            frame->u.beacon.stream_port = get_u16(p + 14);
+            frame->u.beacon.version = get_u16(p + 16);
+            frame->u.beacon.capabilities = get_u16(p + 18);
+            frame->u.beacon.clients = p[20];
+            frame->u.beacon.max_clients = p[21];
+            break;
+        case TELEMETRY_PROFILE:
+            frame->u.profile.section = p[0];
+            memcpy(frame->u.profile.name, p + 1, TELEMETRY_PROFILE_NAME);
+            p += 1 + TELEMETRY_PROFILE_NAME;
+            frame->u.profile.count = get_u32(p);
+            frame->u.profile.min_ns = get_u32(p + 4);
+            frame->u.profile.mean_ns = get_u32(p + 8);
+            frame->u.profile.p50_ns = get_u32(p + 12);
+            frame->u.profile.p99_ns = get_u32(p + 16);
+            frame->u.profile.max_ns = get_u32(p + 20);
+            break;
+        case TELEMETRY_TASK:
+            frame->u.task.task = p[0];
+            memcpy(frame->u.task.name, p + 1, TELEMETRY_TASK_NAME);
+            p += 1 + TELEMETRY_TASK_NAME;
+            frame->u.task.priority = p[0];
+            frame->u.task.cpu_permille = get_u16(p + 1);
+            frame->u.task.stack_free = get_u16(p + 3);
+            break;
+        case TELEMETRY_SYSTEM:
+            frame->u.system.heap_free = get_u32(p);
+            frame->u.system.heap_min = get_u32(p + 4);
+            frame->u.system.busy_permille = get_u16(p + 8);
+            frame->u.system.tasks = p[10];
+            frame->u.system.queue_count = p[11] <= TELEMETRY_SYSTEM_QUEUES ? p[11] : TELEMETRY_SYSTEM_QUEUES;
+            p += 12;
+            for (int i = 0; i < TELEMETRY_SYSTEM_QUEUES; i++) {
+                telemetry_queue *q = &frame->u.system.queues[i];
+                memcpy(q->name, p, TELEMETRY_QUEUE_NAME);
+                q->level = p[TELEMETRY_QUEUE_NAME];
+                q->capacity = p[TELEMETRY_QUEUE_NAME + 1];
+                p += TELEMETRY_QUEUE_NAME + 2;
+            }
+            frame->u.system.cores = p[0] <= TELEMETRY_CORES ? p[0] : TELEMETRY_CORES;
+            for (int i = 0; i < TELEMETRY_CORES; i++) {
+                frame->u.system.core_busy_permille[i] = get_u16(p + 1 + i * 2);
+            }
+            break;
+    }
+    return (int)length;
+}
+
+const char *telemetry_drive_direction(const telemetry_drive *drive, char *buf, size_t cap) {
+    static const char *const moves[] = {"", "Forward", "Backward", "Stopped"};
+    static const char *const turns[] = {"", "Left", "Right", "Stopped"};
+    const char *move = drive->move <= DRIVE_MOVE_STOP ? moves[drive->move] : "";
+    const char *turn = drive->turn <= DRIVE_TURN_STOP ? turns[drive->turn] : "";
+    bool move_idle = drive->move == DRIVE_MOVE_NONE || drive->move == DRIVE_MOVE_STOP;
+    bool turn_idle = drive->turn == DRIVE_TURN_NONE || drive->turn == DRIVE_TURN_STOP;
+
+    if (drive->move == DRIVE_MOVE_STOP && drive->turn == DRIVE_TURN_STOP) {
+        // Only show "Stopped" if both movement and turning are stopped
+        snprintf(buf, cap, "Stopped");
+    } else if (turn_idle) {
+        snprintf(buf, cap, "%s", move);
+    } else if (move_idle) {
+        snprintf(buf, cap, "%s", turn);
+    } else {
+        snprintf(buf, cap, "%s %s", move, turn);
+    }
+    return buf;
+}
@@ -0,0 +1,266 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+// Binary telemetry frames sent from the car to the host.
+//
+// Every frame is little-endian:
+//   offset  size  field
+//   0       1     magic (TELEMETRY_MAGIC)
+//   1       1     version (TELEMETRY_VERSION)
+//   2       2     length of the whole frame including magic and CRC
+//   4       1     type (telemetry_type)
+//   5       2     sequence number, incremented per frame by the sender
+//   7       4     device timestamp in microseconds since boot (wraps)
+//   11      n     payload, layout given by type
+//   11+n    2     CRC-16/CCITT-FALSE over bytes 0 .. 10+n
+//
+// The version changes with any payload layout, since payload sizes are checked
+// exactly. Version 2 added the per-core load to TELEMETRY_SYSTEM.
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define TELEMETRY_MAGIC 0xA5
+#define TELEMETRY_VERSION 2
+#define TELEMETRY_HEADER_SIZE 11
+#define TELEMETRY_CRC_SIZE 2
+#define TELEMETRY_OVERHEAD (TELEMETRY_HEADER_SIZE + TELEMETRY_CRC_SIZE)
+#define TELEMETRY_MAX_FRAME 512
+
+// Decode results other than a frame length
+#define TELEMETRY_NEED_MORE 0        // Buffer holds only part of a frame
+#define TELEMETRY_ERR_MAGIC (-1)     // Not at the start of a frame, skip a byte and retry
+#define TELEMETRY_ERR_VERSION (-2)
+#define TELEMETRY_ERR_LENGTH (-3)
+#define TELEMETRY_ERR_CRC (-4)
+#define TELEMETRY_ERR_TYPE (-5)
+#define TELEMETRY_ERR_REFERENCE (-6) // Delta frame without the previous frame, wait for a keyframe
+
+typedef enum {
+    TELEMETRY_SAMPLE = 1,   // Control loop state
+    TELEMETRY_BARCODE = 2,  // Decoded barcode event
+    TELEMETRY_DRIVE = 3,    // Parsed remote drive command (replaces "Direction: %s; Speed: %d")
+    TELEMETRY_BATCH = 4,    // Several consecutive samples taken at a fixed period
+    TELEMETRY_BATCH_DELTA = 5, // TELEMETRY_BATCH compressed by telemetry_delta.h
+    TELEMETRY_BEACON = 6,   // Discovery announcement, broadcast on TELEMETRY_DISCOVERY_PORT
+    TELEMETRY_LOG = 7,      // Trace line drained on the car (common/trace.h)
+    TELEMETRY_PROFILE = 8,  // Latency summary of one profiled section (common/profile.h)
+    TELEMETRY_TASK = 9,     // Run-time stats of one FreeRTOS task (project_rtos)
+    TELEMETRY_SYSTEM = 10   // Kernel-wide run-time stats: CPU load, heap, queue levels
+} telemetry_type;
+
+// Sample flags
+#define TELEMETRY_FLAG_OBSTACLE 0x01
+#define TELEMETRY_FLAG_DISTANCE_VALID 0x02
+
+// Control loop state, fixed point on the wire
+typedef struct {
+    int32_t x_mm;               // Dead-reckoned pose
+    int32_t y_mm;
+    int16_t heading_mrad;
+    int16_t left_speed_mm_s;    // Wheel speeds from the encoders
+    int16_t right_speed_mm_s;
+    uint16_t left_duty;         // Duty cycles in 1/10000
+    uint16_t right_duty;
+    uint16_t distance_mm;       // Kalman filtered ultrasonic distance
+    uint8_t flags;              // TELEMETRY_FLAG_*
+} telemetry_sample;
+
+#define TELEMETRY_SAMPLE_SIZE 21
+
+typedef struct {
+    char chars[3];              // Decoded characters, start/data/stop
+    uint8_t reverse;            // Scanned in reverse orientation
+} telemetry_barcode;
+
+#define TELEMETRY_BARCODE_SIZE 4
+
+// Movement and turn parts of a drive command
+typedef enum {
+    DRIVE_MOVE_NONE = 0,
+    DRIVE_MOVE_FORWARD,
+    DRIVE_MOVE_BACKWARD,
+    DRIVE_MOVE_STOP
+} drive_move;
+
+typedef enum {
+    DRIVE_TURN_NONE = 0,
+    DRIVE_TURN_LEFT,
+    DRIVE_TURN_RIGHT,
+    DRIVE_TURN_STOP
+} drive_turn;
+
+typedef struct {
+    uint8_t move;               // drive_move
+    uint8_t turn;               // drive_turn
+    int16_t speed;
+} telemetry_drive;
+
+#define TELEMETRY_DRIVE_SIZE 4
+
+// Discovery beacon, broadcast every second so clients find cars without a
+// configured address. Payload: u32 device_id low, u32 device_id high, 4 bytes
+// IPv4 address in network order, u16 tcp_port, u16 stream_port, u16 version
+// (major << 8 | minor), u16 capabilities, u8 clients, u8 max_clients.
+#define TELEMETRY_DISCOVERY_PORT 4244
+#define TELEMETRY_BEACON_SIZE 22
+
+// Capability bits of a beacon
+#define TELEMETRY_CAP_DRIVE 0x0001          // Text drive commands
+#define TELEMETRY_CAP_BINARY_COMMANDS 0x0002
+#define TELEMETRY_CAP_STREAM 0x0004         // UDP sample stream to stream_port
+#define TELEMETRY_CAP_DELTA 0x0008          // Stream uses TELEMETRY_BATCH_DELTA
+#define TELEMETRY_CAP_ADAPTIVE 0x0010       // Rate adapted TCP batches (SUBSCRIBE)
+#define TELEMETRY_CAP_BARCODE 0x0020        // Sends TELEMETRY_BARCODE events
+
+typedef struct {
+    uint64_t device_id;         // Flash unique ID of the board
+    uint8_t ip[4];
+    uint16_t tcp_port;          // Command server
+    uint16_t stream_port;       // Where the car sends its UDP sample stream
+    uint16_t version;           // Firmware version, major << 8 | minor
+    uint16_t capabilities;      // TELEMETRY_CAP_*
+    uint8_t clients;            // Connected TCP clients
+    uint8_t max_clients;
+} telemetry_beacon;
+
+// Log line. Variable length payload: u8 level (trace_level), then the text
+// without a terminator.
+#define TELEMETRY_LOG_MAX 120
+
+typedef struct {
+    uint8_t level;
+    uint8_t length;
+    char text[TELEMETRY_LOG_MAX + 1];   // NUL terminated after decoding
+} telemetry_log;
+
+// Latency summary of a profiled code section. Payload: u8 section, name in 12
+// bytes NUL padded, then u32 count, min_ns, mean_ns, p50_ns, p99_ns, max_ns.
+#define TELEMETRY_PROFILE_NAME 12
+#define TELEMETRY_PROFILE_SIZE 37
+
+typedef struct {
+    uint8_t section;            // Index on the car, stable while it runs
+    char name[TELEMETRY_PROFILE_NAME];  // NUL terminated unless all 12 bytes are used
+    uint32_t count;             // Runs since boot or the last reset
+    uint32_t min_ns;
+    uint32_t mean_ns;
+    uint32_t p50_ns;            // Percentiles, upper edge of their histogram bucket
+    uint32_t p99_ns;
+    uint32_t max_ns;
+} telemetry_profile;
+
+// Run-time stats of one task over the last reporting interval. Payload: u8
+// task, name in 12 bytes NUL padded, u8 priority, u16 cpu_permille, u16
+// stack_free.
+#define TELEMETRY_TASK_NAME 12
+#define TELEMETRY_TASK_SIZE 18
+
+typedef struct {
+    uint8_t task;               // FreeRTOS task number, stable while the task lives
+    char name[TELEMETRY_TASK_NAME];     // NUL terminated unless all 12 bytes are used
+    uint8_t priority;
+    uint16_t cpu_permille;      // Share of the CPU (all cores) over the interval
+    uint16_t stack_free;        // Stack words never used since the task started
+} telemetry_task;
+
+// Kernel-wide run-time stats. Payload: u32 heap_free, u32 heap_min, u16
+// busy_permille, u8 tasks, u8 queue_count, then TELEMETRY_SYSTEM_QUEUES
+// queues of name in 8 bytes NUL padded, u8 level, u8 capacity, then u8
+// cores and a u16 core_busy_permille per TELEMETRY_CORES.
+#define TELEMETRY_SYSTEM_QUEUES 4
+#define TELEMETRY_QUEUE_NAME 8
+#define TELEMETRY_CORES 2
+#define TELEMETRY_SYSTEM_SIZE (12 + TELEMETRY_SYSTEM_QUEUES * (TELEMETRY_QUEUE_NAME + 2) + 1 + TELEMETRY_CORES * 2)
+
+typedef struct {
+    char name[TELEMETRY_QUEUE_NAME];    // NUL terminated unless all 8 bytes are used
+    uint8_t level;
+    uint8_t capacity;
+} telemetry_queue;
+
+typedef struct {
+    uint32_t heap_free;         // FreeRTOS heap bytes
+    uint32_t heap_min;          // Lowest heap_free since boot
+    uint16_t busy_permille;     // CPU share of everything but the idle tasks
+    uint8_t tasks;              // Tasks running, each sent as a TELEMETRY_TASK frame
+    uint8_t queue_count;        // Entries of queues in use
+    telemetry_queue queues[TELEMETRY_SYSTEM_QUEUES];
+    uint8_t cores;              // Cores the scheduler runs on, entries of core_busy_permille in use
+    uint16_t core_busy_permille[TELEMETRY_CORES];
+} telemetry_system;
+
+// Field groups of a sample. A batch may carry only some of them to save
+// bandwidth; absent fields decode as 0. Listed in wire order.
+#define TELEMETRY_FIELD_POSE 0x01   // x_mm, y_mm, heading_mrad (10 bytes)
+#define TELEMETRY_FIELD_SPEED 0x02  // left/right_speed_mm_s (4 bytes)
+#define TELEMETRY_FIELD_DUTY 0x04   // left/right_duty (4 bytes)
+#define TELEMETRY_FIELD_RANGE 0x08  // distance_mm, flags (3 bytes)
+#define TELEMETRY_FIELDS_ALL 0x0F
+
+// Batch of samples. Sample i was taken at timestamp_us + i * period_us and has
+// sample number first_sample + i, so the receiver can count lost samples across
+// datagrams. Header: u32 first_sample, u16 period_us, u8 count, u8 fields.
+#define TELEMETRY_MAX_BATCH 20
+#define TELEMETRY_BATCH_HEADER_SIZE 8
+
+typedef struct {
+    uint32_t first_sample;      // Running sample number of samples[0]
+    uint16_t period_us;
+    uint8_t count;
+    uint8_t fields;             // TELEMETRY_FIELD_* groups present in every sample
+    telemetry_sample samples[TELEMETRY_MAX_BATCH];
+} telemetry_batch;
+
+// Encoded size of one sample carrying the given field groups
+size_t telemetry_sample_size(uint8_t fields);
+
+// Compressed batch payload, expanded with telemetry_delta_decode. Points into
+// the buffer passed to telemetry_decode (or the caller's payload when encoding).
+typedef struct {
+    const uint8_t *payload;
+    uint16_t length;
+} telemetry_delta;
+
+// A decoded frame
+typedef struct {
+    uint8_t type;
+    uint16_t seq;
+    uint32_t timestamp_us;
+    union {
+        telemetry_sample sample;
+        telemetry_barcode barcode;
+        telemetry_drive drive;
+        telemetry_batch batch;
+        telemetry_delta delta;
+        telemetry_beacon beacon;
+        telemetry_log log;
+        telemetry_profile profile;
+        telemetry_task task;
+        telemetry_system system;
+    } u;
+} telemetry_frame;
+
+// Little-endian field helpers, shared with the other protocol encoders
+static inline void put_u16(uint8_t *p, uint16_t v) { p[0] = (uint8_t)v; p[1] = (uint8_t)(v >> 8); }
+static inline void put_u32(uint8_t *p, uint32_t v) { put_u16(p, (uint16_t)v); put_u16(p + 2, (uint16_t)(v >> 16)); }
+static inline uint16_t get_u16(const uint8_t *p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static inline uint32_t get_u32(const uint8_t *p) { return get_u16(p) | ((uint32_t)get_u16(p + 2) << 16); }
+
+uint16_t telemetry_crc16(const uint8_t *data, size_t len);
+
+// Encoded length of a frame in bytes, 0 for an unknown type
+size_t telemetry_encoded_size(const telemetry_frame *frame);
+
+// Encode a frame into buf. Returns the frame length, or 0 if it does not fit.
+size_t telemetry_encode(const telemetry_frame *frame, uint8_t *buf, size_t cap);
+
+// Decode the frame at the start of buf. Returns the number of bytes consumed
+// (> 0), TELEMETRY_NEED_MORE, or a negative TELEMETRY_ERR_* code.
+int telemetry_decode(const uint8_t *buf, size_t len, telemetry_frame *frame);
+
+// Text form of a drive command, e.g. "Forward Left" (the old dashboard string)
+const char *telemetry_drive_direction(const telemetry_drive *drive, char *buf, size_t cap);
+
+#endif // TELEMETRY_H
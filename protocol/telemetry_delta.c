@@ -0,0 +1,246 @@
+#include <string.h>
+#include <stddef.h>
+#include "telemetry_delta.h"
+
+// Numeric fields of a sample in wire order, with the group that carries them
+typedef struct {
+    uint8_t group;
+    uint8_t offset;
+    uint8_t bits;
+} delta_field;
+
+static const delta_field delta_fields[] = {
+    {TELEMETRY_FIELD_POSE, offsetof(telemetry_sample, x_mm), 32},
+    {TELEMETRY_FIELD_POSE, offsetof(telemetry_sample, y_mm), 32},
+    {TELEMETRY_FIELD_POSE, offsetof(telemetry_sample, heading_mrad), 16},
+    {TELEMETRY_FIELD_SPEED, offsetof(telemetry_sample, left_speed_mm_s), 16},
+    {TELEMETRY_FIELD_SPEED, offsetof(telemetry_sample, right_speed_mm_s), 16},
+    {TELEMETRY_FIELD_DUTY, offsetof(telemetry_sample, left_duty), 16},
+    {TELEMETRY_FIELD_DUTY, offsetof(telemetry_sample, right_duty), 16},
+    {TELEMETRY_FIELD_RANGE, offsetof(telemetry_sample, distance_mm), 16},
+    {TELEMETRY_FIELD_RANGE, offsetof(telemetry_sample, flags), 8},
+};
+
+#define DELTA_FIELD_COUNT (sizeof(delta_fields) / sizeof(delta_fields[0]))
+
+static uint32_t field_load(const telemetry_sample *s, const delta_field *f) {
+    const uint8_t *p = (const uint8_t *)s + f->offset;
+    if (f->bits == 32) {
+        uint32_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    if (f->bits == 16) {
+        uint16_t v;
+        memcpy(&v, p, sizeof(v));
+        return v;
+    }
+    return *p;
+}
+
+static void field_store(telemetry_sample *s, const delta_field *f, uint32_t v) {
+    uint8_t *p = (uint8_t *)s + f->offset;
+    if (f->bits == 32) {
+        memcpy(p, &v, sizeof(v));
+    } else if (f->bits == 16) {
+        uint16_t v16 = (uint16_t)v;
+        memcpy(p, &v16, sizeof(v16));
+    } else {
+        *p = (uint8_t)v;
+    }
+}
+
+// Difference wrapped to the field width and sign extended, then zigzag mapped
+// so small negative changes also give small codes: 0, -1, 1, -2 -> 0, 1, 2, 3
+static uint32_t zigzag(uint32_t diff, uint8_t bits) {
+    int32_t d = bits == 32 ? (int32_t)diff : bits == 16 ? (int16_t)diff : (int8_t)diff;
+    return ((uint32_t)d << 1) ^ (uint32_t)(d >> 31);
+}
+
+static uint32_t unzigzag(uint32_t z) {
+    return (z >> 1) ^ (0u - (z & 1));
+}
+
+// Returns the end of the varint, or NULL if it does not fit before end
+static uint8_t *put_varint(uint8_t *p, const uint8_t *end, uint32_t v) {
+    while (v >= 0x80) {
+        if (p >= end) {
+            return NULL;
+        }
+        *p++ = (uint8_t)(v | 0x80);
+        v >>= 7;
+    }
+    if (p >= end) {
+        return NULL;
+    }
+    *p++ = (uint8_t)v;
+    return p;
+}
+
+// Returns the end of the varint, or NULL if it is truncated or longer than 5 bytes
+static const uint8_t *get_varint(const uint8_t *p, const uint8_t *end, uint32_t *v) {
+    uint32_t result = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (p >= end) {
+            return NULL;
+        }
+        uint8_t byte = *p++;
+        result |= (uint32_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
+void telemetry_delta_init(telemetry_delta_state *state, uint8_t keyframe_interval) {
+    memset(state, 0, sizeof(*state));
+    state->keyframe_interval = keyframe_interval ? keyframe_interval : 1;
+}
+
+void telemetry_delta_reset(telemetry_delta_state *state) {
+    state->valid = false;
+}
+
+size_t telemetry_delta_encode(telemetry_delta_state *state, const telemetry_frame *batch, uint8_t *buf, size_t cap) {
+    const telemetry_batch *b = &batch->u.batch;
+    if (batch->type != TELEMETRY_BATCH || b->count > TELEMETRY_MAX_BATCH || (b->fields & ~TELEMETRY_FIELDS_ALL) ||
+        cap < TELEMETRY_OVERHEAD + TELEMETRY_DELTA_HEADER_SIZE) {
+        return 0;
+    }
+    if (cap > TELEMETRY_MAX_FRAME) {
+        cap = TELEMETRY_MAX_FRAME;
+    }
+
+    bool keyframe = !state->valid || b->first_sample != state->next_sample || b->fields != state->fields ||
+                    state->since_keyframe + 1 >= state->keyframe_interval;
+
+    // Payload goes straight to its place in the frame
+    uint8_t *payload = buf + TELEMETRY_HEADER_SIZE;
+    const uint8_t *end = buf + cap - TELEMETRY_CRC_SIZE;
+    put_u32(payload, b->first_sample);
+    put_u16(payload + 4, b->period_us);
+    payload[6] = b->count;
+    payload[7] = b->fields;
+    payload[8] = keyframe ? TELEMETRY_DELTA_KEYFRAME : 0;
+
+    static const telemetry_sample zero;
+    const telemetry_sample *ref = keyframe ? &zero : &state->last;
+    uint8_t *p = payload + TELEMETRY_DELTA_HEADER_SIZE;
+    for (int i = 0; i < b->count; i++) {
+        const telemetry_sample *s = &b->samples[i];
+        for (size_t k = 0; k < DELTA_FIELD_COUNT; k++) {
+            const delta_field *f = &delta_fields[k];
+            if (!(b->fields & f->group)) {
+                continue;
+            }
+            p = put_varint(p, end, zigzag(field_load(s, f) - field_load(ref, f), f->bits));
+            if (!p) {
+                state->valid = false;
+                return 0;
+            }
+        }
+        ref = s;
+    }
+
+    if (b->count > 0) {
+        state->last = b->samples[b->count - 1];
+        state->next_sample = b->first_sample + b->count;
+        state->fields = b->fields;
+        state->valid = true;
+        state->since_keyframe = keyframe ? 0 : state->since_keyframe + 1;
+    }
+
+    telemetry_frame frame;
+    frame.type = TELEMETRY_BATCH_DELTA;
+    frame.seq = batch->seq;
+    frame.timestamp_us = batch->timestamp_us;
+    frame.u.delta.payload = payload;
+    frame.u.delta.length = (uint16_t)(p - payload);
+    return telemetry_encode(&frame, buf, cap);
+}
+
+int telemetry_delta_decode(telemetry_delta_state *state, const telemetry_frame *frame, telemetry_frame *out) {
+    if (frame->type == TELEMETRY_BATCH) {
+        if (out != frame) {
+            *out = *frame;
+        }
+        const telemetry_batch *b = &out->u.batch;
+        if (b->count > 0) {
+            state->last = b->samples[b->count - 1];
+            state->next_sample = b->first_sample + b->count;
+            state->fields = b->fields;
+            state->valid = true;
+        }
+        return b->count;
+    }
+    if (frame->type != TELEMETRY_BATCH_DELTA) {
+        return TELEMETRY_ERR_TYPE;
+    }
+
+    // out may alias frame, so take everything needed from it first
+    const uint8_t *p = frame->u.delta.payload;
+    const uint8_t *end = p + frame->u.delta.length;
+    uint16_t seq = frame->seq;
+    uint32_t timestamp_us = frame->timestamp_us;
+
+    if (frame->u.delta.length < TELEMETRY_DELTA_HEADER_SIZE) {
+        return TELEMETRY_ERR_LENGTH;
+    }
+    uint32_t first_sample = get_u32(p);
+    uint16_t period_us = get_u16(p + 4);
+    uint8_t count = p[6];
+    uint8_t fields = p[7];
+    bool keyframe = p[8] & TELEMETRY_DELTA_KEYFRAME;
+    p += TELEMETRY_DELTA_HEADER_SIZE;
+
+    if (count > TELEMETRY_MAX_BATCH || (fields & ~TELEMETRY_FIELDS_ALL)) {
+        return TELEMETRY_ERR_LENGTH;
+    }
+    if (!keyframe && (!state->valid || first_sample != state->next_sample || fields != state->fields)) {
+        return TELEMETRY_ERR_REFERENCE;
+    }
+
+    // Decode into a scratch batch so a bad frame leaves out and the reference untouched
+    static const telemetry_sample zero;
+    telemetry_batch batch;
+    const telemetry_sample *ref = keyframe ? &zero : &state->last;
+    for (int i = 0; i < count; i++) {
+        telemetry_sample *s = &batch.samples[i];
+        memset(s, 0, sizeof(*s));
+        for (size_t k = 0; k < DELTA_FIELD_COUNT; k++) {
+            const delta_field *f = &delta_fields[k];
+            uint32_t z;
+            if (!(fields & f->group)) {
+                continue;
+            }
+            p = get_varint(p, end, &z);
+            if (!p) {
+                return TELEMETRY_ERR_LENGTH;
+            }
+            field_store(s, f, field_load(ref, f) + unzigzag(z));
+        }
+        ref = s;
+    }
+    if (p != end) {
+        return TELEMETRY_ERR_LENGTH;
+    }
+
+    batch.first_sample = first_sample;
+    batch.period_us = period_us;
+    batch.count = count;
+    batch.fields = fields;
+    if (count > 0) {
+        state->last = batch.samples[count - 1];
+        state->next_sample = first_sample + count;
+        state->fields = fields;
+        state->valid = true;
+    }
+
+    out->type = TELEMETRY_BATCH;
+    out->seq = seq;
+    out->timestamp_us = timestamp_us;
+    memcpy(&out->u.batch, &batch, offsetof(telemetry_batch, samples) + count * sizeof(telemetry_sample));
+    return count;
+}
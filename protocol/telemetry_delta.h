@@ -0,0 +1,54 @@
+#ifndef TELEMETRY_DELTA_H
+#define TELEMETRY_DELTA_H
+
+// Delta compression of TELEMETRY_BATCH frames into TELEMETRY_BATCH_DELTA.
+//
+// Consecutive samples differ by little, so every field is sent as the
+// difference from the same field of the previous sample, zigzag mapped and
+// written as a LEB128 varint (1 byte for a change of -64..63). The reference
+// of the first sample in a frame is the last sample of the previous frame, so
+// the receiver must have decoded that frame. A keyframe codes its first sample
+// against zero instead and is sent every keyframe_interval frames, after a gap
+// in sample numbers and when the field groups change, so after a lost datagram
+// the receiver resynchronises within one keyframe interval.
+//
+// Payload: u32 first_sample, u16 period_us, u8 count, u8 fields, u8 flags
+// (TELEMETRY_DELTA_KEYFRAME), then for each sample the varints of the present
+// fields in wire order (x, y, heading, left/right speed, left/right duty,
+// distance, flags). Differences wrap at the field width.
+
+#include "telemetry.h"
+
+#define TELEMETRY_DELTA_HEADER_SIZE 9
+#define TELEMETRY_DELTA_KEYFRAME 0x01
+#define TELEMETRY_DELTA_KEYFRAME_INTERVAL 5    // Frames; 0.25 s at 20 datagrams/s
+
+// One side of a delta stream; the encoder and the decoder each keep their own
+typedef struct {
+    telemetry_sample last;      // Reference for the next frame's first sample
+    uint32_t next_sample;       // Sample number the next frame must start at to use it
+    uint8_t fields;             // Field groups of the last frame
+    bool valid;                 // last holds a decoded sample
+    uint8_t keyframe_interval;  // Encoder only
+    uint8_t since_keyframe;     // Encoder only, frames sent since the last keyframe
+} telemetry_delta_state;
+
+void telemetry_delta_init(telemetry_delta_state *state, uint8_t keyframe_interval);
+
+// Force the next encoded frame to be a keyframe
+void telemetry_delta_reset(telemetry_delta_state *state);
+
+// Compress a TELEMETRY_BATCH frame into a complete TELEMETRY_BATCH_DELTA frame
+// in buf (same seq and timestamp). Returns the frame length, or 0 if it does not
+// fit in cap; the next frame is then a keyframe, so the caller can send this
+// batch uncompressed instead.
+size_t telemetry_delta_encode(telemetry_delta_state *state, const telemetry_frame *batch, uint8_t *buf, size_t cap);
+
+// Expand a frame from telemetry_decode into a TELEMETRY_BATCH frame in out
+// (which may be the same as frame). TELEMETRY_BATCH frames are copied and kept
+// as the reference too. Returns the sample count, TELEMETRY_ERR_REFERENCE if a
+// delta frame does not follow the last decoded one (drop it and wait for a
+// keyframe), or TELEMETRY_ERR_LENGTH / TELEMETRY_ERR_TYPE for a bad frame.
+int telemetry_delta_decode(telemetry_delta_state *state, const telemetry_frame *frame, telemetry_frame *out);
+
+#endif // TELEMETRY_DELTA_H
@@ -0,0 +1,42 @@
+#include "pico/stdlib.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Memory for the kernel's own tasks, required with configSUPPORT_STATIC_ALLOCATION
+
+static StaticTask_t idle_task_buffer;
+static StackType_t idle_task_stack[configMINIMAL_STACK_SIZE];
+
+void vApplicationGetIdleTaskMemory(StaticTask_t **task_buffer, StackType_t **stack, configSTACK_DEPTH_TYPE *stack_words) {
+    *task_buffer = &idle_task_buffer;
+    *stack = idle_task_stack;
+    *stack_words = configMINIMAL_STACK_SIZE;
+}
+
+#if configNUMBER_OF_CORES > 1
+// Idle tasks of the other cores
+static StaticTask_t passive_idle_task_buffers[configNUMBER_OF_CORES - 1];
+static StackType_t passive_idle_task_stacks[configNUMBER_OF_CORES - 1][configMINIMAL_STACK_SIZE];
+
+void vApplicationGetPassiveIdleTaskMemory(StaticTask_t **task_buffer, StackType_t **stack,
+                                          configSTACK_DEPTH_TYPE *stack_words, BaseType_t index) {
+    *task_buffer = &passive_idle_task_buffers[index];
+    *stack = passive_idle_task_stacks[index];
+    *stack_words = configMINIMAL_STACK_SIZE;
+}
+#endif
+
+static StaticTask_t timer_task_buffer;
+static StackType_t timer_task_stack[configTIMER_TASK_STACK_DEPTH];
+
+void vApplicationGetTimerTaskMemory(StaticTask_t **task_buffer, StackType_t **stack, configSTACK_DEPTH_TYPE *stack_words) {
+    *task_buffer = &timer_task_buffer;
+    *stack = timer_task_stack;
+    *stack_words = configTIMER_TASK_STACK_DEPTH;
+}
+
+// configCHECK_FOR_STACK_OVERFLOW: the task has already written past its
+// stack, so stop before the corruption reaches the motors
+void vApplicationStackOverflowHook(TaskHandle_t task, char *name) {
+    panic("Stack overflow in task %s", name);
+}
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "buddy1.h"
+#include "car_stats.h"
+
+typedef struct {
+    char name[TELEMETRY_QUEUE_NAME];
+    QueueHandle_t queue;
+    unsigned int (*level)(void);    // Used when there is no queue handle
+    uint8_t capacity;
+} watched_queue;
+
+typedef struct {
+    UBaseType_t number;
+    configRUN_TIME_COUNTER_TYPE run_time;
+} run_time_mark;
+
+static watched_queue queues[STATS_MAX_QUEUES];
+static int queue_count = 0;
+
+// Latest sample, and the run time counters of the one before
+static TaskStatus_t tasks[STATS_MAX_TASKS];
+static uint16_t task_cpu_permille[STATS_MAX_TASKS];
+static UBaseType_t task_count = 0;
+static run_time_mark previous[STATS_MAX_TASKS];
+static UBaseType_t previous_count = 0;
+static configRUN_TIME_COUNTER_TYPE previous_total = 0;
+static telemetry_system system_stats;
+static TaskHandle_t idle_tasks[configNUMBER_OF_CORES];     // By core
+
+// Copy of the sample sent by stats_report_frame, taken under the lwIP lock
+// since clients are sent it from lwIP callbacks while the next sample is taken
+static telemetry_system report_system;
+static telemetry_task report_tasks[STATS_MAX_TASKS];
+static int report_task_count = 0;
+
+static bool watch(const char *name, QueueHandle_t queue, unsigned int (*level)(void), unsigned int capacity) {
+    if (queue_count >= STATS_MAX_QUEUES) {
+        return false;
+    }
+    watched_queue *watched = &queues[queue_count++];
+    strncpy(watched->name, name, TELEMETRY_QUEUE_NAME - 1);
+    watched->queue = queue;
+    watched->level = level;
+    watched->capacity = capacity > UINT8_MAX ? UINT8_MAX : (uint8_t)capacity;
+    return true;
+}
+
+bool car_stats_watch_queue(const char *name, QueueHandle_t queue) {
+    return watch(name, queue, NULL, uxQueueMessagesWaiting(queue) + uxQueueSpacesAvailable(queue));
+}
+
+bool car_stats_watch_level(const char *name, unsigned int (*level)(void), unsigned int capacity) {
+    return watch(name, NULL, level, capacity);
+}
+
+// Run time counted up to the previous sample, 0 for a task started since
+static configRUN_TIME_COUNTER_TYPE previous_run_time(UBaseType_t number) {
+    for (UBaseType_t i = 0; i < previous_count; i++) {
+        if (previous[i].number == number) {
+            return previous[i].run_time;
+        }
+    }
+    return 0;
+}
+
+void car_stats_start(void) {
+#if configNUMBER_OF_CORES > 1
+    for (int core = 0; core < configNUMBER_OF_CORES; core++) {
+        idle_tasks[core] = xTaskGetIdleTaskHandleForCore(core);
+#if configUSE_CORE_AFFINITY
+        vTaskCoreAffinitySet(idle_tasks[core], 1u << core);
+#endif
+    }
+#else
+    idle_tasks[0] = xTaskGetIdleTaskHandle();
+#endif
+}
+
+// Core whose idle task this is, or -1
+static int idle_core(const TaskStatus_t *task) {
+    for (int core = 0; core < configNUMBER_OF_CORES; core++) {
+        if (idle_tasks[core] && task->xHandle == idle_tasks[core]) {
+            return core;
+        }
+    }
+    return -1;
+}
+
+void car_stats_sample(void) {
+    configRUN_TIME_COUNTER_TYPE total = 0;
+    task_count = uxTaskGetSystemState(tasks, STATS_MAX_TASKS, &total);
+
+    // Every core counts the whole interval, spread over the tasks it ran
+    uint64_t elapsed = (configRUN_TIME_COUNTER_TYPE)(total - previous_total);
+    uint64_t available = elapsed * configNUMBER_OF_CORES;
+    uint64_t idle = 0;
+    uint64_t core_idle[configNUMBER_OF_CORES] = {0};
+    for (UBaseType_t i = 0; i < task_count; i++) {
+        configRUN_TIME_COUNTER_TYPE ran = tasks[i].ulRunTimeCounter - previous_run_time(tasks[i].xTaskNumber);
+        task_cpu_permille[i] = available ? (uint16_t)((uint64_t)ran * 1000 / available) : 0;
+        int core = idle_core(&tasks[i]);
+        if (core >= 0) {
+            idle += ran;
+            core_idle[core] += ran;
+        }
+    }
+    for (UBaseType_t i = 0; i < task_count; i++) {
+        previous[i].number = tasks[i].xTaskNumber;
+        previous[i].run_time = tasks[i].ulRunTimeCounter;
+    }
+    previous_count = task_count;
+    previous_total = total;
+
+    system_stats.heap_free = xPortGetFreeHeapSize();
+#if CAR_ZERO_HEAP
+    system_stats.heap_min = system_stats.heap_free;     // heap_1 never frees
+#else
+    system_stats.heap_min = xPortGetMinimumEverFreeHeapSize();
+#endif
+    system_stats.busy_permille = available && idle < available ? (uint16_t)(1000 - idle * 1000 / available) : 0;
+    // Each idle task is held to its own core, so its run time is that core's idle time
+    system_stats.cores = configNUMBER_OF_CORES < TELEMETRY_CORES ? configNUMBER_OF_CORES : TELEMETRY_CORES;
+    for (int core = 0; core < system_stats.cores; core++) {
+        system_stats.core_busy_permille[core] =
+            elapsed && core_idle[core] < elapsed ? (uint16_t)(1000 - core_idle[core] * 1000 / elapsed) : 0;
+    }
+    system_stats.tasks = (uint8_t)task_count;
+    system_stats.queue_count = (uint8_t)queue_count;
+    for (int i = 0; i < queue_count; i++) {
+        const watched_queue *watched = &queues[i];
+        unsigned int level = watched->queue ? uxQueueMessagesWaiting(watched->queue) : watched->level();
+        memcpy(system_stats.queues[i].name, watched->name, TELEMETRY_QUEUE_NAME);
+        system_stats.queues[i].level = level > UINT8_MAX ? UINT8_MAX : (uint8_t)level;
+        system_stats.queues[i].capacity = watched->capacity;
+    }
+}
+
+void car_stats_print(void) {
+    printf("Task             pri   cpu%%  stack free\n");
+    for (UBaseType_t i = 0; i < task_count; i++) {
+        printf("  %-14s %3lu %5u.%u %6lu words\n", tasks[i].pcTaskName, (unsigned long)tasks[i].uxCurrentPriority,
+               task_cpu_permille[i] / 10, task_cpu_permille[i] % 10,
+               (unsigned long)tasks[i].usStackHighWaterMark);
+    }
+    printf("CPU %u.%u%% busy", system_stats.busy_permille / 10, system_stats.busy_permille % 10);
+    if (system_stats.cores > 1) {
+        for (int core = 0; core < system_stats.cores; core++) {
+            printf(", core %d %u.%u%%", core, system_stats.core_busy_permille[core] / 10,
+                   system_stats.core_busy_permille[core] % 10);
+        }
+    }
+    printf("; heap %lu bytes free (lowest %lu), queues", (unsigned long)system_stats.heap_free,
+           (unsigned long)system_stats.heap_min);
+    for (int i = 0; i < system_stats.queue_count; i++) {
+        const telemetry_queue *queue = &system_stats.queues[i];
+        printf(" %.8s %u/%u", queue->name, queue->level, queue->capacity);
+    }
+    printf("\n");
+}
+
+// telemetry_report_fn: the system frame, then one frame per task
+static bool stats_report_frame(int index, telemetry_frame *frame) {
+    if (index == 0) {
+        *frame = (telemetry_frame){.type = TELEMETRY_SYSTEM};
+        frame->u.system = report_system;
+        return true;
+    }
+    if (index > report_task_count) {
+        return false;
+    }
+    *frame = (telemetry_frame){.type = TELEMETRY_TASK};
+    frame->u.task = report_tasks[index - 1];
+    return true;
+}
+
+void car_stats_publish(void) {
+    cyw43_arch_lwip_begin();
+    report_system = system_stats;
+    report_task_count = (int)task_count;
+    for (UBaseType_t i = 0; i < task_count; i++) {
+        telemetry_task *task = &report_tasks[i];
+        memset(task, 0, sizeof(*task));
+        task->task = (uint8_t)tasks[i].xTaskNumber;
+        strncpy(task->name, tasks[i].pcTaskName, TELEMETRY_TASK_NAME);
+        task->priority = (uint8_t)tasks[i].uxCurrentPriority;
+        task->cpu_permille = task_cpu_permille[i];
+        task->stack_free = tasks[i].usStackHighWaterMark > UINT16_MAX ? UINT16_MAX
+                                                                      : (uint16_t)tasks[i].usStackHighWaterMark;
+    }
+    telemetry_publish_report(stats_report_frame);
+    cyw43_arch_lwip_end();
+}
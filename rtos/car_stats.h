@@ -0,0 +1,40 @@
+#ifndef CAR_STATS_H
+#define CAR_STATS_H
+
+#include "FreeRTOS.h"
+#include "queue.h"
+#include "telemetry.h"
+
+// Run-time stats of project_rtos, sampled by the logging task every
+// REPORT_INTERVAL_MS. Each sample reads every task's run time (counted on the
+// 1 MHz timer, see FreeRTOSConfig.h) and stack high-water mark, the watched
+// queue levels and the FreeRTOS heap. CPU shares cover the time since the
+// previous sample, as a share of all cores, so they add up to 100%. Each
+// core's load is measured by its idle task, which car_stats_start pins to it.
+//
+// Kernel and SDK tasks (idle, timers, lwIP, cyw43) are included; time in
+// interrupts is charged to the task they interrupted.
+
+#define STATS_MAX_TASKS 16                          // With more tasks a sample finds none
+#define STATS_MAX_QUEUES TELEMETRY_SYSTEM_QUEUES    // Queues that fit in a TELEMETRY_SYSTEM frame
+
+// Report a FreeRTOS queue's level, or a level read by a function for other
+// queues; names longer than TELEMETRY_QUEUE_NAME - 1 are cut. Call before the
+// scheduler starts. Returns false when STATS_MAX_QUEUES are already watched.
+bool car_stats_watch_queue(const char *name, QueueHandle_t queue);
+bool car_stats_watch_level(const char *name, unsigned int (*level)(void), unsigned int capacity);
+
+// Find the idle tasks and hold each to its core; call once from a task
+void car_stats_start(void);
+
+// Take a sample; the functions below report the latest one
+void car_stats_sample(void);
+
+// Print a table of the tasks, then the CPU load, heap and queues
+void car_stats_print(void);
+
+// Send one TELEMETRY_SYSTEM frame, then a TELEMETRY_TASK frame per task, as
+// a report (buddy1.h): each client gets the frames as its send queue drains
+void car_stats_publish(void);
+
+#endif // CAR_STATS_H
@@ -0,0 +1,232 @@
+#include <stdio.h>
+#include <string.h>
+#include "pico/stdlib.h"
+#include "pico/cyw43_arch.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "buddy1.h"
+#include "buddy3.h"
+#include "buddy5.h"
+#include "trace.h"
+#include "profile.h"
+#include "car_stats.h"
+#include "car_tasks.h"
+
+typedef struct {
+    const char *name;
+    TaskFunction_t function;
+    StackType_t *stack;
+    uint32_t stack_words;
+    UBaseType_t priority;
+    UBaseType_t cores;          // Affinity mask, bit n for core n
+} car_task_config;
+
+static void control_task(void *params);
+static void sonar_task(void *params);
+static void barcode_task(void *params);
+static void network_task(void *params);
+static void logging_task(void *params);
+
+static StackType_t control_stack[CONTROL_STACK_WORDS];
+static StackType_t sonar_stack[SONAR_STACK_WORDS];
+static StackType_t barcode_stack[BARCODE_STACK_WORDS];
+static StackType_t network_stack[NETWORK_STACK_WORDS];
+static StackType_t logging_stack[LOGGING_STACK_WORDS];
+
+#define CAR_TASK(name, function, stack, priority, cores) \
+    {name, function, stack, count_of(stack), tskIDLE_PRIORITY + (priority), cores}
+
+static const car_task_config task_configs[CAR_TASK_COUNT] = {
+    [CAR_TASK_CONTROL] = CAR_TASK("control", control_task, control_stack, 5, CONTROL_CORES),
+    [CAR_TASK_SONAR]   = CAR_TASK("sonar", sonar_task, sonar_stack, 4, SONAR_CORES),
+    [CAR_TASK_BARCODE] = CAR_TASK("barcode", barcode_task, barcode_stack, 3, BARCODE_CORES),
+    [CAR_TASK_NETWORK] = CAR_TASK("network", network_task, network_stack, 2, NETWORK_CORES),
+    [CAR_TASK_LOGGING] = CAR_TASK("logging", logging_task, logging_stack, 1, LOGGING_CORES),
+};
+
+static StaticTask_t task_buffers[CAR_TASK_COUNT];
+static TaskHandle_t task_handles[CAR_TASK_COUNT];
+
+static StaticQueue_t range_mailbox_buffer;
+static uint8_t range_mailbox_storage[sizeof(car_range)];
+static QueueHandle_t range_mailbox;     // One car_range, overwritten by sonar
+
+static StaticQueue_t barcode_queue_buffer;
+static uint8_t barcode_queue_storage[BARCODE_QUEUE_DEPTH * sizeof(telemetry_barcode)];
+static QueueHandle_t barcode_queue;     // telemetry_barcode, barcode to network
+static volatile bool network_up = false;
+
+static int control_profile = -1;
+static int sonar_profile = -1;
+static int barcode_profile = -1;
+static int trace_profile = -1;
+
+// LINE command: control steers from the line sensor the barcode task samples
+static const remote_drive_line_follower line_follower = {line_follow_start, line_follow_step,
+                                                         line_follow_set_gains};
+
+// Network side of remote_drive_submit (lwIP thread): wake control to apply it now
+static void command_arrived(void) {
+    xTaskNotifyGive(task_handles[CAR_TASK_CONTROL]);
+}
+
+// Echo IRQ: the pulse has ended, wake the sonar task
+static void echo_received(void) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(task_handles[CAR_TASK_SONAR], &woken);
+    portYIELD_FROM_ISR(woken);
+}
+
+static void control_task(void *params) {
+    car_range range = {0};
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONTROL_PERIOD_MS));
+        xQueuePeek(range_mailbox, &range, 0);
+
+        PROFILE_SCOPE(control_profile);
+        remote_drive_poll(range.distance_cm, range.valid && range.distance_cm <= OBSTACLE_RANGE_CM);
+    }
+}
+
+static void sonar_task(void *params) {
+    TickType_t last_wake = xTaskGetTickCount();
+
+    while (true) {
+        {
+            PROFILE_SCOPE(sonar_profile);
+            xTaskNotifyStateClear(NULL);    // A late echo from the last trigger
+            ultrasonic_trigger();
+            ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ULTRASONIC_WAIT_MS));
+
+            car_range range = {.distance_cm = ultrasonic_finish()};
+            range.valid = distance_valid;
+            obstacle_update(range.distance_cm);
+            buzzer_update();
+            xQueueOverwrite(range_mailbox, &range);
+        }
+        xTaskNotifyGive(task_handles[CAR_TASK_CONTROL]);
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(SONAR_PERIOD_MS));
+    }
+}
+
+// The only ADC user, so the barcode input and the temperature sensor are
+// never selected from two tasks at once
+static void barcode_task(void *params) {
+    TickType_t last_wake = xTaskGetTickCount();
+    TickType_t last_temperature = last_wake;
+    unsigned int decoded = ir_barcode_decoder.decoded_count;
+
+    while (true) {
+        {
+            PROFILE_SCOPE(barcode_profile);
+            read_ir_sensors();  // Barcode sensor into the decoder, line sensor for line_follow_step
+        }
+
+        if (ir_barcode_decoder.decoded_count != decoded) {
+            decoded = ir_barcode_decoder.decoded_count;
+            telemetry_barcode barcode = {.reverse = ir_barcode_decoder.direction};
+            memcpy(barcode.chars, ir_barcode_decoder.result, sizeof(barcode.chars));
+            xQueueSend(barcode_queue, &barcode, 0);     // Dropped if the network is behind
+        }
+
+        if (xTaskGetTickCount() - last_temperature >= pdMS_TO_TICKS(TEMPERATURE_SAMPLE_INTERVAL_MS)) {
+            updateSpeedOfSound();
+            last_temperature = xTaskGetTickCount();
+        }
+        vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(BARCODE_PERIOD_MS));
+    }
+}
+
+// Joins Wi-Fi (up to 30 s) without holding up the other tasks, then
+// publishes decoded barcodes. Commands and the sample stream are handled in
+// lwIP's own thread and the cyw43 driver task.
+static void network_task(void *params) {
+    if (!remote_server_start()) {
+        printf("Remote server failed to start\n");
+        vTaskDelete(NULL);
+    }
+#if configUSE_CORE_AFFINITY && configNUMBER_OF_CORES > 1
+    TaskHandle_t lwip_thread = xTaskGetHandle("tcpip_thread");  // lwIP's TCPIP_THREAD_NAME
+    if (lwip_thread) {
+        vTaskCoreAffinitySet(lwip_thread, LWIP_CORES);
+    }
+#endif
+    trace_set_sink(telemetry_log_sink);   // Trace lines also go to the clients
+    network_up = true;
+
+    telemetry_barcode barcode;
+    while (true) {
+        if (xQueueReceive(barcode_queue, &barcode, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        telemetry_frame frame = {.type = TELEMETRY_BARCODE};
+        frame.u.barcode = barcode;
+        cyw43_arch_lwip_begin();
+        telemetry_publish(&frame);
+        cyw43_arch_lwip_end();
+    }
+}
+
+// Lowest priority: printing on stdio may block without delaying anything else
+static void logging_task(void *params) {
+    TickType_t last_report = xTaskGetTickCount();
+    car_stats_start();
+
+    while (true) {
+        {
+            PROFILE_SCOPE(trace_profile);
+            trace_drain(TRACE_DRAIN_BUDGET);
+        }
+
+        if (xTaskGetTickCount() - last_report >= pdMS_TO_TICKS(REPORT_INTERVAL_MS)) {
+            remote_drive_report();
+            car_stats_sample();
+            car_stats_print();
+            if (network_up) {
+                telemetry_stream_report();
+                telemetry_profile_publish();
+                car_stats_publish();
+            }
+            last_report = xTaskGetTickCount();
+        }
+        vTaskDelay(pdMS_TO_TICKS(LOGGING_PERIOD_MS));
+    }
+}
+
+void car_tasks_start(void) {
+    control_profile = profile_register("control");
+    sonar_profile = profile_register("sonar");
+    barcode_profile = profile_register("barcode");
+    trace_profile = profile_register("trace");
+
+    setup_adc();
+    setup_button();
+    remote_drive_init();
+
+    range_mailbox = xQueueCreateStatic(1, sizeof(car_range), range_mailbox_storage, &range_mailbox_buffer);
+    barcode_queue = xQueueCreateStatic(BARCODE_QUEUE_DEPTH, sizeof(telemetry_barcode), barcode_queue_storage,
+                                       &barcode_queue_buffer);
+    car_stats_watch_queue("range", range_mailbox);
+    car_stats_watch_queue("barcode", barcode_queue);
+    car_stats_watch_level("command", remote_drive_queue_level, REMOTE_QUEUE_DEPTH);
+
+    for (int i = 0; i < CAR_TASK_COUNT; i++) {
+        const car_task_config *config = &task_configs[i];
+        task_handles[i] = xTaskCreateStatic(config->function, config->name, config->stack_words, NULL,
+                                            config->priority, config->stack, &task_buffers[i]);
+#if configUSE_CORE_AFFINITY && configNUMBER_OF_CORES > 1
+        vTaskCoreAffinitySet(task_handles[i], config->cores);
+#endif
+    }
+
+    // Both hooks use the task handles, so install them once the tasks exist
+    remote_drive_set_notify(command_arrived);
+    remote_drive_set_line_follower(&line_follower);
+    ultrasonic_set_echo_callback(echo_received);
+
+    printf("Starting scheduler on %d core(s) %lu us after boot, %lu bytes of FreeRTOS heap free\n",
+           configNUMBER_OF_CORES, (unsigned long)time_us_32(), (unsigned long)xPortGetFreeHeapSize());
+    vTaskStartScheduler();
+}
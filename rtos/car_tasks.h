@@ -0,0 +1,87 @@
+#ifndef CAR_TASKS_H
+#define CAR_TASKS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// FreeRTOS build of the remote drive firmware (project_rtos). The super loop
+// of run_remote_drive in main.c is split into tasks so Wi-Fi processing and
+// blocking I/O can no longer delay the motors:
+//
+//   task      priority  core  wakes on
+//   control   5         0     command arrival or a new range (notification), else
+//                             every CONTROL_PERIOD_MS for maneuvers and the watchdog
+//   sonar     4         0     every SONAR_PERIOD_MS; sleeps on the echo IRQ
+//   barcode   3         0     every BARCODE_PERIOD_MS; owns the ADC, samples the
+//                             barcode and line sensors
+//   network   2         1     barcode queue; lwIP and the cyw43 driver run beside it
+//   logging   1         1     every LOGGING_PERIOD_MS: trace drain and reports
+//
+// With CAR_RTOS_CORES 2 the scheduler runs on both cores and each task is
+// held to the cores in its *_CORES mask (bit n for core n). Core 0 keeps the
+// control loop and the sensors, with their IRQs, so its timing does not
+// depend on network traffic; core 1 takes the network side. The cyw43 driver
+// task starts on the core that initialises Wi-Fi (the network task's), and
+// lwIP's thread is pinned to LWIP_CORES once it exists. Per-core load is in
+// the run-time stats. With CAR_RTOS_CORES 1 everything runs on core 0 and
+// the masks are ignored.
+//
+// The sonar task hands the latest range to control through a one-slot
+// mailbox queue (xQueueOverwrite) and notifies it; decoded barcodes go to the
+// network task through a queue. Only the logging task prints regularly.
+// After a LINE command the control task steers from the latest line sensor
+// sample every CONTROL_PERIOD_MS (buddy3 line_follow_step).
+//
+// Priorities are above tskIDLE_PRIORITY. Stack depths are in words; their
+// high-water marks are printed with each task's CPU share every
+// REPORT_INTERVAL_MS and sent as telemetry (car_stats.h), so check those on
+// the car before changing them.
+//
+// Tasks, stacks and queues are static, so their RAM is fixed at link time
+// and shows in the memory report printed after building project_rtos. The
+// FreeRTOS heap only serves the objects lwIP and the cyw43 driver create at
+// start-up; with CAR_ZERO_HEAP it is allocate-only (heap_1) and the build
+// fails if anything still links malloc.
+
+#define CONTROL_PERIOD_MS 5             // Maneuver and watchdog checks between wakeups
+#define SONAR_PERIOD_MS 50              // Same rate as the super loop's ranging
+#define BARCODE_PERIOD_MS 1             // One ADC sample per bar-width count
+#define LOGGING_PERIOD_MS 10
+#define REPORT_INTERVAL_MS 5000
+
+#define CONTROL_STACK_WORDS 512
+#define SONAR_STACK_WORDS 384
+#define BARCODE_STACK_WORDS 384
+#define NETWORK_STACK_WORDS 1024
+#define LOGGING_STACK_WORDS 1024
+
+#define CONTROL_CORES 0x1
+#define SONAR_CORES 0x1
+#define BARCODE_CORES 0x1
+#define NETWORK_CORES 0x2
+#define LOGGING_CORES 0x2
+#define LWIP_CORES 0x2                  // lwIP's tcpip_thread, created by the SDK
+
+#define BARCODE_QUEUE_DEPTH 4
+#define OBSTACLE_RANGE_CM 15.0f         // Stop distance, as in the super loop
+
+typedef enum {
+    CAR_TASK_CONTROL,
+    CAR_TASK_SONAR,
+    CAR_TASK_BARCODE,
+    CAR_TASK_NETWORK,
+    CAR_TASK_LOGGING,
+    CAR_TASK_COUNT
+} car_task_id;
+
+// Latest filtered range, passed from the sonar task to the control task
+typedef struct {
+    float distance_cm;
+    bool valid;
+} car_range;
+
+// Create the queues and tasks and start the scheduler; does not return.
+// Call after the motors and sensors are initialised.
+void car_tasks_start(void);
+
+#endif // CAR_TASKS_H
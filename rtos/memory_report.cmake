@@ -0,0 +1,86 @@
+# RAM budget of a linked image, run after the link by car_memory_report:
+#
+#   cmake -DELF=project_rtos.elf -DNM=arm-none-eabi-nm [-DFORBID_MALLOC=1] [-DTOP=20] -P memory_report.cmake
+#
+# Prints .data, .bss and the libc heap region from the Pico linker script
+# symbols, then the largest RAM objects. With FORBID_MALLOC set the build
+# fails if malloc or one of its siblings was linked; the .map file next to
+# the image shows what pulled it in.
+
+if (NOT TOP)
+    set(TOP 20)
+endif()
+
+execute_process(COMMAND ${NM} -t d ${ELF} OUTPUT_VARIABLE all_symbols RESULT_VARIABLE result)
+if (NOT result EQUAL 0)
+    message(FATAL_ERROR "memory report: ${NM} failed on ${ELF}")
+endif()
+execute_process(COMMAND ${NM} -S --size-sort -t d ${ELF} OUTPUT_VARIABLE sized_symbols)
+
+# Address of a linker script symbol, or -1 if the image has none
+function(symbol_address name out)
+    if (all_symbols MATCHES "(^|\n)0*([0-9]+) [A-Za-z] ${name}\n")
+        set(${out} ${CMAKE_MATCH_2} PARENT_SCOPE)
+    else()
+        set(${out} -1 PARENT_SCOPE)
+    endif()
+endfunction()
+
+function(report_span label start_name end_name)
+    symbol_address(${start_name} start)
+    symbol_address(${end_name} end)
+    if (start LESS 0 OR end LESS 0)
+        return()
+    endif()
+    math(EXPR bytes "${end} - ${start}")
+    message("  ${label} ${bytes} bytes")
+endfunction()
+
+get_filename_component(image ${ELF} NAME)
+message("RAM budget of ${image}:")
+report_span(".data (incl. RAM code)" __data_start__ __data_end__)
+report_span(".bss                  " __bss_start__ __bss_end__)
+report_span("libc heap region      " __end__ __HeapLimit)
+report_span("core 0 stack          " __StackBottom __StackTop)
+
+# Largest objects in .data and .bss, nm lists them smallest first
+string(REPLACE "\n" ";" lines "${sized_symbols}")
+set(objects "")
+set(total 0)
+foreach (line IN LISTS lines)
+    if (line MATCHES "^[0-9]+ 0*([0-9]+) [bBdD] (.+)$")
+        list(INSERT objects 0 "${CMAKE_MATCH_1} ${CMAKE_MATCH_2}")
+        math(EXPR total "${total} + ${CMAKE_MATCH_1}")
+    endif()
+endforeach()
+list(LENGTH objects count)
+message("  ${count} static objects, ${total} bytes; largest:")
+set(shown 0)
+foreach (object IN LISTS objects)
+    if (shown EQUAL TOP)
+        break()
+    endif()
+    string(REGEX REPLACE "^([0-9]+) (.+)$" "\\1" bytes "${object}")
+    string(REGEX REPLACE "^([0-9]+) (.+)$" "\\2" name "${object}")
+    string(LENGTH "${bytes}" width)
+    while (width LESS 8)
+        string(PREPEND bytes " ")
+        math(EXPR width "${width} + 1")
+    endwhile()
+    message("  ${bytes}  ${name}")
+    math(EXPR shown "${shown} + 1")
+endforeach()
+
+if (FORBID_MALLOC)
+    set(linked "")
+    foreach (name malloc calloc realloc _malloc_r _calloc_r _realloc_r __wrap_malloc __wrap_calloc __wrap_realloc)
+        if (all_symbols MATCHES "(^|\n)[0-9]+ [Tt] ${name}\n")
+            list(APPEND linked ${name})
+        endif()
+    endforeach()
+    if (linked)
+        string(REPLACE ";" ", " linked "${linked}")
+        message(FATAL_ERROR "${image} links ${linked} but is built without a heap (CAR_ZERO_HEAP)")
+    endif()
+    message("  no malloc linked")
+endif()